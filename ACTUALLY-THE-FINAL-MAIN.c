@@ -47,6 +47,20 @@
 #include <stdio.h>  /* sprintf */
 #include <math.h>   /* trunc */
 #include "embeddedML.h"
+#include "gameCore.h"
+#include "gestureClassifier.h"
+#include "gestureConfig.h"
+#include "gestureCore.h"
+#include "imuInterrupts.h"
+#include "imuStream.h"
+#include "gestureFeatures.h"
+#include "gestureOnline.h"
+#include "gestureAnytime.h"
+#include "gestureEnergy.h"
+#include "bootSequence.h"
+#ifdef GESTURE_MODEL_PRETRAINED
+#include "gestureModel.h"
+#endif
 #include "main.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -63,22 +77,119 @@
 
 /* Private define ------------------------------------------------------------*/
 
-/* Data acquisition period [ms] */
-#define DATA_PERIOD_MS (10)
-
-#define NUMBER_TEST_CYCLES 15
 #define STATE_1_DWELL 10000
-#define CLASSIFICATION_ACC_THRESHOLD 1
-#define CLASSIFICATION_DISC_THRESHOLD 1.05
 #define Z_ACCEL_THRESHOLD 300
 #define START_POSITION_INTERVAL 3000
-#define TRAINING_CYCLES 2000
 #define LED_BLINK_INTERVAL 200
 #define ANGLE_MAG_MAX_THRESHOLD 30
 #define MAX_ROTATION_ACQUIRE_CYCLES 800
+#define MESSAGE_SIZE 128
 
 //#define NOT_DEBUGGING
 
+/*
+ * Define GESTURE_MODEL_PRETRAINED to build in the network written to
+ * gestureModel.h by host/modelc. The game then starts right after boot and
+ * TrainOrientation only runs when retraining after a lost game.
+ */
+//#define GESTURE_MODEL_PRETRAINED
+
+/*
+ * CLASSIFIER_ANN trains the network on the captured motions.
+ * CLASSIFIER_CENTROID stores them as per class prototypes instead, so the
+ * game can start as soon as the six motions have been made.
+ * CLASSIFIER_GRAMMAR learns the tilt and push directions of the motions and
+ * composes actions from them with Grammar_Game_Rules; a tilt no rule
+ * starts with ends the capture before the push.
+ * CLASSIFIER_DTW keeps the gyro and accelerometer recordings of the
+ * motions as templates and matches the whole recording of a gesture
+ * against them (gestureDtw.h). Retraining keeps the motions of the last
+ * DTW_MAX_TEMPLATES sessions. It replaces online learning and anytime
+ * classification, which work on the final feature vector.
+ * CLASSIFIER_CNN pushes the gyro and accelerometer samples of both states
+ * into a CNN_Ring and trains the 1D-CNN of gestureCnn.h on the six
+ * windows for CNN_TRAINING_STEPS steps. Like DTW it replaces online
+ * learning and anytime classification. It needs sizeof(CNN_Grad) and six
+ * CNN_Ring windows of RAM on top of CNN_MEMORY_BYTES.
+ */
+#define GESTURE_CLASSIFIER CLASSIFIER_ANN
+
+/*
+ * Define GESTURE_ONLINE_LEARNING to keep adapting the classifier to the
+ * player's confidently classified gestures during play (gestureOnline.h).
+ * A lost game then only asks for retraining once confidence has dropped.
+ * Off by default until crossval --online shows it helps on real
+ * recordings.
+ */
+//#define GESTURE_ONLINE_LEARNING
+
+/*
+ * Define GESTURE_ANYTIME to classify the push while it is captured and end
+ * the capture once the classification is settled (gestureAnytime.h),
+ * instead of waiting for the full acceleration change. Off by default:
+ * tune ANYTIME_MARGIN with host/anytime on recorded traces first.
+ */
+//#define GESTURE_ANYTIME
+
+/*
+ * Define GESTURE_INFERENCE_ONLY, together with GESTURE_MODEL_PRETRAINED and
+ * a float model, for a build that only plays: the network runs from the
+ * const model in flash (Gesture_Model_Bind), TrainOrientation, dedw, the
+ * centroid and grammar models and online learning are left out, and all
+ * messages are formatted in one static buffer. host/ramReport.sh prints
+ * the stack and static RAM use of either build.
+ */
+//#define GESTURE_INFERENCE_ONLY
+
+/*
+ * Define IMU_STREAM to send every LSM6DSM accelerometer and gyroscope read
+ * at IMU_STREAM_ODR_HZ over USB in frames of imuStream.h instead of
+ * playing, for data collection with host/capture.
+ */
+//#define IMU_STREAM
+#define IMU_STREAM_ODR_HZ 1660.0f
+
+/*
+ * Define GESTURE_ENERGY to read the gas gauge at every stage boundary of a
+ * round and print the charge drawn per stage after each round and each
+ * training session (gestureEnergy.h). Without a battery the figures are
+ * estimated from ENERGY_MODEL_SENSORTILE.
+ */
+//#define GESTURE_ENERGY
+
+/*
+ * Define FAST_BOOT to declare the game ready as soon as the LED, USB and
+ * the LSM6DSM are up, and to bring up the RTC, the other sensors and the
+ * SD card while the game first waits (bootSequence.h). A report of the
+ * time to ready against BOOT_READY_TARGET_MS follows once all are done.
+ */
+#define FAST_BOOT
+#define BOOT_READY_TARGET_MS 50
+
+/*
+ * The LSM6DSM takes up to 35 ms to boot after power up. Its initialization
+ * is retried every IMU_RETRY_MS, and after IMU_RETRIES failed attempts the
+ * LED blinks IMU_ERROR_BLINKS between further attempts.
+ */
+#define IMU_RETRY_MS 5
+#define IMU_RETRIES 20
+#define IMU_ERROR_BLINKS 3
+
+#ifdef GESTURE_INFERENCE_ONLY
+#if !defined(GESTURE_MODEL_PRETRAINED) || defined(GESTURE_MODEL_INT8) \
+		|| GESTURE_CLASSIFIER != CLASSIFIER_ANN
+#error "GESTURE_INFERENCE_ONLY needs a float GESTURE_MODEL_PRETRAINED network"
+#endif
+#undef GESTURE_ONLINE_LEARNING
+#endif
+
+#if GESTURE_CLASSIFIER == CLASSIFIER_DTW || GESTURE_CLASSIFIER == CLASSIFIER_CNN
+#undef GESTURE_ONLINE_LEARNING
+#undef GESTURE_ANYTIME
+#endif
+
+#define CNN_TRAINING_STEPS 2000
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 
@@ -91,6 +202,8 @@ static volatile uint8_t MEMSInterrupt = 0;
 static volatile uint8_t no_H_HTS221 = 0;
 static volatile uint8_t no_T_HTS221 = 0;
 static volatile uint8_t no_GG = 0;
+static volatile uint8_t no_LSM303AGR = 0;
+static volatile uint8_t no_LPS22HB = 0;
 
 static RTC_HandleTypeDef RtcHandle;
 static void *LSM6DSM_X_0_handle = NULL;
@@ -103,76 +216,229 @@ static void *HTS221_H_0_handle = NULL;
 static void *HTS221_T_0_handle = NULL;
 static void *GG_handle = NULL;
 
+/*
+ * Messages are handed to CDC_Fill_Buffer, which copies them, right after
+ * sprintf. The inference only build therefore formats them all in one
+ * buffer instead of one per stack frame.
+ */
+
+#ifdef GESTURE_INFERENCE_ONLY
+static char message[MESSAGE_SIZE];
+#define MESSAGE_BUFFER(name) char *name = message
+#else
+#define MESSAGE_BUFFER(name) char name[MESSAGE_SIZE]
+#endif
+
+/*
+ * Feature extraction thresholds, see gestureFeatures.h
+ */
+
+static const Feature_Config feature_config = {
+#ifdef GESTURE_MODEL_PRETRAINED
+	GESTURE_MODEL_ANGLE_MAG_MAX_THRESHOLD,
+	GESTURE_MODEL_ACCEL_THRESHOLD,
+	GESTURE_MODEL_MAX_ACQUIRE_CYCLES,
+#else
+	ANGLE_MAG_MAX_THRESHOLD,
+	2 * Z_ACCEL_THRESHOLD,
+	MAX_ROTATION_ACQUIRE_CYCLES,
+#endif
+	(float)(DATA_PERIOD_MS)/1000
+};
+
+static const Anytime_Config anytime_config = {
+	ANYTIME_MARGIN,
+	ANYTIME_HOLD,
+	ANYTIME_MIN_FRACTION
+};
+
 /* Private function prototypes -----------------------------------------------*/
 
 static void Error_Handler(void);
 static void RTC_Config(void);
 static void RTC_TimeStampConfig(void);
 static void initializeAllSensors(void);
+static void initializeIMU(void);
+static int initializeOtherSensors(void);
+static void enableIMU(void);
+static void enableOtherSensors(void);
 
 /* Private functions ---------------------------------------------------------*/
 
 static volatile uint8_t hasTrained = 0;
-int x_loc;
-int y_loc;
-int cur_x;
-int cur_y;
-int cur_orientation = 0;
-char orientation[4]= {'N','E','S','W'};
-int prev_dist;
+static Game_State game;
+static char game_message[GAME_MESSAGE_SIZE];
+#ifdef GESTURE_ONLINE_LEARNING
+static Online_Learner learner;
+#endif
 int VERBOSE = 0;
 
-unsigned int training_cycles = TRAINING_CYCLES;
+#ifdef GESTURE_ENERGY
+static Energy_Account energy;
+static const Energy_Model energy_model = ENERGY_MODEL_SENSORTILE;
+static int training_sessions = 0;
 
-void movement(int forwards_back){
-	switch(orientation[cur_orientation]){
-	case 'N':
-		if(forwards_back == 1)
-		cur_y++;
-		else
-			cur_y--;
-		break;
-	case 'E':
-		if(forwards_back == 1)
-		cur_x++;
-		else
-			cur_x--;
-		break;
-	case 'S':
-		if(forwards_back == 1)
-		cur_y--;
-		else
-			cur_y++;
-		break;
-	case 'W':
-		if(forwards_back == 1)
-		cur_x--;
-		else
-			cur_x++;
-		break;
+/*
+ * Start stage now and charge the one that ends, at the gas gauge reading
+ * or at the model current if there is no battery
+ */
+
+static void Energy_Mark(Energy_Stage stage) {
+
+	uint32_t voltage_mv = 0;
+	int32_t current_ma = 0;
+	uint8_t status;
+
+	if (no_GG) {
+		Energy_Enter_Estimate(&energy, &energy_model, stage, HAL_GetTick());
+		return;
 	}
+	BSP_GG_Task(GG_handle, &status);
+	BSP_GG_GetVoltage(GG_handle, &voltage_mv);
+	BSP_GG_GetCurrent(GG_handle, &current_ma);
+
+	/* The gauge reports discharge as negative current */
+	Energy_Enter(&energy, stage, HAL_GetTick(), (float) -current_ma,
+			voltage_mv);
+}
+
+static void Energy_Begin(Energy_Stage stage) {
+	Energy_Mark(stage);
+	Energy_Begin_Period(&energy);
+}
+
+/*
+ * Print the charge since Energy_Begin and start the next period
+ */
+
+static void Energy_Report(const char *name, int number) {
+
+	char title[40];
+	MESSAGE_BUFFER(msg);
+
+	Energy_Mark(energy.stage);
+	sprintf(title, "\r\n%s %d%s", name, number, no_GG ? " (estimated)" : "");
+	Energy_Format(&energy.period, title, msg, MESSAGE_SIZE);
+	CDC_Fill_Buffer((uint8_t *) msg, strlen(msg));
+	Energy_Begin(ENERGY_USB);
+}
+
+#define ENERGY_MARK(stage) Energy_Mark(stage)
+#define ENERGY_BEGIN(stage) Energy_Begin(stage)
+#define ENERGY_REPORT(name, number) Energy_Report(name, number)
+#else
+#define ENERGY_MARK(stage)
+#define ENERGY_BEGIN(stage)
+#define ENERGY_REPORT(name, number)
+#endif
+
+#if GESTURE_CLASSIFIER == CLASSIFIER_DTW
+static Dtw_Recorder dtw_gyro;
+static Dtw_Recorder dtw_accel;
+static Dtw_Frame dtw_gesture[DTW_FRAMES];
+static Dtw_Model dtw_model;
+
+#define DTW_RECORD_START(recorder, xyz) Dtw_Record_Start(&recorder, xyz)
+#define DTW_RECORD(recorder, xyz) Dtw_Record(&recorder, xyz)
+#else
+#define DTW_RECORD_START(recorder, xyz)
+#define DTW_RECORD(recorder, xyz)
+#endif
+
+#if GESTURE_CLASSIFIER == CLASSIFIER_CNN
+static CNN cnn;
+static CNN_Grad cnn_grad;
+static CNN_Ring cnn_ring;
+static CNN_Ring cnn_training[6];
+static int cnn_gyro_offset[3];
+
+/*
+ * State 0 only reads the gyro: its samples take the reference read of
+ * State 1 as their acceleration, and State 1 samples the State 0
+ * reference read as their rotation rate, as in extract --cnn
+ */
 
+static const int cnn_rest[3] = { 0, 0, 0 };
+
+#define CNN_STATE_0_START(xyz) do { \
+		CNN_Ring_Reset(&cnn_ring); \
+		memcpy(cnn_gyro_offset, xyz, sizeof(cnn_gyro_offset)); \
+	} while (0)
+#define CNN_STATE_0_SAMPLE(xyz) CNN_Ring_Push(&cnn_ring, cnn_rest, xyz)
+#define CNN_STATE_1_START(xyz) CNN_Ring_Set_Accel(&cnn_ring, xyz)
+#define CNN_STATE_1_SAMPLE(xyz) CNN_Ring_Push(&cnn_ring, xyz, cnn_gyro_offset)
+#else
+#define CNN_STATE_0_START(xyz)
+#define CNN_STATE_0_SAMPLE(xyz)
+#define CNN_STATE_1_START(xyz)
+#define CNN_STATE_1_SAMPLE(xyz)
+#endif
+
+#ifdef FAST_BOOT
+static Boot_Sequence boot;
+static int boot_sensors = -1;
+static int boot_reported = 0;
+
+static int Boot_RTC(void) {
+	RTC_Config();
+	RTC_TimeStampConfig();
+	return 0;
+}
+
+/*
+ * Fails if the LSM303AGR or the LPS22HB is missing. The game goes on
+ * without them.
+ */
+
+static int Boot_Sensors(void) {
+
+	int status = initializeOtherSensors();
+
+	enableOtherSensors();
+	return status;
 }
 
-void turnleft(){
-if (cur_orientation == 0)
-	cur_orientation = 3;
-else
-	cur_orientation--;
+static int Boot_SD(void) {
+	DATALOG_SD_Init();
+	return 0;
 }
 
-void turnright(){
-if (cur_orientation == 3)
-	cur_orientation = 0;
-else
-	cur_orientation++;
+/*
+ * Run the next deferred boot task in place of a sleep and report the boot
+ * once none are left. Returns 1 if a task ran.
+ */
+
+static int Boot_Step(void) {
+
+	int ran = Boot_Run_Next(&boot);
+	MESSAGE_BUFFER(msg);
+
+	if (!boot_reported && !Boot_Pending(&boot)) {
+		boot_reported = 1;
+		msg[0] = '\n';
+		msg[1] = '\r';
+		Boot_Format(&boot, BOOT_READY_TARGET_MS, msg + 2, MESSAGE_SIZE - 2);
+		CDC_Fill_Buffer((uint8_t *) msg, strlen(msg));
+	}
+	return ran;
 }
 
+#define BOOT_STEP() Boot_Step()
+#define BOOT_IDLE Boot_Step
+#define BOOT_REQUIRE(id) Boot_Require(&boot, id)
+#else
+#define BOOT_STEP() 0
+#define BOOT_IDLE NULL
+#define BOOT_REQUIRE(id)
+#endif
+
+unsigned int training_cycles = TRAINING_CYCLES;
+
 void distance()
 {
 	double dist;
 
-	dist =  sqrt((x_loc - cur_x) * (x_loc - cur_x) + (y_loc - cur_y) * (y_loc - cur_y)); //normalized units
+	dist =  sqrt((game.x_loc - game.cur_x) * (game.x_loc - game.cur_x) + (game.y_loc - game.cur_y) * (game.y_loc - game.cur_y)); //normalized units
 
 //	for (int i = 0; i < (int)(dist / 1.2 + 1); i++) {
 //			BSP_LED_On(LED1);
@@ -181,50 +447,11 @@ void distance()
 //			HAL_Delay(175);
 //		}
 
-	char msg3[128];
+	MESSAGE_BUFFER(msg3);
 	sprintf(msg3, "\n\rYou are approximately %f units away", dist);
 	CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
 }
 
-void stable_softmax(float *x, float *y) {
-	int size = 3;
-	float multiplier = 1.0;
-
-	int i;
-
-	//softmax implemented as square law algorithm to be accommodate numerical precision requirements
-
-	y[0] = (x[0] * x[0] * multiplier)
-			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
-					+ (x[2] * x[2] * multiplier));
-	y[1] = (x[1] * x[1] * multiplier)
-			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
-					+ (x[2] * x[2] * multiplier));
-	y[2] = (x[2] * x[2] * multiplier)
-			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
-					+ (x[2] * x[2] * multiplier));
-
-	for (i = 0; i < size; i++) {
-		if (x[i] < 0.0)
-			y[i] = y[i] * -1.0;
-	}
-}
-
-void motion_softmax(int size, float *x, float *y) {
-	float norm;
-
-	norm = sqrt((x[0] * x[0]) + (x[1] * x[1]) + (x[2] * x[2]));
-	y[0] = abs(x[0]) / norm;
-	y[1] = abs(x[1]) / norm;
-	y[2] = abs(x[2]) / norm;
-
-	int i;
-	for (i = 0; i < size; i++) {
-		if (x[i] < 0.0)
-			y[i] = y[i] * -1.0;
-	}
-}
-
 void LED_Code_Blink(int count) {
 
 	int i;
@@ -350,75 +577,60 @@ void getAngularVelocity(void *handle_g, int *xyz) {
 
 /*
  * Note : Feature_Extraction_State_0() sets Z-axis acceleration, ttt_3 = 0
+ *
+ * With anytime non-NULL (started by Anytime_Start) the capture ends as
+ * soon as the classification of the partial push is settled.
  */
 
 void Feature_Extraction_State_1(void *handle, int * ttt_1, int * ttt_2,
-		int * ttt_3, int * ttt_mag_scale) {
+		int * ttt_3, int * ttt_mag_scale, Anytime_State *anytime) {
 
 	int ttt[3];
 	int ttt_initial[3];
-	int axis_index;
-	float accel_mag;
-	char  msg[128];
-
-	int Tsample;
+	MESSAGE_BUFFER(msg);
+	Feature_State_1 state;
 
 	/*
 	 * Acquire acceleration values prior to motion
 	 */
 
 	getAccel(handle, ttt_initial);
+	Feature_State_1_Start(&state, ttt_initial);
+	DTW_RECORD_START(dtw_accel, ttt_initial);
+	CNN_STATE_1_START(ttt_initial);
 
 	sprintf(msg, "\r\nStart Second State Motion to New Orientation when LED On");
 	CDC_Fill_Buffer((uint8_t *) msg, strlen(msg));
 	BSP_LED_On(LED1);
 
-	Tsample = DATA_PERIOD_MS;
-
-	for (int sample_index = 0; sample_index < MAX_ROTATION_ACQUIRE_CYCLES; sample_index++) {
+	for (int sample_index = 0; sample_index < feature_config.max_acquire_cycles; sample_index++) {
 		HAL_Delay(DATA_PERIOD_MS);
 		getAccel(handle, ttt);
-		accel_mag = 0;
-		for (axis_index = 0; axis_index < 3; axis_index++) {
-			ttt[axis_index] = ttt[axis_index] - ttt_initial[axis_index];
-
-			accel_mag = accel_mag + pow((ttt[axis_index]), 2);
+		DTW_RECORD(dtw_accel, ttt);
+		CNN_STATE_1_SAMPLE(ttt);
+		if (Feature_State_1_Sample(&state, &feature_config, ttt)) {
+			break;
 		}
-
-		accel_mag = sqrt(accel_mag);
-		if(accel_mag > 600){
-			sprintf(msg, "\r\nStop Motion");
-			CDC_Fill_Buffer((uint8_t *) msg, strlen(msg));
-			BSP_LED_Off(LED1);
-
-			*ttt_1 = ttt[0];
-			*ttt_2 = ttt[1];
-//			*ttt_3 = ttt[2];
-
-
-			*ttt_mag_scale = (int)(accel_mag);
-			HAL_Delay(1000);
-
-			return;
+		if (anytime != NULL
+				&& Anytime_Sample(anytime, &feature_config, &state, *ttt_3)) {
+			break;
 		}
-
 	}
 
-
 	sprintf(msg, "\r\nStop Motion");
 	CDC_Fill_Buffer((uint8_t *) msg, strlen(msg));
 	BSP_LED_Off(LED1);
-	HAL_Delay(1000);
-
 
+	/*
+	 * Without a push the acceleration change is scaled down
+	 */
 
-	*ttt_1 = ttt[0];
-	*ttt_2 = ttt[1];
-
-	*ttt_1 /= 300;
-	*ttt_2 /= 300;
-//	*ttt_3 = ttt[2];
-	*ttt_mag_scale = (int)(accel_mag / 30);
+	Feature_State_1_Result(&state, ttt_1, ttt_2, ttt_mag_scale);
+	if (anytime != NULL && anytime->committed) {
+		*ttt_1 = anytime->ttt[0];
+		*ttt_2 = anytime->ttt[1];
+	}
+	HAL_Delay(1000);
 
 	return;
 }
@@ -433,12 +645,10 @@ void Feature_Extraction_State_1(void *handle, int * ttt_1, int * ttt_2,
 void Feature_Extraction_State_0(void *handle_g, int * ttt_1, int * ttt_2,
 			int * ttt_3, int * ttt_mag_scale) {
 
-		int ttt[3], ttt_state_0[3], ttt_initial[3], ttt_offset[3];
-		char msg1[128];
-		int axis_index, sample_index;
-		float rotate_angle[3];
-		float angle_mag, angle_mag_max_threshold;
-		float Tsample;
+		int ttt[3], ttt_state_0[3], ttt_offset[3];
+		MESSAGE_BUFFER(msg1);
+		int sample_index;
+		Feature_State_0 state;
 
 
 		/*
@@ -447,24 +657,6 @@ void Feature_Extraction_State_0(void *handle_g, int * ttt_1, int * ttt_2,
 //		ttt_state_0[0] = *ttt_1;
 //		ttt_state_0[1] = *ttt_2;
 
-	angle_mag_max_threshold = ANGLE_MAG_MAX_THRESHOLD;
-
-	/*
-	 * Compute sample period with scaling from milliseconds
-	 * to seconds
-	 */
-
-	Tsample = (float)(DATA_PERIOD_MS)/1000;
-
-	/*
-	 * Initialize rotation angle values
-	 */
-
-	for (axis_index = 0; axis_index < 3; axis_index++) {
-		ttt[axis_index] = 0;
-		rotate_angle[axis_index] = 0;
-	}
-
 	/*
 	 * Rotation Rate Signal integration loop
 	 *
@@ -487,6 +679,9 @@ void Feature_Extraction_State_0(void *handle_g, int * ttt_1, int * ttt_2,
 	 */
 
 	getAngularVelocity(handle_g, ttt_offset);
+	Feature_State_0_Start(&state, ttt_offset);
+	DTW_RECORD_START(dtw_gyro, ttt_offset);
+	CNN_STATE_0_START(ttt_offset);
 
 	/*
 	 * Notify user to initiate motion
@@ -497,15 +692,7 @@ void Feature_Extraction_State_0(void *handle_g, int * ttt_1, int * ttt_2,
 	BSP_LED_On(LED1);
 
 
-	for (sample_index = 0; sample_index < MAX_ROTATION_ACQUIRE_CYCLES; sample_index++) {
-
-		/*
-		 * Acquire initial sample value of rotation rate and remove offset value
-		 */
-
-		for (axis_index = 0; axis_index < 3; axis_index++) {
-			ttt_initial[axis_index] = ttt[axis_index] - ttt_offset[axis_index];
-		}
+	for (sample_index = 0; sample_index < feature_config.max_acquire_cycles; sample_index++) {
 
 		/*
 		 * Introduce integration time period delay
@@ -514,75 +701,39 @@ void Feature_Extraction_State_0(void *handle_g, int * ttt_1, int * ttt_2,
 		HAL_Delay(DATA_PERIOD_MS);
 
 		/*
-		 * Acquire current sample value of rotation rate and remove
-		 * offset value
+		 * Acquire current sample value of rotation rate. Offset removal,
+		 * Z-Axis suppression and integration of the rotation angles in
+		 * degrees happen in Feature_State_0_Sample.
 		 */
 
 		getAngularVelocity(handle_g, ttt);
-		for (axis_index = 0; axis_index < 3; axis_index++) {
-			ttt[axis_index] = ttt[axis_index] - ttt_offset[axis_index];
-		}
-
-		/*
-		 * Suppress value of Z-Axis rotation signals
-		 */
-		ttt_initial[2] = 0;
-		ttt[2] = 0;
+		DTW_RECORD(dtw_gyro, ttt);
+		CNN_STATE_0_SAMPLE(ttt);
 
 		/*
-		 * Compute rotation angles by integration
+		 * Compare rotation angle magnitude with the threshold
 		 */
-
-		for (axis_index = 0; axis_index < 3; axis_index++) {
-			rotate_angle[axis_index] = rotate_angle[axis_index]
-					+ (float)((ttt_initial[axis_index] + ttt[axis_index]) * Tsample / 2);
-		}
-
-		/*
-		 * Compute magnitude of rotational angle summing over X and Y
-		 * axis Rotation Rates.
-		 *
-		 * Convert from milli-degrees to degrees (Note that Rotation
-		 * Rate is sampled in milli-degrees per second).
-		 *
-		 */
-
-		angle_mag = 0;
-		for (axis_index = 0; axis_index < 3; axis_index++) {
-			angle_mag = angle_mag + pow((rotate_angle[axis_index]), 2);
-		}
-		/*
-		 * Compute angle magnitude and convert from milli-degrees to degrees
-		 */
-		angle_mag = sqrt(angle_mag)/1000;
-		/*
-		 * Compute rotation angle magnitude
-		 */
-		if (angle_mag >= angle_mag_max_threshold) {
+		if (Feature_State_0_Sample(&state, &feature_config, ttt)) {
 
 			if(VERBOSE == 1) {
-				sprintf(msg1, "\r\nvalues: %f %f %f", rotate_angle[0], rotate_angle[1], rotate_angle[2]);
+				sprintf(msg1, "\r\nvalues: %f %f %f", state.rotate_angle[0], state.rotate_angle[1], state.rotate_angle[2]);
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 			}
 
 //			*ttt_1 /= 30;
 //			*ttt_2 = rotate_angle[0] / 1000;
-			*ttt_3 = rotate_angle[1] / 100;
-			*ttt_mag_scale = (int) (angle_mag * 100);
+			Feature_State_0_Result(&state, ttt_3, ttt_mag_scale);
 
 			sprintf(msg1, " \r\n");
 			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 
-			sprintf(msg1, "\r\nMotion with Angle Mag of %i degrees complete, Now Return to Next Start Position, ", (int)(angle_mag));
+			sprintf(msg1, "\r\nMotion with Angle Mag of %i degrees complete, Now Return to Next Start Position, ", (int)(state.angle_mag));
 			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 			BSP_LED_Off(LED1);
 			HAL_Delay(3000);
 			return;
 
 //			break;
-		} else {
-//			*ttt_2 = 0;
-			*ttt_3 = 0;
 		}
 
 	}
@@ -631,113 +782,68 @@ void Feature_Extraction_State_0(void *handle_g, int * ttt_1, int * ttt_2,
 
 	*ttt_1 = ttt_state_0[0];  	// The first two features are set to their initial values from State 0
 	*ttt_2 = ttt_state_0[1];	// The first two features are set to their initial values from State 0
-	*ttt_mag_scale = (int) (angle_mag * 100);
+	Feature_State_0_Result(&state, ttt_3, ttt_mag_scale);
 
 	sprintf(msg1, " \r\n");
 	CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 
-	sprintf(msg1, "\r\nMotion with Angle Mag of %i degrees complete, Now Return to Next Start Position, ", (int)(angle_mag));
+	sprintf(msg1, "\r\nMotion with Angle Mag of %i degrees complete, Now Return to Next Start Position, ", (int)(state.angle_mag));
 	CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 	BSP_LED_Off(LED1);
 	HAL_Delay(3000);
 	return;
 }
 
-void printOutput_ANN(ANN *net, int input_state, int * error) {
+#ifdef IMU_STREAM
 
-	char dataOut[256] = { };
-	int i, loc, count;
-	float point = 0.0;
-	float rms_output, mean_output, mean_output_rem, next_max;
-	float classification_metric;
+/*
+ * Stream_IMU never returns. Accelerometer and gyroscope run at the same
+ * rate and both are read as soon as the accelerometer has a new sample.
+ * CDC_Fill_Buffer copies each frame into the USB transmit buffer.
+ */
 
-	/*
-	 * Initialize error state
-	 */
+void Stream_IMU(void *handle, void *handle_g) {
 
-	*error = 0;
+	IMU_Stream_Packet packet;
+	uint8_t frame[IMU_STREAM_MAX_FRAME];
+	SensorAxesRaw_t acceleration, angular_velocity;
+	int16_t accel[3], gyro[3];
+	uint8_t ready;
 
-	count = 0;
-	mean_output = 0;
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		mean_output = mean_output + (net->output[i]);
-		if (net->output[i] > point && net->output[i] > 0.1) {
-			point = net->output[i];
-			loc = i;
-		}
-		count++;
-	}
+	BSP_ACCELERO_Set_ODR_Value(handle, IMU_STREAM_ODR_HZ);
+	BSP_GYRO_Set_ODR_Value(handle_g, IMU_STREAM_ODR_HZ);
+	IMU_Stream_Start(&packet);
+	BSP_LED_On(LED1);
 
-	next_max = 0;
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		if (i == loc) {
+	while (1) {
+		if (BSP_ACCELERO_Get_DRDY_Status(handle, &ready) != COMPONENT_OK
+				|| !ready) {
 			continue;
 		}
-		if (net->output[i] > next_max && net->output[i] > 0.1) {
-			next_max = net->output[i];
+		if (BSP_ACCELERO_Get_AxesRaw(handle, &acceleration) != COMPONENT_OK
+				|| BSP_GYRO_Get_AxesRaw(handle_g, &angular_velocity)
+						!= COMPONENT_OK) {
+			memset(&acceleration, 0, sizeof(acceleration));
+			memset(&angular_velocity, 0, sizeof(angular_velocity));
+			packet.flags |= IMU_STREAM_FLAG_READ_ERROR;
 		}
-	}
-
-	mean_output = (mean_output) / (count);
-
-	count = 0;
-	mean_output_rem = 0;
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		mean_output_rem = mean_output_rem + (net->output[i]);
-		if (i == loc) {
-			continue;
+		accel[0] = acceleration.AXIS_X;
+		accel[1] = acceleration.AXIS_Y;
+		accel[2] = acceleration.AXIS_Z;
+		gyro[0] = angular_velocity.AXIS_X;
+		gyro[1] = angular_velocity.AXIS_Y;
+		gyro[2] = angular_velocity.AXIS_Z;
+
+		if (IMU_Stream_Add(&packet, HAL_GetTick(), accel, gyro)) {
+			CDC_Fill_Buffer(frame, IMU_Stream_Encode(&packet, frame));
+			IMU_Stream_Next(&packet);
 		}
-		count++;
-	}
-
-	mean_output_rem = (mean_output_rem) / (count);
-
-	rms_output = 0;
-
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		rms_output = rms_output + pow((net->output[i] - mean_output), 2);
-	}
-
-	rms_output = sqrt(rms_output / count);
-	if (rms_output != 0) {
-		classification_metric = (point - mean_output) / rms_output;
-	} else {
-		classification_metric = 0;
-	}
-
-	if (loc != input_state) {
-		rms_output = 0;
-		classification_metric = 0;
-		point = 0;
-		mean_output = 0;
-		mean_output_rem = 0;
-	}
-
-	sprintf(dataOut, "\r\nState %i\tMax %i\tMean %i\t\tZ-score %i\tOutputs",
-			loc, (int) (100 * point), (int) (100 * mean_output),
-			(int) (100 * classification_metric));
-	CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		sprintf(dataOut, "\t%i", (int) (100 * net->output[i]));
-		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-	}
-
-	if (loc != input_state) {
-		*error = 1;
-		sprintf(dataOut, "\t Classification Error");
-		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
 	}
+}
 
-	if ((loc == input_state)
-			&& ((classification_metric < CLASSIFICATION_ACC_THRESHOLD)
-					|| ((point / next_max) < CLASSIFICATION_DISC_THRESHOLD))) {
-		*error = 1;
-		sprintf(dataOut, "\t Classification Accuracy Limit");
-		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-	}
+#endif /* IMU_STREAM */
 
-}
+#ifndef GESTURE_INFERENCE_ONLY
 
 /*
  * TrainOrientation requires both accelerometer and gyroscope sensor data
@@ -748,7 +854,10 @@ void printOutput_ANN(ANN *net, int input_state, int * error) {
  *
  */
 
-void TrainOrientation(void *handle, void *handle_g, ANN *net) {
+void TrainOrientation(void *handle, void *handle_g,
+		Gesture_Classifier *classifier) {
+
+	ANN *net = classifier->net;
 
 	uint8_t id, id_g;
 	SensorAxes_t acceleration, angular_velocity;
@@ -801,7 +910,9 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 
 				sprintf(msg1, "\r\nMove to Start Position - Wait for LED On");
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+				ENERGY_MARK(ENERGY_IDLE);
 				HAL_Delay(START_POSITION_INTERVAL);
+				ENERGY_MARK(ENERGY_CAPTURE);
 
 				switch (i) {
 				HAL_Delay(1000);
@@ -815,7 +926,7 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 						&ttt_mag_scale);
 
 				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-								&ttt_mag_scale);
+								&ttt_mag_scale, NULL);
 
 				ttt_initial_max[0] = ttt_1;
 				ttt_initial_max[1] = ttt_2;
@@ -832,7 +943,7 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 						&ttt_mag_scale);
 
 				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-						&ttt_mag_scale);
+						&ttt_mag_scale, NULL);
 
 				ttt_initial_max[0] = ttt_1;
 				ttt_initial_max[1] = ttt_2;
@@ -848,7 +959,7 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 						&ttt_mag_scale);
 
 				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-						&ttt_mag_scale);
+						&ttt_mag_scale, NULL);
 
 				ttt_initial_max[0] = ttt_1;
 				ttt_initial_max[1] = ttt_2;
@@ -864,7 +975,7 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 						&ttt_mag_scale);
 
 				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-						&ttt_mag_scale);
+						&ttt_mag_scale, NULL);
 
 				ttt_initial_max[0] = ttt_1;
 				ttt_initial_max[1] = ttt_2;
@@ -880,7 +991,7 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 						&ttt_mag_scale);
 
 				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-						&ttt_mag_scale);
+						&ttt_mag_scale, NULL);
 
 				ttt_initial_max[0] = ttt_1;
 				ttt_initial_max[1] = ttt_2;
@@ -896,7 +1007,7 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 						&ttt_mag_scale);
 
 				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-						&ttt_mag_scale);
+						&ttt_mag_scale, NULL);
 
 				ttt_initial_max[0] = ttt_1;
 				ttt_initial_max[1] = ttt_2;
@@ -918,6 +1029,12 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 				training_dataset[i][k][0] = xyz[0];
 				training_dataset[i][k][1] = xyz[1];
 				training_dataset[i][k][2] = xyz[2];
+#if GESTURE_CLASSIFIER == CLASSIFIER_DTW
+				Dtw_Gesture(&dtw_gyro, &dtw_accel, dtw_gesture);
+				Dtw_Add(classifier->dtw, dtw_gesture, i);
+#elif GESTURE_CLASSIFIER == CLASSIFIER_CNN
+				cnn_training[i] = cnn_ring;
+#endif
 
 				sprintf(msg1, "\r\n Softmax Input \t");
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
@@ -935,6 +1052,83 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 			}
 		}
+		ENERGY_MARK(ENERGY_TRAINING);
+
+#ifdef GESTURE_ONLINE_LEARNING
+		/*
+		 * The captured motions start the online learning replay buffer
+		 */
+
+		Online_Reset(&learner, 6, 3);
+		for (k = 0; k < num_train_data_cycles; k++) {
+			for (j = 0; j < 6; j++) {
+				Online_Add(&learner, training_dataset[j][k], j);
+			}
+		}
+#endif
+
+		/*
+		 * The centroid classifier needs only the captured motions
+		 */
+
+		if (classifier->kind == CLASSIFIER_CENTROID) {
+			Centroid_Reset(classifier->centroid, 6, 3, CENTROID_REJECT_DISTANCE);
+			for (k = 0; k < num_train_data_cycles; k++) {
+				for (j = 0; j < 6; j++) {
+					Centroid_Add(classifier->centroid, training_dataset[j][k], j);
+				}
+			}
+			LED_Code_Blink(0);
+			sprintf(msg1, "\r\n\r\nPrototypes Stored, Now Start Test Motions\r\n");
+			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+			return;
+		}
+
+		/*
+		 * The DTW templates were stored as the motions were captured
+		 */
+
+		if (classifier->kind == CLASSIFIER_DTW) {
+			LED_Code_Blink(0);
+			sprintf(msg1, "\r\n\r\nTemplates Stored, Now Start Test Motions\r\n");
+			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+			return;
+		}
+
+#if GESTURE_CLASSIFIER == CLASSIFIER_CNN
+		/*
+		 * The CNN trains on the six captured windows in turn
+		 */
+
+		if (classifier->kind == CLASSIFIER_CNN) {
+			for (k = 0; k < CNN_TRAINING_STEPS; k++) {
+				CNN_Train(classifier->cnn, &cnn_grad, &cnn_training[k % 6],
+						k % 6);
+			}
+			LED_Code_Blink(0);
+			sprintf(msg1, "\r\n\r\nTraining Complete, Now Start Test Motions\r\n");
+			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+			return;
+		}
+#endif
+
+		/*
+		 * The grammar learns the primitives each motion is made of
+		 */
+
+		if (classifier->kind == CLASSIFIER_GRAMMAR) {
+			Grammar_Init(classifier->grammar, Grammar_Game_Rules,
+					GRAMMAR_GAME_RULES);
+			for (k = 0; k < num_train_data_cycles; k++) {
+				for (j = 0; j < 6; j++) {
+					Grammar_Train(classifier->grammar, j, training_dataset[j][k]);
+				}
+			}
+			LED_Code_Blink(0);
+			sprintf(msg1, "\r\n\r\nPrimitives Learned, Now Start Test Motions\r\n");
+			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+			return;
+		}
 
 		/*
 		 * Enter NN training
@@ -1040,7 +1234,11 @@ void TrainOrientation(void *handle, void *handle_g, ANN *net) {
 	return;
 }
 
-int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_loc) {
+#endif /* GESTURE_INFERENCE_ONLY */
+
+int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g,
+		Gesture_Classifier *classifier, int prev_loc) {
+	ANN *net = classifier->net;
 	uint8_t id, id_g;
 	SensorAxes_t acceleration;
 	SensorAxes_t angular_velocity;
@@ -1048,10 +1246,12 @@ int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_l
 	uint8_t status_g;
 	float xyz[3];
 	float XYZ[3];
+	float tilt[3] = { 0, 0, 0 };
+	Anytime_State anytime;
 	int ttt_1, ttt_2, ttt_3, ttt_mag_scale;
-	char msg1[128];
+	MESSAGE_BUFFER(msg1);
 	int ttt_initial_max[3];
-	int j, k;
+	int j;
 
 	/*
 	 *  Accel_Gyro_Sensor_Handler includes initialization of both accelerometer and
@@ -1092,23 +1292,52 @@ int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_l
 		 *
 		 */
 
-		k = 0;
-		int roundcheck = 0;
+		ENERGY_BEGIN(ENERGY_IDLE);
+
+		/*
+		 * Game_Step plays the round and ends the game after
+		 * game.max_rounds rounds
+		 */
 
-		while (k < NUMBER_TEST_CYCLES) {
-			prev_dist = sqrt((x_loc - cur_x) * (x_loc - cur_x) + (y_loc - cur_y) * (y_loc - cur_y));
+		while (game.status == GAME_PLAYING) {
 			BSP_LED_Off(LED1);
 
+			ENERGY_MARK(ENERGY_USB);
 			sprintf(msg1, "\n\r\n\rMove to Start Position - Wait for LED On");
 			CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+			ENERGY_MARK(ENERGY_IDLE);
 			HAL_Delay(START_POSITION_INTERVAL);
 
+			ENERGY_MARK(ENERGY_CAPTURE);
 			Feature_Extraction_State_0(handle_g, &ttt_1, &ttt_2, &ttt_3,
 					&ttt_mag_scale);
 
-			Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
-					&ttt_mag_scale);
+			/*
+			 * The grammar only needs the push if a rule continues with
+			 * this tilt
+			 */
+
+			tilt[2] = (float) ttt_3;
+			if (classifier->kind != CLASSIFIER_GRAMMAR
+					|| Grammar_Expect(classifier->grammar,
+							Grammar_Step(classifier->grammar, GRAMMAR_START, tilt))
+							== GRAMMAR_PUSH) {
+				Anytime_Start(&anytime, &anytime_config, classifier);
+#ifdef GESTURE_ANYTIME
+				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
+						&ttt_mag_scale, &anytime);
+#else
+				Feature_Extraction_State_1(handle, &ttt_1, &ttt_2, &ttt_3,
+						&ttt_mag_scale, NULL);
+#endif
+			} else {
+				ttt_1 = 0;
+				ttt_2 = 0;
+				sprintf(msg1, "\r\nNo action starts with this tilt");
+				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
+			}
 
+			ENERGY_MARK(ENERGY_INFERENCE);
 			ttt_initial_max[0] = ttt_1;
 			ttt_initial_max[1] = ttt_2;
 			ttt_initial_max[2] = ttt_3;
@@ -1120,6 +1349,7 @@ int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_l
 			motion_softmax(net->topology[0], XYZ, xyz);
 
 			if(VERBOSE == 1) {
+				ENERGY_MARK(ENERGY_USB);
 
 				sprintf(msg1, "\r\n Softmax Input: \t");
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
@@ -1133,21 +1363,27 @@ int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_l
 					sprintf(msg1, "%i\t", (int) (100 * xyz[j]));
 					CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 				}
+				ENERGY_MARK(ENERGY_INFERENCE);
 			}
 
-			run_ann(net, xyz);
-
-			char msg3[128];
-			float point = 0.0;
+			ANN_Result result;
 			int i;
-			int loc = -1;
-
-			for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-				if (net->output[i] > point && net->output[i] > 0.1) {
-					point = net->output[i];
-					loc = i;
-				}
-			}
+			int loc;
+			int dist;
+			int round;
+
+#if GESTURE_CLASSIFIER == CLASSIFIER_DTW
+			Dtw_Gesture(&dtw_gyro, &dtw_accel, dtw_gesture);
+			Dtw_Classify(classifier->dtw, dtw_gesture, &result);
+#elif GESTURE_CLASSIFIER == CLASSIFIER_CNN
+			CNN_Classify(classifier->cnn, &cnn_ring, &result);
+#else
+			Classifier_Run(classifier, xyz, &result);
+#endif
+			loc = result.loc;
+#ifdef GESTURE_ONLINE_LEARNING
+			Online_Observe(&learner, xyz, &result);
+#endif
 
 //			if (loc == -1) {
 //				LED_Code_Blink(0);
@@ -1155,13 +1391,21 @@ int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_l
 //				LED_Code_Blink(loc + 1);
 //			}
 
-			int GAME_FINISHED = 0;
+			/*
+			 * The classification messages are charged with the LED
+			 * feedback they announce
+			 */
+
+			ENERGY_MARK(ENERGY_FEEDBACK);
+			round = game.round;
+			Game_Step(&game, loc, game_message, sizeof game_message);
+			CDC_Fill_Buffer((uint8_t *) game_message, strlen(game_message));
 
 			switch (loc) {
-			case 0: //forward
-				sprintf(msg3, "\n\rNeural Network Classification - Moved Forwards 1 Unit");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				movement(1);
+			case GAME_FORWARD:
+			case GAME_BACK:
+			case GAME_LEFT:
+			case GAME_RIGHT:
 				for (i = 0; i < 7; i++) {
 					BSP_LED_On(LED1);
 					HAL_Delay(20);
@@ -1169,122 +1413,63 @@ int Accel_Gyro_Sensor_Handler(void *handle, void *handle_g, ANN *net, int prev_l
 					HAL_Delay(30);
 				}
 				break;
-			case 1: //back
-				sprintf(msg3, "\n\rNeural Network Classification - Moved Backwards 1 Unit");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				movement(0);
-				for (i = 0; i < 7; i++) {
-					BSP_LED_On(LED1);
-					HAL_Delay(20);
-					BSP_LED_Off(LED1);
-					HAL_Delay(30);
-				}
+			case GAME_CHECK:
+				LED_Code_Blink(Game_Distance(&game));
 				break;
-			case 2: //left
-				sprintf(msg3, "\n\rNeural Network Classification - Turned Towards the Left");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				turnleft();
-				for (i = 0; i < 7; i++) {
-					BSP_LED_On(LED1);
-					HAL_Delay(20);
-					BSP_LED_Off(LED1);
-					HAL_Delay(30);
-				}
+			case GAME_ROUND:
+				LED_Code_Blink(game.round);
 				break;
-			case 3: //right
-				sprintf(msg3, "\n\rNeural Network Classification - Turned Towards the Right");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				turnright();
-				for (i = 0; i < 7; i++) {
+			}
+
+			if (game.status == GAME_WON) {
+				for (i = 0; i < 1000; i++) {
 					BSP_LED_On(LED1);
 					HAL_Delay(20);
 					BSP_LED_Off(LED1);
-					HAL_Delay(30);
+					HAL_Delay(50);
 				}
-				break;
-			case 4: //check
-				sprintf(msg3, "\n\rNeural Network Classification - Checking Distance to Location");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				int dist;
-
-				dist =  sqrt((x_loc - cur_x) * (x_loc - cur_x) + (y_loc - cur_y) * (y_loc - cur_y)); //normalized units
-
-
-				sprintf(msg3, "\n\rYou are approximately %d units away", dist);
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				LED_Code_Blink(dist);
-				roundcheck = 1;
-				break;
-			case 5:
-				sprintf(msg3, "\n\rNeural Network Classification - Your Current Round is %d" ,k);
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				LED_Code_Blink(k);
-				roundcheck = 1;
-				break;
-			case -1:
-				sprintf(msg3, "\n\rNeural Network Classification - ERROR");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-				break;
-			default:
-				sprintf(msg3, "\n\rNeural Network Classification - NULL");
-				CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
+				ENERGY_REPORT("Round", game.round + 1);
 				break;
 			}
 
-			if (cur_x == x_loc && cur_y == y_loc){
-				sprintf(msg3, "\n\rYOU WON THE GAME ON ROUND %d!\n\n\n\n", k);
-						CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-
-						for (i = 0; i < 1000; i++) {
-							BSP_LED_On(LED1);
-							HAL_Delay(20);
-							BSP_LED_Off(LED1);
-							HAL_Delay(50);
-						}
-
-						break;
-		}
-
-		int dist;
-		dist =  sqrt((x_loc - cur_x) * (x_loc - cur_x) + (y_loc - cur_y) * (y_loc - cur_y));
-		HAL_Delay(500);
-
-		if (dist > prev_dist){
-			sprintf(msg3, "\n\rCOLDER!!!\n", k);
-			CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-
-			BSP_LED_On(LED1);
-			HAL_Delay(800);
-			BSP_LED_Off(LED1);
-
-		}
-		if (dist < prev_dist){
-			sprintf(msg3, "\n\rHOTTER!!!\n", k);
-			CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
+			/*
+			 * Game_Step took prev_dist at the start of the round
+			 */
 
-		}
-		if (dist == prev_dist){
-			sprintf(msg3, "\n\rAround the Same Temperature.\n", k);
-			CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-			for (i = 0; i < 2; i++) {
+			HAL_Delay(500);
+			dist = Game_Distance(&game);
+			if (dist > game.prev_dist) {
 				BSP_LED_On(LED1);
-				HAL_Delay(200);
+				HAL_Delay(800);
 				BSP_LED_Off(LED1);
-				HAL_Delay(200);
 			}
-		}
+			if (dist == game.prev_dist) {
+				for (i = 0; i < 2; i++) {
+					BSP_LED_On(LED1);
+					HAL_Delay(200);
+					BSP_LED_Off(LED1);
+					HAL_Delay(200);
+				}
+			}
 
-		if (roundcheck == 0)
-			k = k + 1;
-		else
-			roundcheck = 0;
+#ifdef GESTURE_ONLINE_LEARNING
+			/*
+			 * Learn from a confident gesture while the player gets ready
+			 */
+			ENERGY_MARK(ENERGY_TRAINING);
+			Online_Update(&learner, classifier);
+#endif
+			ENERGY_MARK(ENERGY_IDLE);
+			HAL_Delay(2000);
 
-//		sprintf(msg3, "\n\nDirection: %c X: %d Y: %d CUR_X %d CUR_Y %d", orientation[cur_orientation], x_loc, y_loc, cur_x, cur_y); //TESTING
-//								CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
+			/*
+			 * A distance check or round query is charged to the round
+			 * it was made in
+			 */
 
-		sprintf(msg3, "\n\nDirection: %c CUR_X %d CUR_Y %d", orientation[cur_orientation], cur_x, cur_y); //TESTING
-								CDC_Fill_Buffer((uint8_t *) msg3, strlen(msg3));
-		HAL_Delay(2000);
+			if (game.round != round) {
+				ENERGY_REPORT("Round", game.round);
+			}
 		}
 	}
 	return prev_loc;
@@ -1300,9 +1485,7 @@ int main(void) {
 //	cur_y = 3;
 
 	uint32_t msTick, msTickPrev = 0;
-	uint8_t doubleTap = 0;
-	char msg2[128];
-	int i;
+	MESSAGE_BUFFER(msg2);
 
 	/* STM32L4xx HAL library initialization:
 	 - Configure the Flash prefetch, instruction and Data caches
@@ -1328,9 +1511,15 @@ int main(void) {
 	}
 #endif
 
+#ifdef FAST_BOOT
+	/* Only the LED, USB and the LSM6DSM are brought up before ready */
+	Boot_Init(&boot, HAL_GetTick);
+	Boot_Add(&boot, "rtc", Boot_RTC, 0);
+#else
 	/* Initialize RTC */
 	RTC_Config();
 	RTC_TimeStampConfig();
+#endif
 
 	/* enable USB power on Pwrctrl CR2 register */
 	HAL_PWREx_EnableVddUSB();
@@ -1348,16 +1537,40 @@ int main(void) {
 		USBD_Start(&USBD_Device);
 	} else /* Configure the SDCard */
 	{
+#ifdef FAST_BOOT
+		Boot_Add(&boot, "sd", Boot_SD, 0);
+#else
 		DATALOG_SD_Init();
+#endif
 	}
+#ifndef FAST_BOOT
 	HAL_Delay(200);
+#endif
 
 	/* Configure and disable all the Chip Select pins */
 	Sensor_IO_SPI_CS_Init_All();
 
 	/* Initialize and Enable the available sensors */
+#ifdef FAST_BOOT
+	initializeIMU();
+	enableIMU();
+	boot_sensors = Boot_Add(&boot, "sensors", Boot_Sensors, 0);
+	Boot_Ready(&boot);
+#else
 	initializeAllSensors();
 	enableAllSensors();
+#endif
+#ifdef GESTURE_ENERGY
+	/* The gas gauge is one of the deferred sensors */
+	BOOT_REQUIRE(boot_sensors);
+	Energy_Start(&energy, HAL_GetTick(), energy_model.current_ma[ENERGY_IDLE],
+			0);
+	Energy_Mark(ENERGY_IDLE);
+#endif
+
+#ifdef IMU_STREAM
+	Stream_IMU(LSM6DSM_X_0_handle, LSM6DSM_G_0_handle);
+#endif
 
 	/* Notify user */
 
@@ -1386,24 +1599,32 @@ int main(void) {
 	sprintf(msg2, "\n\r\nMotion 6: Tilt backwards, then push backwards. (Check Round)\n");
 							CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
 
+#if !defined(GESTURE_MODEL_PRETRAINED) || GESTURE_CLASSIFIER != CLASSIFIER_ANN
 	sprintf(msg2, "\nConfirm with a Double Tap to start training");
 	CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+#endif
 
 	//---EMBEDDED ANN---
-	float weights[81] = { 0.680700, 0.324900, 0.607300, 0.365800, 0.693000,
-			0.527200, 0.754400, 0.287800, 0.592300, 0.570900, 0.644000,
-			0.416500, 0.249200, 0.704200, 0.598700, 0.250300, 0.632700,
-			0.372900, 0.684000, 0.661200, 0.230300, 0.516900, 0.770900,
-			0.315700, 0.756000, 0.293300, 0.509900, 0.627800, 0.781600,
-			0.733500, 0.509700, 0.382600, 0.551200, 0.326700, 0.781000,
-			0.563300, 0.297900, 0.714900, 0.257900, 0.682100, 0.596700,
-			0.467200, 0.339300, 0.533600, 0.548500, 0.374500, 0.722800,
-			0.209100, 0.619400, 0.635700, 0.300100, 0.715300, 0.670800,
-			0.794400, 0.766800, 0.349000, 0.412400, 0.619600, 0.353000,
-			0.690300, 0.772200, 0.666600, 0.254900, 0.402400, 0.780100,
-			0.285300, 0.697700, 0.540800, 0.222800, 0.693300, 0.229800,
-			0.698100, 0.463500, 0.201300, 0.786500, 0.581400, 0.706300,
-			0.653600, 0.542500, 0.766900, 0.411500 };
+#ifdef GESTURE_INFERENCE_ONLY
+	/*
+	 * The frozen model stays in flash, only the outputs need RAM
+	 */
+
+	float output[GESTURE_MODEL_N_OUTPUT];
+
+	ANN net;
+	Gesture_Model_Bind(&net);
+	net.output = output;
+	net.output_activation_function = &relu2;
+	net.hidden_activation_function = &relu2;
+
+	init_pretrained_ann(&net);
+
+	Gesture_Classifier classifier = { GESTURE_CLASSIFIER, &net, NULL, NULL,
+			NULL, NULL };
+#else
+	int i;
+	float weights[81];
 	float dedw[81];
 	float bias[15];
 	unsigned int network_topology[3] = { 3, 9, 6 };
@@ -1426,6 +1647,7 @@ int main(void) {
 		output[i] = 0.0;
 	}
 	for (i = 0; i < 81; i++){
+		weights[i] = ANN_Initial_Weights[i];
 		dedw[i] = 0.0;
 	}
 
@@ -1437,6 +1659,44 @@ int main(void) {
 	net.hidden_activation_function = &relu2;
 
 	init_ann(&net);
+
+	Centroid_Model centroid;
+	Gesture_Grammar grammar;
+	Gesture_Classifier classifier = { GESTURE_CLASSIFIER, &net, &centroid,
+			&grammar, NULL, NULL };
+
+	Centroid_Reset(&centroid, 6, 3, CENTROID_REJECT_DISTANCE);
+	Grammar_Init(&grammar, Grammar_Game_Rules, GRAMMAR_GAME_RULES);
+#if GESTURE_CLASSIFIER == CLASSIFIER_DTW
+	classifier.dtw = &dtw_model;
+	Dtw_Reset(&dtw_model, 6, DTW_BAND, DTW_REJECT_DISTANCE);
+#elif GESTURE_CLASSIFIER == CLASSIFIER_CNN
+	classifier.cnn = &cnn;
+	CNN_Init(&cnn, 0);
+#endif
+#endif
+#ifdef GESTURE_ONLINE_LEARNING
+	Online_Reset(&learner, 6, 3);
+#endif
+
+#if defined(GESTURE_INFERENCE_ONLY)
+	hasTrained = 1;
+	sprintf(msg2, "\nGesture model in flash, starting game");
+	CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+#elif defined(GESTURE_MODEL_PRETRAINED) && GESTURE_CLASSIFIER == CLASSIFIER_ANN
+	/*
+	 * Replace the starting weights with the host trained model and skip
+	 * the training session
+	 */
+
+	if (Gesture_Model_Load(&net) == 0) {
+		hasTrained = 1;
+		sprintf(msg2, "\nPretrained gesture model loaded, starting game");
+	} else {
+		sprintf(msg2, "\nPretrained gesture model does not match the network, Double Tap to start training");
+	}
+	CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+#endif
 	//---------------------
 
 	int loc = -1;
@@ -1452,19 +1712,31 @@ int main(void) {
 			}
 
 			//RTC_Handler( &RtcHandle );
-			x_loc = (rand() % 5) + 1;
-			y_loc = (rand() % 5) + 1;
-			cur_x = 3;
-			cur_y = 3;
+			Game_Start(&game, (rand() % GAME_TARGET_RANGE) + 1,
+					(rand() % GAME_TARGET_RANGE) + 1);
 
 			if (hasTrained){
-				loc = Accel_Gyro_Sensor_Handler(LSM6DSM_X_0_handle, LSM6DSM_G_0_handle, &net, loc);
+				loc = Accel_Gyro_Sensor_Handler(LSM6DSM_X_0_handle, LSM6DSM_G_0_handle, &classifier, loc);
 				/*
-				 * Upon return from Accel_Gyro_Sensor_Handler, initiate retraining.
+				 * Upon return from Accel_Gyro_Sensor_Handler, initiate retraining,
+				 * unless online learning still classifies confidently or
+				 * there is nothing to train.
 				 */
 				hasTrained = 0;
-				sprintf(msg2, "\n\r\n\rYOU LOST! :( Double Tap to retrain and try again");
-				CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+#if defined(GESTURE_INFERENCE_ONLY)
+				hasTrained = 1;
+#elif defined(GESTURE_ONLINE_LEARNING)
+				hasTrained = !Online_Needs_Retraining(&learner);
+#endif
+				if (hasTrained) {
+					sprintf(msg2, "\n\r\n\rYOU LOST! :( Double Tap to try again");
+					CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+					Wait_For_IMU_Event(LSM6DSM_X_0_handle,
+							IMU_EVENT_DOUBLE_TAP, BOOT_IDLE);
+				} else {
+					sprintf(msg2, "\n\r\n\rYOU LOST! :( Double Tap to retrain and try again");
+					CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+				}
 			}
 
 			if (SendOverUSB) {
@@ -1473,19 +1745,24 @@ int main(void) {
 
 		}
 
-		/* Check LSM6DSM Double Tap Event  */
+#ifndef GESTURE_INFERENCE_ONLY
+		/* Sleep until the LSM6DSM reports a Double Tap */
 		if (!hasTrained) {
-			BSP_ACCELERO_Get_Double_Tap_Detection_Status_Ext(LSM6DSM_X_0_handle,
-					&doubleTap);
-			if (doubleTap) { /* Double Tap event */
+			if (Wait_For_IMU_Event(LSM6DSM_X_0_handle,
+					IMU_EVENT_DOUBLE_TAP, BOOT_IDLE)) {
 				LED_Code_Blink(0);
-				TrainOrientation(LSM6DSM_X_0_handle,LSM6DSM_G_0_handle, &net);
+				ENERGY_BEGIN(ENERGY_USB);
+				TrainOrientation(LSM6DSM_X_0_handle,LSM6DSM_G_0_handle, &classifier);
+				ENERGY_REPORT("Training session", ++training_sessions);
 				hasTrained = 1;
 			}
 		}
+#endif
 
-		/* Go to Sleep */
-		__WFI();
+		/* Go to Sleep, unless boot tasks are left */
+		if (!BOOT_STEP()) {
+			__WFI();
+		}
 	}
 }
 
@@ -1495,37 +1772,69 @@ int main(void) {
  * @retval None
  */
 static void initializeAllSensors(void) {
-	if (BSP_ACCELERO_Init(LSM6DSM_X_0, &LSM6DSM_X_0_handle) != COMPONENT_OK) {
-		while (1)
-			;
-	}
+	initializeIMU();
+	initializeOtherSensors();
+}
+
+/*
+ * Wait IMU_RETRY_MS before the next LSM6DSM initialization attempt, or
+ * blink the error code once IMU_RETRIES attempts have failed
+ */
 
-	if (BSP_GYRO_Init(LSM6DSM_G_0, &LSM6DSM_G_0_handle) != COMPONENT_OK) {
-		while (1)
-			;
+static void retryIMU(int *attempts) {
+	if (++*attempts > IMU_RETRIES) {
+		LED_Code_Blink(IMU_ERROR_BLINKS);
+	} else {
+		HAL_Delay(IMU_RETRY_MS);
 	}
+}
 
-	if (BSP_ACCELERO_Init(LSM303AGR_X_0, &LSM303AGR_X_0_handle)
+/**
+ * @brief  Initialize the LSM6DSM, tap detection and its interrupt
+ * @param  None
+ * @retval None
+ */
+static void initializeIMU(void) {
+
+	int attempts = 0;
+
+	/* The game cannot be played without the LSM6DSM: retry until it answers */
+	while (BSP_ACCELERO_Init(LSM6DSM_X_0, &LSM6DSM_X_0_handle)
 			!= COMPONENT_OK) {
-		while (1)
-			;
+		retryIMU(&attempts);
 	}
 
-	if (BSP_MAGNETO_Init(LSM303AGR_M_0, &LSM303AGR_M_0_handle)
-			!= COMPONENT_OK) {
-		while (1)
-			;
+	while (BSP_GYRO_Init(LSM6DSM_G_0, &LSM6DSM_G_0_handle) != COMPONENT_OK) {
+		retryIMU(&attempts);
 	}
 
-	if (BSP_PRESSURE_Init(LPS22HB_P_0, &LPS22HB_P_0_handle) != COMPONENT_OK) {
-		while (1)
-			;
+	//if(!SendOverUSB)
+	//{
+	/* Enable HW Double Tap detection */
+	BSP_ACCELERO_Enable_Double_Tap_Detection_Ext(LSM6DSM_X_0_handle);
+	BSP_ACCELERO_Set_Tap_Threshold_Ext(LSM6DSM_X_0_handle,
+	LSM6DSM_TAP_THRESHOLD_MID);
+	Enable_IMU_Interrupts(LSM6DSM_X_0_handle);
+	//}
+}
+
+/**
+ * @brief  Initialize the sensors the game does not need
+ * @param  None
+ * @retval 0, or -1 if the LSM303AGR or the LPS22HB is missing
+ */
+static int initializeOtherSensors(void) {
+	if (BSP_ACCELERO_Init(LSM303AGR_X_0, &LSM303AGR_X_0_handle)
+			!= COMPONENT_OK
+			|| BSP_MAGNETO_Init(LSM303AGR_M_0, &LSM303AGR_M_0_handle)
+					!= COMPONENT_OK) {
+		no_LSM303AGR = 1;
 	}
 
-	if (BSP_TEMPERATURE_Init(LPS22HB_T_0, &LPS22HB_T_0_handle)
-			!= COMPONENT_OK) {
-		while (1)
-			;
+	if (BSP_PRESSURE_Init(LPS22HB_P_0, &LPS22HB_P_0_handle) != COMPONENT_OK
+			|| BSP_TEMPERATURE_Init(LPS22HB_T_0, &LPS22HB_T_0_handle)
+					!= COMPONENT_OK) {
+		no_LPS22HB = 1;
 	}
 
 	if (BSP_TEMPERATURE_Init(HTS221_T_0, &HTS221_T_0_handle)
@@ -1542,14 +1851,7 @@ static void initializeAllSensors(void) {
 		no_GG = 1;
 	}
 
-	//if(!SendOverUSB)
-	//{
-	/* Enable HW Double Tap detection */
-	BSP_ACCELERO_Enable_Double_Tap_Detection_Ext(LSM6DSM_X_0_handle);
-	BSP_ACCELERO_Set_Tap_Threshold_Ext(LSM6DSM_X_0_handle,
-	LSM6DSM_TAP_THRESHOLD_MID);
-	//}
-
+	return no_LSM303AGR || no_LPS22HB ? -1 : 0;
 }
 
 /**
@@ -1558,12 +1860,24 @@ static void initializeAllSensors(void) {
  * @retval None
  */
 void enableAllSensors(void) {
+	enableIMU();
+	enableOtherSensors();
+}
+
+static void enableIMU(void) {
 	BSP_ACCELERO_Sensor_Enable(LSM6DSM_X_0_handle);
 	BSP_GYRO_Sensor_Enable(LSM6DSM_G_0_handle);
-	BSP_ACCELERO_Sensor_Enable(LSM303AGR_X_0_handle);
-	BSP_MAGNETO_Sensor_Enable(LSM303AGR_M_0_handle);
-	BSP_PRESSURE_Sensor_Enable(LPS22HB_P_0_handle);
-	BSP_TEMPERATURE_Sensor_Enable(LPS22HB_T_0_handle);
+}
+
+static void enableOtherSensors(void) {
+	if (!no_LSM303AGR) {
+		BSP_ACCELERO_Sensor_Enable(LSM303AGR_X_0_handle);
+		BSP_MAGNETO_Sensor_Enable(LSM303AGR_M_0_handle);
+	}
+	if (!no_LPS22HB) {
+		BSP_PRESSURE_Sensor_Enable(LPS22HB_P_0_handle);
+		BSP_TEMPERATURE_Sensor_Enable(LPS22HB_T_0_handle);
+	}
 	if (!no_T_HTS221) {
 		BSP_TEMPERATURE_Sensor_Enable(HTS221_T_0_handle);
 		BSP_HUMIDITY_Sensor_Enable(HTS221_H_0_handle);
@@ -1578,13 +1892,19 @@ void enableAllSensors(void) {
  */
 void disableAllSensors(void) {
 	BSP_ACCELERO_Sensor_Disable(LSM6DSM_X_0_handle);
-	BSP_ACCELERO_Sensor_Disable(LSM303AGR_X_0_handle);
 	BSP_GYRO_Sensor_Disable(LSM6DSM_G_0_handle);
-	BSP_MAGNETO_Sensor_Disable(LSM303AGR_M_0_handle);
-	BSP_HUMIDITY_Sensor_Disable(HTS221_H_0_handle);
-	BSP_TEMPERATURE_Sensor_Disable(HTS221_T_0_handle);
-	BSP_TEMPERATURE_Sensor_Disable(LPS22HB_T_0_handle);
-	BSP_PRESSURE_Sensor_Disable(LPS22HB_P_0_handle);
+	if (!no_LSM303AGR) {
+		BSP_ACCELERO_Sensor_Disable(LSM303AGR_X_0_handle);
+		BSP_MAGNETO_Sensor_Disable(LSM303AGR_M_0_handle);
+	}
+	if (!no_T_HTS221) {
+		BSP_HUMIDITY_Sensor_Disable(HTS221_H_0_handle);
+		BSP_TEMPERATURE_Sensor_Disable(HTS221_T_0_handle);
+	}
+	if (!no_LPS22HB) {
+		BSP_TEMPERATURE_Sensor_Disable(LPS22HB_T_0_handle);
+		BSP_PRESSURE_Sensor_Disable(LPS22HB_P_0_handle);
+	}
 }
 
 /**
@@ -1688,6 +2008,7 @@ void RTC_TimeRegulate(uint8_t hh, uint8_t mm, uint8_t ss) {
  */
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
 	MEMSInterrupt = 1;
+	IMU_Interrupt_Post(GPIO_Pin);
 }
 
 /**
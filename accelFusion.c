@@ -0,0 +1,179 @@
+/**
+ ******************************************************************************
+ * @file    accelFusion.c
+ * @brief   Fusion of the LSM6DSM and LSM303AGR accelerometers
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "accelFusion.h"
+
+void Fusion_Init(Accel_Fusion *fusion,
+		const Fusion_Calibration calibration[FUSION_SENSORS], int n_sensors) {
+
+	int s, a;
+
+	memcpy(fusion->calibration, calibration,
+			sizeof(Fusion_Calibration) * FUSION_SENSORS);
+	for (s = 0; s < FUSION_SENSORS; s++) {
+		for (a = 0; a < 3; a++) {
+			fusion->calibration[s].offset[a] = 0;
+		}
+		fusion->calibration[s].variance = FUSION_DEFAULT_VARIANCE;
+		fusion->weight[s] = s < n_sensors ? 1.0f / n_sensors : 0;
+	}
+	fusion->n_sensors = n_sensors;
+}
+
+/*
+ * Axis a of a raw read, in the axes of the reference and before the
+ * offset
+ */
+
+static float mapped(const Fusion_Calibration *c, const int raw[3], int a) {
+	return (float) (c->sign[a] * raw[c->axis[a]]);
+}
+
+/*
+ * Fall back to the reference sensor alone
+ */
+
+static int reference_only(Accel_Fusion *fusion) {
+
+	int s;
+
+	fusion->n_sensors = 1;
+	for (s = 0; s < FUSION_SENSORS; s++) {
+		fusion->weight[s] = s == 0 ? 1 : 0;
+	}
+	return -1;
+}
+
+int Fusion_Calibrate(Accel_Fusion *fusion,
+		const int (*samples)[FUSION_SENSORS][3], int n) {
+
+	float mean[FUSION_SENSORS][3], sum_var = 0, v;
+	int n_sensors = fusion->n_sensors, s, a, i;
+
+	if (n < 2) {
+		return reference_only(fusion);
+	}
+	for (s = 0; s < n_sensors; s++) {
+		Fusion_Calibration *c = &fusion->calibration[s];
+
+		c->variance = 0;
+		for (a = 0; a < 3; a++) {
+			mean[s][a] = 0;
+			for (i = 0; i < n; i++) {
+				mean[s][a] += mapped(c, samples[i][s], a);
+			}
+			mean[s][a] /= n;
+			for (i = 0; i < n; i++) {
+				v = mapped(c, samples[i][s], a) - mean[s][a];
+				c->variance += v * v;
+			}
+		}
+		c->variance /= 3 * (n - 1);
+		if (c->variance < FUSION_MIN_VARIANCE) {
+			c->variance = FUSION_MIN_VARIANCE;
+		}
+	}
+
+	/* Offsets relative to the reference, which keeps its own */
+	for (s = 0; s < n_sensors; s++) {
+		for (a = 0; a < 3; a++) {
+			fusion->calibration[s].offset[a] = mean[s][a] - mean[0][a];
+			if (fabsf(fusion->calibration[s].offset[a]) > FUSION_MAX_OFFSET_MG) {
+				return reference_only(fusion);
+			}
+		}
+	}
+
+	for (s = 0; s < n_sensors; s++) {
+		sum_var += 1.0f / fusion->calibration[s].variance;
+	}
+	for (s = 0; s < n_sensors; s++) {
+		fusion->weight[s] = 1.0f / fusion->calibration[s].variance / sum_var;
+	}
+	return 0;
+}
+
+void Fusion_Combine(const Accel_Fusion *fusion,
+		const int raw[FUSION_SENSORS][3], const uint8_t valid[FUSION_SENSORS],
+		int xyz[3]) {
+
+	const Fusion_Calibration *c;
+	float sum[3] = { 0, 0, 0 }, weight = 0;
+	int s, a;
+
+	for (s = 0; s < fusion->n_sensors; s++) {
+		if (!valid[s]) {
+			continue;
+		}
+		c = &fusion->calibration[s];
+		for (a = 0; a < 3; a++) {
+			sum[a] += fusion->weight[s] * (mapped(c, raw[s], a) - c->offset[a]);
+		}
+		weight += fusion->weight[s];
+	}
+	for (a = 0; a < 3; a++) {
+		xyz[a] = weight > 0 ? (int) lrintf(sum[a] / weight) : 0;
+	}
+}
+
+float Fusion_Variance(const Accel_Fusion *fusion) {
+
+	float inverse = 0;
+	int s;
+
+	for (s = 0; s < fusion->n_sensors; s++) {
+		inverse += 1.0f / fusion->calibration[s].variance;
+	}
+	return 1.0f / inverse;
+}
+
+void Fusion_Dwell_Start(Fusion_Dwell *dwell, float threshold,
+		float confidence, float settled, float variance) {
+
+	float n = confidence * confidence * variance
+			/ (FUSION_DWELL_MARGIN_MG * FUSION_DWELL_MARGIN_MG);
+
+	dwell->window = n < FUSION_MIN_WINDOW ? FUSION_MIN_WINDOW
+			: n > FUSION_WINDOW ? FUSION_WINDOW : (int) ceilf(n);
+	dwell->n = 0;
+	dwell->next = 0;
+	dwell->threshold = threshold;
+	dwell->confidence = confidence;
+	dwell->settled = settled;
+}
+
+int Fusion_Dwell_Add(Fusion_Dwell *dwell, float value) {
+
+	float mean = 0, var = 0, d;
+	int i;
+
+	dwell->values[dwell->next] = value;
+	dwell->next = (dwell->next + 1) % dwell->window;
+	if (dwell->n < dwell->window) {
+		dwell->n++;
+		if (dwell->n < dwell->window) {
+			return 0;
+		}
+	}
+
+	for (i = 0; i < dwell->window; i++) {
+		mean += dwell->values[i];
+	}
+	mean /= dwell->window;
+	for (i = 0; i < dwell->window; i++) {
+		d = dwell->values[i] - mean;
+		var += d * d;
+	}
+	var /= dwell->window - 1;
+
+	return var < dwell->settled * dwell->settled
+			&& mean - dwell->confidence * sqrtf(var / dwell->window)
+					> dwell->threshold;
+}
@@ -0,0 +1,121 @@
+/**
+ ******************************************************************************
+ * @file    accelFusion.h
+ * @brief   Fusion of the LSM6DSM and LSM303AGR accelerometers
+ ******************************************************************************
+ *
+ * Both accelerometers are read back to back every sampling period, so a
+ * pair of reads is aligned to within one conversion period of either
+ * sensor. Each read is first brought into the frame of the reference
+ * sensor (sensor 0): its axes are permuted and signed as mounted, and
+ * the offset between the two sensors, measured at rest by
+ * Fusion_Calibrate, is removed. The pair is then averaged with weights
+ * inversely proportional to the noise variance of each sensor, which is
+ * below the variance of either one.
+ *
+ * Fusion_Dwell decides when a reading has settled clearly above a
+ * threshold, so that State 1 no longer has to wait a fixed dwell. It
+ * averages a window of the last readings just long enough to know their
+ * mean to within FUSION_DWELL_MARGIN_MG at the confidence asked for: the
+ * lower the noise, the shorter the window, and the sooner a held tilt is
+ * recognised. An Accel_Fusion of the reference sensor alone measures the
+ * noise of a single accelerometer the same way.
+ */
+
+#ifndef ACCEL_FUSION_H
+#define ACCEL_FUSION_H
+
+#include <stdint.h>
+
+#define FUSION_SENSORS 2
+#define FUSION_MIN_WINDOW 4
+#define FUSION_WINDOW 16            /* longest dwell window */
+#define FUSION_MAX_OFFSET_MG 200    /* larger offsets mean a wrong axis map */
+#define FUSION_MIN_VARIANCE 1.0f    /* mg^2, below the output resolution */
+#define FUSION_DEFAULT_VARIANCE 400.0f  /* mg^2, until calibrated */
+
+/*
+ * State 1 dwell of the firmware: the fixed wait it replaces, which is
+ * also the longest it may take, and the Fusion_Dwell settings
+ */
+
+#define FUSION_MAX_DWELL_MS 3000
+#define FUSION_DWELL_CONFIDENCE 3.0f
+#define FUSION_DWELL_SETTLED_MG 25.0f
+#define FUSION_DWELL_MARGIN_MG 10.0f
+
+typedef struct {
+	int axis[3];                /* raw axis of each reference axis */
+	int sign[3];
+	float offset[3];            /* mg, after mapping */
+	float variance;             /* noise at rest [mg^2] */
+} Fusion_Calibration;
+
+typedef struct {
+	Fusion_Calibration calibration[FUSION_SENSORS];
+	float weight[FUSION_SENSORS];
+	int n_sensors;              /* 1 when only the reference is used */
+} Accel_Fusion;
+
+/*
+ * Start with the axis maps of calibration for the first n_sensors
+ * sensors, no offsets, FUSION_DEFAULT_VARIANCE and equal weights
+ */
+
+void Fusion_Init(Accel_Fusion *fusion,
+		const Fusion_Calibration calibration[FUSION_SENSORS], int n_sensors);
+
+/*
+ * Measure offsets and noise from n pairs of reads taken at rest; only
+ * the reference read of each pair is used when n_sensors is 1. Returns
+ * -1, leaving only the reference sensor in use with weight 1, if there
+ * are fewer than two pairs or an offset exceeds FUSION_MAX_OFFSET_MG.
+ */
+
+int Fusion_Calibrate(Accel_Fusion *fusion,
+		const int (*samples)[FUSION_SENSORS][3], int n);
+
+/*
+ * Fused reading in mg from one pair of raw reads. A sensor whose read
+ * failed (valid[s] == 0) is left out.
+ */
+
+void Fusion_Combine(const Accel_Fusion *fusion,
+		const int raw[FUSION_SENSORS][3], const uint8_t valid[FUSION_SENSORS],
+		int xyz[3]);
+
+/*
+ * Noise variance of the fused reading [mg^2]
+ */
+
+float Fusion_Variance(const Accel_Fusion *fusion);
+
+typedef struct {
+	float values[FUSION_WINDOW];
+	int window;                 /* readings averaged */
+	int n;
+	int next;
+	float threshold;
+	float confidence;           /* standard errors above threshold */
+	float settled;              /* largest standard deviation at rest */
+} Fusion_Dwell;
+
+/*
+ * Start a dwell on readings of noise variance [mg^2], usually
+ * Fusion_Variance. The window is the fewest readings whose mean is within
+ * FUSION_DWELL_MARGIN_MG at confidence standard errors, between
+ * FUSION_MIN_WINDOW and FUSION_WINDOW.
+ */
+
+void Fusion_Dwell_Start(Fusion_Dwell *dwell, float threshold,
+		float confidence, float settled, float variance);
+
+/*
+ * Add a reading. Returns 1 once the window is full, its standard
+ * deviation is below settled and its mean is above threshold by
+ * confidence standard errors.
+ */
+
+int Fusion_Dwell_Add(Fusion_Dwell *dwell, float value);
+
+#endif /* ACCEL_FUSION_H */
@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * @file    bootSequence.c
+ * @brief   Deferred boot tasks and boot-to-ready timing
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bootSequence.h"
+
+void Boot_Init(Boot_Sequence *boot, uint32_t (*clock)(void)) {
+	memset(boot, 0, sizeof(Boot_Sequence));
+	boot->clock = clock;
+}
+
+void Boot_Ready(Boot_Sequence *boot) {
+	boot->ready_ms = boot->clock();
+	boot->ready = 1;
+}
+
+int Boot_Add(Boot_Sequence *boot, const char *name, Boot_Function run,
+		uint32_t delay_ms) {
+
+	Boot_Task *task;
+
+	if (boot->n_tasks == BOOT_MAX_TASKS) {
+		return -1;
+	}
+	task = &boot->tasks[boot->n_tasks];
+	task->name = name;
+	task->run = run;
+	task->not_before = boot->clock() + delay_ms;
+	task->state = BOOT_PENDING;
+	task->ms = 0;
+	return boot->n_tasks++;
+}
+
+int Boot_Require(Boot_Sequence *boot, int id) {
+
+	Boot_Task *task;
+	uint32_t start;
+
+	if (id < 0 || id >= boot->n_tasks) {
+		return BOOT_FAILED;
+	}
+	task = &boot->tasks[id];
+	if (task->state == BOOT_PENDING) {
+		start = boot->clock();
+		task->state = task->run() == 0 ? BOOT_DONE : BOOT_FAILED;
+		task->ms = boot->clock() - start;
+	}
+	return task->state;
+}
+
+int Boot_Run_Next(Boot_Sequence *boot) {
+
+	uint32_t now = boot->clock();
+	int i;
+
+	for (i = 0; i < boot->n_tasks; i++) {
+		if (boot->tasks[i].state == BOOT_PENDING
+				&& (int32_t) (now - boot->tasks[i].not_before) >= 0) {
+			Boot_Require(boot, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void Boot_Finish(Boot_Sequence *boot) {
+
+	int i;
+
+	for (i = 0; i < boot->n_tasks; i++) {
+		Boot_Require(boot, i);
+	}
+}
+
+int Boot_Pending(const Boot_Sequence *boot) {
+
+	int i, n = 0;
+
+	for (i = 0; i < boot->n_tasks; i++) {
+		n += boot->tasks[i].state == BOOT_PENDING;
+	}
+	return n;
+}
+
+int Boot_Format(const Boot_Sequence *boot, uint32_t target_ms, char *text,
+		int size) {
+
+	const Boot_Task *task;
+	int i, n;
+
+	n = snprintf(text, size, "Ready in %lu ms (target %lu ms)",
+			(unsigned long) boot->ready_ms, (unsigned long) target_ms);
+	for (i = 0; i < boot->n_tasks && n < size; i++) {
+		task = &boot->tasks[i];
+		n += snprintf(text + n, size - n, ", %s %s", task->name,
+				task->state == BOOT_PENDING ? "pending"
+						: task->state == BOOT_FAILED ? "FAILED" : "");
+		if (task->state != BOOT_PENDING && n < size) {
+			n += snprintf(text + n, size - n, "%s%lu ms",
+					task->state == BOOT_FAILED ? " " : "",
+					(unsigned long) task->ms);
+		}
+	}
+	return n < size ? n : size - 1;
+}
@@ -0,0 +1,98 @@
+/**
+ ******************************************************************************
+ * @file    bootSequence.h
+ * @brief   Deferred boot tasks and boot-to-ready timing
+ ******************************************************************************
+ *
+ * The firmware only brings up what recognizing the first double tap needs
+ * before it declares itself ready (Boot_Ready); everything else is added
+ * as a task that runs later, either while the main loop would otherwise
+ * sleep (Boot_Run_Next) or right away when something needs it
+ * (Boot_Require). Tasks run at most once, in the order they were added
+ * unless required earlier, and a task that fails leaves the rest of the
+ * boot going: its result is kept for the code that depends on it.
+ *
+ * Times are in ms of the clock passed to Boot_Init (HAL_GetTick on the
+ * SensorTile, which counts from HAL_Init).
+ */
+
+#ifndef BOOT_SEQUENCE_H
+#define BOOT_SEQUENCE_H
+
+#include <stdint.h>
+
+#define BOOT_MAX_TASKS 8
+
+enum {
+	BOOT_PENDING,
+	BOOT_DONE,
+	BOOT_FAILED
+};
+
+/*
+ * Returns 0 on success, anything else marks the task BOOT_FAILED
+ */
+
+typedef int (*Boot_Function)(void);
+
+typedef struct {
+	const char *name;
+	Boot_Function run;
+	uint32_t not_before;        /* earliest start for Boot_Run_Next */
+	uint8_t state;
+	uint32_t ms;                /* time the task took */
+} Boot_Task;
+
+typedef struct {
+	uint32_t (*clock)(void);
+	uint32_t ready_ms;          /* clock at Boot_Ready */
+	int ready;
+	int n_tasks;
+	Boot_Task tasks[BOOT_MAX_TASKS];
+} Boot_Sequence;
+
+void Boot_Init(Boot_Sequence *boot, uint32_t (*clock)(void));
+
+/*
+ * Record the boot-to-ready time
+ */
+
+void Boot_Ready(Boot_Sequence *boot);
+
+/*
+ * Add a task that Boot_Run_Next starts no earlier than delay_ms from now.
+ * Returns its id, or -1 when BOOT_MAX_TASKS are taken.
+ */
+
+int Boot_Add(Boot_Sequence *boot, const char *name, Boot_Function run,
+		uint32_t delay_ms);
+
+/*
+ * Run task id now if it has not run yet. Returns its state.
+ */
+
+int Boot_Require(Boot_Sequence *boot, int id);
+
+/*
+ * Run the first pending task that is due. Returns 1 if one ran.
+ */
+
+int Boot_Run_Next(Boot_Sequence *boot);
+
+/*
+ * Run every pending task, due or not
+ */
+
+void Boot_Finish(Boot_Sequence *boot);
+
+int Boot_Pending(const Boot_Sequence *boot);
+
+/*
+ * "Ready in <ms> ms (target <target_ms> ms), <task> <ms> ms ..." with
+ * failed tasks marked. Returns the length written.
+ */
+
+int Boot_Format(const Boot_Sequence *boot, uint32_t target_ms, char *text,
+		int size);
+
+#endif /* BOOT_SEQUENCE_H */
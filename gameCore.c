@@ -0,0 +1,218 @@
+/**
+ ******************************************************************************
+ * @file    gameCore.c
+ * @brief   Hotter / colder navigation game, one state structure per game
+ ******************************************************************************
+ */
+
+#include <math.h>   /* sqrt */
+#include <stdarg.h>
+#include <stdio.h>  /* vsnprintf */
+
+#include "gameCore.h"
+
+const char Game_Orientation[4] = { 'N', 'E', 'S', 'W' };
+
+void Game_Start(Game_State *game, int x_loc, int y_loc) {
+
+	game->x_loc = x_loc;
+	game->y_loc = y_loc;
+	game->cur_x = GAME_START_X;
+	game->cur_y = GAME_START_Y;
+	game->cur_orientation = 0;
+	game->field = NULL;
+	game->prev_dist = Game_Distance(game);
+	game->round = 0;
+	game->max_rounds = GAME_ROUNDS;
+	game->status = GAME_PLAYING;
+}
+
+int Game_Start_Map(Game_State *game, Game_Field *field, int start_x,
+		int start_y, int x_loc, int y_loc) {
+
+	if (Game_Map_Blocked(field->map, start_x, start_y)
+			|| Game_Field_Set_Target(field, x_loc, y_loc) != 0
+			|| Game_Field_Distance(field, start_x, start_y) < 0) {
+		return -1;
+	}
+
+	game->x_loc = x_loc;
+	game->y_loc = y_loc;
+	game->cur_x = start_x;
+	game->cur_y = start_y;
+	game->cur_orientation = 0;
+	game->field = field;
+	game->prev_dist = Game_Distance(game);
+	game->round = 0;
+	game->max_rounds = game->prev_dist + GAME_ROUNDS;
+	game->status = GAME_PLAYING;
+	return 0;
+}
+
+int Game_Set_Target(Game_State *game, int x_loc, int y_loc) {
+
+	if (game->field != NULL
+			&& Game_Field_Set_Target(game->field, x_loc, y_loc) != 0) {
+		return -1;
+	}
+	game->x_loc = x_loc;
+	game->y_loc = y_loc;
+	return 0;
+}
+
+int Game_Distance(const Game_State *game) {
+
+	int dx = game->x_loc - game->cur_x;
+	int dy = game->y_loc - game->cur_y;
+
+	if (game->field != NULL) {
+		return Game_Field_Distance(game->field, game->cur_x, game->cur_y);
+	}
+	return (int) sqrt(dx * dx + dy * dy);
+}
+
+int Game_Move(Game_State *game, int forwards_back) {
+
+	int step = forwards_back == 1 ? 1 : -1;
+	int x = game->cur_x, y = game->cur_y;
+
+	switch (Game_Orientation[game->cur_orientation]) {
+	case 'N':
+		y += step;
+		break;
+	case 'E':
+		x += step;
+		break;
+	case 'S':
+		y -= step;
+		break;
+	case 'W':
+		x -= step;
+		break;
+	}
+
+	if (game->field != NULL && Game_Map_Blocked(game->field->map, x, y)) {
+		return -1;
+	}
+	game->cur_x = x;
+	game->cur_y = y;
+	return 0;
+}
+
+void Game_Turn_Left(Game_State *game) {
+	game->cur_orientation = (game->cur_orientation + 3) % 4;
+}
+
+void Game_Turn_Right(Game_State *game) {
+	game->cur_orientation = (game->cur_orientation + 1) % 4;
+}
+
+/*
+ * Append to msg, keeping track of the space left
+ */
+
+static void append(char **msg, int *size, const char *format, ...) {
+
+	va_list args;
+	int n;
+
+	if (*size <= 1) {
+		return;
+	}
+	va_start(args, format);
+	n = vsnprintf(*msg, *size, format, args);
+	va_end(args);
+	if (n < 0) {
+		return;
+	}
+	if (n >= *size) {
+		n = *size - 1;
+	}
+	*msg += n;
+	*size -= n;
+}
+
+int Game_Step(Game_State *game, int loc, char *msg, int size) {
+
+	int roundcheck = 0;
+	int dist;
+
+	if (size > 0) {
+		msg[0] = '\0';
+	}
+	if (game->status != GAME_PLAYING) {
+		return game->status;
+	}
+
+	game->prev_dist = Game_Distance(game);
+
+	switch (loc) {
+	case GAME_FORWARD:
+		append(&msg, &size, "\n\rNeural Network Classification - Moved Forwards 1 Unit");
+		if (Game_Move(game, 1) != 0) {
+			append(&msg, &size, "\n\rBlocked, you did not move");
+		}
+		break;
+	case GAME_BACK:
+		append(&msg, &size, "\n\rNeural Network Classification - Moved Backwards 1 Unit");
+		if (Game_Move(game, 0) != 0) {
+			append(&msg, &size, "\n\rBlocked, you did not move");
+		}
+		break;
+	case GAME_LEFT:
+		append(&msg, &size, "\n\rNeural Network Classification - Turned Towards the Left");
+		Game_Turn_Left(game);
+		break;
+	case GAME_RIGHT:
+		append(&msg, &size, "\n\rNeural Network Classification - Turned Towards the Right");
+		Game_Turn_Right(game);
+		break;
+	case GAME_CHECK:
+		append(&msg, &size, "\n\rNeural Network Classification - Checking Distance to Location");
+		append(&msg, &size, "\n\rYou are approximately %d units away",
+				Game_Distance(game));
+		roundcheck = 1;
+		break;
+	case GAME_ROUND:
+		append(&msg, &size, "\n\rNeural Network Classification - Your Current Round is %d",
+				game->round);
+		roundcheck = 1;
+		break;
+	case -1:
+		append(&msg, &size, "\n\rNeural Network Classification - ERROR");
+		break;
+	default:
+		append(&msg, &size, "\n\rNeural Network Classification - NULL");
+		break;
+	}
+
+	if (game->cur_x == game->x_loc && game->cur_y == game->y_loc) {
+		append(&msg, &size, "\n\rYOU WON THE GAME ON ROUND %d!\n\n\n\n", game->round);
+		game->status = GAME_WON;
+		return game->status;
+	}
+
+	dist = Game_Distance(game);
+	if (dist > game->prev_dist) {
+		append(&msg, &size, "\n\rCOLDER!!!\n");
+	}
+	if (dist < game->prev_dist) {
+		append(&msg, &size, "\n\rHOTTER!!!\n");
+	}
+	if (dist == game->prev_dist) {
+		append(&msg, &size, "\n\rAround the Same Temperature.\n");
+	}
+
+	if (roundcheck == 0) {
+		game->round++;
+	}
+
+	append(&msg, &size, "\n\nDirection: %c CUR_X %d CUR_Y %d",
+			Game_Orientation[game->cur_orientation], game->cur_x, game->cur_y);
+
+	if (game->round >= game->max_rounds) {
+		append(&msg, &size, "\n\r\n\rYOU LOST! :(");
+		game->status = GAME_LOST;
+	}
+	return game->status;
+}
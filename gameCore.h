@@ -0,0 +1,107 @@
+/**
+ ******************************************************************************
+ * @file    gameCore.h
+ * @brief   Hotter / colder navigation game, one state structure per game
+ ******************************************************************************
+ *
+ * The player starts at (GAME_START_X, GAME_START_Y) facing north and has
+ * GAME_ROUNDS rounds to reach a hidden location, one classified gesture
+ * per round. After every round the player is told whether they are hotter
+ * or colder than before. A distance check or round query does not use up
+ * the round.
+ *
+ * All state lives in Game_State, so any number of games can run side by
+ * side: the firmware keeps one, host/gameServer one per connected device.
+ *
+ * Game_Start plays on the open, unbounded grid of the SensorTile game with
+ * the straight line distance. Game_Start_Map plays on a Game_Map instead:
+ * moves into obstacles or off the map are refused and the distance is the
+ * walking distance from the game's Game_Field (gameMap.h).
+ */
+
+#ifndef GAME_CORE_H
+#define GAME_CORE_H
+
+#include "gameMap.h"
+
+#define GAME_START_X 3
+#define GAME_START_Y 3
+#define GAME_ROUNDS 15
+#define GAME_TARGET_RANGE 5     /* hidden location is 1 .. GAME_TARGET_RANGE */
+
+/*
+ * Gesture classes, as returned in ANN_Result.loc
+ */
+
+#define GAME_FORWARD 0
+#define GAME_BACK 1
+#define GAME_LEFT 2
+#define GAME_RIGHT 3
+#define GAME_CHECK 4
+#define GAME_ROUND 5
+
+#define GAME_PLAYING 0
+#define GAME_WON 1
+#define GAME_LOST 2
+
+typedef struct {
+	int x_loc;              /* hidden location */
+	int y_loc;
+	int cur_x;
+	int cur_y;
+	int cur_orientation;    /* index into Game_Orientation */
+	int prev_dist;          /* distance at the start of the round */
+	int round;
+	int max_rounds;
+	int status;             /* GAME_PLAYING, GAME_WON or GAME_LOST */
+	Game_Field *field;      /* NULL on the open grid */
+} Game_State;
+
+extern const char Game_Orientation[4];
+
+void Game_Start(Game_State *game, int x_loc, int y_loc);
+
+/*
+ * Start at (start_x, start_y) on the map of field with the hidden
+ * location at (x_loc, y_loc). The player gets GAME_ROUNDS rounds more
+ * than the walking distance. Returns -1 if either cell is blocked or the
+ * location can not be reached from the start.
+ */
+
+int Game_Start_Map(Game_State *game, Game_Field *field, int start_x,
+		int start_y, int x_loc, int y_loc);
+
+/*
+ * Move the hidden location during a game. On a map, a move to a
+ * neighbouring cell updates the distance field in place. Returns -1 if
+ * the cell is blocked.
+ */
+
+int Game_Set_Target(Game_State *game, int x_loc, int y_loc);
+
+/*
+ * Distance to the hidden location in whole units, rounded down, or in
+ * steps on a map (-1 if it can not be reached)
+ */
+
+int Game_Distance(const Game_State *game);
+
+/*
+ * Returns -1 when the move is blocked by an obstacle or the map edge
+ */
+
+int Game_Move(Game_State *game, int forwards_back);
+void Game_Turn_Left(Game_State *game);
+void Game_Turn_Right(Game_State *game);
+
+/*
+ * Play one round with gesture class loc (-1 when nothing was classified)
+ * and write the text the SensorTile prints for it to msg, truncated to
+ * size bytes. Returns the game status after the round.
+ */
+
+#define GAME_MESSAGE_SIZE 256   /* room for the longest Game_Step text */
+
+int Game_Step(Game_State *game, int loc, char *msg, int size);
+
+#endif /* GAME_CORE_H */
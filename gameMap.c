@@ -0,0 +1,488 @@
+/**
+ ******************************************************************************
+ * @file    gameMap.c
+ * @brief   Bounded game maps with obstacles and distance fields
+ ******************************************************************************
+ */
+
+#include <stdlib.h> /* malloc, rand_r */
+#include <string.h> /* memset, memcpy */
+
+#include "gameMap.h"
+
+#define CELLS (GAME_MAP_TILE * GAME_MAP_TILE)
+#define NO_SLOT 0xFFFFFFFFu
+#define UNREACHABLE 0xFFFFFFFFu
+
+static const uint32_t kind_max[4] = { 0, 14, 254, 0xFFFFFFFEu };
+static const uint32_t kind_bytes[4] = { 0, CELLS / 2, CELLS, CELLS * 4 };
+
+Game_Map *Game_Map_Create(int width, int height) {
+
+	Game_Map *map;
+
+	if (width < 1 || height < 1 || width > GAME_MAP_MAX_SIZE
+			|| height > GAME_MAP_MAX_SIZE) {
+		return NULL;
+	}
+	map = malloc(sizeof(Game_Map));
+	if (map == NULL) {
+		return NULL;
+	}
+	map->width = width;
+	map->height = height;
+	map->blocked = calloc(((size_t) width * height + 7) / 8, 1);
+	if (map->blocked == NULL) {
+		free(map);
+		return NULL;
+	}
+	return map;
+}
+
+void Game_Map_Destroy(Game_Map *map) {
+	free(map->blocked);
+	free(map);
+}
+
+void Game_Map_Set_Blocked(Game_Map *map, int x, int y, int blocked) {
+
+	size_t i;
+
+	if (x < 0 || y < 0 || x >= map->width || y >= map->height) {
+		return;
+	}
+	i = (size_t) y * map->width + x;
+	if (blocked) {
+		map->blocked[i >> 3] |= 1 << (i & 7);
+	} else {
+		map->blocked[i >> 3] &= ~(1 << (i & 7));
+	}
+}
+
+int Game_Map_Blocked(const Game_Map *map, int x, int y) {
+
+	size_t i;
+
+	if (x < 0 || y < 0 || x >= map->width || y >= map->height) {
+		return 1;
+	}
+	i = (size_t) y * map->width + x;
+	return (map->blocked[i >> 3] >> (i & 7)) & 1;
+}
+
+void Game_Map_Random(Game_Map *map, float density, unsigned int seed) {
+
+	int x, y;
+
+	for (y = 0; y < map->height; y++) {
+		for (x = 0; x < map->width; x++) {
+			Game_Map_Set_Blocked(map, x, y,
+					rand_r(&seed) < density * ((float) RAND_MAX + 1));
+		}
+	}
+}
+
+/*
+ * Tile pools. Freed slots are chained through their first four bytes.
+ */
+
+static void pool_reset(Game_Map_Pool *pool) {
+	pool->used = 0;
+	pool->free = NO_SLOT;
+}
+
+static uint8_t *pool_slot(const Game_Map_Pool *pool, uint32_t slot) {
+	return pool->data + (size_t) slot * pool->slot_bytes;
+}
+
+static uint32_t pool_alloc(Game_Map_Pool *pool) {
+
+	uint32_t slot, capacity;
+	uint8_t *data;
+
+	if (pool->free != NO_SLOT) {
+		slot = pool->free;
+		memcpy(&pool->free, pool_slot(pool, slot), sizeof(uint32_t));
+	} else {
+		if (pool->used == pool->capacity) {
+			capacity = pool->capacity ? 2 * pool->capacity : 64;
+			data = realloc(pool->data, (size_t) capacity * pool->slot_bytes);
+			if (data == NULL) {
+				return NO_SLOT;
+			}
+			pool->data = data;
+			pool->capacity = capacity;
+		}
+		slot = pool->used++;
+	}
+
+	/*
+	 * All ones is the unreachable offset in every width
+	 */
+
+	memset(pool_slot(pool, slot), 0xFF, pool->slot_bytes);
+	return slot;
+}
+
+static void pool_free(Game_Map_Pool *pool, uint32_t slot) {
+	memcpy(pool_slot(pool, slot), &pool->free, sizeof(uint32_t));
+	pool->free = slot;
+}
+
+static uint32_t tile_get(const Game_Field *field, const Game_Map_Tile *tile,
+		int cell) {
+
+	const uint8_t *data;
+	uint32_t value;
+
+	switch (tile->kind) {
+	case GAME_MAP_TILE_NIBBLE:
+		data = pool_slot(&field->pool[GAME_MAP_TILE_NIBBLE], tile->slot);
+		value = (data[cell >> 1] >> ((cell & 1) * 4)) & 0xF;
+		return value == 0xF ? UNREACHABLE : value;
+	case GAME_MAP_TILE_BYTE:
+		data = pool_slot(&field->pool[GAME_MAP_TILE_BYTE], tile->slot);
+		return data[cell] == 0xFF ? UNREACHABLE : data[cell];
+	case GAME_MAP_TILE_WIDE:
+		data = pool_slot(&field->pool[GAME_MAP_TILE_WIDE], tile->slot);
+		return ((const uint32_t *) data)[cell];
+	default:
+		return UNREACHABLE;
+	}
+}
+
+static void tile_put(Game_Field *field, Game_Map_Tile *tile, int cell,
+		uint32_t value) {
+
+	uint8_t *data = pool_slot(&field->pool[tile->kind], tile->slot);
+	int shift;
+
+	switch (tile->kind) {
+	case GAME_MAP_TILE_NIBBLE:
+		shift = (cell & 1) * 4;
+		data[cell >> 1] = (data[cell >> 1] & ~(0xF << shift)) | (value << shift);
+		break;
+	case GAME_MAP_TILE_BYTE:
+		data[cell] = (uint8_t) value;
+		break;
+	case GAME_MAP_TILE_WIDE:
+		((uint32_t *) data)[cell] = value;
+		break;
+	}
+}
+
+/*
+ * Re-encode a tile in kind, adding shift to every reachable offset
+ */
+
+static int tile_recode(Game_Field *field, Game_Map_Tile *tile, int kind,
+		uint32_t shift) {
+
+	uint32_t values[CELLS];
+	uint32_t slot;
+	int cell;
+
+	for (cell = 0; cell < CELLS; cell++) {
+		values[cell] = tile_get(field, tile, cell);
+	}
+	if (kind != tile->kind) {
+		slot = pool_alloc(&field->pool[kind]);
+		if (slot == NO_SLOT) {
+			return -1;
+		}
+		pool_free(&field->pool[tile->kind], tile->slot);
+		tile->kind = (uint8_t) kind;
+		tile->slot = slot;
+	}
+	for (cell = 0; cell < CELLS; cell++) {
+		if (values[cell] != UNREACHABLE) {
+			tile_put(field, tile, cell, values[cell] + shift);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Store the distance of (x, y), rebasing or widening its tile as needed
+ */
+
+static int field_set(Game_Field *field, int x, int y, int32_t distance) {
+
+	Game_Map_Tile *tile = &field->tiles[(y / GAME_MAP_TILE) * field->tiles_x
+			+ x / GAME_MAP_TILE];
+	int cell = (y % GAME_MAP_TILE) * GAME_MAP_TILE + x % GAME_MAP_TILE;
+	int64_t value;
+	uint32_t shift = 0, top = 0, v;
+	int kind, i;
+
+	if (tile->kind == GAME_MAP_TILE_NONE) {
+		tile->slot = pool_alloc(&field->pool[GAME_MAP_TILE_NIBBLE]);
+		if (tile->slot == NO_SLOT) {
+			return -1;
+		}
+		tile->kind = GAME_MAP_TILE_NIBBLE;
+		tile->base = distance - field->bias;
+	}
+
+	value = (int64_t) distance - field->bias - tile->base;
+	if (value < 0 || value > kind_max[tile->kind]) {
+		if (value < 0) {
+			shift = (uint32_t) -value;
+			value = 0;
+		}
+		top = (uint32_t) value;
+		for (i = 0; i < CELLS; i++) {
+			v = tile_get(field, tile, i);
+			if (v != UNREACHABLE && v + shift > top) {
+				top = v + shift;
+			}
+		}
+		for (kind = tile->kind; top > kind_max[kind]; kind++)
+			;
+		if (tile_recode(field, tile, kind, shift) != 0) {
+			return -1;
+		}
+		tile->base -= (int32_t) shift;
+	}
+	tile_put(field, tile, cell, (uint32_t) value);
+	return 0;
+}
+
+static int32_t field_get(const Game_Field *field, int x, int y) {
+
+	const Game_Map_Tile *tile = &field->tiles[(y / GAME_MAP_TILE)
+			* field->tiles_x + x / GAME_MAP_TILE];
+	uint32_t value = tile_get(field, tile,
+			(y % GAME_MAP_TILE) * GAME_MAP_TILE + x % GAME_MAP_TILE);
+
+	return value == UNREACHABLE ? -1 : tile->base + (int32_t) value + field->bias;
+}
+
+Game_Field *Game_Field_Create(const Game_Map *map) {
+
+	Game_Field *field = calloc(1, sizeof(Game_Field));
+	int kind;
+
+	if (field == NULL) {
+		return NULL;
+	}
+	field->map = map;
+	field->target_x = -1;
+	field->target_y = -1;
+	field->tiles_x = (map->width + GAME_MAP_TILE - 1) / GAME_MAP_TILE;
+	field->tiles_y = (map->height + GAME_MAP_TILE - 1) / GAME_MAP_TILE;
+	field->tiles = calloc((size_t) field->tiles_x * field->tiles_y,
+			sizeof(Game_Map_Tile));
+	field->queue_size = 4 * (map->width + map->height);
+	field->queue = malloc(sizeof(uint32_t) * field->queue_size);
+	if (field->tiles == NULL || field->queue == NULL) {
+		Game_Field_Destroy(field);
+		return NULL;
+	}
+	for (kind = GAME_MAP_TILE_NIBBLE; kind <= GAME_MAP_TILE_WIDE; kind++) {
+		field->pool[kind].slot_bytes = kind_bytes[kind];
+		pool_reset(&field->pool[kind]);
+	}
+	return field;
+}
+
+void Game_Field_Destroy(Game_Field *field) {
+
+	int kind;
+
+	for (kind = GAME_MAP_TILE_NIBBLE; kind <= GAME_MAP_TILE_WIDE; kind++) {
+		free(field->pool[kind].data);
+	}
+	free(field->queue);
+	free(field->tiles);
+	free(field);
+}
+
+/*
+ * Ring buffer of cell indices for the breadth-first searches. It is
+ * doubled when full; the frontier of a search is usually far smaller
+ * than the map.
+ */
+
+typedef struct {
+	Game_Field *field;
+	uint32_t head;
+	uint32_t count;
+} Queue;
+
+static int queue_push(Queue *q, uint32_t cell) {
+
+	Game_Field *field = q->field;
+	uint32_t *queue, size, tail;
+
+	if (q->count == field->queue_size) {
+		size = 2 * field->queue_size;
+		queue = malloc(sizeof(uint32_t) * size);
+		if (queue == NULL) {
+			return -1;
+		}
+		tail = field->queue_size - q->head;
+		memcpy(queue, field->queue + q->head, sizeof(uint32_t) * tail);
+		memcpy(queue + tail, field->queue, sizeof(uint32_t) * q->head);
+		free(field->queue);
+		field->queue = queue;
+		field->queue_size = size;
+		q->head = 0;
+	}
+	field->queue[(q->head + q->count) % field->queue_size] = cell;
+	q->count++;
+	return 0;
+}
+
+static uint32_t queue_pop(Queue *q) {
+
+	uint32_t cell = q->field->queue[q->head];
+
+	q->head = (q->head + 1) % q->field->queue_size;
+	q->count--;
+	return cell;
+}
+
+static const int step_x[4] = { 1, -1, 0, 0 };
+static const int step_y[4] = { 0, 0, 1, -1 };
+
+/*
+ * Breadth-first search from the target over the whole map
+ */
+
+static int field_build(Game_Field *field, int x, int y) {
+
+	const Game_Map *map = field->map;
+	Queue q = { field, 0, 0 };
+	uint32_t cell;
+	int32_t d;
+	int kind, i, cx, cy, nx, ny;
+
+	memset(field->tiles, 0,
+			sizeof(Game_Map_Tile) * field->tiles_x * field->tiles_y);
+	for (kind = GAME_MAP_TILE_NIBBLE; kind <= GAME_MAP_TILE_WIDE; kind++) {
+		pool_reset(&field->pool[kind]);
+	}
+	field->bias = 0;
+
+	if (field_set(field, x, y, 0) != 0
+			|| queue_push(&q, (uint32_t) y * map->width + x) != 0) {
+		return -1;
+	}
+	while (q.count > 0) {
+		cell = queue_pop(&q);
+		cx = cell % map->width;
+		cy = cell / map->width;
+		d = field_get(field, cx, cy) + 1;
+		for (i = 0; i < 4; i++) {
+			nx = cx + step_x[i];
+			ny = cy + step_y[i];
+			if (Game_Map_Blocked(map, nx, ny) || field_get(field, nx, ny) >= 0) {
+				continue;
+			}
+			if (field_set(field, nx, ny, d) != 0
+					|| queue_push(&q, (uint32_t) ny * map->width + nx) != 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Target moved from a cell to its neighbour (x, y). The grid is
+ * bipartite, so every distance changes by exactly one: down for the cells
+ * with a shortest path through (x, y), up for the rest. The first are
+ * exactly the cells reached from (x, y) by always stepping one further
+ * from the old target, so only they are visited; the rest follow from
+ * the bias.
+ */
+
+static int field_shift(Game_Field *field, int x, int y) {
+
+	const Game_Map *map = field->map;
+	Queue q = { field, 0, 0 };
+	uint32_t cell;
+	int32_t d;
+	int i, cx, cy, nx, ny;
+
+	field->bias++;
+	if (field_set(field, x, y, field_get(field, x, y) - 2) != 0
+			|| queue_push(&q, (uint32_t) y * map->width + x) != 0) {
+		return -1;
+	}
+	while (q.count > 0) {
+		cell = queue_pop(&q);
+		cx = cell % map->width;
+		cy = cell / map->width;
+
+		/*
+		 * This cell has been lowered, a cell not yet visited one step
+		 * further from the old target reads three more
+		 */
+
+		d = field_get(field, cx, cy) + 3;
+		for (i = 0; i < 4; i++) {
+			nx = cx + step_x[i];
+			ny = cy + step_y[i];
+			if (Game_Map_Blocked(map, nx, ny) || field_get(field, nx, ny) != d) {
+				continue;
+			}
+			if (field_set(field, nx, ny, d - 2) != 0
+					|| queue_push(&q, (uint32_t) ny * map->width + nx) != 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+int Game_Field_Set_Target(Game_Field *field, int x, int y) {
+
+	int dx = x - field->target_x, dy = y - field->target_y;
+	int status;
+
+	if (Game_Map_Blocked(field->map, x, y)) {
+		return -1;
+	}
+	if (field->target_x >= 0 && dx * dx + dy * dy == 1
+			&& field_get(field, x, y) == 1) {
+		status = field_shift(field, x, y);
+	} else if (dx != 0 || dy != 0 || field->target_x < 0) {
+		status = field_build(field, x, y);
+	} else {
+		return 0;
+	}
+
+	if (status != 0) {
+		field->target_x = -1;
+		field->target_y = -1;
+		return -1;
+	}
+	field->target_x = x;
+	field->target_y = y;
+	return 0;
+}
+
+int Game_Field_Distance(const Game_Field *field, int x, int y) {
+
+	if (field->target_x < 0 || x < 0 || y < 0 || x >= field->map->width
+			|| y >= field->map->height) {
+		return -1;
+	}
+	return field_get(field, x, y);
+}
+
+unsigned long Game_Field_Bytes(const Game_Field *field) {
+
+	unsigned long bytes = sizeof(Game_Field)
+			+ sizeof(Game_Map_Tile) * field->tiles_x * field->tiles_y
+			+ sizeof(uint32_t) * field->queue_size;
+	int kind;
+
+	for (kind = GAME_MAP_TILE_NIBBLE; kind <= GAME_MAP_TILE_WIDE; kind++) {
+		bytes += (unsigned long) field->pool[kind].capacity
+				* field->pool[kind].slot_bytes;
+	}
+	return bytes;
+}
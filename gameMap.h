@@ -0,0 +1,115 @@
+/**
+ ******************************************************************************
+ * @file    gameMap.h
+ * @brief   Bounded game maps with obstacles and distance fields
+ ******************************************************************************
+ *
+ * A Game_Map is a grid of up to GAME_MAP_MAX_SIZE x GAME_MAP_MAX_SIZE
+ * cells, one bit each for obstacles. Several games can share one map.
+ *
+ * A Game_Field holds the walking distance (4-connected steps around the
+ * obstacles) from every cell to one target, found by a breadth-first
+ * search when the target is set. The hotter/colder decision and the
+ * distance check are then a table lookup. When the target moves to a
+ * neighbouring cell the field is updated in place: every distance changes
+ * by exactly one, and only the cells that get closer are visited.
+ *
+ * The field is stored in GAME_MAP_TILE x GAME_MAP_TILE tiles, each a base
+ * distance plus one offset per cell in the narrowest width that holds the
+ * tile: 4 bit, 8 bit or 32 bit. Tiles with no reachable cell take no
+ * storage. On open ground an 8 x 8 tile spans at most 14 steps, so a map
+ * costs about half a byte per cell for the field and one bit per cell for
+ * the obstacles.
+ */
+
+#ifndef GAME_MAP_H
+#define GAME_MAP_H
+
+#include <stdint.h>
+
+#define GAME_MAP_MAX_SIZE 4096
+#define GAME_MAP_TILE 8         /* cells per tile side */
+
+#define GAME_MAP_TILE_NONE 0    /* no reachable cell */
+#define GAME_MAP_TILE_NIBBLE 1
+#define GAME_MAP_TILE_BYTE 2
+#define GAME_MAP_TILE_WIDE 3
+
+typedef struct {
+	int width;
+	int height;
+	uint8_t *blocked;           /* 1 bit per cell, row major */
+} Game_Map;
+
+typedef struct {
+	int32_t base;               /* distance of offset 0, less the field bias */
+	uint32_t slot;              /* cell offsets in the pool of kind */
+	uint8_t kind;               /* GAME_MAP_TILE_* */
+} Game_Map_Tile;
+
+typedef struct {
+	uint8_t *data;
+	uint32_t slot_bytes;
+	uint32_t used;              /* slots handed out */
+	uint32_t capacity;
+	uint32_t free;              /* first free slot, free slots are chained */
+} Game_Map_Pool;
+
+typedef struct {
+	const Game_Map *map;
+	int target_x;               /* -1 before the first target */
+	int target_y;
+	int32_t bias;               /* added to every distance */
+	int tiles_x;
+	int tiles_y;
+	Game_Map_Tile *tiles;
+	Game_Map_Pool pool[4];      /* indexed by kind, pool[0] unused */
+	uint32_t *queue;            /* breadth-first search ring */
+	uint32_t queue_size;
+} Game_Field;
+
+/*
+ * A map of open ground, NULL when out of memory or larger than
+ * GAME_MAP_MAX_SIZE
+ */
+
+Game_Map *Game_Map_Create(int width, int height);
+void Game_Map_Destroy(Game_Map *map);
+
+void Game_Map_Set_Blocked(Game_Map *map, int x, int y, int blocked);
+
+/*
+ * Cells outside the map count as blocked
+ */
+
+int Game_Map_Blocked(const Game_Map *map, int x, int y);
+
+/*
+ * Block each cell with probability density
+ */
+
+void Game_Map_Random(Game_Map *map, float density, unsigned int seed);
+
+Game_Field *Game_Field_Create(const Game_Map *map);
+void Game_Field_Destroy(Game_Field *field);
+
+/*
+ * Move the target to (x, y). Returns -1 if the cell is blocked, leaving
+ * the field unchanged, or if memory runs out, leaving no target.
+ */
+
+int Game_Field_Set_Target(Game_Field *field, int x, int y);
+
+/*
+ * Steps from (x, y) to the target, -1 if it can not be reached
+ */
+
+int Game_Field_Distance(const Game_Field *field, int x, int y);
+
+/*
+ * Bytes held by the field, for reporting
+ */
+
+unsigned long Game_Field_Bytes(const Game_Field *field);
+
+#endif /* GAME_MAP_H */
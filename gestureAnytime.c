@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * @file    gestureAnytime.c
+ * @brief   Anytime classification while the State 1 push is captured
+ ******************************************************************************
+ */
+
+#include "gestureAnytime.h"
+
+void Anytime_Config_Default(Anytime_Config *config) {
+
+	config->margin = ANYTIME_MARGIN;
+	config->hold = ANYTIME_HOLD;
+	config->min_fraction = ANYTIME_MIN_FRACTION;
+}
+
+void Anytime_Start(Anytime_State *anytime, const Anytime_Config *config,
+		const Gesture_Classifier *classifier) {
+
+	anytime->config = config;
+	anytime->classifier = classifier;
+	anytime->candidate = -1;
+	anytime->streak = 0;
+	anytime->evaluations = 0;
+	anytime->committed = 0;
+	anytime->ttt[0] = 0;
+	anytime->ttt[1] = 0;
+	anytime->ttt[2] = 0;
+	anytime->result.loc = -1;
+}
+
+int Anytime_Sample(Anytime_State *anytime, const Feature_Config *features,
+		const Feature_State_1 *state, int ttt_3) {
+
+	const Anytime_Config *config = anytime->config;
+	float XYZ[3], xyz[3];
+	float scale, lead;
+	int loc;
+
+	if (anytime->committed) {
+		return 1;
+	}
+	if (state->accel_mag < config->min_fraction * features->accel_threshold) {
+		anytime->candidate = -1;
+		anytime->streak = 0;
+		return 0;
+	}
+
+	/*
+	 * Where the change would reach the threshold, keeping its direction
+	 */
+
+	scale = state->accel_mag < features->accel_threshold ?
+			features->accel_threshold / state->accel_mag : 1;
+	anytime->ttt[0] = (int) (state->ttt[0] * scale);
+	anytime->ttt[1] = (int) (state->ttt[1] * scale);
+	anytime->ttt[2] = ttt_3;
+
+	XYZ[0] = (float) anytime->ttt[0];
+	XYZ[1] = (float) anytime->ttt[1];
+	XYZ[2] = (float) anytime->ttt[2];
+	motion_softmax(3, XYZ, xyz);
+
+	Classifier_Run(anytime->classifier, xyz, &anytime->result);
+	anytime->evaluations++;
+
+	loc = anytime->result.loc;
+	lead = anytime->result.point - anytime->result.next_max;
+	if (loc < 0 || lead < config->margin) {
+		anytime->candidate = -1;
+		anytime->streak = 0;
+		return 0;
+	}
+
+	if (loc == anytime->candidate) {
+		anytime->streak++;
+	} else {
+		anytime->candidate = loc;
+		anytime->streak = 1;
+	}
+	anytime->committed = anytime->streak >= config->hold;
+	return anytime->committed;
+}
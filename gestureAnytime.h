@@ -0,0 +1,72 @@
+/**
+ ******************************************************************************
+ * @file    gestureAnytime.h
+ * @brief   Anytime classification while the State 1 push is captured
+ ******************************************************************************
+ *
+ * Instead of waiting for the acceleration change to reach the State 1
+ * threshold, the classifier is run on the partial push after every sample
+ * once the change is large enough to have a direction. The partial change
+ * is scaled up to the threshold, where the full capture would have
+ * stopped, so the classifier sees inputs on the scale it was trained on.
+ * Capture ends as soon as the same class has led the runner-up by at
+ * least margin for hold samples in a row.
+ *
+ * Committing early trades accuracy for latency; host/anytime replays
+ * recorded traces to pick the smallest margin that keeps accuracy within
+ * a tolerance of the full capture.
+ */
+
+#ifndef GESTURE_ANYTIME_H
+#define GESTURE_ANYTIME_H
+
+#include "gestureClassifier.h"
+#include "gestureFeatures.h"
+
+/*
+ * Placeholder margin, not tuned on recorded traces: host/anytime picks
+ * one for the player's data
+ */
+
+#define ANYTIME_MARGIN 0.3
+#define ANYTIME_HOLD 3
+
+/*
+ * Share of the State 1 threshold the change must reach before the first
+ * classification
+ */
+
+#define ANYTIME_MIN_FRACTION 0.3
+
+typedef struct {
+	float margin;           /* lead of the top output over the runner-up */
+	int hold;               /* samples the lead must last */
+	float min_fraction;
+} Anytime_Config;
+
+typedef struct {
+	const Anytime_Config *config;
+	const Gesture_Classifier *classifier;
+	int candidate;          /* class in the lead, -1 if none */
+	int streak;             /* samples it has led by margin */
+	int evaluations;        /* classifier runs */
+	int committed;
+	int ttt[3];             /* features of the last run, before motion_softmax */
+	ANN_Result result;
+} Anytime_State;
+
+void Anytime_Config_Default(Anytime_Config *config);
+
+void Anytime_Start(Anytime_State *anytime, const Anytime_Config *config,
+		const Gesture_Classifier *classifier);
+
+/*
+ * Offer State 1 after each Feature_State_1_Sample, with the State 0 tilt
+ * feature ttt_3. Returns 1 once committed; anytime->ttt then holds the
+ * features to classify in place of Feature_State_1_Result.
+ */
+
+int Anytime_Sample(Anytime_State *anytime, const Feature_Config *features,
+		const Feature_State_1 *state, int ttt_3);
+
+#endif /* GESTURE_ANYTIME_H */
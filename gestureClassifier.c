@@ -0,0 +1,107 @@
+/**
+ ******************************************************************************
+ * @file    gestureClassifier.c
+ * @brief   Gesture classifier backends behind one classify call
+ ******************************************************************************
+ */
+
+#include <math.h>   /* sqrt */
+#include <string.h> /* memset */
+
+#include "gestureClassifier.h"
+
+void Centroid_Reset(Centroid_Model *model, int n_classes, int n_features,
+		float reject_distance) {
+
+	int i, j;
+
+	model->n_classes = n_classes;
+	model->n_features = n_features;
+	model->reject_distance = reject_distance;
+	for (i = 0; i < CENTROID_MAX_CLASSES; i++) {
+		for (j = 0; j < CENTROID_MAX_FEATURES; j++) {
+			model->centroid[i][j] = 0;
+		}
+		model->norm[i] = 0;
+		model->count[i] = 0;
+	}
+}
+
+void Centroid_Add(Centroid_Model *model, const float *x, int label) {
+
+	float *c;
+	float norm = 0;
+	int j;
+
+	if (label < 0 || label >= model->n_classes) {
+		return;
+	}
+
+	c = model->centroid[label];
+	model->count[label]++;
+	for (j = 0; j < model->n_features; j++) {
+		c[j] = c[j] + (x[j] - c[j]) / model->count[label];
+		norm = norm + c[j] * c[j];
+	}
+
+	/*
+	 * Keep the prototype length so scoring needs no square root per class
+	 */
+
+	model->norm[label] = sqrt(norm);
+}
+
+void Centroid_Score(const Centroid_Model *model, const float *x,
+		float *output) {
+
+	float norm = 0, dot, s;
+	int i, j;
+
+	for (j = 0; j < model->n_features; j++) {
+		norm = norm + x[j] * x[j];
+	}
+	norm = sqrt(norm);
+
+	for (i = 0; i < model->n_classes; i++) {
+		output[i] = 0;
+		if (model->norm[i] == 0 || norm == 0) {
+			continue;
+		}
+		dot = 0;
+		for (j = 0; j < model->n_features; j++) {
+			dot = dot + x[j] * model->centroid[i][j];
+		}
+		s = dot / (norm * model->norm[i]);
+		output[i] = s > 0 ? s : 0;
+	}
+}
+
+void Classifier_Run(const Gesture_Classifier *classifier, float *input,
+		ANN_Result *result) {
+
+	float score[CENTROID_MAX_CLASSES];
+	ANN *net = classifier->net;
+
+	switch (classifier->kind) {
+	case CLASSIFIER_CENTROID:
+		Centroid_Score(classifier->centroid, input, score);
+		ANN_Scan_Output(score, classifier->centroid->n_classes, result);
+		if (result->loc >= 0
+				&& 1 - result->point > classifier->centroid->reject_distance) {
+			result->loc = -1;
+		}
+		break;
+	case CLASSIFIER_GRAMMAR:
+		Grammar_Run(classifier->grammar, input, result);
+		break;
+	case CLASSIFIER_DTW:
+	case CLASSIFIER_CNN:
+		memset(result, 0, sizeof(ANN_Result));
+		result->loc = -1;
+		break;
+	default:
+		run_ann(net, input);
+		ANN_Scan_Output(net->output, net->topology[net->n_layers - 1], result);
+		break;
+	}
+}
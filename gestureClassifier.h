@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * @file    gestureClassifier.h
+ * @brief   Gesture classifier backends behind one classify call
+ ******************************************************************************
+ *
+ * CLASSIFIER_ANN is the embeddedML network trained by TrainOrientation.
+ * CLASSIFIER_CENTROID keeps one prototype per class, the mean of its
+ * motion_softmax vectors, and classifies by cosine similarity. Training is
+ * just storing the captured vectors, so it completes as soon as the
+ * training motions have been captured, and classification is a handful
+ * of multiply-adds per class.
+ *
+ * CLASSIFIER_GRAMMAR splits each action into primitive motions and
+ * composes them with a state machine (gestureGrammar.h).
+ *
+ * CLASSIFIER_DTW matches the raw gyro and accelerometer recordings of the
+ * gesture against templates captured by TrainOrientation (gestureDtw.h).
+ * It takes the frames of Dtw_Gesture rather than the feature vector, so
+ * it is run with Dtw_Classify instead of Classifier_Run.
+ *
+ * CLASSIFIER_CNN runs the 1D convolutional network of gestureCnn.h over
+ * the window of raw accelerometer and gyroscope samples of the gesture,
+ * trained on the windows of the training motions. It takes the sample
+ * window rather than the feature vector, so it is run with CNN_Classify
+ * instead of Classifier_Run.
+ *
+ * All fill an ANN_Result, so callers switch on result.loc the same way
+ * whichever backend is selected.
+ */
+
+#ifndef GESTURE_CLASSIFIER_H
+#define GESTURE_CLASSIFIER_H
+
+#include "embeddedML.h"
+#include "gestureCnn.h"
+#include "gestureCore.h"
+#include "gestureDtw.h"
+#include "gestureGrammar.h"
+
+#define CLASSIFIER_ANN 0
+#define CLASSIFIER_CENTROID 1
+#define CLASSIFIER_GRAMMAR 2
+#define CLASSIFIER_DTW 3
+#define CLASSIFIER_CNN 4
+
+#define CENTROID_MAX_CLASSES 8
+#define CENTROID_MAX_FEATURES 8
+
+/*
+ * Largest cosine distance, 1 - cos(angle), from the nearest prototype
+ * that is still classified. 0.1 is about 26 degrees.
+ */
+
+#define CENTROID_REJECT_DISTANCE 0.1
+
+typedef struct {
+	int n_classes;
+	int n_features;
+	float reject_distance;
+	float centroid[CENTROID_MAX_CLASSES][CENTROID_MAX_FEATURES];
+	float norm[CENTROID_MAX_CLASSES];
+	int count[CENTROID_MAX_CLASSES];
+} Centroid_Model;
+
+typedef struct {
+	int kind;                   /* CLASSIFIER_ANN, _CENTROID, _GRAMMAR, _DTW or _CNN */
+	ANN *net;
+	Centroid_Model *centroid;
+	Gesture_Grammar *grammar;
+	Dtw_Model *dtw;
+	CNN *cnn;
+} Gesture_Classifier;
+
+void Centroid_Reset(Centroid_Model *model, int n_classes, int n_features,
+		float reject_distance);
+
+/*
+ * Fold one training vector into the running mean of its class
+ */
+
+void Centroid_Add(Centroid_Model *model, const float *x, int label);
+
+/*
+ * Cosine similarity of x to every prototype, clipped at zero, in output.
+ * Classes without training vectors score zero.
+ */
+
+void Centroid_Score(const Centroid_Model *model, const float *x,
+		float *output);
+
+/*
+ * Classify one input vector (after motion_softmax). With the centroid
+ * backend result.loc is -1 when the nearest prototype is further than
+ * reject_distance, with the grammar when no rule matches. The DTW and CNN
+ * backends do not take a feature vector and reject every input here; run
+ * them with Dtw_Classify and CNN_Classify, which only the builds that
+ * select them link.
+ */
+
+void Classifier_Run(const Gesture_Classifier *classifier, float *input,
+		ANN_Result *result);
+
+#endif /* GESTURE_CLASSIFIER_H */
@@ -0,0 +1,258 @@
+/**
+ ******************************************************************************
+ * @file    gestureCnn.c
+ * @brief   Small 1D convolutional network over raw IMU sample windows
+ ******************************************************************************
+ */
+
+#include <math.h>   /* expf, logf, sqrtf */
+#include <string.h> /* memset */
+
+#include "gestureCnn.h"
+#include "gestureCore.h"
+
+void CNN_Ring_Reset(CNN_Ring *ring) {
+	memset(ring, 0, sizeof(CNN_Ring));
+}
+
+void CNN_Ring_Load(CNN_Ring *ring, const float *window) {
+
+	int i;
+
+	for (i = 0; i < CNN_WINDOW * CNN_AXES; i++) {
+		ring->samples[i / CNN_AXES][i % CNN_AXES] = (int16_t) window[i];
+	}
+	ring->head = 0;
+	ring->count = CNN_WINDOW;
+}
+
+void CNN_Ring_Store(const CNN_Ring *ring, float *window) {
+
+	int i;
+
+	for (i = 0; i < CNN_WINDOW * CNN_AXES; i++) {
+		window[i] = ring->samples[(ring->head + i / CNN_AXES) % CNN_WINDOW]
+				[i % CNN_AXES];
+	}
+}
+
+static int16_t saturate(int x) {
+	return x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : (int16_t) x);
+}
+
+void CNN_Ring_Push(CNN_Ring *ring, const int *accel,
+		const int *angular_velocity) {
+
+	int16_t *s = ring->samples[ring->head];
+	int axis_index;
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		s[axis_index] = saturate(accel[axis_index]);
+		s[3 + axis_index] = saturate(angular_velocity[axis_index] / 100);
+	}
+	ring->head = (ring->head + 1) % CNN_WINDOW;
+	if (ring->count < CNN_WINDOW) {
+		ring->count++;
+	}
+}
+
+void CNN_Ring_Set_Accel(CNN_Ring *ring, const int *accel) {
+
+	int i, axis_index;
+
+	for (i = 0; i < ring->count; i++) {
+		int16_t *s = ring->samples[(ring->head + CNN_WINDOW - 1 - i)
+				% CNN_WINDOW];
+		for (axis_index = 0; axis_index < 3; axis_index++) {
+			s[axis_index] = saturate(accel[axis_index]);
+		}
+	}
+}
+
+/*
+ * Sample t of the window, 0 being the oldest. Slots not yet written
+ * since CNN_Ring_Reset are zero, which gives the padding.
+ */
+
+static const int16_t *window_sample(const CNN_Ring *ring, int t) {
+	return ring->samples[(unsigned int) (ring->head + t) % CNN_WINDOW];
+}
+
+void CNN_Init(CNN *cnn, unsigned int seed) {
+
+	float *w;
+	float limit;
+	unsigned int i;
+
+	memset(cnn, 0, sizeof(CNN));
+	cnn->eta = 0.01f;
+
+	w = &cnn->params.w1[0][0][0];
+	limit = sqrtf(6.0f / (CNN_K1 * CNN_AXES));
+	for (i = 0; i < sizeof(cnn->params.w1) / sizeof(float); i++) {
+		w[i] = Gesture_Rand_Uniform(&seed, -limit, limit);
+	}
+
+	w = &cnn->params.w2[0][0][0];
+	limit = sqrtf(6.0f / (CNN_K2 * CNN_C1));
+	for (i = 0; i < sizeof(cnn->params.w2) / sizeof(float); i++) {
+		w[i] = Gesture_Rand_Uniform(&seed, -limit, limit);
+	}
+
+	w = &cnn->params.w3[0][0];
+	limit = sqrtf(6.0f / CNN_C2);
+	for (i = 0; i < sizeof(cnn->params.w3) / sizeof(float); i++) {
+		w[i] = Gesture_Rand_Uniform(&seed, -limit, limit);
+	}
+}
+
+void CNN_Run(CNN *cnn, const CNN_Ring *ring) {
+
+	const CNN_Params *p = &cnn->params;
+	int t, f, k, c, j;
+	float sum, max, total;
+
+	/*
+	 * Layer 1 slides directly over the ring buffer
+	 */
+
+	for (t = 0; t < CNN_L1; t++) {
+		for (f = 0; f < CNN_C1; f++) {
+			sum = 0;
+			for (k = 0; k < CNN_K1; k++) {
+				const int16_t *x = window_sample(ring, t * CNN_S1 + k);
+				for (c = 0; c < CNN_AXES; c++) {
+					sum += p->w1[f][k][c] * x[c];
+				}
+			}
+			sum = p->b1[f] + CNN_INPUT_SCALE * sum;
+			cnn->a1[t][f] = sum > 0 ? sum : 0;
+		}
+	}
+
+	for (t = 0; t < CNN_L2; t++) {
+		for (f = 0; f < CNN_C2; f++) {
+			sum = p->b2[f];
+			for (k = 0; k < CNN_K2; k++) {
+				const float *x = cnn->a1[t * CNN_S2 + k];
+				for (c = 0; c < CNN_C1; c++) {
+					sum += p->w2[f][k][c] * x[c];
+				}
+			}
+			cnn->a2[t][f] = sum > 0 ? sum : 0;
+		}
+	}
+
+	for (f = 0; f < CNN_C2; f++) {
+		sum = 0;
+		for (t = 0; t < CNN_L2; t++) {
+			sum += cnn->a2[t][f];
+		}
+		cnn->pool[f] = sum / CNN_L2;
+	}
+
+	max = -INFINITY;
+	for (j = 0; j < CNN_CLASSES; j++) {
+		sum = p->b3[j];
+		for (f = 0; f < CNN_C2; f++) {
+			sum += p->w3[j][f] * cnn->pool[f];
+		}
+		cnn->output[j] = sum;
+		max = sum > max ? sum : max;
+	}
+
+	total = 0;
+	for (j = 0; j < CNN_CLASSES; j++) {
+		cnn->output[j] = expf(cnn->output[j] - max);
+		total += cnn->output[j];
+	}
+	for (j = 0; j < CNN_CLASSES; j++) {
+		cnn->output[j] /= total;
+	}
+}
+
+float CNN_Train(CNN *cnn, CNN_Grad *grad, const CNN_Ring *ring, int label) {
+
+	CNN_Params *p = &cnn->params;
+	CNN_Params *g = &grad->params;
+	float dz[CNN_CLASSES], dpool[CNN_C2];
+	float *pw, *gw;
+	float d, loss;
+	int t, f, k, c, j;
+	unsigned int i;
+
+	CNN_Run(cnn, ring);
+	loss = -logf(cnn->output[label] > 1e-12f ? cnn->output[label] : 1e-12f);
+
+	memset(grad, 0, sizeof(CNN_Grad));
+
+	/*
+	 * Softmax with cross-entropy: dL/dz = output - one hot label
+	 */
+
+	for (j = 0; j < CNN_CLASSES; j++) {
+		dz[j] = cnn->output[j] - (j == label ? 1.0f : 0.0f);
+		g->b3[j] = dz[j];
+		for (f = 0; f < CNN_C2; f++) {
+			g->w3[j][f] = dz[j] * cnn->pool[f];
+		}
+	}
+	for (f = 0; f < CNN_C2; f++) {
+		d = 0;
+		for (j = 0; j < CNN_CLASSES; j++) {
+			d += dz[j] * p->w3[j][f];
+		}
+		dpool[f] = d / CNN_L2;
+	}
+
+	/*
+	 * Layer 2: scatter each output error back over its kernel window
+	 */
+
+	for (t = 0; t < CNN_L2; t++) {
+		for (f = 0; f < CNN_C2; f++) {
+			if (cnn->a2[t][f] <= 0) {
+				continue;
+			}
+			d = dpool[f];
+			g->b2[f] += d;
+			for (k = 0; k < CNN_K2; k++) {
+				const float *x = cnn->a1[t * CNN_S2 + k];
+				float *dx = grad->d1[t * CNN_S2 + k];
+				for (c = 0; c < CNN_C1; c++) {
+					g->w2[f][k][c] += d * x[c];
+					dx[c] += d * p->w2[f][k][c];
+				}
+			}
+		}
+	}
+
+	for (t = 0; t < CNN_L1; t++) {
+		for (f = 0; f < CNN_C1; f++) {
+			if (cnn->a1[t][f] <= 0) {
+				continue;
+			}
+			d = grad->d1[t][f];
+			g->b1[f] += d;
+			d *= CNN_INPUT_SCALE;
+			for (k = 0; k < CNN_K1; k++) {
+				const int16_t *x = window_sample(ring, t * CNN_S1 + k);
+				for (c = 0; c < CNN_AXES; c++) {
+					g->w1[f][k][c] += d * x[c];
+				}
+			}
+		}
+	}
+
+	pw = (float *) p;
+	gw = (float *) g;
+	for (i = 0; i < sizeof(CNN_Params) / sizeof(float); i++) {
+		pw[i] -= cnn->eta * gw[i];
+	}
+	return loss;
+}
+
+void CNN_Classify(CNN *cnn, const CNN_Ring *ring, ANN_Result *result) {
+	CNN_Run(cnn, ring);
+	ANN_Scan_Output(cnn->output, CNN_CLASSES, result);
+}
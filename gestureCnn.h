@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * @file    gestureCnn.h
+ * @brief   Small 1D convolutional network over raw IMU sample windows
+ ******************************************************************************
+ *
+ * An alternative to the embeddedML ANN that sees the whole motion rather
+ * than the final feature snapshot, so sequences such as tilt then push
+ * are visible to the model. Samples go into a ring buffer as they are
+ * read; the network runs over the last CNN_WINDOW samples:
+ *
+ *   6 axes x CNN_WINDOW
+ *   -> conv CNN_C1 filters, width CNN_K1, stride CNN_S1, relu
+ *   -> conv CNN_C2 filters, width CNN_K2, stride CNN_S2, relu
+ *   -> global average pool
+ *   -> dense CNN_CLASSES, softmax
+ *
+ * The convolutions read the ring buffer and the previous layer in place,
+ * sliding the kernel along time, with no im2col copy. All sizes are
+ * compile time constants and every buffer lives in the structures below,
+ * so the memory use is fixed: CNN_MEMORY_BYTES for inference plus
+ * sizeof(CNN_Grad) when training on the device.
+ *
+ * Outputs are probabilities and can be scored with ANN_Scan_Output.
+ */
+
+#ifndef GESTURE_CNN_H
+#define GESTURE_CNN_H
+
+#include <stdint.h>
+
+#include "gestureCore.h"
+
+#define CNN_AXES 6              /* ax ay az gx gy gz */
+#define CNN_WINDOW 128          /* samples, 1.28 s at DATA_PERIOD_MS */
+
+#define CNN_C1 8
+#define CNN_K1 7
+#define CNN_S1 2
+#define CNN_L1 ((CNN_WINDOW - CNN_K1) / CNN_S1 + 1)
+
+#define CNN_C2 12
+#define CNN_K2 5
+#define CNN_S2 2
+#define CNN_L2 ((CNN_L1 - CNN_K2) / CNN_S2 + 1)
+
+#define CNN_CLASSES 6
+
+/*
+ * Multiply-accumulates per forward pass
+ */
+
+#define CNN_MACS (CNN_L1 * CNN_C1 * CNN_K1 * CNN_AXES \
+		+ CNN_L2 * CNN_C2 * CNN_K2 * CNN_C1 + CNN_CLASSES * CNN_C2)
+
+/*
+ * Raw samples: acceleration in mg, rotation rate in units of 0.1
+ * degrees/s so both fit int16_t. One input unit of the network is 1 g or
+ * 100 degrees/s.
+ */
+
+#define CNN_INPUT_SCALE 0.001f
+
+typedef struct {
+	int16_t samples[CNN_WINDOW][CNN_AXES];
+	int head;                   /* next slot to write, oldest sample when full */
+	int count;
+} CNN_Ring;
+
+typedef struct {
+	float w1[CNN_C1][CNN_K1][CNN_AXES];
+	float b1[CNN_C1];
+	float w2[CNN_C2][CNN_K2][CNN_C1];
+	float b2[CNN_C2];
+	float w3[CNN_CLASSES][CNN_C2];
+	float b3[CNN_CLASSES];
+} CNN_Params;
+
+typedef struct {
+	CNN_Params params;
+	float a1[CNN_L1][CNN_C1];
+	float a2[CNN_L2][CNN_C2];
+	float pool[CNN_C2];
+	float output[CNN_CLASSES];
+	float eta;                  /* learning rate */
+} CNN;
+
+/*
+ * Training scratch: parameter gradients and the first layer error
+ */
+
+typedef struct {
+	CNN_Params params;
+	float d1[CNN_L1][CNN_C1];
+} CNN_Grad;
+
+#define CNN_MEMORY_BYTES (sizeof(CNN) + sizeof(CNN_Ring))
+
+void CNN_Ring_Reset(CNN_Ring *ring);
+
+/*
+ * Copy a full window to or from CNN_WINDOW x CNN_AXES floats holding the
+ * raw ring samples, oldest first, as stored in a host corpus
+ */
+
+void CNN_Ring_Load(CNN_Ring *ring, const float *window);
+void CNN_Ring_Store(const CNN_Ring *ring, float *window);
+
+/*
+ * Append one sample: accel in mg and angular_velocity in milli-degrees
+ * per second, as returned by the BSP drivers
+ */
+
+void CNN_Ring_Push(CNN_Ring *ring, const int *accel,
+		const int *angular_velocity);
+
+/*
+ * Overwrite the acceleration of every sample pushed so far. State 0 only
+ * reads the gyro, so its samples take the reference read of State 1.
+ */
+
+void CNN_Ring_Set_Accel(CNN_Ring *ring, const int *accel);
+
+/*
+ * Uniform weights scaled by the fan-in of each layer from a fixed seed
+ */
+
+void CNN_Init(CNN *cnn, unsigned int seed);
+
+/*
+ * Forward pass over the last CNN_WINDOW samples of ring, oldest first.
+ * A ring that is not yet full is padded with zeros at the start.
+ */
+
+void CNN_Run(CNN *cnn, const CNN_Ring *ring);
+
+/*
+ * One stochastic gradient descent step towards class label on the window
+ * in ring. Returns the cross-entropy loss before the update.
+ */
+
+float CNN_Train(CNN *cnn, CNN_Grad *grad, const CNN_Ring *ring, int label);
+
+/*
+ * CNN_Run and score the output as the classifier backends do
+ */
+
+void CNN_Classify(CNN *cnn, const CNN_Ring *ring, ANN_Result *result);
+
+#endif /* GESTURE_CNN_H */
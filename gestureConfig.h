@@ -0,0 +1,20 @@
+/**
+ ******************************************************************************
+ * @file    gestureConfig.h
+ * @brief   Sampling and training settings shared by the firmware and host
+ ******************************************************************************
+ *
+ * The host tools replay and train exactly as the firmware does, so these
+ * live in one place rather than in each tool.
+ */
+
+#ifndef GESTURE_CONFIG_H
+#define GESTURE_CONFIG_H
+
+/* Data acquisition period [ms] */
+#define DATA_PERIOD_MS (10)
+
+/* Training updates TrainOrientation runs before giving up on convergence */
+#define TRAINING_CYCLES 2000
+
+#endif /* GESTURE_CONFIG_H */
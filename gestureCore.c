@@ -0,0 +1,335 @@
+/**
+ ******************************************************************************
+ * @file    gestureCore.c
+ * @brief   Motion feature and classification kernels shared by the
+ *          SensorTile firmware and the host tools
+ ******************************************************************************
+ */
+
+#include <string.h> /* strlen */
+#include <stdio.h>  /* sprintf */
+#include <stdlib.h> /* abs */
+#include <stdint.h> /* uint8_t */
+#include <math.h>   /* sqrt, pow */
+
+#include "gestureCore.h"
+#include "usbd_cdc_interface.h"
+
+const float ANN_Initial_Weights[ANN_INITIAL_WEIGHTS] = {
+		0.680700, 0.324900, 0.607300, 0.365800, 0.693000,
+		0.527200, 0.754400, 0.287800, 0.592300, 0.570900, 0.644000,
+		0.416500, 0.249200, 0.704200, 0.598700, 0.250300, 0.632700,
+		0.372900, 0.684000, 0.661200, 0.230300, 0.516900, 0.770900,
+		0.315700, 0.756000, 0.293300, 0.509900, 0.627800, 0.781600,
+		0.733500, 0.509700, 0.382600, 0.551200, 0.326700, 0.781000,
+		0.563300, 0.297900, 0.714900, 0.257900, 0.682100, 0.596700,
+		0.467200, 0.339300, 0.533600, 0.548500, 0.374500, 0.722800,
+		0.209100, 0.619400, 0.635700, 0.300100, 0.715300, 0.670800,
+		0.794400, 0.766800, 0.349000, 0.412400, 0.619600, 0.353000,
+		0.690300, 0.772200, 0.666600, 0.254900, 0.402400, 0.780100,
+		0.285300, 0.697700, 0.540800, 0.222800, 0.693300, 0.229800,
+		0.698100, 0.463500, 0.201300, 0.786500, 0.581400, 0.706300,
+		0.653600, 0.542500, 0.766900, 0.411500 };
+
+void stable_softmax(float *x, float *y) {
+	int size = 3;
+	float multiplier = 1.0;
+
+	int i;
+
+	//softmax implemented as square law algorithm to be accommodate numerical precision requirements
+
+	y[0] = (x[0] * x[0] * multiplier)
+			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
+					+ (x[2] * x[2] * multiplier));
+	y[1] = (x[1] * x[1] * multiplier)
+			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
+					+ (x[2] * x[2] * multiplier));
+	y[2] = (x[2] * x[2] * multiplier)
+			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
+					+ (x[2] * x[2] * multiplier));
+
+	for (i = 0; i < size; i++) {
+		if (x[i] < 0.0)
+			y[i] = y[i] * -1.0;
+	}
+}
+
+void motion_softmax(int size, float *x, float *y) {
+	float norm;
+
+	norm = sqrt((x[0] * x[0]) + (x[1] * x[1]) + (x[2] * x[2]));
+	y[0] = abs(x[0]) / norm;
+	y[1] = abs(x[1]) / norm;
+	y[2] = abs(x[2]) / norm;
+
+	int i;
+	for (i = 0; i < size; i++) {
+		if (x[i] < 0.0)
+			y[i] = y[i] * -1.0;
+	}
+}
+
+float Gyro_Integrate_Angle(float *rotate_angle, const int *ttt_initial,
+		const int *ttt, float Tsample) {
+
+	int axis_index;
+	float angle_mag;
+
+	/*
+	 * Compute rotation angles by integration
+	 */
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		rotate_angle[axis_index] = rotate_angle[axis_index]
+				+ (float)((ttt_initial[axis_index] + ttt[axis_index]) * Tsample / 2);
+	}
+
+	/*
+	 * Compute magnitude of rotational angle summing over X and Y
+	 * axis Rotation Rates.
+	 *
+	 * Convert from milli-degrees to degrees (Note that Rotation
+	 * Rate is sampled in milli-degrees per second).
+	 *
+	 */
+
+	angle_mag = 0;
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		angle_mag = angle_mag + pow((rotate_angle[axis_index]), 2);
+	}
+
+	return sqrt(angle_mag)/1000;
+}
+
+/*
+ * Single pass over the network outputs computing everything the
+ * classification criteria need. Matches the original multi-pass scan
+ * in printOutput_ANN: only outputs above 0.1 are candidates for the
+ * maximum and the runner-up, and the spread is taken over
+ * (outputs - 1) degrees of freedom once a maximum has been found.
+ */
+
+void ANN_Scan_Output(const float *output, int n_output, ANN_Result *result) {
+
+	int i, loc = -1, count;
+	float o, point = 0.0, next_max = 0.0;
+	float sum = 0.0, sum_sq = 0.0;
+	float mean, var;
+
+	for (i = 0; i < n_output; i++) {
+		o = output[i];
+		sum = sum + o;
+		sum_sq = sum_sq + o * o;
+		if (o > point && o > 0.1) {
+			next_max = point;
+			point = o;
+			loc = i;
+		} else if (o > next_max && o > 0.1) {
+			next_max = o;
+		}
+	}
+
+	mean = sum / n_output;
+	count = (loc >= 0) ? n_output - 1 : n_output;
+	var = (sum_sq - n_output * mean * mean) / count;
+	if (var < 0) {
+		var = 0;
+	}
+
+	result->loc = loc;
+	result->point = point;
+	result->next_max = next_max;
+	result->mean = mean;
+	result->rms = sqrt(var);
+	result->z_score = (result->rms != 0) ? (point - mean) / result->rms : 0;
+}
+
+int ANN_Result_Error(const ANN_Result *result, int input_state) {
+
+	if (result->loc != input_state) {
+		return ANN_CLASSIFICATION_ERROR;
+	}
+	if ((result->z_score < CLASSIFICATION_ACC_THRESHOLD)
+			|| ((result->point / result->next_max) < CLASSIFICATION_DISC_THRESHOLD)) {
+		return ANN_ACCURACY_LIMIT;
+	}
+	return ANN_CLASSIFIED;
+}
+
+/*
+ * Forward pass over a batch of input vectors.
+ *
+ * Vectors are processed in blocks of ANN_BATCH_BLOCK. Within a block each
+ * weight is loaded once and applied to every vector of the block, so the
+ * weights are streamed once per block instead of once per vector.
+ * Activations are stored neuron-major ([neuron][vector]) so the inner loop
+ * over the vectors of a block is contiguous and has a fixed trip count,
+ * and a partial last block is padded with zero inputs.
+ *
+ * The weight layout and activations are those of run_ann: for each layer,
+ * neuron j owns the row weights[j * inputs .. j * inputs + inputs - 1]
+ * and one bias value.
+ */
+
+int run_ann_batch(ANN *net, const float *inputs, int n_vectors,
+		float *outputs, ANN_Result *results) {
+
+	unsigned int l, j, k;
+	unsigned int n_in, n_out, n_input, n_output;
+	int v, base, block;
+	float scan[ANN_BATCH_MAX_OUTPUT];
+	float act[2][ANN_BATCH_MAX_WIDTH * ANN_BATCH_BLOCK];
+
+	n_input = net->topology[0];
+	n_output = net->topology[net->n_layers - 1];
+	if (n_output > ANN_BATCH_MAX_OUTPUT) {
+		return -1;
+	}
+	for (l = 0; l < net->n_layers; l++) {
+		if (net->topology[l] > ANN_BATCH_MAX_WIDTH) {
+			return -1;
+		}
+	}
+
+	for (base = 0; base < n_vectors; base += ANN_BATCH_BLOCK) {
+		block = n_vectors - base;
+		if (block > ANN_BATCH_BLOCK) {
+			block = ANN_BATCH_BLOCK;
+		}
+
+		float *in = act[0];
+		float *out = act[1];
+		const float *w = net->weights;
+		const float *b = net->bias;
+
+		for (k = 0; k < n_input; k++) {
+			for (v = 0; v < ANN_BATCH_BLOCK; v++) {
+				in[k * ANN_BATCH_BLOCK + v] = (v < block) ?
+						inputs[(base + v) * n_input + k] : 0;
+			}
+		}
+
+		for (l = 1; l < net->n_layers; l++) {
+			float (*activation)(float) = (l == net->n_layers - 1) ?
+					net->output_activation_function :
+					net->hidden_activation_function;
+
+			n_in = net->topology[l - 1];
+			n_out = net->topology[l];
+
+			for (j = 0; j < n_out; j++) {
+				const float *row = w + j * n_in;
+				float sum[ANN_BATCH_BLOCK];
+
+				for (v = 0; v < ANN_BATCH_BLOCK; v++) {
+					sum[v] = b[j];
+				}
+				for (k = 0; k < n_in; k++) {
+					const float wk = row[k];
+					const float *x = in + k * ANN_BATCH_BLOCK;
+					for (v = 0; v < ANN_BATCH_BLOCK; v++) {
+						sum[v] = sum[v] + wk * x[v];
+					}
+				}
+				for (v = 0; v < block; v++) {
+					out[j * ANN_BATCH_BLOCK + v] = activation(sum[v]);
+				}
+				for (; v < ANN_BATCH_BLOCK; v++) {
+					out[j * ANN_BATCH_BLOCK + v] = 0;
+				}
+			}
+
+			w = w + n_in * n_out;
+			b = b + n_out;
+
+			float *t = in;
+			in = out;
+			out = t;
+		}
+
+		for (v = 0; v < block; v++) {
+			for (j = 0; j < n_output; j++) {
+				scan[j] = in[j * ANN_BATCH_BLOCK + v];
+			}
+			if (outputs != NULL) {
+				for (j = 0; j < n_output; j++) {
+					outputs[(base + v) * n_output + j] = in[j * ANN_BATCH_BLOCK + v];
+				}
+			}
+			if (results != NULL) {
+				ANN_Scan_Output(scan, n_output, &results[base + v]);
+			}
+		}
+	}
+	return 0;
+}
+
+void printOutput_ANN(ANN *net, int input_state, int * error) {
+
+	char dataOut[256] = { };
+	int i;
+	float point, mean_output, classification_metric;
+	ANN_Result result;
+
+	ANN_Scan_Output(net->output, net->topology[net->n_layers - 1], &result);
+
+	/*
+	 * Initialize error state
+	 */
+
+	*error = (ANN_Result_Error(&result, input_state) != ANN_CLASSIFIED);
+
+	point = result.point;
+	mean_output = result.mean;
+	classification_metric = result.z_score;
+
+	if (result.loc != input_state) {
+		classification_metric = 0;
+		point = 0;
+		mean_output = 0;
+	}
+
+	sprintf(dataOut, "\r\nState %i\tMax %i\tMean %i\t\tZ-score %i\tOutputs",
+			result.loc, (int) (100 * point), (int) (100 * mean_output),
+			(int) (100 * classification_metric));
+	CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
+
+	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
+		sprintf(dataOut, "\t%i", (int) (100 * net->output[i]));
+		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
+	}
+
+	switch (ANN_Result_Error(&result, input_state)) {
+	case ANN_CLASSIFICATION_ERROR:
+		sprintf(dataOut, "\t Classification Error");
+		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
+		break;
+	case ANN_ACCURACY_LIMIT:
+		sprintf(dataOut, "\t Classification Accuracy Limit");
+		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
+		break;
+	default:
+		break;
+	}
+
+}
+
+unsigned int Gesture_Rand(unsigned int *state) {
+
+	/*
+	 * xorshift32, never seeded with zero
+	 */
+
+	unsigned int x = *state ? *state : 0x9E3779B9u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+float Gesture_Rand_Uniform(unsigned int *state, float lo, float hi) {
+	return lo + (hi - lo) * (float) (Gesture_Rand(state) >> 8) / (float) (1 << 24);
+}
@@ -0,0 +1,103 @@
+/**
+ ******************************************************************************
+ * @file    gestureCore.h
+ * @brief   Motion feature and classification kernels shared by the
+ *          SensorTile firmware and the host tools
+ ******************************************************************************
+ *
+ * Nothing in here touches the HAL or the BSP sensor drivers, so the same
+ * code that runs on the SensorTile can be compiled on the host for
+ * benchmarking and offline evaluation. Text output still goes through
+ * CDC_Fill_Buffer; host builds provide their own CDC_Fill_Buffer (see
+ * host/usbd_cdc_interface.h).
+ */
+
+#ifndef GESTURE_CORE_H
+#define GESTURE_CORE_H
+
+#include "embeddedML.h"
+
+#define CLASSIFICATION_ACC_THRESHOLD 1
+#define CLASSIFICATION_DISC_THRESHOLD 1.05
+
+/*
+ * Starting weights of the 3-9-6 network used by every firmware variant
+ */
+
+#define ANN_INITIAL_WEIGHTS 81
+
+extern const float ANN_Initial_Weights[ANN_INITIAL_WEIGHTS];
+
+/*
+ * Classification summary of one network output vector
+ */
+
+#define ANN_CLASSIFIED 0
+#define ANN_CLASSIFICATION_ERROR 1
+#define ANN_ACCURACY_LIMIT 2
+
+typedef struct {
+	int loc;          /* index of the maximum output above 0.1, or -1 */
+	float point;      /* maximum output */
+	float next_max;   /* runner-up output above 0.1, or 0 */
+	float mean;       /* mean output */
+	float rms;        /* spread of the outputs about the mean */
+	float z_score;    /* (point - mean) / rms */
+} ANN_Result;
+
+/*
+ * Number of vectors sharing each pass over the weights in run_ann_batch
+ */
+
+#define ANN_BATCH_BLOCK 8
+
+/*
+ * Largest output layer scored by run_ann_batch
+ */
+
+#define ANN_BATCH_MAX_OUTPUT 64
+
+/*
+ * Widest layer run by run_ann_batch, so its activations have a fixed
+ * size (2 * ANN_BATCH_MAX_WIDTH * ANN_BATCH_BLOCK floats)
+ */
+
+#define ANN_BATCH_MAX_WIDTH 128
+
+void stable_softmax(float *x, float *y);
+void motion_softmax(int size, float *x, float *y);
+void printOutput_ANN(ANN *net, int input_state, int * error);
+
+void ANN_Scan_Output(const float *output, int n_output, ANN_Result *result);
+int ANN_Result_Error(const ANN_Result *result, int input_state);
+
+/*
+ * Classify n_vectors input vectors stored back to back in inputs.
+ * outputs (n_vectors * output layer size) and results (n_vectors) may
+ * each be NULL when not needed. net->output is left untouched. Returns -1,
+ * computing nothing, for an output layer wider than ANN_BATCH_MAX_OUTPUT
+ * or any layer wider than ANN_BATCH_MAX_WIDTH.
+ */
+
+int run_ann_batch(ANN *net, const float *inputs, int n_vectors,
+		float *outputs, ANN_Result *results);
+
+/*
+ * One step of the trapezoidal rotation rate integration used by
+ * Feature_Extraction_State_0. Rotation rates are in milli-degrees per
+ * second, rotate_angle accumulates milli-degrees and the return value is
+ * the rotation angle magnitude in degrees.
+ */
+
+float Gyro_Integrate_Angle(float *rotate_angle, const int *ttt_initial,
+		const int *ttt, float Tsample);
+
+/*
+ * Deterministic xorshift32 generator for weight initialisation, so runs
+ * can be repeated with a fixed seed on the device and the host alike
+ */
+
+unsigned int Gesture_Rand(unsigned int *state);
+float Gesture_Rand_Uniform(unsigned int *state, float lo, float hi);
+
+#endif /* GESTURE_CORE_H */
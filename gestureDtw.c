@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ * @file    gestureDtw.c
+ * @brief   Template matching of raw gestures by dynamic time warping
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "gestureDtw.h"
+#include "gestureFeatures.h"
+
+#define DTW_INFINITY 1e30f
+
+typedef int32_t Dtw_Mask __attribute__((vector_size(16)));
+
+void Dtw_Record_Start(Dtw_Recorder *recorder, const int *reference) {
+	recorder->n = 0;
+	recorder->stride = 1;
+	recorder->phase = 0;
+	Dtw_Record(recorder, reference);
+}
+
+void Dtw_Record(Dtw_Recorder *recorder, const int *xyz) {
+
+	int i;
+
+	if (++recorder->phase < recorder->stride) {
+		return;
+	}
+	recorder->phase = 0;
+	if (recorder->n == DTW_RECORD_SIZE) {
+		for (i = 0; i < DTW_RECORD_SIZE / 2; i++) {
+			memcpy(recorder->samples[i], recorder->samples[2 * i],
+					sizeof(recorder->samples[0]));
+		}
+		recorder->n = DTW_RECORD_SIZE / 2;
+		recorder->stride *= 2;
+	}
+	memcpy(recorder->samples[recorder->n++], xyz, sizeof(recorder->samples[0]));
+}
+
+/*
+ * Samples after the reference, relative to it and scaled, linearly
+ * resampled to DTW_STATE_FRAMES frames
+ */
+
+static void resample(const Dtw_Recorder *recorder, float scale,
+		Dtw_Frame *frames) {
+
+	const int *reference = recorder->samples[0];
+	int n = recorder->n - 1, i, k, a;
+	float t, f;
+
+	for (i = 0; i < DTW_STATE_FRAMES; i++) {
+		frames[i] = (Dtw_Frame) { 0, 0, 0, 0 };
+		if (n < 1) {
+			continue;
+		}
+		t = n > 1 ? (float) i * (n - 1) / (DTW_STATE_FRAMES - 1) : 0;
+		k = (int) t;
+		if (k > n - 2) {
+			k = n > 1 ? n - 2 : 0;
+		}
+		f = t - k;
+		for (a = 0; a < 3; a++) {
+			frames[i][a] = (recorder->samples[1 + k][a] - reference[a])
+					* (1 - f);
+			if (n > 1) {
+				frames[i][a] += (recorder->samples[2 + k][a] - reference[a])
+						* f;
+			}
+			frames[i][a] /= scale;
+		}
+	}
+}
+
+void Dtw_Gesture(const Dtw_Recorder *gyro, const Dtw_Recorder *accel,
+		Dtw_Frame *frames) {
+	resample(gyro, FEATURE_WINDOW_GYRO_SCALE, frames);
+	resample(accel, FEATURE_WINDOW_ACCEL_SCALE, frames + DTW_STATE_FRAMES);
+}
+
+void Dtw_Reset(Dtw_Model *model, int n_classes, int band,
+		float reject_distance) {
+	memset(model, 0, sizeof(Dtw_Model));
+	model->n_classes = n_classes;
+	model->band = band;
+	model->reject_distance = reject_distance;
+}
+
+void Dtw_Add(Dtw_Model *model, const Dtw_Frame *frames, int label) {
+
+	int slot;
+
+	if (label < 0 || label >= model->n_classes) {
+		return;
+	}
+	slot = model->count[label]++ % DTW_MAX_TEMPLATES;
+	memcpy(model->templates[label][slot], frames,
+			sizeof(Dtw_Frame) * DTW_FRAMES);
+}
+
+static inline float frame_distance(Dtw_Frame a, Dtw_Frame b) {
+
+	Dtw_Frame d = a - b;
+
+	d *= d;
+	return d[0] + d[1] + d[2] + d[3];
+}
+
+static inline Dtw_Frame frame_max(Dtw_Frame a, Dtw_Frame b) {
+
+	Dtw_Mask m = a > b;
+
+	return (Dtw_Frame) (((Dtw_Mask) a & m) | ((Dtw_Mask) b & ~m));
+}
+
+static inline Dtw_Frame frame_min(Dtw_Frame a, Dtw_Frame b) {
+
+	Dtw_Mask m = a < b;
+
+	return (Dtw_Frame) (((Dtw_Mask) a & m) | ((Dtw_Mask) b & ~m));
+}
+
+static long distance(const Dtw_Frame *a, const Dtw_Frame *b, int band,
+		float abandon, float *sum) {
+
+	float rows[2][DTW_FRAMES + 1], *prev = rows[0], *cur = rows[1], *swap;
+	float best, row_min;
+	long cells = 0;
+	int i, j, lo, hi;
+
+	prev[0] = 0;
+	for (j = 1; j <= DTW_FRAMES; j++) {
+		prev[j] = DTW_INFINITY;
+	}
+	for (i = 1; i <= DTW_FRAMES; i++) {
+		lo = i - band > 1 ? i - band : 1;
+		hi = i + band < DTW_FRAMES ? i + band : DTW_FRAMES;
+		cur[lo - 1] = DTW_INFINITY;
+		row_min = DTW_INFINITY;
+		for (j = lo; j <= hi; j++) {
+			best = prev[j - 1];
+			if (prev[j] < best) {
+				best = prev[j];
+			}
+			if (cur[j - 1] < best) {
+				best = cur[j - 1];
+			}
+			cur[j] = best + frame_distance(a[i - 1], b[j - 1]);
+			if (cur[j] < row_min) {
+				row_min = cur[j];
+			}
+		}
+		if (hi < DTW_FRAMES) {
+			cur[hi + 1] = DTW_INFINITY;
+		}
+		cells += hi - lo + 1;
+		if (row_min > abandon) {
+			*sum = row_min;
+			return cells;
+		}
+		swap = prev;
+		prev = cur;
+		cur = swap;
+	}
+	*sum = prev[DTW_FRAMES];
+	return cells;
+}
+
+float Dtw_Distance(const Dtw_Frame *a, const Dtw_Frame *b, int band,
+		float abandon) {
+
+	float sum;
+
+	distance(a, b, band, abandon, &sum);
+	return sum;
+}
+
+/*
+ * LB_Keogh: every template frame is matched to some gesture frame within
+ * the band, so it costs at least its squared distance outside the
+ * envelope of those frames
+ */
+
+static float lower_bound(const Dtw_Frame *frames, const Dtw_Frame *upper,
+		const Dtw_Frame *lower) {
+
+	const Dtw_Frame zero = { 0, 0, 0, 0 };
+	Dtw_Frame e, sum = zero;
+	int j;
+
+	for (j = 0; j < DTW_FRAMES; j++) {
+		e = frame_max(frames[j] - upper[j], zero)
+				+ frame_max(lower[j] - frames[j], zero);
+		sum += e * e;
+	}
+	return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+long Dtw_Score(const Dtw_Model *model, const Dtw_Frame *gesture,
+		float *output) {
+
+	Dtw_Frame upper[DTW_FRAMES], lower[DTW_FRAMES];
+	float bound[DTW_MAX_CLASSES * DTW_MAX_TEMPLATES];
+	float nearest[DTW_MAX_CLASSES], best = DTW_INFINITY, sum, b;
+	int order[DTW_MAX_CLASSES * DTW_MAX_TEMPLATES];
+	int n = 0, c, t, i, j, k, o;
+	long cells = 0;
+
+	/* Envelope of the gesture over the band */
+	for (i = 0; i < DTW_FRAMES; i++) {
+		upper[i] = lower[i] = gesture[i];
+		for (j = i - model->band; j <= i + model->band; j++) {
+			if (j >= 0 && j < DTW_FRAMES) {
+				upper[i] = frame_max(upper[i], gesture[j]);
+				lower[i] = frame_min(lower[i], gesture[j]);
+			}
+		}
+	}
+
+	/* Templates by increasing lower bound */
+	for (c = 0; c < model->n_classes; c++) {
+		nearest[c] = DTW_INFINITY;
+		k = model->count[c] < DTW_MAX_TEMPLATES ?
+				model->count[c] : DTW_MAX_TEMPLATES;
+		for (t = 0; t < k; t++) {
+			o = c * DTW_MAX_TEMPLATES + t;
+			b = lower_bound(model->templates[c][t], upper, lower);
+			for (i = n; i > 0 && bound[order[i - 1]] > b; i--) {
+				order[i] = order[i - 1];
+			}
+			order[i] = o;
+			bound[o] = b;
+			n++;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		o = order[i];
+		c = o / DTW_MAX_TEMPLATES;
+		t = o % DTW_MAX_TEMPLATES;
+		if (bound[o] >= best) {
+			sum = bound[o];
+		} else {
+			cells += distance(gesture, model->templates[c][t], model->band,
+					best, &sum);
+			if (sum < best) {
+				best = sum;
+			}
+		}
+		if (sum < nearest[c]) {
+			nearest[c] = sum;
+		}
+	}
+
+	for (c = 0; c < model->n_classes; c++) {
+		output[c] = nearest[c] < DTW_INFINITY ?
+				1.0f / (1.0f + sqrtf(nearest[c] / DTW_FRAMES)) : 0;
+	}
+	return cells;
+}
+
+void Dtw_Classify(const Dtw_Model *model, const Dtw_Frame *gesture,
+		ANN_Result *result) {
+
+	float score[DTW_MAX_CLASSES];
+
+	Dtw_Score(model, gesture, score);
+	ANN_Scan_Output(score, model->n_classes, result);
+	if (result->loc >= 0 && 1 / result->point - 1 > model->reject_distance) {
+		result->loc = -1;
+	}
+}
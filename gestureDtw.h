@@ -0,0 +1,123 @@
+/**
+ ******************************************************************************
+ * @file    gestureDtw.h
+ * @brief   Template matching of raw gestures by dynamic time warping
+ ******************************************************************************
+ *
+ * An alternative to the classifiers of gestureClassifier.h that compares
+ * the whole motion instead of the final feature vector. TrainOrientation
+ * stores the recording of every training motion as a template of its
+ * class; a gesture is classified as the class of the template it is
+ * closest to under dynamic time warping, so the same motion made faster
+ * or slower still matches.
+ *
+ * A gesture is the State 0 gyro recording followed by the State 1
+ * accelerometer recording, each taken relative to its reference read,
+ * scaled so 100 degrees/s and 1 g are 1.0 and resampled to
+ * DTW_STATE_FRAMES frames. The warping path is kept within DTW_BAND
+ * frames of the diagonal (Sakoe-Chiba band). Templates are visited in
+ * order of their LB_Keogh lower bound against the band envelope of the
+ * gesture; a template whose bound is above the best distance so far is
+ * skipped, and the warping of the others is abandoned as soon as a whole
+ * row of the cost matrix is above it.
+ *
+ * Frames are GCC vectors of four floats, x y z and a zero lane, so the
+ * frame distances and envelope bounds compile to SIMD instructions where
+ * the target has them (SSE, NEON) and to plain VFP code on the
+ * Cortex-M4F.
+ */
+
+#ifndef GESTURE_DTW_H
+#define GESTURE_DTW_H
+
+#include <stdint.h>
+
+#include "gestureCore.h"
+
+#define DTW_STATE_FRAMES 24
+#define DTW_FRAMES (2 * DTW_STATE_FRAMES)
+#define DTW_BAND 5
+#define DTW_MAX_CLASSES 8
+#define DTW_MAX_TEMPLATES 2         /* per class, the oldest is replaced */
+
+/*
+ * Largest RMS frame distance along the warping path that is still
+ * classified
+ */
+
+#define DTW_REJECT_DISTANCE 1.0f
+
+/*
+ * Samples kept per state while recording. Once full, every other sample
+ * is dropped and only every second one is recorded from then on, so any
+ * length of capture fits.
+ */
+
+#define DTW_RECORD_SIZE 128
+
+typedef float Dtw_Frame __attribute__((vector_size(16)));
+
+typedef struct {
+	int samples[DTW_RECORD_SIZE][3];
+	int n;
+	int stride;                 /* samples per recorded sample */
+	int phase;
+} Dtw_Recorder;
+
+typedef struct {
+	int n_classes;
+	int band;
+	float reject_distance;
+	int count[DTW_MAX_CLASSES];  /* templates added */
+	Dtw_Frame templates[DTW_MAX_CLASSES][DTW_MAX_TEMPLATES][DTW_FRAMES];
+} Dtw_Model;
+
+/*
+ * Start a recording with the reference read taken before the LED turns on
+ */
+
+void Dtw_Record_Start(Dtw_Recorder *recorder, const int *reference);
+void Dtw_Record(Dtw_Recorder *recorder, const int *xyz);
+
+/*
+ * Frames of the gesture recorded by gyro (angular velocity in
+ * milli-degrees/s) and accel (acceleration in mg)
+ */
+
+void Dtw_Gesture(const Dtw_Recorder *gyro, const Dtw_Recorder *accel,
+		Dtw_Frame *frames);
+
+void Dtw_Reset(Dtw_Model *model, int n_classes, int band,
+		float reject_distance);
+void Dtw_Add(Dtw_Model *model, const Dtw_Frame *frames, int label);
+
+/*
+ * Sum of squared frame distances along the best warping path within band.
+ * Once every path is above abandon the sum is not finished: a value
+ * above abandon is returned, a lower bound of the distance.
+ */
+
+float Dtw_Distance(const Dtw_Frame *a, const Dtw_Frame *b, int band,
+		float abandon);
+
+/*
+ * Score every class 1 / (1 + d), d the RMS frame distance of its nearest
+ * template, zero for classes without templates. Only the best class gets
+ * its exact distance; the others are scored by a lower bound of theirs,
+ * which keeps them below it. Returns the number of cost matrix cells
+ * computed.
+ */
+
+long Dtw_Score(const Dtw_Model *model, const Dtw_Frame *gesture,
+		float *output);
+
+/*
+ * Dtw_Score and score the output as the classifier backends do, with
+ * result.loc -1 when the nearest template is further than
+ * model->reject_distance
+ */
+
+void Dtw_Classify(const Dtw_Model *model, const Dtw_Frame *gesture,
+		ANN_Result *result);
+
+#endif /* GESTURE_DTW_H */
@@ -0,0 +1,128 @@
+/**
+ ******************************************************************************
+ * @file    gestureEnergy.c
+ * @brief   Charge drawn per game stage, from the gas gauge or a model
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gestureEnergy.h"
+
+const char *const Energy_Stage_Name[ENERGY_STAGES] = {
+	"idle", "capture", "inference", "feedback", "usb", "training"
+};
+
+/*
+ * mA over ms in uAh
+ */
+
+static float charge(float current_ma, uint32_t ms) {
+	return current_ma * (float) ms / 3600.0f;
+}
+
+static void add(Energy_Account *account, Energy_Stage stage, uint32_t ms,
+		float uah) {
+	account->period.ms[stage] += ms;
+	account->period.uah[stage] += uah;
+	account->total.ms[stage] += ms;
+	account->total.uah[stage] += uah;
+}
+
+void Energy_Start(Energy_Account *account, uint32_t tick, float current_ma,
+		uint32_t voltage_mv) {
+	memset(account, 0, sizeof(Energy_Account));
+	account->stage = ENERGY_IDLE;
+	account->tick = tick;
+	account->current_ma = current_ma;
+	account->voltage_mv = voltage_mv;
+}
+
+void Energy_Enter(Energy_Account *account, Energy_Stage stage, uint32_t tick,
+		float current_ma, uint32_t voltage_mv) {
+
+	uint32_t ms = tick - account->tick;
+
+	add(account, account->stage, ms,
+			charge((account->current_ma + current_ma) / 2, ms));
+	account->stage = stage;
+	account->tick = tick;
+	account->current_ma = current_ma;
+	account->voltage_mv = voltage_mv;
+}
+
+void Energy_Enter_Estimate(Energy_Account *account, const Energy_Model *model,
+		Energy_Stage stage, uint32_t tick) {
+
+	uint32_t ms = tick - account->tick;
+
+	add(account, account->stage, ms,
+			charge(model->current_ma[account->stage], ms));
+	account->stage = stage;
+	account->tick = tick;
+	account->current_ma = model->current_ma[stage];
+}
+
+void Energy_Add_Estimate(Energy_Account *account, const Energy_Model *model,
+		Energy_Stage stage, uint32_t ms) {
+	add(account, stage, ms, charge(model->current_ma[stage], ms));
+}
+
+void Energy_Begin_Period(Energy_Account *account) {
+	memset(&account->period, 0, sizeof(Energy_Totals));
+}
+
+float Energy_Sum(const Energy_Totals *totals) {
+
+	float sum = 0;
+	int s;
+
+	for (s = 0; s < ENERGY_STAGES; s++) {
+		sum += totals->uah[s];
+	}
+	return sum;
+}
+
+/*
+ * Tenths of a uAh, rounded, for %d formatting
+ */
+
+static int tenths(float uah) {
+	return (int) (uah * 10 + (uah < 0 ? -0.5f : 0.5f));
+}
+
+static int append(char *text, int size, int n, const char *name, float uah) {
+
+	int t = tenths(uah);
+
+	if (n >= size) {
+		return n;
+	}
+	return n + snprintf(text + n, size - n, "%s%s%d.%d", name,
+			t < 0 && t > -10 ? "-" : "", t / 10, (t < 0 ? -t : t) % 10);
+}
+
+int Energy_Format(const Energy_Totals *totals, const char *name, char *text,
+		int size) {
+
+	uint32_t ms = 0;
+	int s, n;
+
+	for (s = 0; s < ENERGY_STAGES; s++) {
+		ms += totals->ms[s];
+	}
+	n = snprintf(text, size, "%s: ", name);
+	n = append(text, size, n, "", Energy_Sum(totals));
+	if (n < size) {
+		n += snprintf(text + n, size - n, " uAh in %lu ms:",
+				(unsigned long) ms);
+	}
+	for (s = 0; s < ENERGY_STAGES; s++) {
+		if (totals->ms[s] > 0 && n < size) {
+			n += snprintf(text + n, size - n, " %s ", Energy_Stage_Name[s]);
+			n = append(text, size, n, "", totals->uah[s]);
+		}
+	}
+	return n < size ? n : size - 1;
+}
@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ * @file    gestureEnergy.h
+ * @brief   Charge drawn per game stage, from the gas gauge or a model
+ ******************************************************************************
+ *
+ * The game marks the boundary of every stage of a round (capture,
+ * inference, LED feedback, USB output, training and the idle waits in
+ * between) with Energy_Enter, passing the battery current and voltage
+ * read from the STC3115 gas gauge at that moment. The interval since the
+ * previous boundary is charged to the stage that just ended, at the mean
+ * of the currents read at its two ends.
+ *
+ * The gauge averages its current readings over its own conversion period,
+ * so stages much shorter than that are charged the average of their
+ * neighbourhood; totals per round or training session are the reliable
+ * figure. The gauge sees the battery only: on USB power it reads the
+ * charge current, not what the board draws.
+ *
+ * Without a gauge, and on the host, Energy_Enter_Estimate charges each
+ * stage at the current of an Energy_Model instead.
+ */
+
+#ifndef GESTURE_ENERGY_H
+#define GESTURE_ENERGY_H
+
+#include <stdint.h>
+
+typedef enum {
+	ENERGY_IDLE,
+	ENERGY_CAPTURE,
+	ENERGY_INFERENCE,
+	ENERGY_FEEDBACK,
+	ENERGY_USB,
+	ENERGY_TRAINING,
+	ENERGY_STAGES
+} Energy_Stage;
+
+extern const char *const Energy_Stage_Name[ENERGY_STAGES];
+
+typedef struct {
+	uint32_t ms[ENERGY_STAGES];
+	float uah[ENERGY_STAGES];   /* micro-ampere-hours */
+} Energy_Totals;
+
+typedef struct {
+	Energy_Stage stage;         /* stage since the last boundary */
+	uint32_t tick;              /* ms at the last boundary */
+	float current_ma;           /* drawn at the last boundary */
+	uint32_t voltage_mv;        /* at the last boundary */
+	Energy_Totals period;       /* since Energy_Begin_Period */
+	Energy_Totals total;        /* since Energy_Start */
+} Energy_Account;
+
+/*
+ * Current drawn in each stage [mA]
+ */
+
+typedef struct {
+	float current_ma[ENERGY_STAGES];
+} Energy_Model;
+
+/*
+ * SensorTile estimates at 80 MHz with the LSM6DSM running: HAL_Delay keeps
+ * the core busy, so the idle waits draw close to the capture current. LED
+ * feedback adds the LED at about half duty. Calibrate against the gauge.
+ */
+
+#define ENERGY_MODEL_SENSORTILE { { 9.0f, 9.5f, 10.0f, 11.0f, 11.5f, 10.0f } }
+
+void Energy_Start(Energy_Account *account, uint32_t tick, float current_ma,
+		uint32_t voltage_mv);
+
+/*
+ * Charge the interval since the last boundary to the stage that ends and
+ * start stage. current_ma is the current drawn from the battery.
+ */
+
+void Energy_Enter(Energy_Account *account, Energy_Stage stage, uint32_t tick,
+		float current_ma, uint32_t voltage_mv);
+
+/*
+ * Energy_Enter with the interval charged at the model current of the
+ * stage that ends
+ */
+
+void Energy_Enter_Estimate(Energy_Account *account, const Energy_Model *model,
+		Energy_Stage stage, uint32_t tick);
+
+/*
+ * Add ms of stage at the model current, for simulations that know how
+ * long each stage lasts
+ */
+
+void Energy_Add_Estimate(Energy_Account *account, const Energy_Model *model,
+		Energy_Stage stage, uint32_t ms);
+
+void Energy_Begin_Period(Energy_Account *account);
+
+float Energy_Sum(const Energy_Totals *totals);
+
+/*
+ * "<name>: <total> uAh in <ms> ms, capture <uAh> ..." without floating
+ * point formatting, one decimal. Returns the length written.
+ */
+
+int Energy_Format(const Energy_Totals *totals, const char *name, char *text,
+		int size);
+
+#endif /* GESTURE_ENERGY_H */
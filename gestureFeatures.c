@@ -0,0 +1,269 @@
+/**
+ ******************************************************************************
+ * @file    gestureFeatures.c
+ * @brief   Sample driven form of the two state feature extraction
+ ******************************************************************************
+ */
+
+#include <math.h>   /* sqrt, pow */
+#include <stddef.h> /* NULL */
+
+#include "gestureCore.h"
+#include "gestureFeatures.h"
+
+void Feature_Window_Reset(Feature_Window *window, float scale,
+		float dead_band) {
+
+	int axis_index;
+
+	window->n = 0;
+	window->scale = scale;
+	window->dead_band = dead_band;
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		window->mean[axis_index] = 0;
+		window->m2[axis_index] = 0;
+		window->min[axis_index] = 0;
+		window->max[axis_index] = 0;
+		window->sign[axis_index] = 0;
+		window->zero_crossings[axis_index] = 0;
+	}
+	window->peak = 0;
+}
+
+void Feature_Window_Add(Feature_Window *window, const int *xyz) {
+
+	int axis_index, sign;
+	float x, delta, mag = 0;
+
+	window->n++;
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		x = (float) xyz[axis_index];
+
+		delta = x - window->mean[axis_index];
+		window->mean[axis_index] += delta / window->n;
+		window->m2[axis_index] += delta * (x - window->mean[axis_index]);
+
+		if (window->n == 1 || x < window->min[axis_index]) {
+			window->min[axis_index] = x;
+		}
+		if (window->n == 1 || x > window->max[axis_index]) {
+			window->max[axis_index] = x;
+		}
+
+		/*
+		 * A zero crossing is a change of sign between samples outside
+		 * the dead band, so sensor noise about zero is not counted
+		 */
+
+		sign = x > window->dead_band ? 1 : (x < -window->dead_band ? -1 : 0);
+		if (sign != 0) {
+			if (window->sign[axis_index] != 0 && sign != window->sign[axis_index]) {
+				window->zero_crossings[axis_index]++;
+			}
+			window->sign[axis_index] = sign;
+		}
+
+		mag += x * x;
+	}
+	if (mag > window->peak) {
+		window->peak = mag;
+	}
+}
+
+void Feature_Window_Vector(const Feature_Window *window, float Tsample,
+		float *features) {
+
+	int axis_index;
+	int n = window->n > 0 ? window->n : 1;
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		features[axis_index] = window->mean[axis_index] / window->scale;
+		features[3 + axis_index] = sqrt(window->m2[axis_index] / n)
+				/ window->scale;
+		features[6 + axis_index] = window->min[axis_index] / window->scale;
+		features[9 + axis_index] = window->max[axis_index] / window->scale;
+		features[12 + axis_index] = (float) window->zero_crossings[axis_index]
+				/ n;
+	}
+	features[15] = sqrt(window->peak) / window->scale;
+	features[16] = window->n * Tsample;
+}
+
+void Feature_State_0_Start(Feature_State_0 *state, const int *ttt_offset) {
+
+	int axis_index;
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		state->ttt[axis_index] = 0;
+		state->ttt_offset[axis_index] = ttt_offset[axis_index];
+		state->rotate_angle[axis_index] = 0;
+	}
+	state->angle_mag = 0;
+	state->sample_index = 0;
+	state->complete = 0;
+	state->window = NULL;
+}
+
+int Feature_State_0_Sample(Feature_State_0 *state, const Feature_Config *config,
+		const int *angular_velocity) {
+
+	int ttt_initial[3];
+	int axis_index;
+
+	/*
+	 * Previous sample value of rotation rate with the offset removed.
+	 * Note that state->ttt already has the offset removed, so it is taken
+	 * off a second time here. This is what the SensorTile has always done
+	 * and the thresholds were tuned with it, so it is kept.
+	 */
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		ttt_initial[axis_index] = state->ttt[axis_index]
+				- state->ttt_offset[axis_index];
+	}
+
+	/*
+	 * Current sample value of rotation rate with the offset removed
+	 */
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		state->ttt[axis_index] = angular_velocity[axis_index]
+				- state->ttt_offset[axis_index];
+	}
+
+	if (state->window != NULL) {
+		Feature_Window_Add(state->window, state->ttt);
+	}
+
+	/*
+	 * Suppress value of Z-Axis rotation signals
+	 */
+
+	ttt_initial[2] = 0;
+	state->ttt[2] = 0;
+
+	state->angle_mag = Gyro_Integrate_Angle(state->rotate_angle, ttt_initial,
+			state->ttt, config->Tsample);
+	state->sample_index++;
+
+	if (state->angle_mag >= config->angle_mag_max_threshold) {
+		state->complete = 1;
+	}
+	return state->complete;
+}
+
+void Feature_State_0_Result(const Feature_State_0 *state, int *ttt_3,
+		int *ttt_mag_scale) {
+
+	*ttt_3 = state->complete ? state->rotate_angle[1] / 100 : 0;
+	*ttt_mag_scale = (int) (state->angle_mag * 100);
+}
+
+void Feature_State_1_Start(Feature_State_1 *state, const int *ttt_initial) {
+
+	int axis_index;
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		state->ttt[axis_index] = 0;
+		state->ttt_initial[axis_index] = ttt_initial[axis_index];
+	}
+	state->accel_mag = 0;
+	state->sample_index = 0;
+	state->complete = 0;
+	state->window = NULL;
+}
+
+int Feature_State_1_Sample(Feature_State_1 *state, const Feature_Config *config,
+		const int *acceleration) {
+
+	int axis_index;
+	float accel_mag = 0;
+
+	for (axis_index = 0; axis_index < 3; axis_index++) {
+		state->ttt[axis_index] = acceleration[axis_index]
+				- state->ttt_initial[axis_index];
+		accel_mag = accel_mag + pow((state->ttt[axis_index]), 2);
+	}
+
+	state->accel_mag = sqrt(accel_mag);
+	state->sample_index++;
+
+	if (state->window != NULL) {
+		Feature_Window_Add(state->window, state->ttt);
+	}
+
+	if (state->accel_mag > config->accel_threshold) {
+		state->complete = 1;
+	}
+	return state->complete;
+}
+
+void Feature_State_1_Result(const Feature_State_1 *state, int *ttt_1,
+		int *ttt_2, int *ttt_mag_scale) {
+
+	*ttt_1 = state->ttt[0];
+	*ttt_2 = state->ttt[1];
+
+	/*
+	 * Without a push the residual change is scaled down
+	 */
+
+	if (state->complete) {
+		*ttt_mag_scale = (int) (state->accel_mag);
+	} else {
+		*ttt_1 /= 300;
+		*ttt_2 /= 300;
+		*ttt_mag_scale = (int) (state->accel_mag / 30);
+	}
+}
+
+void Feature_Replay(const Feature_Config *config, const int (*state_0)[3],
+		int n_0, const int (*state_1)[3], int n_1, float *features,
+		int *samples_used, float *window) {
+
+	Feature_State_0 s0;
+	Feature_State_1 s1;
+	Feature_Window w0, w1;
+	int ttt_1 = 0, ttt_2 = 0, ttt_3 = 0, ttt_mag_scale;
+	int i;
+
+	samples_used[0] = 0;
+	samples_used[1] = 0;
+	Feature_Window_Reset(&w0, FEATURE_WINDOW_GYRO_SCALE,
+			FEATURE_WINDOW_GYRO_DEAD_BAND);
+	Feature_Window_Reset(&w1, FEATURE_WINDOW_ACCEL_SCALE,
+			FEATURE_WINDOW_ACCEL_DEAD_BAND);
+
+	if (n_0 > 0) {
+		Feature_State_0_Start(&s0, state_0[0]);
+		s0.window = window != NULL ? &w0 : NULL;
+		for (i = 1; i < n_0 && i <= config->max_acquire_cycles; i++) {
+			if (Feature_State_0_Sample(&s0, config, state_0[i])) {
+				break;
+			}
+		}
+		Feature_State_0_Result(&s0, &ttt_3, &ttt_mag_scale);
+		samples_used[0] = s0.sample_index;
+	}
+
+	if (n_1 > 0) {
+		Feature_State_1_Start(&s1, state_1[0]);
+		s1.window = window != NULL ? &w1 : NULL;
+		for (i = 1; i < n_1 && i <= config->max_acquire_cycles; i++) {
+			if (Feature_State_1_Sample(&s1, config, state_1[i])) {
+				break;
+			}
+		}
+		Feature_State_1_Result(&s1, &ttt_1, &ttt_2, &ttt_mag_scale);
+		samples_used[1] = s1.sample_index;
+	}
+
+	features[0] = (float) ttt_1;
+	features[1] = (float) ttt_2;
+	features[2] = (float) ttt_3;
+
+	if (window != NULL) {
+		Feature_Window_Vector(&w0, config->Tsample, window);
+		Feature_Window_Vector(&w1, config->Tsample, window + FEATURE_WINDOW_SIZE);
+	}
+}
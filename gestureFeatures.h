@@ -0,0 +1,158 @@
+/**
+ ******************************************************************************
+ * @file    gestureFeatures.h
+ * @brief   Sample driven form of the two state feature extraction
+ ******************************************************************************
+ *
+ * Feature_Extraction_State_0 and Feature_Extraction_State_1 in the firmware
+ * read one sensor sample per DATA_PERIOD_MS and feed it to the state
+ * machines below. Keeping the arithmetic here, apart from the sensor reads,
+ * delays and LED prompts, lets the host replay recorded IMU traces through
+ * exactly the same feature computation with different thresholds.
+ *
+ * Units are those of the BSP drivers: mg for acceleration and milli-degrees
+ * per second for rotation rate.
+ */
+
+#ifndef GESTURE_FEATURES_H
+#define GESTURE_FEATURES_H
+
+typedef struct {
+	float angle_mag_max_threshold;  /* State 0 rotation that ends capture [degrees] */
+	float accel_threshold;          /* State 1 acceleration change that ends capture [mg] */
+	int max_acquire_cycles;         /* samples per state before giving up */
+	float Tsample;                  /* sample period [s] */
+} Feature_Config;
+
+/*
+ * Running statistics of one sensor over a gesture window, updated with
+ * constant work per sample (Welford mean and variance) so nothing has to
+ * be buffered for a second pass. Axis values are taken as the state
+ * machines see them: rotation rate with the offset removed, acceleration
+ * as the change from the starting value.
+ *
+ * Only the host tools use these so far (sweep --window, extract --window).
+ * The firmware network is still 3-9-6 on the three motion_softmax inputs
+ * and its state machines run with window NULL; a device network over the
+ * window features needs a wider input layer and a trained model first.
+ */
+
+#define FEATURE_WINDOW_SIZE 17
+
+typedef struct {
+	int n;
+	float scale;        /* input units per feature unit */
+	float dead_band;    /* |x| below this does not count as a sign */
+	float mean[3];
+	float m2[3];
+	float min[3];
+	float max[3];
+	int sign[3];
+	int zero_crossings[3];
+	float peak;         /* largest squared magnitude */
+} Feature_Window;
+
+/*
+ * State 0: integrate X and Y rotation rate until the rotation angle
+ * magnitude reaches angle_mag_max_threshold
+ */
+
+typedef struct {
+	int ttt[3];
+	int ttt_offset[3];
+	float rotate_angle[3];
+	float angle_mag;
+	int sample_index;
+	int complete;
+	Feature_Window *window;      /* optional, NULL after Start */
+} Feature_State_0;
+
+/*
+ * State 1: wait for the acceleration change from the starting value to
+ * exceed accel_threshold
+ */
+
+typedef struct {
+	int ttt[3];
+	int ttt_initial[3];
+	float accel_mag;
+	int sample_index;
+	int complete;
+	Feature_Window *window;      /* optional, NULL after Start */
+} Feature_State_1;
+
+/*
+ * Scales and dead bands used for the State 0 gyro and State 1
+ * accelerometer windows: 100 degrees/s and 1 g map to 1.0
+ */
+
+#define FEATURE_WINDOW_GYRO_SCALE 100000.0f
+#define FEATURE_WINDOW_GYRO_DEAD_BAND 10000.0f
+#define FEATURE_WINDOW_ACCEL_SCALE 1000.0f
+#define FEATURE_WINDOW_ACCEL_DEAD_BAND 100.0f
+
+void Feature_Window_Reset(Feature_Window *window, float scale,
+		float dead_band);
+void Feature_Window_Add(Feature_Window *window, const int *xyz);
+
+/*
+ * Write the FEATURE_WINDOW_SIZE features of the window: per axis mean,
+ * standard deviation, minimum, maximum and zero crossings per sample,
+ * then the peak magnitude and the window duration in seconds
+ */
+
+void Feature_Window_Vector(const Feature_Window *window, float Tsample,
+		float *features);
+
+void Feature_State_0_Start(Feature_State_0 *state, const int *ttt_offset);
+
+/*
+ * Returns 1 once the rotation threshold has been reached
+ */
+
+int Feature_State_0_Sample(Feature_State_0 *state, const Feature_Config *config,
+		const int *angular_velocity);
+
+/*
+ * ttt_3 is zero for a capture that timed out before the rotation
+ * threshold was reached
+ */
+
+void Feature_State_0_Result(const Feature_State_0 *state, int *ttt_3,
+		int *ttt_mag_scale);
+
+void Feature_State_1_Start(Feature_State_1 *state, const int *ttt_initial);
+
+/*
+ * Returns 1 once the acceleration threshold has been exceeded
+ */
+
+int Feature_State_1_Sample(Feature_State_1 *state, const Feature_Config *config,
+		const int *acceleration);
+void Feature_State_1_Result(const Feature_State_1 *state, int *ttt_1,
+		int *ttt_2, int *ttt_mag_scale);
+
+/*
+ * Replay a recorded gesture through both states.
+ *
+ * state_0 holds n_0 gyro samples (gx gy gz) recorded from the start of
+ * State 0 and state_1 holds n_1 accelerometer samples (ax ay az) from the
+ * start of State 1; the first sample of each is the reference read taken
+ * before the LED turns on. Each state stops at its threshold, after
+ * max_acquire_cycles samples, or at the end of its recording, whichever
+ * comes first.
+ *
+ * features receives { ttt_1, ttt_2, ttt_3 } as passed to motion_softmax and
+ * samples_used the number of samples each state consumed after the
+ * reference read. window, if not NULL, receives the State 0 gyro window
+ * followed by the State 1 accelerometer window, FEATURE_REPLAY_WINDOW_SIZE
+ * values.
+ */
+
+#define FEATURE_REPLAY_WINDOW_SIZE (2 * FEATURE_WINDOW_SIZE)
+
+void Feature_Replay(const Feature_Config *config, const int (*state_0)[3],
+		int n_0, const int (*state_1)[3], int n_1, float *features,
+		int *samples_used, float *window);
+
+#endif /* GESTURE_FEATURES_H */
@@ -0,0 +1,250 @@
+/**
+ ******************************************************************************
+ * @file    gestureGrammar.c
+ * @brief   Gesture grammar composing primitive motions into actions
+ ******************************************************************************
+ */
+
+#include <math.h>   /* sqrt */
+#include <string.h> /* memset */
+
+#include "gestureGrammar.h"
+
+const Grammar_Rule Grammar_Game_Rules[GRAMMAR_GAME_RULES] = {
+	/* Motion 1: forwards 1 unit */
+	{ 0, 2, { GRAMMAR_TILT_FORWARD, GRAMMAR_PUSH_FORWARD } },
+	/* Motion 2: backwards 1 unit */
+	{ 1, 2, { GRAMMAR_TILT_FORWARD, GRAMMAR_PUSH_BACKWARD } },
+	/* Motion 3: turn left */
+	{ 2, 2, { GRAMMAR_TILT_FORWARD, GRAMMAR_PUSH_LEFT } },
+	/* Motion 4: turn right */
+	{ 3, 2, { GRAMMAR_TILT_FORWARD, GRAMMAR_PUSH_RIGHT } },
+	/* Motion 5: check distance */
+	{ 4, 2, { GRAMMAR_TILT_BACKWARD, GRAMMAR_PUSH_FORWARD } },
+	/* Motion 6: check round */
+	{ 5, 2, { GRAMMAR_TILT_BACKWARD, GRAMMAR_PUSH_BACKWARD } },
+};
+
+static const int first_symbol[GRAMMAR_KINDS] = { GRAMMAR_TILT_NONE,
+		GRAMMAR_PUSH_NONE };
+
+static int symbol_kind(int symbol) {
+	return symbol >= GRAMMAR_PUSH_NONE ? GRAMMAR_PUSH : GRAMMAR_TILT;
+}
+
+static void primitive_reset(Grammar_Primitive *p, int n_directions,
+		int n_features, int feature_0, int feature_1, float min_norm) {
+
+	memset(p, 0, sizeof(Grammar_Primitive));
+	p->n_directions = n_directions;
+	p->n_features = n_features;
+	p->feature[0] = feature_0;
+	p->feature[1] = feature_1;
+	p->min_norm = min_norm;
+}
+
+int Grammar_Init(Gesture_Grammar *grammar, const Grammar_Rule *rules,
+		int n_rules) {
+
+	const Grammar_Rule *r;
+	int i, s, state, symbol, kind;
+
+	memset(grammar, 0, sizeof(Gesture_Grammar));
+	memset(grammar->next, GRAMMAR_REJECT, sizeof(grammar->next));
+	memset(grammar->action, -1, sizeof(grammar->action));
+	memset(grammar->kind, -1, sizeof(grammar->kind));
+	grammar->rules = rules;
+	grammar->n_rules = n_rules;
+	grammar->n_states = 1;
+
+	/*
+	 * Tilt reads ttt_3, push reads ttt_1 and ttt_2
+	 */
+
+	primitive_reset(&grammar->primitive[GRAMMAR_TILT], 2, 1, 2, 0,
+			GRAMMAR_TILT_MIN_NORM);
+	primitive_reset(&grammar->primitive[GRAMMAR_PUSH], 4, 2, 0, 1,
+			GRAMMAR_PUSH_MIN_NORM);
+
+	if (n_rules > GRAMMAR_MAX_RULES) {
+		return -1;
+	}
+
+	/*
+	 * Build a trie of the rules: one state per distinct prefix
+	 */
+
+	for (i = 0; i < n_rules; i++) {
+		r = &rules[i];
+		if (r->n_steps < 1 || r->n_steps > GRAMMAR_MAX_STEPS || r->action < 0
+				|| r->action >= GRAMMAR_MAX_ACTIONS) {
+			return -1;
+		}
+		state = GRAMMAR_START;
+		for (s = 0; s < r->n_steps; s++) {
+			symbol = r->step[s];
+			if (symbol >= GRAMMAR_SYMBOLS || grammar->action[state] >= 0) {
+				return -1;
+			}
+			kind = symbol_kind(symbol);
+			if (grammar->kind[state] >= 0 && grammar->kind[state] != kind) {
+				return -1;
+			}
+			grammar->kind[state] = kind;
+			if (grammar->next[state][symbol] == GRAMMAR_REJECT) {
+				grammar->next[state][symbol] = grammar->n_states++;
+			}
+			state = grammar->next[state][symbol];
+		}
+		if (grammar->action[state] >= 0 || grammar->kind[state] >= 0) {
+			return -1;
+		}
+		grammar->action[state] = r->action;
+		if (r->action >= grammar->n_actions) {
+			grammar->n_actions = r->action + 1;
+		}
+	}
+	return 0;
+}
+
+void Grammar_Train(Gesture_Grammar *grammar, int action, const float *x) {
+
+	const Grammar_Rule *r = NULL;
+	Grammar_Primitive *p;
+	float *d;
+	float norm;
+	int i, j, s, kind;
+
+	for (i = 0; i < grammar->n_rules && r == NULL; i++) {
+		if (grammar->rules[i].action == action) {
+			r = &grammar->rules[i];
+		}
+	}
+	if (r == NULL) {
+		return;
+	}
+
+	for (s = 0; s < r->n_steps; s++) {
+		kind = symbol_kind(r->step[s]);
+		i = r->step[s] - first_symbol[kind] - 1;
+		if (i < 0) {
+			continue;
+		}
+
+		/*
+		 * Running mean of the primitive's inputs, as Centroid_Add
+		 */
+
+		p = &grammar->primitive[kind];
+		d = p->direction[i];
+		p->count[i]++;
+		norm = 0;
+		for (j = 0; j < p->n_features; j++) {
+			d[j] = d[j] + (x[p->feature[j]] - d[j]) / p->count[i];
+			norm = norm + d[j] * d[j];
+		}
+		p->norm[i] = sqrt(norm);
+	}
+}
+
+int Grammar_Primitive_Classify(const Gesture_Grammar *grammar, int kind,
+		const float *x, float *score) {
+
+	const Grammar_Primitive *p = &grammar->primitive[kind];
+	float norm = 0, dot, s, best = 0;
+	int i, j, moving, symbol = GRAMMAR_REJECT;
+
+	for (j = 0; j < p->n_features; j++) {
+		norm = norm + x[p->feature[j]] * x[p->feature[j]];
+	}
+	norm = sqrt(norm);
+
+	moving = norm > p->min_norm;
+	if (!moving) {
+		symbol = first_symbol[kind];
+		best = 1;
+	}
+	if (score != NULL) {
+		score[0] = best;
+	}
+
+	for (i = 0; i < p->n_directions; i++) {
+		s = 0;
+		if (moving && p->norm[i] != 0) {
+			dot = 0;
+			for (j = 0; j < p->n_features; j++) {
+				dot = dot + x[p->feature[j]] * p->direction[i][j];
+			}
+			s = dot / (norm * p->norm[i]);
+		}
+		if (s > best) {
+			best = s;
+			symbol = first_symbol[kind] + 1 + i;
+		}
+		if (score != NULL) {
+			score[i + 1] = s > 0 ? s : 0;
+		}
+	}
+	return symbol;
+}
+
+int Grammar_Expect(const Gesture_Grammar *grammar, int state) {
+	return state >= 0 ? grammar->kind[state] : -1;
+}
+
+int Grammar_Step(const Gesture_Grammar *grammar, int state, const float *x) {
+
+	int symbol, kind = Grammar_Expect(grammar, state);
+
+	if (kind < 0) {
+		return GRAMMAR_REJECT;
+	}
+	symbol = Grammar_Primitive_Classify(grammar, kind, x, NULL);
+	if (symbol == GRAMMAR_REJECT) {
+		return GRAMMAR_REJECT;
+	}
+	return grammar->next[state][symbol];
+}
+
+int Grammar_Action(const Gesture_Grammar *grammar, int state) {
+	return state >= 0 ? grammar->action[state] : -1;
+}
+
+void Grammar_Run(const Gesture_Grammar *grammar, const float *x,
+		ANN_Result *result) {
+
+	float similarity[GRAMMAR_KINDS][GRAMMAR_MAX_DIRECTIONS + 1];
+	float score[GRAMMAR_MAX_ACTIONS];
+	float s, weakest;
+	const Grammar_Rule *r;
+	int i, k, state = GRAMMAR_START;
+
+	for (k = 0; k < GRAMMAR_KINDS; k++) {
+		Grammar_Primitive_Classify(grammar, k, x, similarity[k]);
+	}
+
+	for (i = 0; i < grammar->n_actions; i++) {
+		score[i] = 0;
+	}
+	for (i = 0; i < grammar->n_rules; i++) {
+		r = &grammar->rules[i];
+		weakest = 1;
+		for (k = 0; k < r->n_steps; k++) {
+			s = similarity[symbol_kind(r->step[k])]
+					[r->step[k] - first_symbol[symbol_kind(r->step[k])]];
+			if (s < weakest) {
+				weakest = s;
+			}
+		}
+		if (weakest > score[r->action]) {
+			score[r->action] = weakest;
+		}
+	}
+
+	ANN_Scan_Output(score, grammar->n_actions, result);
+
+	while (Grammar_Expect(grammar, state) >= 0) {
+		state = Grammar_Step(grammar, state, x);
+	}
+	result->loc = Grammar_Action(grammar, state);
+}
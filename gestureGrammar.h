@@ -0,0 +1,159 @@
+/**
+ ******************************************************************************
+ * @file    gestureGrammar.h
+ * @brief   Gesture grammar composing primitive motions into actions
+ ******************************************************************************
+ *
+ * Every game action is a short sequence of primitive motions, e.g. "tilt
+ * forwards, then push right". A Gesture_Grammar classifies each primitive
+ * on its own, with a handful of learned unit directions, and a table
+ * driven state machine compiled from Grammar_Rule entries turns the
+ * sequence of primitives into an action.
+ *
+ * A tilt is the State 0 rotation (ttt_3) and a push the State 1
+ * acceleration change (ttt_1, ttt_2) of the motion_softmax vector. The
+ * directions are learned from captured actions, each split into its
+ * primitives by its rule, so a new action made of known primitives needs
+ * only a new rule and no retraining. The tilt alone also tells whether
+ * any rule can follow, so the push need not be captured when none can.
+ */
+
+#ifndef GESTURE_GRAMMAR_H
+#define GESTURE_GRAMMAR_H
+
+#include <stdint.h>
+
+#include "gestureCore.h"
+
+/*
+ * Primitive kinds, in capture order
+ */
+
+#define GRAMMAR_TILT 0
+#define GRAMMAR_PUSH 1
+#define GRAMMAR_KINDS 2
+
+/*
+ * Primitive symbols. The first symbol of each kind is "no motion".
+ */
+
+#define GRAMMAR_TILT_NONE 0
+#define GRAMMAR_TILT_FORWARD 1
+#define GRAMMAR_TILT_BACKWARD 2
+#define GRAMMAR_PUSH_NONE 3
+#define GRAMMAR_PUSH_FORWARD 4
+#define GRAMMAR_PUSH_BACKWARD 5
+#define GRAMMAR_PUSH_LEFT 6
+#define GRAMMAR_PUSH_RIGHT 7
+#define GRAMMAR_SYMBOLS 8
+
+#define GRAMMAR_MAX_DIRECTIONS 4    /* symbols of a kind besides none */
+#define GRAMMAR_MAX_FEATURES 2      /* motion_softmax inputs of a kind */
+
+#define GRAMMAR_MAX_STEPS 4
+#define GRAMMAR_MAX_RULES 16
+#define GRAMMAR_MAX_ACTIONS 16
+#define GRAMMAR_MAX_STATES (GRAMMAR_MAX_RULES * GRAMMAR_MAX_STEPS + 1)
+
+#define GRAMMAR_START 0
+#define GRAMMAR_REJECT -1
+
+/*
+ * Inputs with a smaller length count as no motion, on the motion_softmax
+ * scale. Without a push State 1 scales the change down by 300.
+ */
+
+#define GRAMMAR_TILT_MIN_NORM 0.05
+#define GRAMMAR_PUSH_MIN_NORM 0.1
+
+typedef struct {
+	int action;
+	int n_steps;
+	uint8_t step[GRAMMAR_MAX_STEPS];
+} Grammar_Rule;
+
+/*
+ * The six actions of the game, in the order of the network outputs
+ */
+
+#define GRAMMAR_GAME_RULES 6
+
+extern const Grammar_Rule Grammar_Game_Rules[GRAMMAR_GAME_RULES];
+
+typedef struct {
+	int n_directions;
+	int n_features;
+	int feature[GRAMMAR_MAX_FEATURES];  /* index into the motion_softmax vector */
+	float min_norm;
+	float direction[GRAMMAR_MAX_DIRECTIONS][GRAMMAR_MAX_FEATURES];
+	float norm[GRAMMAR_MAX_DIRECTIONS];
+	int count[GRAMMAR_MAX_DIRECTIONS];
+} Grammar_Primitive;
+
+typedef struct {
+	const Grammar_Rule *rules;
+	int n_rules;
+	int n_actions;
+	int n_states;
+	int8_t next[GRAMMAR_MAX_STATES][GRAMMAR_SYMBOLS];   /* GRAMMAR_REJECT = no rule */
+	int8_t action[GRAMMAR_MAX_STATES];  /* -1 while a rule is incomplete */
+	int8_t kind[GRAMMAR_MAX_STATES];    /* primitive read next, -1 at the end */
+	Grammar_Primitive primitive[GRAMMAR_KINDS];
+} Gesture_Grammar;
+
+/*
+ * Compile rules (kept by reference) into the state machine and forget all
+ * learned directions. Returns -1 if the rules do not fit the tables, if a
+ * rule is a prefix of another, or if two rules branch on different
+ * primitive kinds after the same steps.
+ */
+
+int Grammar_Init(Gesture_Grammar *grammar, const Grammar_Rule *rules,
+		int n_rules);
+
+/*
+ * Learn the primitive directions of a captured action from its
+ * motion_softmax vector x, using the first rule of the action
+ */
+
+void Grammar_Train(Gesture_Grammar *grammar, int action, const float *x);
+
+/*
+ * Primitive symbol of kind in x, GRAMMAR_REJECT when there is motion but
+ * no direction has been learned that it is within 90 degrees of.
+ * score, if not NULL, receives the similarity of every symbol.
+ */
+
+int Grammar_Primitive_Classify(const Gesture_Grammar *grammar, int kind,
+		const float *x, float *score);
+
+/*
+ * Primitive kind read in state, -1 once an action is complete
+ */
+
+int Grammar_Expect(const Gesture_Grammar *grammar, int state);
+
+/*
+ * Classify the expected primitive of x and move on, GRAMMAR_REJECT if no
+ * rule continues with it. Only the features of that primitive are read.
+ */
+
+int Grammar_Step(const Gesture_Grammar *grammar, int state, const float *x);
+
+/*
+ * Action completed in state, -1 if none
+ */
+
+int Grammar_Action(const Gesture_Grammar *grammar, int state);
+
+/*
+ * Run the state machine over all primitives of x. result.loc is the
+ * action or -1. Every action is scored with the weakest primitive
+ * similarity of its rule, so the z-score and runner-up ratio measure how
+ * clearly the primitives were recognised.
+ */
+
+void Grammar_Run(const Gesture_Grammar *grammar, const float *x,
+		ANN_Result *result);
+
+#endif /* GESTURE_GRAMMAR_H */
@@ -0,0 +1,145 @@
+/**
+ ******************************************************************************
+ * @file    gestureOnline.c
+ * @brief   Online adaptation of the gesture classifier during play
+ ******************************************************************************
+ */
+
+#include <string.h> /* memset, memcpy */
+
+#include "gestureOnline.h"
+
+void Online_Reset(Online_Learner *learner, int n_classes, int n_features) {
+
+	memset(learner, 0, sizeof(Online_Learner));
+	learner->n_classes = n_classes < ONLINE_MAX_CLASSES ?
+			n_classes : ONLINE_MAX_CLASSES;
+	learner->n_features = n_features < ONLINE_MAX_FEATURES ?
+			n_features : ONLINE_MAX_FEATURES;
+	learner->confident_z = ONLINE_CONFIDENT_Z;
+	learner->eta_scale = ONLINE_ETA_SCALE;
+}
+
+void Online_Add(Online_Learner *learner, const float *x, int label) {
+
+	Online_Sample *s;
+
+	if (label < 0 || label >= learner->n_classes) {
+		return;
+	}
+
+	s = &learner->replay[label][learner->next[label]];
+	memcpy(s->x, x, sizeof(float) * learner->n_features);
+	s->label = label;
+	learner->next[label] = (learner->next[label] + 1) % ONLINE_REPLAY_PER_CLASS;
+	if (learner->count[label] < ONLINE_REPLAY_PER_CLASS) {
+		learner->count[label]++;
+	}
+}
+
+int Online_Observe(Online_Learner *learner, const float *x,
+		const ANN_Result *result) {
+
+	int confident;
+
+	confident = result->loc >= 0 && result->loc < learner->n_classes
+			&& result->z_score >= learner->confident_z
+			&& result->point / result->next_max >= CLASSIFICATION_DISC_THRESHOLD;
+
+	learner->history = (learner->history << 1) | confident;
+	if (learner->history_len < ONLINE_HISTORY) {
+		learner->history_len++;
+	}
+
+	if (confident) {
+		memcpy(learner->sample.x, x, sizeof(float) * learner->n_features);
+		learner->sample.label = result->loc;
+		learner->pending = 1;
+	}
+	return confident;
+}
+
+int Online_Update(Online_Learner *learner,
+		const Gesture_Classifier *classifier) {
+
+	ANN *net = classifier->net;
+	float target[ONLINE_MAX_CLASSES];
+	float x[ONLINE_MAX_FEATURES];
+	float eta, beta;
+	int c, label, steps = 0;
+	Online_Sample *s;
+
+	if (!learner->pending) {
+		return 0;
+	}
+	learner->pending = 0;
+	label = learner->sample.label;
+	Online_Add(learner, learner->sample.x, label);
+	learner->updates++;
+
+	if (classifier->kind == CLASSIFIER_CENTROID) {
+		Centroid_Add(classifier->centroid, learner->sample.x, label);
+		return 1;
+	}
+	if (classifier->kind == CLASSIFIER_GRAMMAR) {
+		Grammar_Train(classifier->grammar, label, learner->sample.x);
+		return 1;
+	}
+
+	if (net->topology[net->n_layers - 1] > ONLINE_MAX_CLASSES) {
+		return 0;
+	}
+
+	eta = net->eta;
+	beta = net->beta;
+	net->eta = eta * learner->eta_scale;
+	net->beta = beta * learner->eta_scale;
+
+	/*
+	 * The new sample, then one held sample of every other class, taking
+	 * the slots of each class in turn
+	 */
+
+	for (c = 0; c < ONLINE_MAX_CLASSES; c++) {
+		target[c] = 0.0;
+	}
+	target[label] = 1.0;
+	memcpy(x, learner->sample.x, sizeof(float) * learner->n_features);
+	train_ann(net, x, target);
+	target[label] = 0.0;
+	steps++;
+
+	for (c = 0; c < learner->n_classes; c++) {
+		if (c == label || learner->count[c] == 0) {
+			continue;
+		}
+		s = &learner->replay[c][learner->cursor % learner->count[c]];
+		memcpy(x, s->x, sizeof(float) * learner->n_features);
+		target[c] = 1.0;
+		train_ann(net, x, target);
+		target[c] = 0.0;
+		steps++;
+	}
+	learner->cursor++;
+
+	net->eta = eta;
+	net->beta = beta;
+	return steps;
+}
+
+int Online_Needs_Retraining(const Online_Learner *learner) {
+
+	uint32_t bits;
+	int i, confident = 0;
+
+	if (learner->history_len < ONLINE_HISTORY_MIN) {
+		return 0;
+	}
+
+	bits = learner->history;
+	for (i = 0; i < learner->history_len; i++) {
+		confident += bits & 1;
+		bits >>= 1;
+	}
+	return 2 * confident < learner->history_len;
+}
@@ -0,0 +1,103 @@
+/**
+ ******************************************************************************
+ * @file    gestureOnline.h
+ * @brief   Online adaptation of the gesture classifier during play
+ ******************************************************************************
+ *
+ * Gestures classified with high confidence during a game are taken as
+ * correctly labeled and fed back to the classifier. For the network that
+ * is one train_ann update at a fraction of the training learning rate,
+ * followed by one replayed sample of every other class so that gestures
+ * the player makes rarely are not forgotten. The centroid backend folds
+ * the sample into its prototype, the grammar into its primitive
+ * directions.
+ *
+ * The replay buffer keeps the last ONLINE_REPLAY_PER_CLASS samples of each
+ * class and starts out with the motions captured by TrainOrientation.
+ *
+ * True labels are never known during play, so the share of confident
+ * classifications over the last ONLINE_HISTORY gestures stands in for
+ * accuracy: once fewer than half are confident, Online_Needs_Retraining
+ * asks for a full training session.
+ *
+ * Classification and updates are separate calls so the update can run in
+ * idle time, between rounds.
+ */
+
+#ifndef GESTURE_ONLINE_H
+#define GESTURE_ONLINE_H
+
+#include <stdint.h>
+
+#include "gestureClassifier.h"
+
+#define ONLINE_MAX_CLASSES 8
+#define ONLINE_MAX_FEATURES 8
+#define ONLINE_REPLAY_PER_CLASS 4
+
+/*
+ * A classification is confident when its z-score reaches
+ * ONLINE_CONFIDENT_Z (at most 2.04 with six outputs, for a one-hot output)
+ * and it passes the runner-up ratio of printOutput_ANN
+ */
+
+#define ONLINE_CONFIDENT_Z 1.8
+
+/*
+ * Online updates use the training eta and beta scaled by ONLINE_ETA_SCALE
+ */
+
+#define ONLINE_ETA_SCALE 0.1
+
+#define ONLINE_HISTORY 16       /* gestures in the confidence window */
+#define ONLINE_HISTORY_MIN 8    /* needed before retraining is asked for */
+
+typedef struct {
+	float x[ONLINE_MAX_FEATURES];
+	int label;
+} Online_Sample;
+
+typedef struct {
+	int n_classes;
+	int n_features;
+	float confident_z;
+	float eta_scale;
+	Online_Sample replay[ONLINE_MAX_CLASSES][ONLINE_REPLAY_PER_CLASS];
+	int count[ONLINE_MAX_CLASSES];  /* samples held per class */
+	int next[ONLINE_MAX_CLASSES];   /* slot the next sample replaces */
+	unsigned int cursor;            /* replay slot rotation */
+	int pending;                    /* sample waits for Online_Update */
+	Online_Sample sample;
+	uint32_t history;               /* 1 bit per gesture, 1 = confident */
+	int history_len;
+	long updates;
+} Online_Learner;
+
+void Online_Reset(Online_Learner *learner, int n_classes, int n_features);
+
+/*
+ * Put a sample of a known class in the replay buffer, e.g. a training
+ * motion. The oldest sample of the class makes room when it is full.
+ */
+
+void Online_Add(Online_Learner *learner, const float *x, int label);
+
+/*
+ * Record the classification of x (after motion_softmax). Returns 1 when it
+ * is confident, in which case x is kept for the next Online_Update.
+ */
+
+int Online_Observe(Online_Learner *learner, const float *x,
+		const ANN_Result *result);
+
+/*
+ * Learn from the sample kept by Online_Observe, if any. Returns the number
+ * of train_ann updates made, 0 when there was nothing to learn.
+ */
+
+int Online_Update(Online_Learner *learner,
+		const Gesture_Classifier *classifier);
+
+int Online_Needs_Retraining(const Online_Learner *learner);
+
+#endif /* GESTURE_ONLINE_H */
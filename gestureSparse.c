@@ -0,0 +1,246 @@
+/**
+ ******************************************************************************
+ * @file    gestureSparse.c
+ * @brief   Block sparse storage and forward pass for pruned networks
+ ******************************************************************************
+ */
+
+#include <stdlib.h> /* qsort */
+
+#include "gestureSparse.h"
+
+#define MAX_PADDED_WIDTH \
+		((SPARSE_MAX_WIDTH + SPARSE_BLOCK - 1) / SPARSE_BLOCK * SPARSE_BLOCK)
+
+typedef struct {
+	float norm;
+	int block;
+} Block_Norm;
+
+static unsigned int blocks_per_row(unsigned int n_in) {
+	return (n_in + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+}
+
+static int too_wide(const ANN *net) {
+
+	unsigned int l;
+
+	for (l = 0; l < net->n_layers; l++) {
+		if (net->topology[l] > SPARSE_MAX_WIDTH) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int compare_norm(const void *a, const void *b) {
+
+	float x = ((const Block_Norm *) a)->norm;
+	float y = ((const Block_Norm *) b)->norm;
+
+	return x < y ? -1 : x > y;
+}
+
+int Sparse_Max_Blocks(const ANN *net) {
+
+	unsigned int l;
+	int n = 0;
+
+	for (l = 1; l < net->n_layers; l++) {
+		n += net->topology[l] * blocks_per_row(net->topology[l - 1]);
+	}
+	return n;
+}
+
+int Sparse_Rows(const ANN *net) {
+
+	unsigned int l;
+	int n = 0;
+
+	for (l = 1; l < net->n_layers; l++) {
+		n += net->topology[l];
+	}
+	return n;
+}
+
+int Sparse_Prune(ANN *net, float sparsity, unsigned char *keep) {
+
+	unsigned int l, j, k, c, n_in, n_out, per_row;
+	float *w = net->weights;
+	float *dw = net->dedw;
+	unsigned char *m = keep;
+	Block_Norm norms[SPARSE_MAX_LAYER_BLOCKS];
+	int i, n, n_pruned, kept = 0;
+
+	if (too_wide(net)) {
+		return -1;
+	}
+
+	for (l = 1; l < net->n_layers; l++) {
+		n_in = net->topology[l - 1];
+		n_out = net->topology[l];
+		per_row = blocks_per_row(n_in);
+		n = (int) (n_out * per_row);
+
+		for (j = 0; j < n_out; j++) {
+			for (c = 0; c < per_row; c++) {
+				Block_Norm *b = &norms[j * per_row + c];
+				b->block = (int) (j * per_row + c);
+				b->norm = 0;
+				for (k = c * SPARSE_BLOCK; k < n_in && k < (c + 1) * SPARSE_BLOCK;
+						k++) {
+					b->norm = b->norm + w[j * n_in + k] * w[j * n_in + k];
+				}
+			}
+		}
+		qsort(norms, n, sizeof(Block_Norm), compare_norm);
+
+		for (k = 0; k < n_out * n_in; k++) {
+			m[k] = 1;
+		}
+		n_pruned = (int) (sparsity * n + 0.5f);
+		for (i = 0; i < n_pruned; i++) {
+			j = norms[i].block / per_row;
+			c = norms[i].block % per_row;
+			for (k = c * SPARSE_BLOCK; k < n_in && k < (c + 1) * SPARSE_BLOCK;
+					k++) {
+				m[j * n_in + k] = 0;
+			}
+		}
+		for (k = 0; k < n_out * n_in; k++) {
+			if (m[k]) {
+				kept++;
+			} else {
+				w[k] = 0;
+				dw[k] = 0;
+			}
+		}
+
+		w += n_out * n_in;
+		dw += n_out * n_in;
+		m += n_out * n_in;
+	}
+	return kept;
+}
+
+int Sparse_Pack(const ANN *net, Sparse_ANN *sparse, uint16_t *row_start,
+		uint16_t *block_col, float *values, int max_blocks) {
+
+	unsigned int l, j, k, c, n_in, n_out, per_row;
+	const float *w = net->weights;
+	const float *row;
+	float *v;
+	int r = 0, n = 0, nonzero;
+
+	if (too_wide(net)) {
+		return -1;
+	}
+
+	for (l = 1; l < net->n_layers; l++) {
+		n_in = net->topology[l - 1];
+		n_out = net->topology[l];
+		per_row = blocks_per_row(n_in);
+
+		for (j = 0; j < n_out; j++) {
+			row = w + j * n_in;
+			row_start[r++] = (uint16_t) n;
+			for (c = 0; c < per_row; c++) {
+				nonzero = 0;
+				for (k = c * SPARSE_BLOCK; k < n_in && k < (c + 1) * SPARSE_BLOCK;
+						k++) {
+					nonzero = nonzero || row[k] != 0;
+				}
+				if (!nonzero) {
+					continue;
+				}
+				if (n == max_blocks || n == UINT16_MAX) {
+					return -1;
+				}
+				block_col[n] = (uint16_t) (c * SPARSE_BLOCK);
+				v = values + n * SPARSE_BLOCK;
+				for (k = 0; k < SPARSE_BLOCK; k++) {
+					v[k] = c * SPARSE_BLOCK + k < n_in ? row[c * SPARSE_BLOCK + k] : 0;
+				}
+				n++;
+			}
+		}
+		w += n_out * n_in;
+	}
+	row_start[r] = (uint16_t) n;
+
+	sparse->n_layers = net->n_layers;
+	sparse->topology = net->topology;
+	sparse->bias = net->bias;
+	sparse->output_activation_function = net->output_activation_function;
+	sparse->hidden_activation_function = net->hidden_activation_function;
+	sparse->n_rows = r;
+	sparse->n_blocks = n;
+	sparse->row_start = row_start;
+	sparse->block_col = block_col;
+	sparse->values = values;
+	return n;
+}
+
+unsigned int Sparse_Bytes(const Sparse_ANN *sparse) {
+	return (sparse->n_rows + 1) * sizeof(uint16_t)
+			+ sparse->n_blocks * (sizeof(uint16_t) + SPARSE_BLOCK * sizeof(float));
+}
+
+void Sparse_Run(const Sparse_ANN *sparse, const float *input, float *output) {
+
+	unsigned int l, j, k, n_out;
+	const uint16_t *row_start = sparse->row_start;
+	const float *b = sparse->bias;
+	const float *v, *x;
+	float sum;
+	int i;
+
+	/*
+	 * Activations are padded to whole blocks with zeros, so a block at the
+	 * end of a row can be read in full. Sparse_Pack only packs layers of
+	 * up to SPARSE_MAX_WIDTH neurons.
+	 */
+
+	float act[2][MAX_PADDED_WIDTH];
+	float *in = act[0];
+	float *out = act[1];
+
+	for (k = 0; k < MAX_PADDED_WIDTH; k++) {
+		in[k] = k < sparse->topology[0] ? input[k] : 0;
+		out[k] = 0;
+	}
+
+	for (l = 1; l < sparse->n_layers; l++) {
+		float (*activation)(float) = (l == sparse->n_layers - 1) ?
+				sparse->output_activation_function :
+				sparse->hidden_activation_function;
+
+		n_out = sparse->topology[l];
+
+		for (j = 0; j < n_out; j++) {
+			sum = b[j];
+			for (i = row_start[j]; i < row_start[j + 1]; i++) {
+				v = sparse->values + i * SPARSE_BLOCK;
+				x = in + sparse->block_col[i];
+				for (k = 0; k < SPARSE_BLOCK; k++) {
+					sum = sum + v[k] * x[k];
+				}
+			}
+			out[j] = activation(sum);
+		}
+		for (k = n_out; k < blocks_per_row(n_out) * SPARSE_BLOCK; k++) {
+			out[k] = 0;
+		}
+
+		row_start += n_out;
+		b += n_out;
+
+		float *t = in;
+		in = out;
+		out = t;
+	}
+
+	for (j = 0; j < sparse->topology[sparse->n_layers - 1]; j++) {
+		output[j] = in[j];
+	}
+}
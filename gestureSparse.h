@@ -0,0 +1,98 @@
+/**
+ ******************************************************************************
+ * @file    gestureSparse.h
+ * @brief   Block sparse storage and forward pass for pruned networks
+ ******************************************************************************
+ *
+ * Networks larger than the 3-9-6 one spend most of their memory and time
+ * on weights that barely matter. Sparse_Prune zeroes whole blocks of
+ * SPARSE_BLOCK consecutive weights of a neuron's row, those with the
+ * smallest magnitude, so the rest can be fine-tuned with the pruned
+ * weights held at zero (Host_ANN_Train_Masked).
+ *
+ * Sparse_Pack then stores only the blocks left, row by row:
+ *
+ *   row_start  one entry per neuron of every layer after the input, plus
+ *              one: the neuron's blocks are row_start[r] .. row_start[r+1]
+ *   block_col  first input of each block
+ *   values     SPARSE_BLOCK weights per block, rows padded with zeros
+ *
+ * Sparse_Run walks the stored blocks only, a fixed SPARSE_BLOCK
+ * multiply-accumulates each, and skips pruned blocks without testing
+ * them. Bias and activations are those of the network it was packed from.
+ */
+
+#ifndef GESTURE_SPARSE_H
+#define GESTURE_SPARSE_H
+
+#include <stdint.h>
+
+#include "embeddedML.h"
+
+#define SPARSE_BLOCK 4
+
+/*
+ * Widest layer, so the block norms of Sparse_Prune and the activations of
+ * Sparse_Run have a fixed size
+ */
+
+#define SPARSE_MAX_WIDTH 64
+#define SPARSE_MAX_LAYER_BLOCKS \
+		(SPARSE_MAX_WIDTH * ((SPARSE_MAX_WIDTH + SPARSE_BLOCK - 1) / SPARSE_BLOCK))
+
+typedef struct {
+	unsigned int n_layers;
+	const unsigned int *topology;
+	const float *bias;
+	float (*output_activation_function)(float);
+	float (*hidden_activation_function)(float);
+	int n_rows;                 /* neurons after the input layer */
+	int n_blocks;               /* blocks stored */
+	const uint16_t *row_start;
+	const uint16_t *block_col;
+	const float *values;
+} Sparse_ANN;
+
+/*
+ * Blocks of the dense network, the most Sparse_Pack can store, and its
+ * rows
+ */
+
+int Sparse_Max_Blocks(const ANN *net);
+int Sparse_Rows(const ANN *net);
+
+/*
+ * Zero the share sparsity (0 .. 1) of the blocks of every layer with the
+ * smallest sum of squares, weights and momentum (dedw). keep, one entry
+ * per weight, is set to 0 for pruned weights and 1 for the others.
+ * Blocks already pruned have the smallest sum, so a growing sparsity
+ * keeps them pruned. Returns the weights kept, or -1 if a layer is
+ * wider than SPARSE_MAX_WIDTH.
+ */
+
+int Sparse_Prune(ANN *net, float sparsity, unsigned char *keep);
+
+/*
+ * Store the nonzero blocks of net. row_start holds Sparse_Rows(net) + 1
+ * entries, block_col and values max_blocks blocks. Returns the blocks
+ * stored, or -1 if they do not fit or a layer is wider than
+ * SPARSE_MAX_WIDTH.
+ */
+
+int Sparse_Pack(const ANN *net, Sparse_ANN *sparse, uint16_t *row_start,
+		uint16_t *block_col, float *values, int max_blocks);
+
+/*
+ * Bytes of row_start, block_col and values, for comparison with the
+ * net->n_weights floats of the dense network
+ */
+
+unsigned int Sparse_Bytes(const Sparse_ANN *sparse);
+
+/*
+ * Forward pass; output receives the output layer
+ */
+
+void Sparse_Run(const Sparse_ANN *sparse, const float *input, float *output);
+
+#endif /* GESTURE_SPARSE_H */
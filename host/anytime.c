@@ -0,0 +1,374 @@
+/**
+ ******************************************************************************
+ * @file    anytime.c
+ * @brief   Latency and accuracy of anytime classification on recorded traces
+ ******************************************************************************
+ *
+ * Replays recorded IMU traces (see trace.h) through the firmware feature
+ * extraction and cross-validates a classifier, scoring every held out
+ * gesture twice: once on the full capture, and once with the anytime
+ * classification of gestureAnytime.c committing during State 1, for each
+ * margin given. Each margin is reported with its accuracy, the change
+ * from the full capture, and the median and 90th percentile latency from
+ * LED on to the end of capture over both states.
+ *
+ * Usage:
+ *   anytime [options] TRACES
+ *     --margin=0.05,0.1  margins to try (default 0.05,0.1,0.2,0.3,0.5,0.8)
+ *     --hold=3           samples the lead must last (ANYTIME_HOLD)
+ *     --fraction=0.3     share of the threshold before the first try
+ *     --tolerance=1      accuracy loss allowed when picking a margin,
+ *                        in percentage points
+ *     --classifier=ann   ann, centroid or grammar
+ *     --angle=30         ANGLE_MAG_MAX_THRESHOLD [degrees]
+ *     --accel=600        State 1 acceleration change [mg]
+ *     --folds=K          folds (default 5)
+ *     --seed=S           fold and weight seed (0 = firmware weights)
+ *
+ * The margin printed last is the one with the lowest median latency whose
+ * accuracy is within the tolerance of the full capture. Capture uAh is the
+ * mean charge per gesture drawn while capturing, at the capture current
+ * of ENERGY_MODEL_SENSORTILE (gestureEnergy.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gestureConfig.h"
+#include "gestureCore.h"
+#include "gestureAnytime.h"
+#include "gestureEnergy.h"
+#include "gestureFeatures.h"
+#include "corpus.h"
+#include "evaluate.h"
+#include "hostModel.h"
+#include "trace.h"
+
+#define ANYTIME_MAX_MARGINS 32
+
+typedef struct {
+	float margin;
+	int correct;
+	int early;              /* gestures committed before the threshold */
+	long evaluations;
+	int *latency_ms;        /* one per gesture */
+} Margin_Score;
+
+/*
+ * State 1 of one trace with anytime classification. Returns the samples
+ * used and writes the features the classifier sees.
+ */
+
+static int replay_state_1(const Feature_Config *features,
+		const Gesture_Trace *trace, int ttt_3, Anytime_State *anytime,
+		float *x) {
+
+	Feature_State_1 state;
+	int ttt_1 = 0, ttt_2 = 0, ttt_mag_scale, i;
+
+	if (trace->n_1 > 0) {
+		Feature_State_1_Start(&state, trace->state_1[0]);
+		for (i = 1; i < trace->n_1 && i <= features->max_acquire_cycles; i++) {
+			if (Feature_State_1_Sample(&state, features, trace->state_1[i])
+					|| Anytime_Sample(anytime, features, &state, ttt_3)) {
+				break;
+			}
+		}
+		Feature_State_1_Result(&state, &ttt_1, &ttt_2, &ttt_mag_scale);
+		if (anytime->committed) {
+			ttt_1 = anytime->ttt[0];
+			ttt_2 = anytime->ttt[1];
+		}
+	}
+
+	x[0] = (float) ttt_1;
+	x[1] = (float) ttt_2;
+	x[2] = (float) ttt_3;
+	return trace->n_1 > 0 ? state.sample_index : 0;
+}
+
+static int compare_int(const void *a, const void *b) {
+	return *(const int *) a - *(const int *) b;
+}
+
+static int percentile(int *values, int n, double p) {
+
+	qsort(values, n, sizeof(int), compare_int);
+	return n > 0 ? values[(int) (p * (n - 1))] : 0;
+}
+
+/*
+ * Mean modeled charge of the captures [uAh]
+ */
+
+static float capture_charge(const int *latency_ms, int n) {
+
+	static const Energy_Model model = ENERGY_MODEL_SENSORTILE;
+	Energy_Account account;
+	int i;
+
+	Energy_Start(&account, 0, 0, 0);
+	for (i = 0; i < n; i++) {
+		Energy_Add_Estimate(&account, &model, ENERGY_CAPTURE,
+				(uint32_t) latency_ms[i]);
+	}
+	return n > 0 ? Energy_Sum(&account.total) / n : 0;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--margin=M,...] [--hold=N] [--fraction=F]"
+			" [--tolerance=PCT] [--classifier=ann|centroid|grammar]"
+			" [--angle=A] [--accel=A] [--folds=K] [--seed=S] TRACES\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	Feature_Config features = { 30, 600, 800, (float) DATA_PERIOD_MS / 1000 };
+	Anytime_Config config;
+	Train_Options options;
+	Trace_Set set;
+	Gesture_Corpus corpus;
+	Centroid_Model centroid;
+	Gesture_Grammar grammar;
+	Gesture_Classifier classifier;
+	Anytime_State anytime;
+	ANN_Result result;
+	Margin_Score margins[ANYTIME_MAX_MARGINS];
+	int n_margins = 0, folds = 5;
+	unsigned int seed = 0;
+	double tolerance = 1.0;
+	const char *path = NULL, *v;
+	char *end;
+	float *train_x, *raw, xyz[3], x[3];
+	int *train_y, *fold_of, *state_0_samples, *full_latency;
+	int i, j, f, m, n_train, n_test = 0, full_correct = 0, best = -1;
+	double accuracy, full_accuracy;
+
+	Anytime_Config_Default(&config);
+	Train_Options_Default(&options);
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--margin")) != NULL) {
+			while (*v != '\0' && n_margins < ANYTIME_MAX_MARGINS) {
+				margins[n_margins].margin = strtof(v, &end);
+				if (end == v) {
+					usage(argv[0]);
+					return 2;
+				}
+				n_margins++;
+				v = *end == ',' ? end + 1 : end;
+			}
+		} else if ((v = option_value(argv[i], "--hold")) != NULL) {
+			config.hold = atoi(v);
+		} else if ((v = option_value(argv[i], "--fraction")) != NULL) {
+			config.min_fraction = (float) atof(v);
+		} else if ((v = option_value(argv[i], "--tolerance")) != NULL) {
+			tolerance = atof(v);
+		} else if ((v = option_value(argv[i], "--classifier")) != NULL) {
+			if (strcmp(v, "ann") == 0) {
+				options.classifier = CLASSIFIER_ANN;
+			} else if (strcmp(v, "centroid") == 0) {
+				options.classifier = CLASSIFIER_CENTROID;
+			} else if (strcmp(v, "grammar") == 0) {
+				options.classifier = CLASSIFIER_GRAMMAR;
+			} else {
+				usage(argv[0]);
+				return 2;
+			}
+		} else if ((v = option_value(argv[i], "--angle")) != NULL) {
+			features.angle_mag_max_threshold = (float) atof(v);
+		} else if ((v = option_value(argv[i], "--accel")) != NULL) {
+			features.accel_threshold = (float) atof(v);
+		} else if ((v = option_value(argv[i], "--folds")) != NULL) {
+			folds = atoi(v);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			seed = (unsigned int) strtoul(v, NULL, 10);
+			options.weight_seed = seed;
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (path == NULL || folds < 2 || config.hold < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (n_margins == 0) {
+		const float defaults[] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.8 };
+		for (n_margins = 0; n_margins < 6; n_margins++) {
+			margins[n_margins].margin = defaults[n_margins];
+		}
+	}
+
+	if (Trace_Load(path, &set) != 0) {
+		return 1;
+	}
+
+	/*
+	 * Full captures, normalized as on the device
+	 */
+
+	corpus.n_samples = set.n_traces;
+	corpus.n_features = 3;
+	corpus.n_classes = set.n_classes;
+	corpus.normalized = 1;
+	corpus.labels = malloc(sizeof(int) * set.n_traces);
+	corpus.features = malloc(sizeof(float) * 3 * set.n_traces);
+	raw = malloc(sizeof(float) * 3 * set.n_traces);
+	train_x = malloc(sizeof(float) * 3 * set.n_traces);
+	train_y = malloc(sizeof(int) * set.n_traces);
+	fold_of = malloc(sizeof(int) * set.n_traces);
+	state_0_samples = malloc(sizeof(int) * set.n_traces);
+	full_latency = malloc(sizeof(int) * set.n_traces);
+	for (m = 0; m < n_margins; m++) {
+		margins[m].correct = 0;
+		margins[m].early = 0;
+		margins[m].evaluations = 0;
+		margins[m].latency_ms = malloc(sizeof(int) * set.n_traces);
+		if (margins[m].latency_ms == NULL) {
+			fprintf(stderr, "anytime: out of memory\n");
+			return 1;
+		}
+	}
+	if (corpus.labels == NULL || corpus.features == NULL || raw == NULL
+			|| train_x == NULL || train_y == NULL || fold_of == NULL
+			|| state_0_samples == NULL || full_latency == NULL) {
+		fprintf(stderr, "anytime: out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < set.n_traces; i++) {
+		const Gesture_Trace *trace = &set.traces[i];
+		int samples_used[2];
+		Feature_Replay(&features, (const int (*)[3]) trace->state_0,
+				trace->n_0, (const int (*)[3]) trace->state_1, trace->n_1,
+				raw + i * 3, samples_used, NULL);
+		motion_softmax(3, raw + i * 3, corpus.features + i * 3);
+		corpus.labels[i] = trace->label;
+		state_0_samples[i] = samples_used[0];
+		full_latency[i] = (samples_used[0] + samples_used[1]) * DATA_PERIOD_MS;
+	}
+
+	if (Evaluate_Assign_Folds(&corpus, folds, seed + 7919u, fold_of) != 0) {
+		fprintf(stderr, "anytime: out of memory\n");
+		return 1;
+	}
+
+	for (f = 0; f < folds; f++) {
+		classifier.kind = options.classifier;
+		classifier.net = Host_ANN_Create(options.topology, options.n_layers,
+				options.weight_seed);
+		classifier.centroid = &centroid;
+		classifier.grammar = &grammar;
+		classifier.dtw = NULL;
+		classifier.cnn = NULL;
+		if (classifier.net == NULL) {
+			fprintf(stderr, "anytime: out of memory\n");
+			return 1;
+		}
+
+		n_train = 0;
+		for (i = 0; i < set.n_traces; i++) {
+			if (fold_of[i] != f) {
+				memcpy(train_x + n_train * 3, corpus.features + i * 3,
+						sizeof(float) * 3);
+				train_y[n_train++] = corpus.labels[i];
+			}
+		}
+		if (Evaluate_Train(&options, train_x, train_y, n_train,
+				corpus.n_classes, 3, &classifier) == -2) {
+			fprintf(stderr, "anytime: the classifier can not hold the %d"
+					" classes of %s\n", corpus.n_classes, path);
+			return 1;
+		}
+
+		for (i = 0; i < set.n_traces; i++) {
+			const Gesture_Trace *trace = &set.traces[i];
+			if (fold_of[i] != f) {
+				continue;
+			}
+
+			memcpy(xyz, corpus.features + i * 3, sizeof(xyz));
+			Classifier_Run(&classifier, xyz, &result);
+			full_correct += result.loc == trace->label;
+
+			for (m = 0; m < n_margins; m++) {
+				Anytime_Config c = config;
+				c.margin = margins[m].margin;
+				Anytime_Start(&anytime, &c, &classifier);
+				j = replay_state_1(&features, trace, (int) raw[i * 3 + 2],
+						&anytime, x);
+				motion_softmax(3, x, xyz);
+				Classifier_Run(&classifier, xyz, &result);
+				margins[m].correct += result.loc == trace->label;
+				margins[m].early += anytime.committed;
+				margins[m].evaluations += anytime.evaluations;
+				margins[m].latency_ms[n_test] = (state_0_samples[i] + j)
+						* DATA_PERIOD_MS;
+			}
+			n_test++;
+		}
+		Host_ANN_Destroy(classifier.net);
+	}
+
+	full_accuracy = 100.0 * full_correct / n_test;
+	printf("Traces %s: %d gestures, %d classes, %d folds\n", path, n_test,
+			corpus.n_classes, folds);
+	printf("Full capture: accuracy %.2f%%  median %d ms  p90 %d ms"
+			"  capture %.1f uAh\n\n", full_accuracy,
+			percentile(full_latency, set.n_traces, 0.5),
+			percentile(full_latency, set.n_traces, 0.9),
+			capture_charge(full_latency, set.n_traces));
+
+	printf("Margin\tAccuracy\tChange\tMedian ms\tp90 ms\tEarly\tRuns/gesture"
+			"\tCapture uAh\n");
+	for (m = 0; m < n_margins; m++) {
+		Margin_Score *s = &margins[m];
+		int median = percentile(s->latency_ms, n_test, 0.5);
+		accuracy = 100.0 * s->correct / n_test;
+		printf("%.3f\t%.2f%%\t\t%+.2f\t%d\t\t%d\t%.1f%%\t%.1f\t\t%.1f\n",
+				s->margin, accuracy, accuracy - full_accuracy, median,
+				percentile(s->latency_ms, n_test, 0.9),
+				100.0 * s->early / n_test, (double) s->evaluations / n_test,
+				capture_charge(s->latency_ms, n_test));
+		if (accuracy >= full_accuracy - tolerance && (best < 0
+				|| median < percentile(margins[best].latency_ms, n_test, 0.5))) {
+			best = m;
+		}
+	}
+
+	if (best >= 0) {
+		printf("\nMargin %.3f keeps accuracy within %.2f points, median"
+				" latency %d ms\n", margins[best].margin, tolerance,
+				percentile(margins[best].latency_ms, n_test, 0.5));
+	} else {
+		printf("\nNo margin keeps accuracy within %.2f points\n", tolerance);
+	}
+
+	for (m = 0; m < n_margins; m++) {
+		free(margins[m].latency_ms);
+	}
+	free(full_latency);
+	free(state_0_samples);
+	free(fold_of);
+	free(train_y);
+	free(train_x);
+	free(raw);
+	free(corpus.features);
+	free(corpus.labels);
+	Trace_Free(&set);
+	return 0;
+}
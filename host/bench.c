@@ -0,0 +1,776 @@
+/**
+ ******************************************************************************
+ * @file    bench.c
+ * @brief   Host microbenchmarks for the ML and feature extraction kernels
+ ******************************************************************************
+ *
+ * Each benchmark follows the Google Benchmark model: the body is run for
+ * a number of iterations that is doubled until the run takes at least
+ * --min_time seconds, and the report gives the time per iteration and
+ * the throughput in items per second.
+ *
+ * All inputs are drawn from fixed seeds, so two runs on different
+ * commits measure exactly the same work. The gyro integration benchmark
+ * replays a recorded gyro trace given with --trace (one "gx gy gz" sample
+ * in milli-degrees per second per line), or a fixed synthetic tilt when
+ * no trace is given.
+ *
+ * Usage:
+ *   bench [--filter=SUBSTRING] [--min_time=SECONDS]
+ *         [--format=console|json|csv] [--out=FILE] [--trace=FILE]
+ *
+ * The json format uses the Google Benchmark schema, so results from two
+ * commits can be diffed with its tools/compare.py.
+ *
+ * Kernels with a known multiply-accumulate count also report an estimate
+ * of the SensorTile cost, mcu_cycles per iteration, at
+ * BENCH_MCU_CYCLES_PER_MAC. This is a planning figure for the Cortex-M4F,
+ * not a measurement; time on the device with the DWT cycle counter.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gestureConfig.h"
+#include "gestureCore.h"
+#include "gestureCnn.h"
+#include "gestureDtw.h"
+#include "hostModel.h"
+
+#define BENCH_SEED 1
+#define BENCH_INPUTS 64
+#define BENCH_TRACE_MAX 4096
+#define BENCH_MAX_RESULTS 256
+
+/*
+ * Cortex-M4F at -O2: two loads and a VMLA per multiply-accumulate plus
+ * loop overhead, no SIMD for float
+ */
+
+#define BENCH_MCU_CYCLES_PER_MAC 4
+#define BENCH_MCU_CLOCK_HZ 80000000
+
+typedef struct {
+	long iterations;
+	long items_per_iteration;
+	double mcu_cycles;          /* estimated cycles per iteration, 0 = none */
+	const char *arg;
+} Bench_State;
+
+typedef void (*Bench_Function)(Bench_State *state);
+
+typedef struct {
+	const char *name;
+	Bench_Function function;
+	const char *arg;
+} Bench_Entry;
+
+typedef struct {
+	char name[96];
+	long iterations;
+	double real_ns;
+	double cpu_ns;
+	double items_per_second;
+	double mcu_cycles;
+} Bench_Result;
+
+/*
+ * Sink that keeps the optimizer from dropping benchmark bodies
+ */
+
+static volatile float bench_sink;
+
+static int trace[BENCH_TRACE_MAX][3];
+static int trace_length;
+
+/*
+ * ---------------------------------------------------------------------------
+ * Inputs
+ * ---------------------------------------------------------------------------
+ */
+
+static void make_inputs(float *inputs, unsigned int width, unsigned int count) {
+
+	unsigned int seed = BENCH_SEED;
+	unsigned int i;
+
+	for (i = 0; i < width * count; i++) {
+		inputs[i] = Host_Rand_Uniform(&seed, -1.0, 1.0);
+	}
+}
+
+/*
+ * Synthetic tilt: a smooth 45 degree rotation about X over two seconds
+ * followed by rest, plus a fixed offset and seeded noise
+ */
+
+static void make_synthetic_trace(void) {
+
+	unsigned int seed = BENCH_SEED;
+	int i;
+
+	trace_length = 800;
+	for (i = 0; i < trace_length; i++) {
+		float t = (float) i / 200;
+		float rate = t < 1 ? 45000 * (float) M_PI / 2 * sinf((float) M_PI * t) : 0;
+
+		trace[i][0] = 350 + (int) rate + (int) Host_Rand_Uniform(&seed, -200, 200);
+		trace[i][1] = -420 + (int) Host_Rand_Uniform(&seed, -200, 200);
+		trace[i][2] = 140 + (int) Host_Rand_Uniform(&seed, -200, 200);
+	}
+}
+
+static int load_trace(const char *path) {
+
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		return -1;
+	}
+	trace_length = 0;
+	while (trace_length < BENCH_TRACE_MAX
+			&& fscanf(f, "%d %d %d", &trace[trace_length][0],
+					&trace[trace_length][1], &trace[trace_length][2]) == 3) {
+		trace_length++;
+	}
+	fclose(f);
+	return trace_length > 0 ? 0 : -1;
+}
+
+static ANN *create_net(const char *arg) {
+
+	unsigned int topology[HOST_ANN_MAX_LAYERS];
+	int n_layers = Host_Parse_Topology(arg, topology);
+
+	return n_layers ? Host_ANN_Create(topology, n_layers, 0) : NULL;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ * Benchmarks
+ * ---------------------------------------------------------------------------
+ */
+
+static void BM_init_ann(Bench_State *state) {
+
+	ANN *net = create_net(state->arg);
+	long i;
+
+	for (i = 0; i < state->iterations; i++) {
+		Host_ANN_Reset(net, BENCH_SEED + (unsigned int) (i & 7));
+	}
+	bench_sink = net->weights[0];
+	state->items_per_iteration = net->n_weights;
+	Host_ANN_Destroy(net);
+}
+
+static void BM_run_ann(Bench_State *state) {
+
+	ANN *net = create_net(state->arg);
+	unsigned int width = net->topology[0];
+	float *inputs = malloc(sizeof(float) * width * BENCH_INPUTS);
+	long i;
+
+	make_inputs(inputs, width, BENCH_INPUTS);
+	for (i = 0; i < state->iterations; i++) {
+		run_ann(net, inputs + (i % BENCH_INPUTS) * width);
+		bench_sink = net->output[0];
+	}
+	state->items_per_iteration = 1;
+	free(inputs);
+	Host_ANN_Destroy(net);
+}
+
+static void BM_train_ann(Bench_State *state) {
+
+	ANN *net = create_net(state->arg);
+	unsigned int width = net->topology[0];
+	unsigned int classes = net->topology[net->n_layers - 1];
+	float *inputs = malloc(sizeof(float) * width * BENCH_INPUTS);
+	float *target = calloc(classes, sizeof(float));
+	long i;
+	unsigned int c;
+
+	make_inputs(inputs, width, BENCH_INPUTS);
+	for (i = 0; i < state->iterations; i++) {
+		c = (unsigned int) (i % classes);
+		target[c] = 1.0;
+		train_ann(net, inputs + (i % BENCH_INPUTS) * width, target);
+		target[c] = 0.0;
+	}
+	bench_sink = net->weights[0];
+	state->items_per_iteration = 1;
+	free(target);
+	free(inputs);
+	Host_ANN_Destroy(net);
+}
+
+/*
+ * One item per classified vector, including the fused output scan
+ */
+
+static void BM_run_ann_batch(Bench_State *state) {
+
+	ANN *net = create_net(state->arg);
+	unsigned int width = net->topology[0];
+	float *inputs = malloc(sizeof(float) * width * BENCH_INPUTS);
+	ANN_Result results[BENCH_INPUTS];
+	long i;
+
+	make_inputs(inputs, width, BENCH_INPUTS);
+	for (i = 0; i < state->iterations; i++) {
+		run_ann_batch(net, inputs, BENCH_INPUTS, NULL, results);
+		bench_sink = results[i % BENCH_INPUTS].z_score;
+	}
+	state->items_per_iteration = BENCH_INPUTS;
+	free(inputs);
+	Host_ANN_Destroy(net);
+}
+
+/*
+ * run_ann followed by the fused scan, the per-vector equivalent of
+ * BM_run_ann_batch
+ */
+
+static void BM_run_ann_scan(Bench_State *state) {
+
+	ANN *net = create_net(state->arg);
+	unsigned int width = net->topology[0];
+	unsigned int classes = net->topology[net->n_layers - 1];
+	float *inputs = malloc(sizeof(float) * width * BENCH_INPUTS);
+	ANN_Result result;
+	long i;
+
+	make_inputs(inputs, width, BENCH_INPUTS);
+	for (i = 0; i < state->iterations; i++) {
+		run_ann(net, inputs + (i % BENCH_INPUTS) * width);
+		ANN_Scan_Output(net->output, classes, &result);
+		bench_sink = result.z_score;
+	}
+	state->items_per_iteration = 1;
+	free(inputs);
+	Host_ANN_Destroy(net);
+}
+
+static void BM_motion_softmax(Bench_State *state) {
+
+	float inputs[3 * BENCH_INPUTS];
+	float xyz[3];
+	long i;
+
+	make_inputs(inputs, 3, BENCH_INPUTS);
+	for (i = 0; i < state->iterations; i++) {
+		motion_softmax(3, inputs + (i % BENCH_INPUTS) * 3, xyz);
+		bench_sink = xyz[0];
+	}
+	state->items_per_iteration = 1;
+}
+
+static void BM_stable_softmax(Bench_State *state) {
+
+	float inputs[3 * BENCH_INPUTS];
+	float xyz[3];
+	long i;
+
+	make_inputs(inputs, 3, BENCH_INPUTS);
+	for (i = 0; i < state->iterations; i++) {
+		stable_softmax(inputs + (i % BENCH_INPUTS) * 3, xyz);
+		bench_sink = xyz[0];
+	}
+	state->items_per_iteration = 1;
+}
+
+static void BM_printOutput_ANN(Bench_State *state) {
+
+	ANN *net = create_net(state->arg);
+	unsigned int width = net->topology[0];
+	unsigned int classes = net->topology[net->n_layers - 1];
+	float *outputs = malloc(sizeof(float) * classes * BENCH_INPUTS);
+	float *inputs = malloc(sizeof(float) * width * BENCH_INPUTS);
+	float *saved = net->output;
+	int error, sum = 0;
+	long i;
+
+	/*
+	 * Score a fixed set of network outputs so only the scan is timed
+	 */
+
+	make_inputs(inputs, width, BENCH_INPUTS);
+	for (i = 0; i < BENCH_INPUTS; i++) {
+		net->output = outputs + i * classes;
+		run_ann(net, inputs + i * width);
+	}
+
+	for (i = 0; i < state->iterations; i++) {
+		net->output = outputs + (i % BENCH_INPUTS) * classes;
+		printOutput_ANN(net, (int) (i % classes), &error);
+		sum += error;
+	}
+	bench_sink = (float) sum;
+	state->items_per_iteration = 1;
+	net->output = saved;
+	free(inputs);
+	free(outputs);
+	Host_ANN_Destroy(net);
+}
+
+/*
+ * The Feature_Extraction_State_0 integration loop without the sensor
+ * reads and the threshold exit, one item per gyro sample
+ */
+
+static void BM_gyro_integration(Bench_State *state) {
+
+	float Tsample = (float) (DATA_PERIOD_MS) / 1000;
+	float rotate_angle[3];
+	int ttt[3], ttt_initial[3];
+	float angle_mag = 0;
+	int axis_index, sample_index;
+	long i;
+
+	for (i = 0; i < state->iterations; i++) {
+		for (axis_index = 0; axis_index < 3; axis_index++) {
+			ttt[axis_index] = 0;
+			rotate_angle[axis_index] = 0;
+		}
+		for (sample_index = 1; sample_index < trace_length; sample_index++) {
+			for (axis_index = 0; axis_index < 3; axis_index++) {
+				ttt_initial[axis_index] = ttt[axis_index] - trace[0][axis_index];
+				ttt[axis_index] = trace[sample_index][axis_index]
+						- trace[0][axis_index];
+			}
+			ttt_initial[2] = 0;
+			ttt[2] = 0;
+			angle_mag = Gyro_Integrate_Angle(rotate_angle, ttt_initial, ttt,
+					Tsample);
+		}
+		bench_sink = angle_mag;
+	}
+	state->items_per_iteration = trace_length - 1;
+}
+
+/*
+ * 6-axis window for the CNN: the gyro trace on X with a push on
+ * accelerometer Y over the second half
+ */
+
+static void fill_cnn_ring(CNN_Ring *ring) {
+
+	int accel[3];
+	int i;
+
+	CNN_Ring_Reset(ring);
+	for (i = 0; i < CNN_WINDOW; i++) {
+		accel[0] = 12;
+		accel[1] = i < CNN_WINDOW / 2 ? -8 : 640;
+		accel[2] = 1003;
+		CNN_Ring_Push(ring, accel, trace[i % trace_length]);
+	}
+}
+
+static void BM_cnn_run(Bench_State *state) {
+
+	static CNN cnn;
+	static CNN_Ring ring;
+	long i;
+
+	CNN_Init(&cnn, BENCH_SEED);
+	fill_cnn_ring(&ring);
+	for (i = 0; i < state->iterations; i++) {
+		CNN_Run(&cnn, &ring);
+		bench_sink = cnn.output[0];
+	}
+	state->items_per_iteration = 1;
+	state->mcu_cycles = (double) CNN_MACS * BENCH_MCU_CYCLES_PER_MAC;
+}
+
+static void BM_cnn_train(Bench_State *state) {
+
+	static CNN cnn;
+	static CNN_Grad grad;
+	static CNN_Ring ring;
+	long i;
+
+	CNN_Init(&cnn, BENCH_SEED);
+	fill_cnn_ring(&ring);
+	for (i = 0; i < state->iterations; i++) {
+		bench_sink = CNN_Train(&cnn, &grad, &ring, (int) (i % CNN_CLASSES));
+	}
+	state->items_per_iteration = 1;
+
+	/*
+	 * Backward pass is roughly two forward passes of work
+	 */
+
+	state->mcu_cycles = 3.0 * CNN_MACS * BENCH_MCU_CYCLES_PER_MAC;
+}
+
+/*
+ * A gesture of class c made at speed percent of the trace: the gyro trace
+ * with its axes rotated and signed per class, then a 600 mg push along
+ * one accelerometer axis
+ */
+
+static void record_dtw_gesture(int c, int speed, Dtw_Frame *frames) {
+
+	Dtw_Recorder gyro, accel;
+	int xyz[3], rest[3] = { 0, 0, 1000 };
+	int i, a, n = trace_length * 100 / speed;
+
+	for (i = 0; i < n; i++) {
+		for (a = 0; a < 3; a++) {
+			xyz[a] = trace[i * speed / 100][(a + c) % 3];
+		}
+		if (c >= 3) {
+			xyz[0] = -xyz[0];
+		}
+		if (i == 0) {
+			Dtw_Record_Start(&gyro, xyz);
+		} else {
+			Dtw_Record(&gyro, xyz);
+		}
+	}
+
+	Dtw_Record_Start(&accel, rest);
+	for (i = 0; i < n / 4; i++) {
+		memcpy(xyz, rest, sizeof(xyz));
+		xyz[c % 3] += (c >= 3 ? -600 : 600) * (i < n / 8 ? i : n / 8) / (n / 8);
+		Dtw_Record(&accel, xyz);
+	}
+
+	Dtw_Gesture(&gyro, &accel, frames);
+}
+
+/*
+ * Classify one gesture against two templates of each of six classes, one
+ * item per gesture
+ */
+
+static void BM_dtw_classify(Bench_State *state) {
+
+	static Dtw_Model model;
+	Dtw_Frame frames[DTW_FRAMES];
+	float output[DTW_MAX_CLASSES];
+	long i, cells = 0;
+	int c;
+
+	Dtw_Reset(&model, 6, DTW_BAND, DTW_REJECT_DISTANCE);
+	for (c = 0; c < 6; c++) {
+		record_dtw_gesture(c, 100, frames);
+		Dtw_Add(&model, frames, c);
+		record_dtw_gesture(c, 80, frames);
+		Dtw_Add(&model, frames, c);
+	}
+	record_dtw_gesture(2, 115, frames);
+	for (i = 0; i < state->iterations; i++) {
+		cells = Dtw_Score(&model, frames, output);
+		bench_sink = output[2];
+	}
+	state->items_per_iteration = 1;
+
+	/*
+	 * Three multiply-adds per cost matrix cell and per lower bound frame
+	 */
+
+	state->mcu_cycles = 3.0 * (cells + 12 * DTW_FRAMES)
+			* BENCH_MCU_CYCLES_PER_MAC;
+}
+
+static const Bench_Entry benchmarks[] = {
+	{ "init_ann", BM_init_ann, "3-9-6" },
+	{ "init_ann", BM_init_ann, "3-32-6" },
+	{ "init_ann", BM_init_ann, "16-64-6" },
+	{ "init_ann", BM_init_ann, "48-128-64-6" },
+	{ "run_ann", BM_run_ann, "3-9-6" },
+	{ "run_ann", BM_run_ann, "3-32-6" },
+	{ "run_ann", BM_run_ann, "16-64-6" },
+	{ "run_ann", BM_run_ann, "48-128-64-6" },
+	{ "run_ann_scan", BM_run_ann_scan, "3-9-6" },
+	{ "run_ann_scan", BM_run_ann_scan, "16-64-6" },
+	{ "run_ann_scan", BM_run_ann_scan, "48-128-64-6" },
+	{ "run_ann_batch", BM_run_ann_batch, "3-9-6" },
+	{ "run_ann_batch", BM_run_ann_batch, "16-64-6" },
+	{ "run_ann_batch", BM_run_ann_batch, "48-128-64-6" },
+	{ "train_ann", BM_train_ann, "3-9-6" },
+	{ "train_ann", BM_train_ann, "3-32-6" },
+	{ "train_ann", BM_train_ann, "16-64-6" },
+	{ "train_ann", BM_train_ann, "48-128-64-6" },
+	{ "motion_softmax", BM_motion_softmax, NULL },
+	{ "stable_softmax", BM_stable_softmax, NULL },
+	{ "printOutput_ANN", BM_printOutput_ANN, "3-9-6" },
+	{ "printOutput_ANN", BM_printOutput_ANN, "16-64-32" },
+	{ "gyro_integration", BM_gyro_integration, NULL },
+	{ "cnn_run", BM_cnn_run, NULL },
+	{ "cnn_train", BM_cnn_train, NULL },
+	{ "dtw_classify", BM_dtw_classify, NULL },
+};
+
+/*
+ * ---------------------------------------------------------------------------
+ * Runner
+ * ---------------------------------------------------------------------------
+ */
+
+static double elapsed_ns(clockid_t clock, const struct timespec *start) {
+
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+	return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static void run_benchmark(const Bench_Entry *entry, double min_time,
+		Bench_Result *result) {
+
+	Bench_State state;
+	struct timespec real_start, cpu_start;
+	double real_ns, cpu_ns;
+	long iterations = 1;
+
+	for (;;) {
+		state.iterations = iterations;
+		state.items_per_iteration = 0;
+		state.mcu_cycles = 0;
+		state.arg = entry->arg;
+
+		clock_gettime(CLOCK_MONOTONIC, &real_start);
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+		entry->function(&state);
+		cpu_ns = elapsed_ns(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+		real_ns = elapsed_ns(CLOCK_MONOTONIC, &real_start);
+
+		if (real_ns >= min_time * 1e9 || iterations >= (1L << 40)) {
+			break;
+		}
+
+		/*
+		 * Grow towards the target time, at most tenfold per step
+		 */
+
+		if (real_ns < min_time * 1e8) {
+			iterations *= 10;
+		} else {
+			iterations = (long) (iterations * 1.4 * min_time * 1e9 / real_ns);
+		}
+	}
+
+	if (entry->arg != NULL) {
+		snprintf(result->name, sizeof(result->name), "%s/%s", entry->name,
+				entry->arg);
+	} else {
+		snprintf(result->name, sizeof(result->name), "%s", entry->name);
+	}
+	result->iterations = iterations;
+	result->real_ns = real_ns / iterations;
+	result->cpu_ns = cpu_ns / iterations;
+	result->items_per_second = state.items_per_iteration * iterations
+			/ (real_ns / 1e9);
+	result->mcu_cycles = state.mcu_cycles;
+}
+
+/*
+ * run_ann_batch reimplements the embeddedML forward pass, so confirm it
+ * agrees with run_ann before timing anything
+ */
+
+static int check_batch_parity(const char *arg) {
+
+	ANN *net = create_net(arg);
+	unsigned int width = net->topology[0];
+	unsigned int classes = net->topology[net->n_layers - 1];
+	float *inputs = malloc(sizeof(float) * width * BENCH_INPUTS);
+	float *outputs = malloc(sizeof(float) * classes * BENCH_INPUTS);
+	ANN_Result results[BENCH_INPUTS];
+	unsigned int i, j;
+	int failed = 0;
+
+	make_inputs(inputs, width, BENCH_INPUTS);
+	run_ann_batch(net, inputs, BENCH_INPUTS, outputs, results);
+	for (i = 0; i < BENCH_INPUTS && !failed; i++) {
+		run_ann(net, inputs + i * width);
+		for (j = 0; j < classes; j++) {
+			if (fabsf(net->output[j] - outputs[i * classes + j])
+					> 1e-4 * (1 + fabsf(net->output[j]))) {
+				fprintf(stderr, "bench: run_ann_batch/%s differs from run_ann"
+						" at vector %u output %u\n", arg, i, j);
+				failed = 1;
+				break;
+			}
+		}
+	}
+	free(outputs);
+	free(inputs);
+	Host_ANN_Destroy(net);
+	return failed;
+}
+
+static void write_console(FILE *out, const Bench_Result *results, int count) {
+
+	int i;
+
+	fprintf(out, "%-32s %14s %14s %12s %14s\n", "Benchmark", "Time (ns)",
+			"CPU (ns)", "Iterations", "items/s");
+	for (i = 0; i < count; i++) {
+		fprintf(out, "%-32s %14.1f %14.1f %12ld %14.4g", results[i].name,
+				results[i].real_ns, results[i].cpu_ns, results[i].iterations,
+				results[i].items_per_second);
+		if (results[i].mcu_cycles > 0) {
+			fprintf(out, "   ~%.0f MCU cycles, %.2f ms at %d MHz",
+					results[i].mcu_cycles,
+					1e3 * results[i].mcu_cycles / BENCH_MCU_CLOCK_HZ,
+					BENCH_MCU_CLOCK_HZ / 1000000);
+		}
+		fprintf(out, "\n");
+	}
+}
+
+static void write_csv(FILE *out, const Bench_Result *results, int count) {
+
+	int i;
+
+	fprintf(out, "name,iterations,real_time,cpu_time,time_unit,items_per_second,"
+			"mcu_cycles\n");
+	for (i = 0; i < count; i++) {
+		fprintf(out, "\"%s\",%ld,%.3f,%.3f,ns,%.6g,%.0f\n", results[i].name,
+				results[i].iterations, results[i].real_ns, results[i].cpu_ns,
+				results[i].items_per_second, results[i].mcu_cycles);
+	}
+}
+
+static void write_json(FILE *out, const Bench_Result *results, int count,
+		const char *trace_name) {
+
+	char date[64], host[128];
+	time_t now = time(NULL);
+	int i;
+
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+	if (gethostname(host, sizeof(host)) != 0) {
+		strcpy(host, "unknown");
+	}
+
+	fprintf(out, "{\n  \"context\": {\n");
+	fprintf(out, "    \"date\": \"%s\",\n", date);
+	fprintf(out, "    \"host_name\": \"%s\",\n", host);
+	fprintf(out, "    \"executable\": \"bench\",\n");
+	fprintf(out, "    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(out, "    \"seed\": %d,\n", BENCH_SEED);
+	fprintf(out, "    \"trace\": \"%s\"\n", trace_name);
+	fprintf(out, "  },\n  \"benchmarks\": [\n");
+	for (i = 0; i < count; i++) {
+		fprintf(out, "    {\n");
+		fprintf(out, "      \"name\": \"%s\",\n", results[i].name);
+		fprintf(out, "      \"run_name\": \"%s\",\n", results[i].name);
+		fprintf(out, "      \"run_type\": \"iteration\",\n");
+		fprintf(out, "      \"iterations\": %ld,\n", results[i].iterations);
+		fprintf(out, "      \"real_time\": %.3f,\n", results[i].real_ns);
+		fprintf(out, "      \"cpu_time\": %.3f,\n", results[i].cpu_ns);
+		fprintf(out, "      \"time_unit\": \"ns\",\n");
+		fprintf(out, "      \"items_per_second\": %.6g%s\n",
+				results[i].items_per_second,
+				results[i].mcu_cycles > 0 ? "," : "");
+		if (results[i].mcu_cycles > 0) {
+			fprintf(out, "      \"mcu_cycles\": %.0f\n", results[i].mcu_cycles);
+		}
+		fprintf(out, "    }%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+
+	static Bench_Result results[BENCH_MAX_RESULTS];
+	const char *filter = NULL, *format = "console", *out_path = NULL;
+	const char *trace_path = NULL, *v;
+	double min_time = 0.5;
+	char name[96];
+	FILE *out = stdout;
+	int i, count = 0;
+	int n_entries = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--filter")) != NULL) {
+			filter = v;
+		} else if ((v = option_value(argv[i], "--min_time")) != NULL) {
+			min_time = atof(v);
+		} else if ((v = option_value(argv[i], "--format")) != NULL) {
+			format = v;
+		} else if ((v = option_value(argv[i], "--out")) != NULL) {
+			out_path = v;
+		} else if ((v = option_value(argv[i], "--trace")) != NULL) {
+			trace_path = v;
+		} else {
+			fprintf(stderr, "usage: %s [--filter=SUBSTRING] [--min_time=SECONDS]"
+					" [--format=console|json|csv] [--out=FILE] [--trace=FILE]\n",
+					argv[0]);
+			return 2;
+		}
+	}
+
+	if (trace_path != NULL) {
+		if (load_trace(trace_path) != 0) {
+			fprintf(stderr, "bench: cannot read trace %s\n", trace_path);
+			return 1;
+		}
+	} else {
+		make_synthetic_trace();
+	}
+
+	if (check_batch_parity("3-9-6") || check_batch_parity("48-128-64-6")) {
+		return 1;
+	}
+
+	for (i = 0; i < n_entries && count < BENCH_MAX_RESULTS; i++) {
+		if (benchmarks[i].arg != NULL) {
+			snprintf(name, sizeof(name), "%s/%s", benchmarks[i].name,
+					benchmarks[i].arg);
+		} else {
+			snprintf(name, sizeof(name), "%s", benchmarks[i].name);
+		}
+		if (filter != NULL && strstr(name, filter) == NULL) {
+			continue;
+		}
+		run_benchmark(&benchmarks[i], min_time, &results[count]);
+		if (strcmp(format, "console") != 0 || out_path != NULL) {
+			fprintf(stderr, "%s done\n", name);
+		}
+		count++;
+	}
+
+	if (out_path != NULL) {
+		out = fopen(out_path, "w");
+		if (out == NULL) {
+			fprintf(stderr, "bench: cannot write %s\n", out_path);
+			return 1;
+		}
+	}
+
+	if (strcmp(format, "json") == 0) {
+		write_json(out, results, count, trace_path ? trace_path : "synthetic");
+	} else if (strcmp(format, "csv") == 0) {
+		write_csv(out, results, count);
+	} else {
+		write_console(out, results, count);
+	}
+
+	if (out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
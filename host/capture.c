@@ -0,0 +1,323 @@
+/**
+ ******************************************************************************
+ * @file    capture.c
+ * @brief   Capture the raw IMU stream of the firmware's IMU_STREAM mode
+ ******************************************************************************
+ *
+ * Reads the framed sample stream of imuStream.h from the SensorTile's USB
+ * serial port, or from a pseudo terminal opened with --pty that a device
+ * or a simulator is bridged onto, checks every frame's CRC and sequence
+ * number and writes the samples to a stream file.
+ *
+ * The stream file is little endian:
+ *   "IMUS", uint16 version (1), uint16 axes (6), float rate [Hz]
+ *   then one block per frame received:
+ *   uint32 index of the first sample, uint16 n, uint16 flags,
+ *   n samples of ax ay az gx gy gz as raw int16 counts
+ * Sample indexes count the samples of lost frames too, so a gap shows up
+ * as a jump in the index. --text writes "index ax ay az gx gy gz" lines
+ * instead.
+ *
+ * Usage:
+ *   capture [options] DEVICE OUT
+ *   capture [options] --pty OUT
+ *     --pty              read from a new pseudo terminal, its name is
+ *                        printed on start
+ *     --rate=1660        sample rate set in the firmware [Hz]
+ *     --seconds=N        stop after N seconds (default: on Ctrl-C)
+ *     --text             write text lines
+ *
+ * The totals printed on exit include the frames lost and damaged.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "imuStream.h"
+
+#define CAPTURE_READ_SIZE 65536
+
+typedef struct {
+	FILE *out;
+	int text;
+	int have_seq;
+	uint16_t last_seq;
+	uint32_t index;             /* next sample index */
+	uint32_t first_tick;
+	uint32_t last_tick;
+	uint32_t last_index;        /* index of the last frame's first sample */
+	long frames;
+	long samples;
+	long lost;                  /* frames missing from the sequence */
+	long gaps;
+	long crc_errors;
+	long skipped;               /* bytes outside frames */
+	long read_errors;           /* frames with IMU_STREAM_FLAG_READ_ERROR */
+} Capture;
+
+static volatile sig_atomic_t stopping;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void on_signal(int signal_number) {
+	(void) signal_number;
+	stopping = 1;
+}
+
+static void put_16(FILE *out, uint16_t x) {
+	fputc(x & 0xFF, out);
+	fputc(x >> 8, out);
+}
+
+static void put_32(FILE *out, uint32_t x) {
+	put_16(out, (uint16_t) x);
+	put_16(out, (uint16_t) (x >> 16));
+}
+
+static void write_header(Capture *c, float rate) {
+
+	uint32_t bits;
+
+	if (c->text) {
+		fprintf(c->out, "# raw IMU stream, %g Hz\n"
+				"# index ax ay az gx gy gz\n", rate);
+		return;
+	}
+	memcpy(&bits, &rate, sizeof(bits));
+	fwrite("IMUS", 1, 4, c->out);
+	put_16(c->out, 1);
+	put_16(c->out, IMU_STREAM_AXES);
+	put_32(c->out, bits);
+}
+
+static void write_packet(Capture *c, const IMU_Stream_Packet *packet) {
+
+	int i, j;
+
+	if (c->have_seq) {
+		int lost = IMU_Stream_Gap(c->last_seq, packet->seq);
+		if (lost > 0) {
+			c->lost += lost;
+			c->gaps++;
+			c->index += (uint32_t) lost * IMU_STREAM_SAMPLES_PER_PACKET;
+		}
+	} else {
+		c->first_tick = packet->tick;
+	}
+	c->have_seq = 1;
+	c->last_seq = packet->seq;
+	c->last_tick = packet->tick;
+	c->last_index = c->index;
+	c->frames++;
+	c->samples += packet->n;
+	if (packet->flags & IMU_STREAM_FLAG_READ_ERROR) {
+		c->read_errors++;
+	}
+
+	if (c->text) {
+		for (i = 0; i < packet->n; i++) {
+			fprintf(c->out, "%u", (unsigned int) (c->index + i));
+			for (j = 0; j < IMU_STREAM_AXES; j++) {
+				fprintf(c->out, " %d", packet->samples[i][j]);
+			}
+			fputc('\n', c->out);
+		}
+	} else {
+		put_32(c->out, c->index);
+		put_16(c->out, packet->n);
+		put_16(c->out, packet->flags);
+		for (i = 0; i < packet->n; i++) {
+			for (j = 0; j < IMU_STREAM_AXES; j++) {
+				put_16(c->out, (uint16_t) packet->samples[i][j]);
+			}
+		}
+	}
+	c->index += packet->n;
+}
+
+/*
+ * Decode every complete frame in buffer. Returns the bytes left over.
+ */
+
+static int decode(Capture *c, uint8_t *buffer, int n) {
+
+	IMU_Stream_Packet packet;
+	int used, offset = 0, status;
+
+	while ((status = IMU_Stream_Decode(buffer + offset, n - offset, &packet,
+			&used)) != IMU_STREAM_MORE) {
+		if (status == IMU_STREAM_PACKET) {
+			write_packet(c, &packet);
+		} else if (status == IMU_STREAM_CRC_ERROR) {
+			c->crc_errors++;
+		} else {
+			c->skipped += used;
+		}
+		offset += used;
+	}
+	memmove(buffer, buffer + offset, n - offset);
+	return n - offset;
+}
+
+/*
+ * Pseudo terminal in raw mode. The slave stays open here so that the
+ * master does not read end of file while nothing is bridged onto it.
+ */
+
+static int open_pty(void) {
+
+	struct termios raw;
+	int master, slave;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		return -1;
+	}
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (slave < 0 || tcgetattr(slave, &raw) != 0) {
+		close(master);
+		return -1;
+	}
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+	printf("Capturing from %s\n", ptsname(master));
+	fflush(stdout);
+	return master;
+}
+
+static int open_device(const char *path) {
+
+	struct termios raw;
+	int fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+
+	if (fd >= 0 && isatty(fd) && tcgetattr(fd, &raw) == 0) {
+		cfmakeraw(&raw);
+		tcsetattr(fd, TCSANOW, &raw);
+	}
+	return fd;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--rate=HZ] [--seconds=N] [--text]"
+			" DEVICE|--pty OUT\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	static uint8_t buffer[CAPTURE_READ_SIZE + IMU_STREAM_MAX_FRAME];
+	struct sigaction action;
+	Capture c;
+	const char *device = NULL, *out_path = NULL, *v;
+	float rate = 1660, seconds = 0;
+	double start, elapsed;
+	int i, fd, pty = 0, pending = 0;
+	ssize_t got;
+
+	memset(&c, 0, sizeof(c));
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--rate")) != NULL) {
+			rate = (float) atof(v);
+		} else if ((v = option_value(argv[i], "--seconds")) != NULL) {
+			seconds = (float) atof(v);
+		} else if (strcmp(argv[i], "--text") == 0) {
+			c.text = 1;
+		} else if (strcmp(argv[i], "--pty") == 0) {
+			pty = 1;
+		} else if (argv[i][0] != '-' && device == NULL && !pty) {
+			device = argv[i];
+		} else if (argv[i][0] != '-' && out_path == NULL) {
+			out_path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (out_path == NULL || (device == NULL) == !pty || rate <= 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	fd = pty ? open_pty() : open_device(device);
+	if (fd < 0) {
+		fprintf(stderr, "capture: cannot open %s\n",
+				pty ? "a pseudo terminal" : device);
+		return 1;
+	}
+	c.out = fopen(out_path, c.text ? "w" : "wb");
+	if (c.out == NULL) {
+		fprintf(stderr, "capture: cannot write %s\n", out_path);
+		return 1;
+	}
+	setvbuf(c.out, NULL, _IOFBF, 1 << 20);
+	write_header(&c, rate);
+
+	/*
+	 * No SA_RESTART, so Ctrl-C interrupts the blocking read
+	 */
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	if (seconds > 0) {
+		sigaction(SIGALRM, &action, NULL);
+		alarm((unsigned int) (seconds + 0.999f));
+	}
+
+	start = now_ms();
+	while (!stopping) {
+		got = read(fd, buffer + pending, CAPTURE_READ_SIZE);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			break;
+		}
+		pending = decode(&c, buffer, pending + (int) got);
+	}
+	elapsed = (now_ms() - start) / 1e3;
+	c.skipped += pending;
+
+	if (fclose(c.out) != 0) {
+		fprintf(stderr, "capture: cannot write %s\n", out_path);
+		return 1;
+	}
+
+	printf("Frames %ld  samples %ld  in %.1f s\n", c.frames, c.samples,
+			elapsed);
+	if (c.frames > 1 && c.last_tick != c.first_tick) {
+		printf("Device rate %.1f Hz (%g expected)\n",
+				c.last_index * 1e3 / (c.last_tick - c.first_tick), rate);
+	}
+	printf("Lost frames %ld in %ld gaps, CRC errors %ld, bytes skipped %ld,"
+			" read errors %ld\n", c.lost, c.gaps, c.crc_errors, c.skipped,
+			c.read_errors);
+	return 0;
+}
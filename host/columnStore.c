@@ -0,0 +1,271 @@
+/**
+ ******************************************************************************
+ * @file    columnStore.c
+ * @brief   Memory-mapped columnar store of captured gestures
+ ******************************************************************************
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "columnStore.h"
+
+static uint64_t align_up(uint64_t offset) {
+	return (offset + STORE_ALIGN - 1) / STORE_ALIGN * STORE_ALIGN;
+}
+
+static int pad_to(FILE *f, uint64_t from, uint64_t to) {
+
+	for (; from < to; from++) {
+		if (fputc(0, f) == EOF) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int Store_Is_Store(const char *path) {
+
+	char magic[4];
+	FILE *f = fopen(path, "rb");
+	int is_store;
+
+	if (f == NULL) {
+		return 0;
+	}
+	is_store = fread(magic, 1, 4, f) == 4 && memcmp(magic, STORE_MAGIC, 4) == 0;
+	fclose(f);
+	return is_store;
+}
+
+int Store_Open(const char *path, Gesture_Store *store) {
+
+	const Store_Header *header;
+	struct stat st;
+	uint64_t end;
+	void *map;
+	int fd, i;
+
+	memset(store, 0, sizeof(Gesture_Store));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "store: cannot open %s\n", path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	if ((size_t) st.st_size < sizeof(Store_Header)) {
+		fprintf(stderr, "store: %s is not a gesture store\n", path);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "store: cannot map %s\n", path);
+		return -1;
+	}
+	store->base = map;
+	store->size = (size_t) st.st_size;
+	header = map;
+
+	if (memcmp(header->magic, STORE_MAGIC, 4) != 0) {
+		fprintf(stderr, "store: %s is not a gesture store\n", path);
+		goto fail;
+	}
+	if (header->byte_order != STORE_BYTE_ORDER) {
+		fprintf(stderr, "store: %s was written with the other byte order\n",
+				path);
+		goto fail;
+	}
+	if (header->version != STORE_VERSION || header->axes != STORE_AXES) {
+		fprintf(stderr, "store: %s is version %u with %u axes, expected"
+				" version %d with %d\n", path, header->version, header->axes,
+				STORE_VERSION, STORE_AXES);
+		goto fail;
+	}
+	if (header->size != store->size || header->n_gestures > INT32_MAX
+			|| header->meta_offset % STORE_ALIGN != 0
+			|| header->meta_offset + (uint64_t) header->n_gestures
+					* sizeof(Store_Meta) > header->index_offset
+			|| header->index_offset % sizeof(uint64_t) != 0
+			|| header->index_offset + (uint64_t) header->n_gestures
+					* sizeof(uint64_t) > store->size) {
+		fprintf(stderr, "store: %s is truncated or damaged\n", path);
+		goto fail;
+	}
+
+	store->n_gestures = (int) header->n_gestures;
+	store->n_classes = (int) header->n_classes;
+	store->n_rows = header->n_rows;
+	store->meta = (const Store_Meta *) (store->base + header->meta_offset);
+	store->index = (const uint64_t *) (store->base + header->index_offset);
+
+	/*
+	 * One pass over meta and index, not the samples, so that a damaged
+	 * file cannot send a reader outside the mapping
+	 */
+
+	for (i = 0; i < store->n_gestures; i++) {
+
+		/*
+		 * An offset past the mapping would wrap the end of its samples
+		 * around to a small value
+		 */
+
+		if (store->index[i] > store->size - sizeof(Store_Header)) {
+			fprintf(stderr, "store: %s: gesture %d is damaged\n", path, i);
+			goto fail;
+		}
+		end = store->index[i] + (uint64_t) STORE_AXES * store->meta[i].n
+				* sizeof(int16_t);
+		if (store->index[i] < sizeof(Store_Header)
+				|| store->index[i] % STORE_ALIGN != 0
+				|| end > header->meta_offset
+				|| store->meta[i].n_0 > store->meta[i].n
+				|| store->meta[i].label < 0
+				|| store->meta[i].label >= store->n_classes) {
+			fprintf(stderr, "store: %s: gesture %d is damaged\n", path, i);
+			goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	Store_Close(store);
+	return -1;
+}
+
+void Store_Close(Gesture_Store *store) {
+	if (store->base != NULL) {
+		munmap((void *) store->base, store->size);
+	}
+	memset(store, 0, sizeof(Gesture_Store));
+}
+
+int Store_Create(Store_Writer *writer, const char *path) {
+
+	memset(writer, 0, sizeof(Store_Writer));
+	writer->path = path;
+	writer->f = fopen(path, "wb");
+	if (writer->f == NULL) {
+		fprintf(stderr, "store: cannot write %s\n", path);
+		return -1;
+	}
+	setvbuf(writer->f, NULL, _IOFBF, 1 << 20);
+
+	memcpy(writer->header.magic, STORE_MAGIC, 4);
+	writer->header.version = STORE_VERSION;
+	writer->header.axes = STORE_AXES;
+	writer->header.byte_order = STORE_BYTE_ORDER;
+
+	/*
+	 * The header is written again by Store_Finish
+	 */
+
+	if (fwrite(&writer->header, sizeof(Store_Header), 1, writer->f) != 1) {
+		fprintf(stderr, "store: cannot write %s\n", path);
+		return -1;
+	}
+	writer->offset = sizeof(Store_Header);
+	return 0;
+}
+
+int Store_Append(Store_Writer *writer, const Store_Meta *meta,
+		const int16_t *const *columns) {
+
+	uint64_t start = align_up(writer->offset);
+	int a;
+
+	if (meta->label < 0 || meta->label >= CORPUS_MAX_CLASSES
+			|| meta->n_0 > meta->n) {
+		fprintf(stderr, "store: %s: bad gesture %u\n", writer->path,
+				writer->header.n_gestures);
+		return -1;
+	}
+	if (writer->header.n_gestures == (uint32_t) writer->capacity) {
+		int grow = writer->capacity ? writer->capacity * 2 : 1024;
+		Store_Meta *m = realloc(writer->meta, grow * sizeof(Store_Meta));
+		uint64_t *index;
+
+		if (m == NULL) {
+			fprintf(stderr, "store: out of memory\n");
+			return -1;
+		}
+		writer->meta = m;
+		index = realloc(writer->index, grow * sizeof(uint64_t));
+		if (index == NULL) {
+			fprintf(stderr, "store: out of memory\n");
+			return -1;
+		}
+		writer->index = index;
+		writer->capacity = grow;
+	}
+
+	if (pad_to(writer->f, writer->offset, start) != 0) {
+		fprintf(stderr, "store: cannot write %s\n", writer->path);
+		return -1;
+	}
+	for (a = 0; a < STORE_AXES; a++) {
+		if (fwrite(columns[a], sizeof(int16_t), meta->n, writer->f) != meta->n) {
+			fprintf(stderr, "store: cannot write %s\n", writer->path);
+			return -1;
+		}
+	}
+	writer->offset = start + (uint64_t) STORE_AXES * meta->n * sizeof(int16_t);
+
+	writer->meta[writer->header.n_gestures] = *meta;
+	writer->index[writer->header.n_gestures] = start;
+	writer->header.n_gestures++;
+	writer->header.n_rows += meta->n;
+	if ((uint32_t) meta->label + 1 > writer->header.n_classes) {
+		writer->header.n_classes = (uint32_t) meta->label + 1;
+	}
+	return 0;
+}
+
+int Store_Finish(Store_Writer *writer) {
+
+	Store_Header *header = &writer->header;
+	uint32_t n = header->n_gestures;
+	int status = -1;
+
+	if (writer->f == NULL) {
+		goto done;
+	}
+
+	header->meta_offset = align_up(writer->offset);
+	header->index_offset = header->meta_offset + (uint64_t) n * sizeof(Store_Meta);
+	header->size = header->index_offset + (uint64_t) n * sizeof(uint64_t);
+
+	if (pad_to(writer->f, writer->offset, header->meta_offset) != 0
+			|| fwrite(writer->meta, sizeof(Store_Meta), n, writer->f) != n
+			|| fwrite(writer->index, sizeof(uint64_t), n, writer->f) != n
+			|| fseek(writer->f, 0, SEEK_SET) != 0
+			|| fwrite(header, sizeof(Store_Header), 1, writer->f) != 1) {
+		fprintf(stderr, "store: cannot write %s\n", writer->path);
+		fclose(writer->f);
+		goto done;
+	}
+	if (fclose(writer->f) != 0) {
+		fprintf(stderr, "store: cannot write %s\n", writer->path);
+		goto done;
+	}
+	status = 0;
+
+done:
+	free(writer->meta);
+	free(writer->index);
+	writer->f = NULL;
+	writer->meta = NULL;
+	writer->index = NULL;
+	return status;
+}
@@ -0,0 +1,140 @@
+/**
+ ******************************************************************************
+ * @file    columnStore.h
+ * @brief   Memory-mapped columnar store of captured gestures
+ ******************************************************************************
+ *
+ * Text traces (trace.h) cost a parse of every sample on every run. A store
+ * file holds the same gestures in binary form, laid out so that a tool
+ * maps it and reads the samples in place:
+ *
+ *   header       Store_Header, 64 bytes
+ *   blocks       one per gesture, STORE_ALIGN aligned: the gesture's n rows
+ *                as STORE_AXES int16 columns of n counts each,
+ *                ax[n] ay[n] az[n] gx[n] gy[n] gz[n]
+ *   meta         Store_Meta per gesture, one column
+ *   index        uint64 file offset of each gesture's block
+ *
+ * Rows 0 .. n_0 - 1 of a gesture are State 0 and the rest State 1. Counts
+ * times the gesture's accel_scale and gyro_scale give the mg and
+ * milli-degrees/s of the BSP drivers; a trace replay only reads the gyro
+ * axes in State 0 and the accelerometer axes in State 1.
+ *
+ * Fields are stored in host byte order and Store_Open refuses a file
+ * written with the other one, so nothing is converted on read.
+ */
+
+#ifndef HOST_COLUMN_STORE_H
+#define HOST_COLUMN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define STORE_MAGIC "GSTC"
+#define STORE_VERSION 1
+#define STORE_BYTE_ORDER 0x01020304u
+#define STORE_AXES 6
+#define STORE_ALIGN 64
+
+enum {
+	STORE_AX, STORE_AY, STORE_AZ, STORE_GX, STORE_GY, STORE_GZ
+};
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t axes;
+	uint32_t byte_order;
+	uint32_t n_gestures;
+	uint32_t n_classes;
+	uint32_t reserved;
+	uint64_t n_rows;            /* over all gestures */
+	uint64_t meta_offset;
+	uint64_t index_offset;
+	uint64_t size;              /* of the whole file */
+	uint64_t reserved_2;
+} Store_Header;
+
+typedef struct {
+	int32_t label;
+	uint32_t device;            /* capturing device, or source file */
+	uint32_t n;                 /* rows */
+	uint32_t n_0;               /* State 0 rows */
+	float accel_scale;          /* mg per count */
+	float gyro_scale;           /* milli-degrees/s per count */
+
+	/* Feature_Config of the firmware at capture */
+	float angle_threshold;
+	float accel_threshold;
+	int32_t max_acquire_cycles;
+	float Tsample;
+	uint32_t reserved[2];
+} Store_Meta;
+
+typedef struct {
+	int n_gestures;
+	int n_classes;
+	uint64_t n_rows;
+	const Store_Meta *meta;
+	const uint64_t *index;
+	const uint8_t *base;
+	size_t size;
+} Gesture_Store;
+
+/*
+ * Map a store read only. The pointers in store stay valid until
+ * Store_Close.
+ */
+
+int Store_Open(const char *path, Gesture_Store *store);
+void Store_Close(Gesture_Store *store);
+
+/*
+ * Column axis (STORE_AX ...) of gesture i, meta[i].n counts
+ */
+
+static inline const int16_t *Store_Column(const Gesture_Store *store, int i,
+		int axis) {
+	return (const int16_t *) (store->base + store->index[i])
+			+ (size_t) axis * store->meta[i].n;
+}
+
+/*
+ * Writing streams the blocks out and keeps only meta and index in memory,
+ * then appends them and fills in the header on Store_Finish
+ */
+
+typedef struct {
+	FILE *f;
+	const char *path;
+	Store_Header header;
+	Store_Meta *meta;
+	uint64_t *index;
+	int capacity;
+	uint64_t offset;            /* end of the blocks written */
+} Store_Writer;
+
+int Store_Create(Store_Writer *writer, const char *path);
+
+/*
+ * Append a gesture of meta->n rows given as STORE_AXES columns
+ */
+
+int Store_Append(Store_Writer *writer, const Store_Meta *meta,
+		const int16_t *const *columns);
+
+/*
+ * Write meta, index and header and close the file. Store_Finish also
+ * releases a writer after a failed Store_Append.
+ */
+
+int Store_Finish(Store_Writer *writer);
+
+/*
+ * Nonzero if the file at path starts with STORE_MAGIC
+ */
+
+int Store_Is_Store(const char *path);
+
+#endif /* HOST_COLUMN_STORE_H */
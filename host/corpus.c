@@ -0,0 +1,228 @@
+/**
+ ******************************************************************************
+ * @file    corpus.c
+ * @brief   Labeled gesture corpora for the host evaluation tools
+ ******************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gestureCore.h"
+#include "corpus.h"
+
+static int append(Gesture_Corpus *corpus, int *capacity, int label,
+		const float *features) {
+
+	if (corpus->n_samples == *capacity) {
+		int grow = *capacity ? *capacity * 2 : 256;
+		int *labels = realloc(corpus->labels, grow * sizeof(int));
+		float *data;
+
+		if (labels == NULL) {
+			return -1;
+		}
+		corpus->labels = labels;
+		data = realloc(corpus->features,
+				(size_t) grow * corpus->n_features * sizeof(float));
+		if (data == NULL) {
+			return -1;
+		}
+		corpus->features = data;
+		*capacity = grow;
+	}
+
+	corpus->labels[corpus->n_samples] = label;
+	memcpy(corpus->features + (size_t) corpus->n_samples * corpus->n_features,
+			features, corpus->n_features * sizeof(float));
+	corpus->n_samples++;
+	if (label + 1 > corpus->n_classes) {
+		corpus->n_classes = label + 1;
+	}
+	return 0;
+}
+
+static int load_binary(FILE *f, const char *path, Gesture_Corpus *corpus) {
+
+	uint32_t header[5];
+	size_t n;
+	int i;
+
+	if (fread(header, sizeof(uint32_t), 5, f) != 5
+			|| header[0] != CORPUS_VERSION || header[1] == 0
+			|| header[1] > INT32_MAX || header[2] == 0
+			|| header[2] > CORPUS_MAX_FEATURES || header[3] > CORPUS_MAX_CLASSES) {
+		fprintf(stderr, "corpus: %s has a bad header\n", path);
+		return -1;
+	}
+	corpus->n_samples = (int) header[1];
+	corpus->n_features = (int) header[2];
+	corpus->n_classes = (int) header[3];
+	corpus->normalized = header[4] != 0;
+
+	n = (size_t) corpus->n_samples * corpus->n_features;
+	corpus->labels = malloc(sizeof(int) * corpus->n_samples);
+	corpus->features = malloc(sizeof(float) * n);
+	if (corpus->labels == NULL || corpus->features == NULL) {
+		fprintf(stderr, "corpus: out of memory\n");
+		return -1;
+	}
+	if (fread(corpus->labels, sizeof(int32_t), corpus->n_samples, f)
+			!= (size_t) corpus->n_samples
+			|| fread(corpus->features, sizeof(float), n, f) != n) {
+		fprintf(stderr, "corpus: %s is truncated\n", path);
+		return -1;
+	}
+	for (i = 0; i < corpus->n_samples; i++) {
+		if (corpus->labels[i] < 0 || corpus->labels[i] >= corpus->n_classes) {
+			fprintf(stderr, "corpus: %s: gesture %d has a bad label\n", path, i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int Corpus_Load(const char *path, Gesture_Corpus *corpus) {
+
+	char line[1024];
+	float features[CORPUS_MAX_FEATURES];
+	int capacity = 0, line_number = 0;
+	int label, n;
+	char *p, *end;
+	FILE *f;
+
+	memset(corpus, 0, sizeof(Gesture_Corpus));
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "corpus: cannot open %s\n", path);
+		return -1;
+	}
+
+	if (fread(line, 1, 4, f) == 4 && memcmp(line, CORPUS_MAGIC, 4) == 0) {
+		if (load_binary(f, path, corpus) != 0) {
+			goto fail;
+		}
+		fclose(f);
+		return 0;
+	}
+	rewind(f);
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line_number++;
+		p = line;
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+			continue;
+		}
+
+		label = (int) strtol(p, &end, 10);
+		if (end == p || label < 0 || label >= CORPUS_MAX_CLASSES) {
+			fprintf(stderr, "corpus: %s:%d: bad label\n", path, line_number);
+			goto fail;
+		}
+		p = end;
+
+		n = 0;
+		for (;;) {
+			float value = strtof(p, &end);
+			if (end == p) {
+				break;
+			}
+			if (n == CORPUS_MAX_FEATURES) {
+				fprintf(stderr, "corpus: %s:%d: too many features\n", path,
+						line_number);
+				goto fail;
+			}
+			features[n++] = value;
+			p = end;
+		}
+
+		if (corpus->n_features == 0) {
+			corpus->n_features = n;
+		}
+		if (n == 0 || n != corpus->n_features) {
+			fprintf(stderr, "corpus: %s:%d: expected %d features\n", path,
+					line_number, corpus->n_features);
+			goto fail;
+		}
+
+		if (append(corpus, &capacity, label, features) != 0) {
+			fprintf(stderr, "corpus: out of memory\n");
+			goto fail;
+		}
+	}
+
+	fclose(f);
+	if (corpus->n_samples == 0) {
+		fprintf(stderr, "corpus: %s holds no gestures\n", path);
+		return -1;
+	}
+	return 0;
+
+fail:
+	fclose(f);
+	Corpus_Free(corpus);
+	return -1;
+}
+
+int Corpus_Save(const char *path, const Gesture_Corpus *corpus) {
+
+	uint32_t header[5];
+	size_t n = (size_t) corpus->n_samples * corpus->n_features;
+	FILE *f = fopen(path, "wb");
+
+	if (f == NULL) {
+		fprintf(stderr, "corpus: cannot write %s\n", path);
+		return -1;
+	}
+	header[0] = CORPUS_VERSION;
+	header[1] = (uint32_t) corpus->n_samples;
+	header[2] = (uint32_t) corpus->n_features;
+	header[3] = (uint32_t) corpus->n_classes;
+	header[4] = (uint32_t) corpus->normalized;
+
+	if (fwrite(CORPUS_MAGIC, 1, 4, f) != 4
+			|| fwrite(header, sizeof(uint32_t), 5, f) != 5
+			|| fwrite(corpus->labels, sizeof(int32_t), corpus->n_samples, f)
+					!= (size_t) corpus->n_samples
+			|| fwrite(corpus->features, sizeof(float), n, f) != n) {
+		fprintf(stderr, "corpus: cannot write %s\n", path);
+		fclose(f);
+		return -1;
+	}
+	if (fclose(f) != 0) {
+		fprintf(stderr, "corpus: cannot write %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+void Corpus_Free(Gesture_Corpus *corpus) {
+	free(corpus->labels);
+	free(corpus->features);
+	memset(corpus, 0, sizeof(Gesture_Corpus));
+}
+
+void Corpus_Normalize(Gesture_Corpus *corpus) {
+
+	float xyz[3];
+	float *x;
+	int i;
+
+	if (corpus->n_features != 3 || corpus->normalized) {
+		return;
+	}
+	for (i = 0; i < corpus->n_samples; i++) {
+		x = corpus->features + i * 3;
+		motion_softmax(3, x, xyz);
+		x[0] = xyz[0];
+		x[1] = xyz[1];
+		x[2] = xyz[2];
+	}
+	corpus->normalized = 1;
+}
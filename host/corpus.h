@@ -0,0 +1,57 @@
+/**
+ ******************************************************************************
+ * @file    corpus.h
+ * @brief   Labeled gesture corpora for the host evaluation tools
+ ******************************************************************************
+ *
+ * A feature corpus is a text file with one captured gesture per line:
+ *
+ *   label f1 f2 f3
+ *
+ * label is the network output index of the gesture (0 = Motion 1 ...
+ * 5 = Motion 6) and f1..fn are the features as printed on the "Softmax
+ * Input" line by TrainOrientation, i.e. before motion_softmax. Blank lines
+ * and lines starting with '#' are ignored. Every line must carry the same
+ * number of features.
+ *
+ * Corpus_Save writes the binary form, which Corpus_Load recognises by its
+ * magic, all in host byte order:
+ *
+ *   "GFEA", uint32 version (1), n_samples, n_features, n_classes,
+ *   normalized, then int32 labels[n_samples] and
+ *   float features[n_samples][n_features]
+ *
+ * A normalized corpus already holds network inputs, and Corpus_Normalize
+ * leaves it alone.
+ */
+
+#ifndef HOST_CORPUS_H
+#define HOST_CORPUS_H
+
+#define CORPUS_MAX_FEATURES 1024    /* room for a CNN sample window */
+#define CORPUS_MAX_CLASSES 32
+
+typedef struct {
+	int n_samples;
+	int n_features;
+	int n_classes;
+	int *labels;
+	float *features;   /* n_samples x n_features */
+	int normalized;
+} Gesture_Corpus;
+
+#define CORPUS_MAGIC "GFEA"
+#define CORPUS_VERSION 1
+
+int Corpus_Load(const char *path, Gesture_Corpus *corpus);
+int Corpus_Save(const char *path, const Gesture_Corpus *corpus);
+void Corpus_Free(Gesture_Corpus *corpus);
+
+/*
+ * Convert captured features into network inputs in place, exactly as
+ * the firmware does before run_ann (motion_softmax for three features)
+ */
+
+void Corpus_Normalize(Gesture_Corpus *corpus);
+
+#endif /* HOST_CORPUS_H */
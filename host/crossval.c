@@ -0,0 +1,317 @@
+/**
+ ******************************************************************************
+ * @file    crossval.c
+ * @brief   Parallel k-fold cross-validation of the gesture network
+ ******************************************************************************
+ *
+ * Splits a labeled feature corpus (see corpus.h) into k stratified folds,
+ * trains a fresh network on k - 1 folds with the TrainOrientation loop
+ * (Host_ANN_Train) and scores the held out fold with run_ann and the
+ * printOutput_ANN criteria. Every fold of every repeat is an independent
+ * job on the worker pool, each with its own ANN, so the run scales with
+ * the number of cores as long as folds * repeats >= threads.
+ *
+ * Usage:
+ *   crossval [options] CORPUS
+ *     --folds=K          number of folds (default 5)
+ *     --repeats=R        repeat the k-fold split R times with new shuffles
+ *     --threads=N        worker threads (default: online CPUs)
+ *     --topology=3-9-6   network topology, input width must match corpus
+ *     --cycles=N         training_cycles limit (default 2000)
+ *     --seed=S           shuffle seed, and weight seed (0 = firmware weights)
+ *     --confusion=FILE   write the summed confusion matrix as CSV
+ *     --classifier=ann   ann, centroid for per class prototypes, grammar
+ *                        for primitive motions composed by rules, or cnn
+ *                        for a corpus of sample windows (extract --cnn)
+ *     --reject=D         centroid rejection distance (default 0.1)
+ *     --online           learn from confident gestures while scoring (not
+ *                        with cnn)
+ *
+ * Accuracy counts held out gestures whose maximum output is the right
+ * class. Accepted counts those that also pass the z-score and runner-up
+ * ratio limits of printOutput_ANN, i.e. that the game would act on. For
+ * centroids it counts those within the rejection distance instead.
+ *
+ * --online plays each held out fold in order through gestureOnline.c, as
+ * the firmware does during a game, and reports how many gestures were
+ * learned from.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gestureCore.h"
+#include "corpus.h"
+#include "evaluate.h"
+#include "hostModel.h"
+#include "threadPool.h"
+
+typedef struct {
+	const Gesture_Corpus *corpus;
+	const int *fold_of;       /* fold index of every sample for this repeat */
+	const Train_Options *options;
+	int fold;
+	int repeat;
+
+	/* results */
+	Fold_Score score;
+	int *confusion;           /* n_classes x (n_classes + 1), last column = no class */
+} Fold_Job;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void run_fold(void *arg) {
+
+	Fold_Job *job = arg;
+
+	Evaluate_Fold(job->corpus, job->fold_of, job->fold, job->options,
+			&job->score, job->confusion);
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--folds=K] [--repeats=R] [--threads=N]"
+			" [--topology=3-9-6] [--cycles=N] [--seed=S] [--confusion=FILE]"
+			" [--classifier=ann|centroid|grammar|cnn] [--reject=D] [--online]"
+			" CORPUS\n",
+			argv0);
+}
+
+int main(int argc, char **argv) {
+
+	Gesture_Corpus corpus;
+	Train_Options options;
+	int folds = 5, repeats = 1, threads = 0;
+	unsigned int seed = 0;
+	const char *path = NULL, *confusion_path = NULL, *v;
+	Thread_Pool *pool;
+	Fold_Job *jobs;
+	int *fold_of, *confusion;
+	int i, j, r, n_jobs, columns;
+	int total = 0, correct = 0, accepted = 0, converged = 0, updates = 0;
+	double start, wall_ms, train_ms = 0;
+	char steps[16];
+
+	Train_Options_Default(&options);
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--folds")) != NULL) {
+			folds = atoi(v);
+		} else if ((v = option_value(argv[i], "--repeats")) != NULL) {
+			repeats = atoi(v);
+		} else if ((v = option_value(argv[i], "--threads")) != NULL) {
+			threads = atoi(v);
+		} else if ((v = option_value(argv[i], "--topology")) != NULL) {
+			options.n_layers = Host_Parse_Topology(v, options.topology);
+		} else if ((v = option_value(argv[i], "--cycles")) != NULL) {
+			options.training_cycles = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			seed = (unsigned int) strtoul(v, NULL, 10);
+			options.weight_seed = seed;
+		} else if ((v = option_value(argv[i], "--confusion")) != NULL) {
+			confusion_path = v;
+		} else if ((v = option_value(argv[i], "--classifier")) != NULL) {
+			if (strcmp(v, "ann") == 0) {
+				options.classifier = CLASSIFIER_ANN;
+			} else if (strcmp(v, "centroid") == 0) {
+				options.classifier = CLASSIFIER_CENTROID;
+			} else if (strcmp(v, "grammar") == 0) {
+				options.classifier = CLASSIFIER_GRAMMAR;
+			} else if (strcmp(v, "cnn") == 0) {
+				options.classifier = CLASSIFIER_CNN;
+			} else {
+				usage(argv[0]);
+				return 2;
+			}
+		} else if ((v = option_value(argv[i], "--reject")) != NULL) {
+			options.reject_distance = (float) atof(v);
+		} else if (strcmp(argv[i], "--online") == 0) {
+			options.online = 1;
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (path == NULL || folds < 2 || repeats < 1 || options.n_layers == 0
+			|| (options.online && options.classifier == CLASSIFIER_CNN)) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (Corpus_Load(path, &corpus) != 0) {
+		return 1;
+	}
+	if (options.classifier == CLASSIFIER_CENTROID) {
+		if (corpus.n_features > CENTROID_MAX_FEATURES
+				|| corpus.n_classes > CENTROID_MAX_CLASSES) {
+			fprintf(stderr, "crossval: centroids hold at most %d features and"
+					" %d classes\n", CENTROID_MAX_FEATURES, CENTROID_MAX_CLASSES);
+			return 1;
+		}
+	} else if (options.classifier == CLASSIFIER_GRAMMAR) {
+		if (corpus.n_features != 3 || corpus.n_classes > GRAMMAR_GAME_RULES) {
+			fprintf(stderr, "crossval: the grammar reads the 3 motion features"
+					" of at most %d game actions\n", GRAMMAR_GAME_RULES);
+			return 1;
+		}
+	} else if (options.classifier == CLASSIFIER_CNN) {
+		if (corpus.n_features != CNN_WINDOW * CNN_AXES
+				|| corpus.n_classes > CNN_CLASSES) {
+			fprintf(stderr, "crossval: the CNN reads windows of %d samples of"
+					" %d axes, of at most %d classes\n", CNN_WINDOW, CNN_AXES,
+					CNN_CLASSES);
+			return 1;
+		}
+	} else if ((int) options.topology[0] != corpus.n_features) {
+		fprintf(stderr, "crossval: topology input %u does not match %d corpus"
+				" features\n", options.topology[0], corpus.n_features);
+		return 1;
+	}
+	if (options.classifier != CLASSIFIER_CNN
+			&& (int) options.topology[options.n_layers - 1] < corpus.n_classes) {
+		fprintf(stderr, "crossval: topology output %u is smaller than the %d"
+				" corpus classes\n", options.topology[options.n_layers - 1],
+				corpus.n_classes);
+		return 1;
+	}
+	Corpus_Normalize(&corpus);
+
+	n_jobs = folds * repeats;
+	columns = corpus.n_classes + 1;
+	jobs = calloc(n_jobs, sizeof(Fold_Job));
+	fold_of = malloc(sizeof(int) * corpus.n_samples * repeats);
+	confusion = calloc((size_t) n_jobs * corpus.n_classes * columns, sizeof(int));
+	pool = Thread_Pool_Create(threads);
+	if (jobs == NULL || fold_of == NULL || confusion == NULL || pool == NULL) {
+		fprintf(stderr, "crossval: out of memory\n");
+		return 1;
+	}
+
+	for (r = 0; r < repeats; r++) {
+		if (Evaluate_Assign_Folds(&corpus, folds, seed + 7919u * (r + 1),
+				fold_of + (size_t) r * corpus.n_samples) != 0) {
+			fprintf(stderr, "crossval: out of memory\n");
+			return 1;
+		}
+	}
+
+	start = now_ms();
+	for (r = 0; r < repeats; r++) {
+		for (i = 0; i < folds; i++) {
+			Fold_Job *job = &jobs[r * folds + i];
+			job->corpus = &corpus;
+			job->fold_of = fold_of + (size_t) r * corpus.n_samples;
+			job->options = &options;
+			job->fold = i;
+			job->repeat = r;
+			job->confusion = confusion
+					+ (size_t) (r * folds + i) * corpus.n_classes * columns;
+			Thread_Pool_Submit(pool, run_fold, job);
+		}
+	}
+	Thread_Pool_Wait(pool);
+	wall_ms = now_ms() - start;
+
+	printf("Corpus %s: %d gestures, %d classes, %d features\n", path,
+			corpus.n_samples, corpus.n_classes, corpus.n_features);
+	printf("%d folds x %d repeats on %d threads\n\n", folds, repeats,
+			Thread_Pool_Size(pool));
+
+	printf("Repeat\tFold\tTrain\tTest\tSteps\tTrain ms\tAccuracy\tAccepted\n");
+	for (j = 0; j < n_jobs; j++) {
+		Fold_Job *job = &jobs[j];
+		Fold_Score *score = &job->score;
+		if (score->steps == -2) {
+			fprintf(stderr, "crossval: fold %d of repeat %d ran out of memory\n",
+					job->fold, job->repeat);
+			return 1;
+		}
+
+		/* The prototype backends do not iterate */
+		if (options.classifier == CLASSIFIER_CENTROID
+				|| options.classifier == CLASSIFIER_GRAMMAR) {
+			snprintf(steps, sizeof steps, "-");
+		} else {
+			snprintf(steps, sizeof steps, "%s%d", score->steps < 0 ? ">" : "",
+					score->steps < 0 ?
+							(int) options.training_cycles : score->steps);
+		}
+		printf("%d\t%d\t%d\t%d\t%s\t%.1f\t\t%.1f%%\t\t%.1f%%\n", job->repeat,
+				job->fold, score->n_train, score->n_test, steps, score->train_ms,
+				score->n_test ? 100.0 * score->correct / score->n_test : 0,
+				score->n_test ? 100.0 * score->accepted / score->n_test : 0);
+		total += score->n_test;
+		correct += score->correct;
+		accepted += score->accepted;
+		converged += score->steps >= 0;
+		updates += score->updates;
+		train_ms += score->train_ms;
+		if (j > 0) {
+			for (i = 0; i < corpus.n_classes * columns; i++) {
+				confusion[i] += job->confusion[i];
+			}
+		}
+	}
+
+	printf("\nAccuracy %.2f%%  Accepted %.2f%%  Converged %d/%d folds\n",
+			100.0 * correct / total, 100.0 * accepted / total, converged, n_jobs);
+	if (options.online) {
+		printf("Online updates %d of %d gestures\n", updates, total);
+	}
+	printf("Wall %.1f ms, %.1f ms of training, %.2f folds/s\n\n", wall_ms,
+			train_ms, n_jobs / (wall_ms / 1e3));
+
+	printf("Confusion (rows: true class, columns: classified as)\n");
+	for (j = 0; j < corpus.n_classes; j++) {
+		printf("\t%d", j);
+	}
+	printf("\tnone\n");
+	for (i = 0; i < corpus.n_classes; i++) {
+		printf("%d", i);
+		for (j = 0; j < columns; j++) {
+			printf("\t%d", confusion[i * columns + j]);
+		}
+		printf("\n");
+	}
+
+	if (confusion_path != NULL) {
+		FILE *f = fopen(confusion_path, "w");
+		if (f == NULL) {
+			fprintf(stderr, "crossval: cannot write %s\n", confusion_path);
+			return 1;
+		}
+		for (i = 0; i < corpus.n_classes; i++) {
+			for (j = 0; j < columns; j++) {
+				fprintf(f, "%s%d", j ? "," : "", confusion[i * columns + j]);
+			}
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+
+	Thread_Pool_Destroy(pool);
+	free(confusion);
+	free(fold_of);
+	free(jobs);
+	Corpus_Free(&corpus);
+	return 0;
+}
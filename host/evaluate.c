@@ -0,0 +1,246 @@
+/**
+ ******************************************************************************
+ * @file    evaluate.c
+ * @brief   Held out evaluation of the gesture network on a corpus
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gestureConfig.h"
+#include "gestureCore.h"
+#include "evaluate.h"
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+void Train_Options_Default(Train_Options *options) {
+
+	memset(options, 0, sizeof(Train_Options));
+	options->classifier = CLASSIFIER_ANN;
+	options->reject_distance = CENTROID_REJECT_DISTANCE;
+	options->topology[0] = 3;
+	options->topology[1] = 9;
+	options->topology[2] = 6;
+	options->n_layers = 3;
+	options->training_cycles = TRAINING_CYCLES;
+	options->weight_seed = 0;
+	options->eta = 0.13;
+	options->beta = 0.01;
+	options->alpha = 0.25;
+}
+
+int Evaluate_Assign_Folds(const Gesture_Corpus *corpus, int folds,
+		unsigned int seed, int *fold_of) {
+
+	int *members = malloc(sizeof(int) * corpus->n_samples);
+	int c, i, n, t, r;
+
+	if (members == NULL) {
+		return -1;
+	}
+	for (c = 0; c < corpus->n_classes; c++) {
+		n = 0;
+		for (i = 0; i < corpus->n_samples; i++) {
+			if (corpus->labels[i] == c) {
+				members[n++] = i;
+			}
+		}
+		for (i = n - 1; i > 0; i--) {
+			r = (int) (Host_Rand(&seed) % (unsigned int) (i + 1));
+			t = members[i];
+			members[i] = members[r];
+			members[r] = t;
+		}
+		for (i = 0; i < n; i++) {
+			fold_of[members[i]] = (i + c) % folds;
+		}
+	}
+	free(members);
+	return 0;
+}
+
+static int train_cnn(const Train_Options *options, const float *x,
+		const int *y, int n, int n_classes, int width, CNN *cnn) {
+
+	CNN_Grad *grad;
+	CNN_Ring ring;
+	unsigned int seed = options->weight_seed, step;
+
+	if (width != CNN_WINDOW * CNN_AXES || n_classes > CNN_CLASSES || n < 1) {
+		return -2;
+	}
+	grad = malloc(sizeof(CNN_Grad));
+	if (grad == NULL) {
+		return -2;
+	}
+	CNN_Init(cnn, seed);
+	for (step = 0; step < options->training_cycles; step++) {
+		int i = (int) (Host_Rand(&seed) % (unsigned int) n);
+		CNN_Ring_Load(&ring, x + (size_t) i * width);
+		CNN_Train(cnn, grad, &ring, y[i]);
+	}
+	free(grad);
+	return (int) options->training_cycles;
+}
+
+int Evaluate_Train(const Train_Options *options, const float *x,
+		const int *y, int n, int n_classes, int width,
+		Gesture_Classifier *classifier) {
+
+	ANN *net = classifier->net;
+	int i;
+
+	switch (options->classifier) {
+	case CLASSIFIER_CENTROID:
+		if (width > CENTROID_MAX_FEATURES || n_classes > CENTROID_MAX_CLASSES) {
+			return -2;
+		}
+		Centroid_Reset(classifier->centroid, n_classes, width,
+				options->reject_distance);
+		for (i = 0; i < n; i++) {
+			Centroid_Add(classifier->centroid, x + (size_t) i * width, y[i]);
+		}
+		return 0;
+	case CLASSIFIER_GRAMMAR:
+		if (width != 3 || n_classes > GRAMMAR_GAME_RULES) {
+			return -2;
+		}
+		Grammar_Init(classifier->grammar, Grammar_Game_Rules,
+				GRAMMAR_GAME_RULES);
+		for (i = 0; i < n; i++) {
+			Grammar_Train(classifier->grammar, y[i], x + (size_t) i * width);
+		}
+		return 0;
+	case CLASSIFIER_CNN:
+		return train_cnn(options, x, y, n, n_classes, width, classifier->cnn);
+	default:
+		net->eta = options->eta;
+		net->beta = options->beta;
+		net->alpha = options->alpha;
+		return Host_ANN_Train(net, x, y, n, options->training_cycles);
+	}
+}
+
+void Evaluate_Fold(const Gesture_Corpus *corpus, const int *fold_of, int fold,
+		const Train_Options *options, Fold_Score *score, int *confusion) {
+
+	int width = corpus->n_features;
+	int columns = corpus->n_classes + 1;
+	float *train_x = malloc(sizeof(float) * corpus->n_samples * width);
+	float *test_x = malloc(sizeof(float) * corpus->n_samples * width);
+	int *train_y = malloc(sizeof(int) * corpus->n_samples);
+	int *test_y = malloc(sizeof(int) * corpus->n_samples);
+	ANN_Result *results = malloc(sizeof(ANN_Result) * corpus->n_samples);
+	ANN *net = Host_ANN_Create(options->topology, options->n_layers,
+			options->weight_seed);
+	Centroid_Model centroid;
+	Gesture_Grammar grammar;
+	CNN *cnn = options->classifier == CLASSIFIER_CNN ? malloc(sizeof(CNN)) : NULL;
+	Gesture_Classifier classifier = { options->classifier, net, &centroid,
+			&grammar, NULL, cnn };
+	CNN_Ring ring;
+	Online_Learner learner;
+	float output[CENTROID_MAX_CLASSES];
+	double start;
+	int i, loc, accepted;
+
+	memset(score, 0, sizeof(Fold_Score));
+
+	if (train_x == NULL || test_x == NULL || train_y == NULL || test_y == NULL
+			|| results == NULL || net == NULL
+			|| (options->classifier == CLASSIFIER_CNN && cnn == NULL)) {
+		score->steps = -2;
+		goto done;
+	}
+
+	for (i = 0; i < corpus->n_samples; i++) {
+		const float *x = corpus->features + (size_t) i * width;
+		if (fold_of[i] == fold) {
+			memcpy(test_x + (size_t) score->n_test * width, x, sizeof(float) * width);
+			test_y[score->n_test++] = corpus->labels[i];
+		} else {
+			memcpy(train_x + (size_t) score->n_train * width, x, sizeof(float) * width);
+			train_y[score->n_train++] = corpus->labels[i];
+		}
+	}
+
+	start = now_ms();
+	score->steps = Evaluate_Train(options, train_x, train_y, score->n_train,
+			corpus->n_classes, width, &classifier);
+	score->train_ms = now_ms() - start;
+	if (score->steps == -2) {
+		goto done;
+	}
+
+	if (options->classifier == CLASSIFIER_ANN && !options->online) {
+		run_ann_batch(net, test_x, score->n_test, NULL, results);
+	}
+	for (i = 0; i < score->n_test && !options->online; i++) {
+		if (options->classifier == CLASSIFIER_CENTROID) {
+			Centroid_Score(&centroid, test_x + (size_t) i * width, output);
+			ANN_Scan_Output(output, corpus->n_classes, &results[i]);
+		} else if (options->classifier == CLASSIFIER_GRAMMAR) {
+			Grammar_Run(&grammar, test_x + (size_t) i * width, &results[i]);
+		} else if (options->classifier == CLASSIFIER_CNN) {
+			CNN_Ring_Load(&ring, test_x + (size_t) i * width);
+			CNN_Classify(cnn, &ring, &results[i]);
+		}
+	}
+
+	if (options->online) {
+		Online_Reset(&learner, corpus->n_classes, width);
+		for (i = 0; i < score->n_train; i++) {
+			Online_Add(&learner, train_x + (size_t) i * width, train_y[i]);
+		}
+		for (i = 0; i < score->n_test; i++) {
+			Classifier_Run(&classifier, test_x + (size_t) i * width, &results[i]);
+			Online_Observe(&learner, test_x + (size_t) i * width, &results[i]);
+			if (Online_Update(&learner, &classifier) > 0) {
+				score->updates++;
+			}
+		}
+	}
+
+	for (i = 0; i < score->n_test; i++) {
+		loc = results[i].loc;
+		if (loc == test_y[i]) {
+			score->correct++;
+		}
+		if (options->classifier == CLASSIFIER_CENTROID) {
+			accepted = loc == test_y[i]
+					&& 1 - results[i].point <= options->reject_distance;
+		} else if (options->classifier == CLASSIFIER_GRAMMAR) {
+			accepted = loc == test_y[i];
+		} else {
+			accepted = ANN_Result_Error(&results[i], test_y[i]) == ANN_CLASSIFIED;
+		}
+		if (accepted) {
+			score->accepted++;
+		}
+		if (confusion != NULL) {
+			if (loc < 0 || loc >= corpus->n_classes) {
+				loc = corpus->n_classes;
+			}
+			confusion[test_y[i] * columns + loc]++;
+		}
+	}
+
+done:
+	if (net != NULL) {
+		Host_ANN_Destroy(net);
+	}
+	free(cnn);
+	free(results);
+	free(test_y);
+	free(train_y);
+	free(test_x);
+	free(train_x);
+}
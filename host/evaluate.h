@@ -0,0 +1,94 @@
+/**
+ ******************************************************************************
+ * @file    evaluate.h
+ * @brief   Held out evaluation of the gesture network on a corpus
+ ******************************************************************************
+ *
+ * Shared by crossval and sweep: stratified fold assignment, and training a
+ * fresh network on every fold but one before scoring the held out fold.
+ * With the centroid classifier the training folds are averaged into class
+ * prototypes instead (see gestureClassifier.h), and with the grammar into
+ * the directions of its primitive motions (gestureGrammar.h), using the
+ * rules of the six game actions. The CNN (gestureCnn.h) trains on a
+ * corpus of raw sample windows written by extract --cnn, with
+ * training_cycles stochastic gradient steps on randomly drawn windows.
+ *
+ * With online set the held out fold is played in order as in a game: each
+ * gesture is scored, then learned from if it was confident (see
+ * gestureOnline.h), so later gestures are scored by the adapted model.
+ */
+
+#ifndef HOST_EVALUATE_H
+#define HOST_EVALUATE_H
+
+#include "corpus.h"
+#include "gestureClassifier.h"
+#include "gestureOnline.h"
+#include "hostModel.h"
+
+typedef struct {
+	int classifier;         /* CLASSIFIER_ANN, _CENTROID, _GRAMMAR or _CNN */
+	float reject_distance;  /* centroid only */
+	int online;             /* adapt while scoring the held out fold */
+	unsigned int topology[HOST_ANN_MAX_LAYERS];
+	unsigned int n_layers;
+	unsigned int training_cycles;
+	unsigned int weight_seed;
+	float eta;
+	float beta;
+	float alpha;
+} Train_Options;
+
+typedef struct {
+	int n_train;
+	int n_test;
+	int steps;              /* training updates or CNN gradient steps, 0 for
+	                           the prototype backends, -1 = did not
+	                           converge, -2 = no memory */
+	double train_ms;
+	int correct;            /* maximum output is the true class */
+	int accepted;           /* ... and passes the printOutput_ANN limits, or
+	                           the rejection distance for centroids, or
+	                           matches a grammar rule */
+	int updates;            /* online updates made */
+} Fold_Score;
+
+/*
+ * 3-9-6 network with the options and TRAINING_CYCLES of main(), and
+ * CENTROID_REJECT_DISTANCE
+ */
+
+void Train_Options_Default(Train_Options *options);
+
+/*
+ * Stratified assignment: shuffle each class separately and deal its
+ * samples round robin over the folds. Returns -1 when out of memory.
+ */
+
+int Evaluate_Assign_Folds(const Gesture_Corpus *corpus, int folds,
+		unsigned int seed, int *fold_of);
+
+/*
+ * Train the backend of classifier selected by options on n normalized
+ * samples. classifier->net must come from Host_ANN_Create with the
+ * topology of options, and classifier->cnn from malloc for the CNN.
+ * Returns the updates Host_ANN_Train took, 0 for the prototype backends,
+ * the gradient steps for the CNN, or -2 if the backend can not hold the
+ * data.
+ */
+
+int Evaluate_Train(const Train_Options *options, const float *x,
+		const int *y, int n, int n_classes, int width,
+		Gesture_Classifier *classifier);
+
+/*
+ * Train on every sample whose fold_of entry differs from fold and score
+ * the rest. corpus must already be normalized. confusion, if not NULL,
+ * is n_classes x (n_classes + 1) with the last column counting gestures
+ * no class was found for, and is added to.
+ */
+
+void Evaluate_Fold(const Gesture_Corpus *corpus, const int *fold_of, int fold,
+		const Train_Options *options, Fold_Score *score, int *confusion);
+
+#endif /* HOST_EVALUATE_H */
@@ -0,0 +1,248 @@
+/**
+ ******************************************************************************
+ * @file    extract.c
+ * @brief   Extract network inputs from recorded gestures on all cores
+ ******************************************************************************
+ *
+ * Runs the firmware feature extraction and motion_softmax over every
+ * gesture of a trace file or gesture store (featurePipeline.h) and writes
+ * the result as a binary corpus (corpus.h) that crossval, modelc and
+ * prune train on directly. Stores are read in place from the mapping.
+ *
+ * Usage:
+ *   extract [options] TRACES|STORE [OUT]
+ *     --angle=30         ANGLE_MAG_MAX_THRESHOLD [degrees]
+ *     --accel=600        State 1 acceleration change [mg]
+ *     --acquire=800      MAX_ROTATION_ACQUIRE_CYCLES
+ *     --window           add the running window statistics of both states
+ *     --cnn              write the raw sample window of the CNN instead,
+ *                        for crossval --classifier=cnn
+ *     --threads=N        worker threads (default: online CPUs)
+ *     --chunk=N          gestures per chunk (default 64)
+ *     --scaling=1,2,4    time the extraction on each number of threads
+ *                        instead of the default, and check that every run
+ *                        gives the same corpus
+ *     --repeat=N         extractions per timing (default 1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gestureConfig.h"
+#include "featurePipeline.h"
+
+#define EXTRACT_MAX_THREADS 32
+
+typedef struct {
+	const Trace_Set *set;
+	const Gesture_Store *store;
+	Pipeline_Options options;
+} Extract_Source;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static int extract(Thread_Pool *pool, const Extract_Source *source,
+		Gesture_Corpus *corpus, long *samples) {
+	if (source->store != NULL) {
+		return Pipeline_Run_Store(pool, source->store, &source->options, corpus,
+				samples);
+	}
+	return Pipeline_Run_Traces(pool, source->set, &source->options, corpus,
+			samples);
+}
+
+static int same_corpus(const Gesture_Corpus *a, const Gesture_Corpus *b) {
+	return a->n_samples == b->n_samples && a->n_features == b->n_features
+			&& memcmp(a->labels, b->labels, sizeof(int) * a->n_samples) == 0
+			&& memcmp(a->features, b->features,
+					sizeof(float) * a->n_samples * a->n_features) == 0;
+}
+
+/*
+ * Time repeat extractions on pool, keeping the corpus of the last one
+ */
+
+static double timed(Thread_Pool *pool, const Extract_Source *source,
+		int repeat, Gesture_Corpus *corpus, long *samples) {
+
+	double start = now_ms();
+	int r;
+
+	for (r = 0; r < repeat; r++) {
+		if (r > 0) {
+			Corpus_Free(corpus);
+		}
+		if (extract(pool, source, corpus, samples) != 0) {
+			return -1;
+		}
+	}
+	return (now_ms() - start) / repeat;
+}
+
+static int scaling(const Extract_Source *source, const int *threads,
+		int n_threads, int repeat) {
+
+	Gesture_Corpus reference, corpus;
+	Thread_Pool *pool;
+	double ms, base = 0;
+	long samples;
+	int i, same = 1;
+
+	printf("Threads\tms\tGestures/s\tSpeedup\tEfficiency\n");
+	for (i = 0; i < n_threads; i++) {
+		pool = Thread_Pool_Create(threads[i]);
+		if (pool == NULL) {
+			fprintf(stderr, "extract: cannot start %d threads\n", threads[i]);
+			return 1;
+		}
+		ms = timed(pool, source, repeat, i == 0 ? &reference : &corpus,
+				&samples);
+		Thread_Pool_Destroy(pool);
+		if (ms < 0) {
+			return 1;
+		}
+		if (i == 0) {
+			base = ms * threads[0];
+		} else {
+			same = same && same_corpus(&reference, &corpus);
+			Corpus_Free(&corpus);
+		}
+		printf("%d\t%.2f\t%.0f\t\t%.2f\t%.0f%%\n", threads[i], ms,
+				ms > 0 ? reference.n_samples * 1e3 / ms : 0,
+				ms > 0 ? base / ms : 0,
+				ms > 0 ? 100.0 * base / ms / threads[i] : 0);
+	}
+	printf("\nCorpus %s on every thread count\n", same ? "identical" : "DIFFERS");
+	Corpus_Free(&reference);
+	return same ? 0 : 1;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--angle=F] [--accel=F] [--acquire=N] [--window]"
+			" [--cnn] [--threads=N] [--chunk=N] [--scaling=N,N,...] [--repeat=N]"
+			" TRACES|STORE [OUT]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	int scaling_threads[EXTRACT_MAX_THREADS];
+	Extract_Source source;
+	Gesture_Store store;
+	Gesture_Corpus corpus;
+	Trace_Set set;
+	Thread_Pool *pool;
+	const char *path = NULL, *out = NULL, *v;
+	char *end;
+	int i, status, threads = 0, repeat = 1, n_scaling = 0;
+	long samples;
+	double ms;
+
+	memset(&source, 0, sizeof(source));
+	source.options.config.angle_mag_max_threshold = 30;
+	source.options.config.accel_threshold = 600;
+	source.options.config.max_acquire_cycles = 800;
+	source.options.config.Tsample = (float) (DATA_PERIOD_MS) / 1000;
+	source.options.chunk = PIPELINE_CHUNK;
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--angle")) != NULL) {
+			source.options.config.angle_mag_max_threshold = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--accel")) != NULL) {
+			source.options.config.accel_threshold = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--acquire")) != NULL) {
+			source.options.config.max_acquire_cycles = atoi(v);
+		} else if (strcmp(argv[i], "--window") == 0) {
+			source.options.window = PIPELINE_WINDOW;
+		} else if (strcmp(argv[i], "--cnn") == 0) {
+			source.options.window = PIPELINE_CNN;
+		} else if ((v = option_value(argv[i], "--threads")) != NULL) {
+			threads = atoi(v);
+		} else if ((v = option_value(argv[i], "--chunk")) != NULL) {
+			source.options.chunk = atoi(v);
+		} else if ((v = option_value(argv[i], "--repeat")) != NULL) {
+			repeat = atoi(v);
+		} else if ((v = option_value(argv[i], "--scaling")) != NULL) {
+			while (*v != '\0' && n_scaling < EXTRACT_MAX_THREADS) {
+				scaling_threads[n_scaling] = (int) strtol(v, &end, 10);
+				if (end == v || scaling_threads[n_scaling] < 1) {
+					usage(argv[0]);
+					return 2;
+				}
+				n_scaling++;
+				v = *end == ',' ? end + 1 : end;
+			}
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else if (argv[i][0] != '-' && out == NULL) {
+			out = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (path == NULL || (out == NULL && n_scaling == 0) || repeat < 1
+			|| source.options.chunk < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (Store_Is_Store(path)) {
+		if (Store_Open(path, &store) != 0) {
+			return 1;
+		}
+		source.store = &store;
+	} else {
+		if (Trace_Load(path, &set) != 0) {
+			return 1;
+		}
+		source.set = &set;
+	}
+
+	if (n_scaling > 0) {
+		status = scaling(&source, scaling_threads, n_scaling, repeat);
+		goto done;
+	}
+
+	status = 1;
+	pool = Thread_Pool_Create(threads);
+	if (pool == NULL) {
+		fprintf(stderr, "extract: cannot start the worker threads\n");
+		goto done;
+	}
+	ms = timed(pool, &source, repeat, &corpus, &samples);
+	if (ms >= 0) {
+		printf("Extracted %d gestures of %d features on %d threads in %.1f ms,"
+				" mean capture %.0f ms\n", corpus.n_samples, corpus.n_features,
+				Thread_Pool_Size(pool), ms,
+				(double) samples * DATA_PERIOD_MS / corpus.n_samples);
+		status = Corpus_Save(out, &corpus) != 0;
+		Corpus_Free(&corpus);
+	}
+	Thread_Pool_Destroy(pool);
+
+done:
+	if (source.store != NULL) {
+		Store_Close(&store);
+	} else {
+		Trace_Free(&set);
+	}
+	return status;
+}
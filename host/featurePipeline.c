@@ -0,0 +1,209 @@
+/**
+ ******************************************************************************
+ * @file    featurePipeline.c
+ * @brief   Parallel feature extraction of recorded gestures
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gestureCore.h"
+#include "featurePipeline.h"
+
+typedef struct {
+	const Pipeline_Options *options;
+	const Trace_Set *set;
+	const Gesture_Store *store;
+	Gesture_Corpus *corpus;
+	int *used;                  /* samples consumed per gesture */
+	int failed;
+} Pipeline_Job;
+
+int Pipeline_Width(int window) {
+	switch (window) {
+	case PIPELINE_WINDOW:
+		return 3 + FEATURE_REPLAY_WINDOW_SIZE;
+	case PIPELINE_CNN:
+		return CNN_WINDOW * CNN_AXES;
+	default:
+		return 3;
+	}
+}
+
+static void cnn_window(const Feature_Config *config,
+		const int (*state_0)[3], int n_0, const int (*state_1)[3], int n_1,
+		float *x, int *samples_used) {
+
+	static const int rest[3] = { 0, 0, 0 };
+	float features[3];
+	CNN_Ring ring;
+	int i;
+
+	Feature_Replay(config, state_0, n_0, state_1, n_1, features, samples_used,
+			NULL);
+	CNN_Ring_Reset(&ring);
+	for (i = 1; i <= samples_used[0]; i++) {
+		CNN_Ring_Push(&ring, rest, state_0[i]);
+	}
+	CNN_Ring_Set_Accel(&ring, n_1 > 0 ? state_1[0] : rest);
+	for (i = 1; i <= samples_used[1]; i++) {
+		CNN_Ring_Push(&ring, state_1[i], n_0 > 0 ? state_0[0] : rest);
+	}
+	CNN_Ring_Store(&ring, x);
+}
+
+void Pipeline_Extract(const Feature_Config *config, int window,
+		const int (*state_0)[3], int n_0, const int (*state_1)[3], int n_1,
+		float *x, int *samples_used) {
+
+	float xyz[3];
+
+	if (window == PIPELINE_CNN) {
+		cnn_window(config, state_0, n_0, state_1, n_1, x, samples_used);
+		return;
+	}
+	Feature_Replay(config, state_0, n_0, state_1, n_1, x, samples_used,
+			window ? x + 3 : NULL);
+	motion_softmax(3, x, xyz);
+	x[0] = xyz[0];
+	x[1] = xyz[1];
+	x[2] = xyz[2];
+}
+
+static void trace_chunk(void *arg, int begin, int end) {
+
+	Pipeline_Job *job = arg;
+	const Gesture_Trace *trace;
+	int width = job->corpus->n_features;
+	int samples_used[2];
+	int i;
+
+	for (i = begin; i < end; i++) {
+		trace = &job->set->traces[i];
+		Pipeline_Extract(&job->options->config, job->options->window,
+				(const int (*)[3]) trace->state_0, trace->n_0,
+				(const int (*)[3]) trace->state_1, trace->n_1,
+				job->corpus->features + (size_t) i * width, samples_used);
+		job->corpus->labels[i] = trace->label;
+		job->used[i] = samples_used[0] + samples_used[1];
+	}
+}
+
+/*
+ * Counts of one axis into column axis of rows. store pack only writes
+ * whole scales, which take an integer multiply.
+ */
+
+static void copy_axis(int (*rows)[3], int axis, const int16_t *counts, int n,
+		float scale) {
+
+	int i, whole = (int) scale;
+
+	if (whole == scale) {
+		for (i = 0; i < n; i++) {
+			rows[i][axis] = counts[i] * whole;
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			rows[i][axis] = (int) lrintf(counts[i] * scale);
+		}
+	}
+}
+
+/*
+ * Store gestures are converted into the rows Feature_Replay reads, in a
+ * buffer of the chunk's own
+ */
+
+static void store_chunk(void *arg, int begin, int end) {
+
+	Pipeline_Job *job = arg;
+	const Gesture_Store *store = job->store;
+	const Store_Meta *m;
+	int width = job->corpus->n_features;
+	int samples_used[2];
+	int (*rows)[3];
+	uint32_t n_max = 1;
+	int i, a;
+
+	for (i = begin; i < end; i++) {
+		n_max = store->meta[i].n > n_max ? store->meta[i].n : n_max;
+	}
+	rows = malloc(sizeof(int[3]) * n_max);
+	if (rows == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	for (i = begin; i < end; i++) {
+		m = &store->meta[i];
+		for (a = 0; a < 3; a++) {
+			copy_axis(rows, a, Store_Column(store, i, STORE_GX + a), (int) m->n_0,
+					m->gyro_scale);
+			copy_axis(rows + m->n_0, a, Store_Column(store, i, STORE_AX + a)
+					+ m->n_0, (int) (m->n - m->n_0), m->accel_scale);
+		}
+		Pipeline_Extract(&job->options->config, job->options->window,
+				(const int (*)[3]) rows, (int) m->n_0,
+				(const int (*)[3]) rows + m->n_0, (int) (m->n - m->n_0),
+				job->corpus->features + (size_t) i * width, samples_used);
+		job->corpus->labels[i] = m->label;
+		job->used[i] = samples_used[0] + samples_used[1];
+	}
+	free(rows);
+}
+
+static int run(Thread_Pool *pool, Pipeline_Job *job, int n, int n_classes,
+		Thread_Pool_Range body, long *samples) {
+
+	Gesture_Corpus *corpus = job->corpus;
+	int i, width = Pipeline_Width(job->options->window);
+
+	memset(corpus, 0, sizeof(Gesture_Corpus));
+	corpus->n_samples = n;
+	corpus->n_features = width;
+	corpus->n_classes = n_classes;
+	corpus->normalized = 1;
+	corpus->labels = malloc(sizeof(int) * n);
+	corpus->features = malloc(sizeof(float) * width * (size_t) n);
+	job->used = malloc(sizeof(int) * n);
+	job->failed = 0;
+	if (corpus->labels == NULL || corpus->features == NULL || job->used == NULL
+			|| Thread_Pool_For(pool, n, job->options->chunk > 0 ?
+					job->options->chunk : PIPELINE_CHUNK, body, job) != 0
+			|| job->failed) {
+		fprintf(stderr, "pipeline: out of memory\n");
+		free(job->used);
+		Corpus_Free(corpus);
+		return -1;
+	}
+
+	if (samples != NULL) {
+		*samples = 0;
+		for (i = 0; i < n; i++) {
+			*samples += job->used[i];
+		}
+	}
+	free(job->used);
+	return 0;
+}
+
+int Pipeline_Run_Traces(Thread_Pool *pool, const Trace_Set *set,
+		const Pipeline_Options *options, Gesture_Corpus *corpus, long *samples) {
+
+	Pipeline_Job job = { options, set, NULL, corpus, NULL, 0 };
+
+	return run(pool, &job, set->n_traces, set->n_classes, trace_chunk, samples);
+}
+
+int Pipeline_Run_Store(Thread_Pool *pool, const Gesture_Store *store,
+		const Pipeline_Options *options, Gesture_Corpus *corpus, long *samples) {
+
+	Pipeline_Job job = { options, NULL, store, corpus, NULL, 0 };
+
+	return run(pool, &job, store->n_gestures, store->n_classes, store_chunk,
+			samples);
+}
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * @file    featurePipeline.h
+ * @brief   Parallel feature extraction of recorded gestures
+ ******************************************************************************
+ *
+ * Replays every recorded gesture through the firmware feature extraction
+ * (Feature_Replay in gestureFeatures.c) and motion_softmax, and collects
+ * the network inputs in a corpus ready for training. The gestures are
+ * split into chunks that the pool's workers share by work stealing
+ * (Thread_Pool_For); each gesture writes only its own row, so the corpus
+ * is in recording order and identical for any number of threads.
+ */
+
+#ifndef HOST_FEATURE_PIPELINE_H
+#define HOST_FEATURE_PIPELINE_H
+
+#include "gestureCnn.h"
+#include "gestureFeatures.h"
+#include "corpus.h"
+#include "columnStore.h"
+#include "threadPool.h"
+#include "trace.h"
+
+#define PIPELINE_CHUNK 64
+
+/*
+ * What a gesture becomes: the three motion_softmax inputs, those plus the
+ * window statistics of both states, or the raw sample window of the CNN
+ */
+
+#define PIPELINE_SNAPSHOT 0
+#define PIPELINE_WINDOW 1
+#define PIPELINE_CNN 2
+
+typedef struct {
+	Feature_Config config;
+	int window;                 /* PIPELINE_SNAPSHOT, _WINDOW or _CNN */
+	int chunk;                  /* gestures per chunk, PIPELINE_CHUNK if 0 */
+} Pipeline_Options;
+
+/*
+ * Features per gesture: 3, 3 + FEATURE_REPLAY_WINDOW_SIZE with
+ * PIPELINE_WINDOW, or CNN_WINDOW * CNN_AXES with PIPELINE_CNN
+ */
+
+int Pipeline_Width(int window);
+
+/*
+ * One gesture: Feature_Replay, then motion_softmax on the three snapshot
+ * features as on the device; the window statistics are already scaled.
+ * x receives Pipeline_Width(window) values, samples_used as for
+ * Feature_Replay.
+ *
+ * With PIPELINE_CNN, x is the CNN window of the samples Feature_Replay
+ * used. Each state reads one sensor, so the State 0 samples carry the
+ * State 1 reference acceleration and the State 1 samples the State 0
+ * reference rotation rate, as the firmware's CLASSIFIER_CNN pushes them.
+ */
+
+void Pipeline_Extract(const Feature_Config *config, int window,
+		const int (*state_0)[3], int n_0, const int (*state_1)[3], int n_1,
+		float *x, int *samples_used);
+
+/*
+ * Fill corpus, released with Corpus_Free, from traces or straight from a
+ * mapped store. samples, if not NULL, receives the samples the states
+ * consumed over all gestures.
+ */
+
+int Pipeline_Run_Traces(Thread_Pool *pool, const Trace_Set *set,
+		const Pipeline_Options *options, Gesture_Corpus *corpus, long *samples);
+int Pipeline_Run_Store(Thread_Pool *pool, const Gesture_Store *store,
+		const Pipeline_Options *options, Gesture_Corpus *corpus, long *samples);
+
+#endif /* HOST_FEATURE_PIPELINE_H */
@@ -0,0 +1,390 @@
+/**
+ ******************************************************************************
+ * @file    fusionCheck.c
+ * @brief   Simulated check of accelFusion.c and the State 1 dwell
+ ******************************************************************************
+ *
+ * Runs the State 1 code of main.c against simulated accelerometers and
+ * exits nonzero if it misbehaves. It checks that Fusion_Calibrate falls
+ * back to the LSM6DSM alone with weight 1 when given fewer than two pairs
+ * or a wrong axis map, and that a right map recovers the offset between
+ * the sensors and a fused variance below either sensor's. The LSM6DSM
+ * alone is calibrated from the same reads, as main.c does without
+ * DUAL_ACCEL.
+ *
+ * It then plays --trials State 1 captures: the player reacts, tilts the
+ * SensorTile by more than Z_ACCEL_THRESHOLD (or, in half of them, by well
+ * under it) and holds still. Each capture is decided three ways: by one
+ * LSM6DSM read after the fixed FUSION_MAX_DWELL_MS wait, and by the
+ * Fusion_Dwell loop of Feature_Extraction_State_1 on the LSM6DSM alone and
+ * on the fused reading, each with the window its measured noise calls
+ * for. For each it prints the window, how often the decision is right
+ * and the median, 90th percentile and longest dwell of the tilted
+ * captures; the others wait out the whole dwell unless misjudged. The
+ * check fails if a dwell runs past FUSION_MAX_DWELL_MS, if the median
+ * LSM6DSM dwell is not shorter than the fixed wait, if the median fused
+ * dwell is not shorter than the LSM6DSM one, or if the fused dwell is
+ * right less often than the fixed wait by more than --tolerance points.
+ *
+ * Calibration at rest only sees gravity, so a map that swaps or flips x
+ * and y is accepted while the SensorTile lies flat. The LSM303AGR map of
+ * main.c has to be measured rather than left to calibration.
+ *
+ * Usage:
+ *   fusionCheck [options]
+ *     --trials=N         simulated captures (default 2000)
+ *     --noise=A,B        white noise of the LSM6DSM and LSM303AGR
+ *                        [mg RMS] (default 10,15)
+ *     --tremor=T         hand tremor seen by both sensors [mg RMS]
+ *                        (default 5)
+ *     --threshold=T      Z_ACCEL_THRESHOLD [mg] (default 300)
+ *     --tolerance=P      accuracy the fused dwell may lose against the
+ *                        fixed wait [percentage points] (default 1)
+ *     --seed=S           simulation seed
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "accelFusion.h"
+#include "gestureConfig.h"
+
+#define CHECK_CALIBRATION_SAMPLES 32    /* FUSION_CALIBRATION_SAMPLES */
+#define CHECK_MODES 3
+
+#define MODE_FIXED 0
+#define MODE_SINGLE 1
+#define MODE_FUSED 2
+
+static const char *mode_names[CHECK_MODES] = {
+	"fixed wait, LSM6DSM", "dwell, LSM6DSM", "dwell, fused"
+};
+
+/*
+ * The LSM303AGR as simulated: raw axis axis[a] holds sign[a] times
+ * reference axis a, plus offset
+ */
+
+static const Fusion_Calibration mounted[FUSION_SENSORS] = {
+	{ { 0, 1, 2 }, { 1, 1, 1 }, { 0, 0, 0 }, 0 },
+	{ { 1, 0, 2 }, { 1, -1, 1 }, { 0, 0, 0 }, 0 }
+};
+static const float mounted_offset[3] = { 40, -25, 30 };
+
+typedef struct {
+	float noise[FUSION_SENSORS];
+	float tremor;
+	float threshold;
+	unsigned int seed;
+} Sensor_Model;
+
+typedef struct {
+	int correct;
+	int n;
+	int *latency;               /* ms, one per tilted capture */
+} Mode_Score;
+
+static float uniform(unsigned int *seed, float lo, float hi) {
+	return lo + (hi - lo) * (float) rand_r(seed) / ((float) RAND_MAX + 1);
+}
+
+static float gaussian(unsigned int *seed) {
+
+	float u = uniform(seed, 1e-7f, 1), v = uniform(seed, 0, 1);
+
+	return sqrtf(-2 * logf(u)) * cosf(6.2831853f * v);
+}
+
+/*
+ * One pair of raw reads of the true acceleration xyz [mg]
+ */
+
+static void read_pair(Sensor_Model *model, const float xyz[3],
+		int raw[FUSION_SENSORS][3]) {
+
+	float shaken[3];
+	int s, a;
+
+	for (a = 0; a < 3; a++) {
+		shaken[a] = xyz[a] + model->tremor * gaussian(&model->seed);
+	}
+	for (s = 0; s < FUSION_SENSORS; s++) {
+		for (a = 0; a < 3; a++) {
+			raw[s][mounted[s].axis[a]] = (int) lrintf(mounted[s].sign[a]
+					* (shaken[a] + (s ? mounted_offset[a] : 0)
+					+ model->noise[s] * gaussian(&model->seed)));
+		}
+	}
+}
+
+static float xy_change(const int xyz[3], const int initial[3]) {
+	return sqrtf((float) ((xyz[0] - initial[0]) * (xyz[0] - initial[0])
+			+ (xyz[1] - initial[1]) * (xyz[1] - initial[1])));
+}
+
+/*
+ * True acceleration t ms after the LED turns on: at rest, then a linear
+ * tilt from react to react + ramp ms, then held
+ */
+
+static void motion(const float rest[3], const float moved[3], float react,
+		float ramp, int t, float xyz[3]) {
+
+	float f = (t - react) / ramp;
+	int a;
+
+	f = f < 0 ? 0 : f > 1 ? 1 : f;
+	for (a = 0; a < 3; a++) {
+		xyz[a] = rest[a] + f * (moved[a] - rest[a]);
+	}
+}
+
+static int compare_int(const void *a, const void *b) {
+
+	int x = *(const int *) a, y = *(const int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int failures;
+
+static void check(int ok, const char *what) {
+	printf("%s\t%s\n", ok ? "ok" : "FAILED", what);
+	failures += !ok;
+}
+
+static int uses_reference_only(const Accel_Fusion *fusion) {
+	return fusion->n_sensors == 1 && fusion->weight[0] == 1
+			&& fusion->weight[1] == 0;
+}
+
+static void check_calibration(Sensor_Model *model, Accel_Fusion *fusion,
+		Accel_Fusion *single) {
+
+	static const float flat[3] = { 0, 0, 1000 };
+	Fusion_Calibration upside_down[FUSION_SENSORS];
+	int samples[CHECK_CALIBRATION_SAMPLES][FUSION_SENSORS][3];
+	int i, a, ok;
+	float bound;
+
+	for (i = 0; i < CHECK_CALIBRATION_SAMPLES; i++) {
+		read_pair(model, flat, samples[i]);
+	}
+
+	Fusion_Init(fusion, mounted, FUSION_SENSORS);
+	ok = Fusion_Calibrate(fusion, (const int (*)[FUSION_SENSORS][3]) samples,
+			1) == -1 && uses_reference_only(fusion);
+	check(ok, "one calibration pair falls back to the LSM6DSM");
+
+	memcpy(upside_down, mounted, sizeof(upside_down));
+	upside_down[1].sign[2] = -1;
+	Fusion_Init(fusion, upside_down, FUSION_SENSORS);
+	ok = Fusion_Calibrate(fusion, (const int (*)[FUSION_SENSORS][3]) samples,
+			CHECK_CALIBRATION_SAMPLES) == -1 && uses_reference_only(fusion);
+	check(ok, "a flipped z axis falls back to the LSM6DSM");
+
+	Fusion_Init(fusion, mounted, FUSION_SENSORS);
+	ok = Fusion_Calibrate(fusion, (const int (*)[FUSION_SENSORS][3]) samples,
+			CHECK_CALIBRATION_SAMPLES) == 0
+			&& fusion->n_sensors == FUSION_SENSORS;
+	for (a = 0; a < 3 && ok; a++) {
+		bound = 5 * sqrtf((model->noise[0] * model->noise[0]
+				+ model->noise[1] * model->noise[1])
+				/ CHECK_CALIBRATION_SAMPLES) + 1;
+		ok = fabsf(fusion->calibration[1].offset[a] - mounted_offset[a])
+				< bound;
+	}
+	check(ok, "the right map recovers the offset of the LSM303AGR");
+	check(Fusion_Variance(fusion) < fusion->calibration[0].variance
+			&& Fusion_Variance(fusion) < fusion->calibration[1].variance,
+			"the fused variance is below either sensor's");
+	printf("\tnoise %.0f, %.0f, fused %.0f mg^2\n",
+			fusion->calibration[0].variance, fusion->calibration[1].variance,
+			Fusion_Variance(fusion));
+
+	Fusion_Init(single, mounted, 1);
+	ok = Fusion_Calibrate(single, (const int (*)[FUSION_SENSORS][3]) samples,
+			CHECK_CALIBRATION_SAMPLES) == 0 && uses_reference_only(single)
+			&& Fusion_Variance(single) == fusion->calibration[0].variance;
+	check(ok, "the LSM6DSM alone measures its own noise");
+}
+
+/*
+ * One State 1 capture decided by mode. Returns the dwell in ms and sets
+ * *tilted to the decision.
+ */
+
+static int capture(Sensor_Model *model, const Accel_Fusion *fused,
+		const Accel_Fusion *single, int mode, const float rest[3],
+		const float moved[3], float react, float ramp, int *tilted) {
+
+	static const uint8_t valid[FUSION_SENSORS] = { 1, 1 };
+	const Accel_Fusion *fusion = mode == MODE_FUSED ? fused : single;
+	Fusion_Dwell dwell;
+	int raw[FUSION_SENSORS][3], initial[3], xyz[3];
+	float truth[3];
+	int t = 0;
+
+	read_pair(model, rest, raw);
+	Fusion_Combine(fusion, (const int (*)[3]) raw, valid, initial);
+
+	if (mode == MODE_FIXED) {
+		t = FUSION_MAX_DWELL_MS;
+		motion(rest, moved, react, ramp, t, truth);
+		read_pair(model, truth, raw);
+		Fusion_Combine(fusion, (const int (*)[3]) raw, valid, xyz);
+	} else {
+		Fusion_Dwell_Start(&dwell, model->threshold, FUSION_DWELL_CONFIDENCE,
+				FUSION_DWELL_SETTLED_MG, Fusion_Variance(fusion));
+		do {
+			t += DATA_PERIOD_MS;
+			motion(rest, moved, react, ramp, t, truth);
+			read_pair(model, truth, raw);
+			Fusion_Combine(fusion, (const int (*)[3]) raw, valid, xyz);
+		} while (!Fusion_Dwell_Add(&dwell, xy_change(xyz, initial))
+				&& t < FUSION_MAX_DWELL_MS);
+	}
+	*tilted = xy_change(xyz, initial) > model->threshold;
+	return t;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--trials=N] [--noise=A,B] [--tremor=T]"
+			" [--threshold=T] [--tolerance=P] [--seed=S]\n", argv0);
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+
+	Sensor_Model model = { { 10, 15 }, 5, 300, 1 };
+	Accel_Fusion fused, single;
+	Fusion_Dwell dwell;
+	Mode_Score score[CHECK_MODES];
+	float rest[3], moved[3], react, ramp, change, angle, tolerance = 1;
+	float accuracy[CHECK_MODES];
+	int median[CHECK_MODES];
+	int trials = 2000, i, m, tilt, tilted, latency, longest;
+	const char *v;
+	char *end;
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--trials")) != NULL) {
+			trials = atoi(v);
+		} else if ((v = option_value(argv[i], "--noise")) != NULL) {
+			model.noise[0] = strtof(v, &end);
+			if (*end != ',') {
+				usage(argv[0]);
+				return 2;
+			}
+			model.noise[1] = strtof(end + 1, NULL);
+		} else if ((v = option_value(argv[i], "--tremor")) != NULL) {
+			model.tremor = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--threshold")) != NULL) {
+			model.threshold = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--tolerance")) != NULL) {
+			tolerance = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			model.seed = (unsigned int) strtoul(v, NULL, 10);
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (trials < 2 || model.noise[0] < 0 || model.noise[1] < 0
+			|| model.tremor < 0 || model.threshold <= 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	check_calibration(&model, &fused, &single);
+
+	for (m = 0; m < CHECK_MODES; m++) {
+		score[m].correct = 0;
+		score[m].n = 0;
+		score[m].latency = malloc(sizeof(int) * trials);
+		if (score[m].latency == NULL) {
+			fprintf(stderr, "fusionCheck: out of memory\n");
+			return 1;
+		}
+	}
+
+	/*
+	 * Every mode sees the same motion, with its own sensor noise
+	 */
+
+	longest = 0;
+	for (i = 0; i < trials; i++) {
+		tilt = i % 2 == 0;
+		rest[0] = uniform(&model.seed, -100, 100);
+		rest[1] = uniform(&model.seed, -100, 100);
+		angle = uniform(&model.seed, 0, 6.2831853f);
+		change = tilt ? uniform(&model.seed, 1.2f, 2.5f) * model.threshold
+				: uniform(&model.seed, 0, 0.6f) * model.threshold;
+		moved[0] = rest[0] + change * cosf(angle);
+		moved[1] = rest[1] + change * sinf(angle);
+		rest[2] = sqrtf(1e6f - rest[0] * rest[0] - rest[1] * rest[1]);
+		moved[2] = sqrtf(fmaxf(0, 1e6f - moved[0] * moved[0]
+				- moved[1] * moved[1]));
+		react = uniform(&model.seed, 200, 600);
+		ramp = uniform(&model.seed, 300, 800);
+
+		for (m = 0; m < CHECK_MODES; m++) {
+			latency = capture(&model, &fused, &single, m, rest, moved, react,
+					ramp, &tilted);
+			score[m].correct += tilted == tilt;
+			if (tilt) {
+				score[m].latency[score[m].n++] = latency;
+			}
+			if (m != MODE_FIXED && latency > longest) {
+				longest = latency;
+			}
+		}
+	}
+
+	printf("\n%d captures, noise %.0f, %.0f mg, tremor %.0f mg, threshold"
+			" %.0f mg\n\n", trials, model.noise[0], model.noise[1],
+			model.tremor, model.threshold);
+	printf("Mode\t\t\tWindow\tRight\t\tTilt dwell ms: median\tp90\tmax\n");
+	for (m = 0; m < CHECK_MODES; m++) {
+		qsort(score[m].latency, score[m].n, sizeof(int), compare_int);
+		accuracy[m] = 100.0f * score[m].correct / trials;
+		median[m] = score[m].latency[score[m].n / 2];
+		if (m == MODE_FIXED) {
+			printf("%-20s\t-", mode_names[m]);
+		} else {
+			Fusion_Dwell_Start(&dwell, model.threshold,
+					FUSION_DWELL_CONFIDENCE, FUSION_DWELL_SETTLED_MG,
+					Fusion_Variance(m == MODE_FUSED ? &fused : &single));
+			printf("%-20s\t%d", mode_names[m], dwell.window);
+		}
+		printf("\t%.2f%%\t\t%d\t\t\t%d\t%d\n", accuracy[m], median[m],
+				score[m].latency[score[m].n * 9 / 10],
+				score[m].latency[score[m].n - 1]);
+	}
+	printf("\n");
+
+	check(longest <= FUSION_MAX_DWELL_MS,
+			"no dwell runs past FUSION_MAX_DWELL_MS");
+	check(median[MODE_SINGLE] < FUSION_MAX_DWELL_MS,
+			"the LSM6DSM dwell is shorter than the fixed wait");
+	check(median[MODE_FUSED] < median[MODE_SINGLE],
+			"the fused dwell is shorter than the LSM6DSM dwell");
+	check(accuracy[MODE_FUSED] >= accuracy[MODE_FIXED] - tolerance,
+			"the fused dwell decides as well as the fixed wait");
+
+	for (m = 0; m < CHECK_MODES; m++) {
+		free(score[m].latency);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,376 @@
+/**
+ ******************************************************************************
+ * @file    gameLoad.c
+ * @brief   Load generator for gameServer
+ ******************************************************************************
+ *
+ * Opens many simulated devices against gameServer and plays random
+ * gestures on all of them, measuring the time from sending a
+ * classification event to receiving the end of its reply. The sessions
+ * are spread over threads, each with its own epoll loop.
+ *
+ * Each device sends its next event as soon as the previous one is
+ * answered, or, with --interval, every interval milliseconds as a real
+ * SensorTile would (a round takes several seconds there). A finished
+ * game is followed by "new". Replies are requested in quiet mode unless
+ * --verbose is given.
+ *
+ * Usage:
+ *   gameLoad [options]
+ *     --socket=PATH      server socket (default /tmp/gameServer.sock)
+ *     --sessions=N       simulated devices (default 1000)
+ *     --events=E         events per device (default 100)
+ *     --interval=MS      time between events of one device (default 0)
+ *     --threads=N        client threads (default: online CPUs)
+ *     --seed=S           gesture seed
+ *     --verbose          ask for the full game text
+ *
+ * Latency percentiles are over every event of every device.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "threadPool.h"
+
+#define LOAD_BUCKETS 100000     /* latency histogram, 1 us each */
+#define LOAD_MAX_EVENTS 256
+
+typedef struct {
+	int fd;
+	int sent;                   /* events sent */
+	int waiting;                /* replies outstanding */
+	int game_over;
+	double sent_ms;
+	double next_ms;             /* when the next event is due */
+	char reply[16];             /* start of the current status line */
+	int reply_len;
+	int in_status;
+} Device;
+
+typedef struct {
+	int index;
+	int n_devices;
+	Device *devices;
+	unsigned int seed;
+	long replies;
+	long errors;
+	double max_us;
+	unsigned int *histogram;
+} Load_Thread;
+
+static const char *socket_path = "/tmp/gameServer.sock";
+static int events_per_device = 100;
+static double interval_ms = 0;
+static int verbose = 0;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static int device_connect(void) {
+
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+	if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+static int device_send(Load_Thread *thread, Device *d) {
+
+	char line[32];
+	int n;
+
+	if (d->game_over) {
+		n = snprintf(line, sizeof(line), "new\n");
+		d->game_over = 0;
+	} else {
+		n = snprintf(line, sizeof(line), "%d\n",
+				(int) (rand_r(&thread->seed) % 7) - 1);
+	}
+	d->sent_ms = now_ms();
+	d->sent++;
+	d->waiting++;
+	return write(d->fd, line, n) == n ? 0 : -1;
+}
+
+/*
+ * Scan reply bytes for the status lines that end each reply
+ */
+
+static void device_receive(Load_Thread *thread, Device *d, const char *buf,
+		int n) {
+
+	double us;
+	int i, status, round;
+
+	for (i = 0; i < n; i++) {
+		if (buf[i] == '@') {
+			d->in_status = 1;
+			d->reply_len = 0;
+		} else if (d->in_status && buf[i] == '\n') {
+			d->reply[d->reply_len] = '\0';
+			d->in_status = 0;
+			d->waiting--;
+			if (sscanf(d->reply, "%d %d", &status, &round) == 2 && status != 0) {
+				d->game_over = 1;
+			}
+			if (d->sent > 0 && d->waiting == 0) {
+				us = (now_ms() - d->sent_ms) * 1e3;
+				thread->histogram[us < LOAD_BUCKETS ? (int) us : LOAD_BUCKETS - 1]++;
+				if (us > thread->max_us) {
+					thread->max_us = us;
+				}
+				thread->replies++;
+				d->next_ms = d->sent_ms + interval_ms;
+			}
+		} else if (d->in_status && d->reply_len < (int) sizeof(d->reply) - 1) {
+			d->reply[d->reply_len++] = buf[i];
+		}
+	}
+}
+
+static void *load_thread(void *arg) {
+
+	Load_Thread *thread = arg;
+	struct epoll_event ev, events[LOAD_MAX_EVENTS];
+	char buf[4096];
+	Device *d;
+	double t, wait_ms;
+	int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	int i, n, active = 0;
+	ssize_t got;
+
+	for (i = 0; i < thread->n_devices; i++) {
+		d = &thread->devices[i];
+		d->fd = device_connect();
+		if (d->fd < 0) {
+			thread->errors++;
+			continue;
+		}
+		if (!verbose) {
+			write(d->fd, "quiet\n", 6);
+			d->waiting++;
+		}
+
+		/*
+		 * Spread the first events over one interval so the devices do
+		 * not all fire at once
+		 */
+
+		d->next_ms = now_ms() + interval_ms * i / thread->n_devices;
+		ev.events = EPOLLIN;
+		ev.data.ptr = d;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, d->fd, &ev);
+		active++;
+	}
+
+	while (active > 0) {
+
+		/*
+		 * Send every event that is due and find the next deadline
+		 */
+
+		t = now_ms();
+		wait_ms = 1000;
+		for (i = 0; i < thread->n_devices; i++) {
+			d = &thread->devices[i];
+			if (d->fd < 0 || d->waiting > 0) {
+				continue;
+			}
+			if (d->sent == events_per_device) {
+				close(d->fd);
+				d->fd = -1;
+				active--;
+				continue;
+			}
+			if (d->next_ms <= t) {
+				if (device_send(thread, d) != 0) {
+					thread->errors++;
+				}
+			} else if (d->next_ms - t < wait_ms) {
+				wait_ms = d->next_ms - t;
+			}
+		}
+		if (active == 0) {
+			break;
+		}
+
+		n = epoll_wait(epoll_fd, events, LOAD_MAX_EVENTS, (int) wait_ms);
+		for (i = 0; i < n; i++) {
+			d = events[i].data.ptr;
+			got = read(d->fd, buf, sizeof(buf));
+			if (got > 0) {
+				device_receive(thread, d, buf, (int) got);
+			} else if (got == 0 || errno != EINTR) {
+				thread->errors++;
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, d->fd, NULL);
+				close(d->fd);
+				d->fd = -1;
+				active--;
+			}
+		}
+	}
+	close(epoll_fd);
+	return NULL;
+}
+
+static double percentile(const unsigned int *histogram, long total, double p) {
+
+	long target = (long) (p * total), seen = 0;
+	int i;
+
+	for (i = 0; i < LOAD_BUCKETS; i++) {
+		seen += histogram[i];
+		if (seen > target) {
+			return i;
+		}
+	}
+	return LOAD_BUCKETS;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--socket=PATH] [--sessions=N] [--events=E]"
+			" [--interval=MS] [--threads=N] [--seed=S] [--verbose]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	struct rlimit limit;
+	Load_Thread *threads;
+	pthread_t *ids;
+	Device *devices;
+	unsigned int *histogram;
+	int sessions = 1000, n_threads = 0;
+	unsigned int seed = 1;
+	long replies = 0, errors = 0;
+	double max_us = 0, start, wall_ms;
+	const char *v;
+	int i, j, first;
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--socket")) != NULL) {
+			socket_path = v;
+		} else if ((v = option_value(argv[i], "--sessions")) != NULL) {
+			sessions = atoi(v);
+		} else if ((v = option_value(argv[i], "--events")) != NULL) {
+			events_per_device = atoi(v);
+		} else if ((v = option_value(argv[i], "--interval")) != NULL) {
+			interval_ms = atof(v);
+		} else if ((v = option_value(argv[i], "--threads")) != NULL) {
+			n_threads = atoi(v);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			seed = (unsigned int) strtoul(v, NULL, 10);
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			verbose = 1;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (n_threads <= 0) {
+		n_threads = Thread_Pool_Online_CPUs();
+	}
+	if (sessions < 1 || events_per_device < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (n_threads > sessions) {
+		n_threads = sessions;
+	}
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	threads = calloc(n_threads, sizeof(Load_Thread));
+	ids = calloc(n_threads, sizeof(pthread_t));
+	devices = calloc(sessions, sizeof(Device));
+	histogram = calloc((size_t) n_threads * LOAD_BUCKETS, sizeof(unsigned int));
+	if (threads == NULL || ids == NULL || devices == NULL || histogram == NULL) {
+		fprintf(stderr, "gameLoad: out of memory\n");
+		return 1;
+	}
+
+	start = now_ms();
+	for (i = 0, first = 0; i < n_threads; i++) {
+		Load_Thread *thread = &threads[i];
+		thread->index = i;
+		thread->n_devices = sessions / n_threads + (i < sessions % n_threads);
+		thread->devices = devices + first;
+		thread->seed = seed + 7919u * (i + 1);
+		thread->histogram = histogram + (size_t) i * LOAD_BUCKETS;
+		first += thread->n_devices;
+		pthread_create(&ids[i], NULL, load_thread, thread);
+	}
+	for (i = 0; i < n_threads; i++) {
+		pthread_join(ids[i], NULL);
+		replies += threads[i].replies;
+		errors += threads[i].errors;
+		if (threads[i].max_us > max_us) {
+			max_us = threads[i].max_us;
+		}
+		if (i > 0) {
+			for (j = 0; j < LOAD_BUCKETS; j++) {
+				histogram[j] += threads[i].histogram[j];
+			}
+		}
+	}
+	wall_ms = now_ms() - start;
+
+	printf("%d sessions on %d threads, %d events each", sessions, n_threads,
+			events_per_device);
+	if (interval_ms > 0) {
+		printf(" every %.0f ms", interval_ms);
+	}
+	printf("\n%ld events in %.1f ms, %.0f events/s, %ld errors\n", replies,
+			wall_ms, replies / (wall_ms / 1e3), errors);
+	if (replies > 0) {
+		printf("Latency us: p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %.0f\n",
+				percentile(histogram, replies, 0.5),
+				percentile(histogram, replies, 0.9),
+				percentile(histogram, replies, 0.99),
+				percentile(histogram, replies, 0.999), max_us);
+	}
+
+	free(histogram);
+	free(devices);
+	free(ids);
+	free(threads);
+	return errors > 0;
+}
@@ -0,0 +1,571 @@
+/**
+ ******************************************************************************
+ * @file    gameServer.c
+ * @brief   Multi-session game server for simulated or real devices
+ ******************************************************************************
+ *
+ * Runs one independent game (gameCore.h) per connection. Devices, or
+ * gameLoad, connect over a Unix domain socket or one of the pseudo
+ * terminals opened with --pty and send one classification event per
+ * line; the server plays the round and answers with the text the
+ * SensorTile would print.
+ *
+ * One thread waits on epoll for every connection. Connections are
+ * registered EPOLLONESHOT, so a ready connection is handed to exactly one
+ * worker of the pool, which reads and answers all complete lines and then
+ * re-arms it. A session is therefore only ever touched by one thread at a
+ * time and needs no lock.
+ *
+ * Protocol, one command per line:
+ *   N          gesture class N (-1 = not classified), plays one round
+ *   new [X Y]  start a new game, hidden location X Y or random
+ *   target X Y move the hidden location during the game
+ *   quiet      leave out the game text, send status lines only
+ *   verbose    send the game text again (default)
+ * Every command is answered by the game text, if any, followed by a status
+ * line "@ STATUS ROUND CUR_X CUR_Y ORIENTATION". '@' appears nowhere else.
+ *
+ * Usage:
+ *   gameServer [options]
+ *     --socket=PATH      Unix socket to listen on (default /tmp/gameServer.sock)
+ *     --pty=N            also open N pseudo terminals, one session each
+ *     --threads=N        worker threads (default: online CPUs)
+ *     --seed=S           seed of the hidden locations
+ *     --map=WxH          play on a W x H map (gameMap.h), start and hidden
+ *                        location at random open cells
+ *     --obstacles=F      share of blocked map cells (default 0.2)
+ *     --stats            print sessions, events/s and CPU use every second
+ *
+ * Stop with Ctrl-C; the totals and events per CPU second are printed on
+ * exit. Run with --threads=1 to measure sessions per core.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gameCore.h"
+#include "gameMap.h"
+#include "threadPool.h"
+
+#define SERVER_LINE 128         /* longest command line */
+#define SERVER_OUT 4096         /* unsent reply bytes per session */
+#define SERVER_REPLY 512        /* room kept for one reply */
+#define SERVER_READS 16         /* reads per turn, so one client can not hog a worker */
+#define SERVER_MAX_EVENTS 256
+
+typedef struct {
+	int fd;
+	int pty;                    /* pseudo terminal, never closed */
+	int quiet;
+	unsigned int seed;
+	Game_State game;
+	Game_Field *field;          /* with --map */
+	char in[SERVER_LINE];
+	int in_len;
+	char out[SERVER_OUT];
+	int out_len;
+	int out_sent;
+} Session;
+
+typedef struct {
+	int epoll_fd;
+	unsigned int seed;
+	Game_Map *map;              /* shared by every session, or NULL */
+	long sessions;              /* open sessions */
+	long opened;                /* sessions ever opened, also seeds them */
+	long events;                /* commands answered */
+} Server;
+
+static Server server;
+static volatile sig_atomic_t stopping;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static double cpu_ms(void) {
+
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3
+			+ usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+}
+
+static void on_signal(int signal_number) {
+	(void) signal_number;
+	stopping = 1;
+}
+
+/*
+ * On a map, draw cells until the hidden location can be reached
+ */
+
+static int new_game(Session *s, int x_loc, int y_loc, int random) {
+
+	Game_Map *map = server.map;
+	int tries;
+
+	if (map == NULL) {
+		if (random) {
+			x_loc = rand_r(&s->seed) % GAME_TARGET_RANGE + 1;
+			y_loc = rand_r(&s->seed) % GAME_TARGET_RANGE + 1;
+		}
+		Game_Start(&s->game, x_loc, y_loc);
+		return 0;
+	}
+
+	for (tries = 0; tries < 100; tries++) {
+		if (random) {
+			x_loc = rand_r(&s->seed) % map->width;
+			y_loc = rand_r(&s->seed) % map->height;
+		}
+		if (Game_Start_Map(&s->game, s->field, rand_r(&s->seed) % map->width,
+				rand_r(&s->seed) % map->height, x_loc, y_loc) == 0) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static Session *session_create(int fd, int pty) {
+
+	Session *s = calloc(1, sizeof(Session));
+
+	if (s == NULL) {
+		return NULL;
+	}
+	s->fd = fd;
+	s->pty = pty;
+	s->seed = server.seed + 7919u * (unsigned int) __atomic_add_fetch(
+			&server.opened, 1, __ATOMIC_RELAXED);
+	if (server.map != NULL) {
+		s->field = Game_Field_Create(server.map);
+	}
+	if ((server.map != NULL && s->field == NULL) || new_game(s, 0, 0, 1) != 0) {
+		if (s->field != NULL) {
+			Game_Field_Destroy(s->field);
+		}
+		free(s);
+		return NULL;
+	}
+	__atomic_add_fetch(&server.sessions, 1, __ATOMIC_RELAXED);
+	return s;
+}
+
+static void session_close(Session *s) {
+	epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+	close(s->fd);
+	__atomic_sub_fetch(&server.sessions, 1, __ATOMIC_RELAXED);
+	if (s->field != NULL) {
+		Game_Field_Destroy(s->field);
+	}
+	free(s);
+}
+
+static int session_arm(Session *s, int op) {
+
+	struct epoll_event ev;
+
+	ev.events = (s->out_sent < s->out_len ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+	ev.data.ptr = s;
+	return epoll_ctl(server.epoll_fd, op, s->fd, &ev);
+}
+
+/*
+ * Answer one command line into the output buffer
+ */
+
+static void session_command(Session *s, char *line) {
+
+	char *out = s->out + s->out_len;
+	int size = SERVER_OUT - s->out_len;
+	int n = 0, x = 0, y = 0, loc, random;
+	char *end;
+
+	if (strncmp(line, "new", 3) == 0) {
+		random = sscanf(line + 3, "%d %d", &x, &y) != 2;
+		if (new_game(s, x, y, random) != 0) {
+			n = snprintf(out, size, "\n\rThat location can not be reached");
+		}
+	} else if (strncmp(line, "target", 6) == 0) {
+		if (sscanf(line + 6, "%d %d", &x, &y) != 2
+				|| Game_Set_Target(&s->game, x, y) != 0) {
+			n = snprintf(out, size, "\n\rThat location is blocked");
+		}
+	} else if (strcmp(line, "quiet") == 0) {
+		s->quiet = 1;
+	} else if (strcmp(line, "verbose") == 0) {
+		s->quiet = 0;
+	} else {
+		loc = (int) strtol(line, &end, 10);
+		if (end == line) {
+			n = snprintf(out, size, "\n\rUnknown command");
+		} else {
+			Game_Step(&s->game, loc, out, s->quiet ? 0 : size);
+			n = s->quiet ? 0 : (int) strlen(out);
+		}
+	}
+
+	n += snprintf(out + n, size - n, "\n@ %d %d %d %d %c\n", s->game.status,
+			s->game.round, s->game.cur_x, s->game.cur_y,
+			Game_Orientation[s->game.cur_orientation]);
+	s->out_len += n < size ? n : size - 1;
+	__atomic_add_fetch(&server.events, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Answer every complete line in the input buffer while there is room for
+ * the reply. Returns the number of commands answered.
+ */
+
+static int session_parse(Session *s) {
+
+	int start = 0, i, answered = 0;
+
+	for (i = 0; i < s->in_len; i++) {
+		if (s->in[i] != '\n' && s->in[i] != '\r') {
+			continue;
+		}
+		if (SERVER_OUT - s->out_len < SERVER_REPLY) {
+			break;
+		}
+		s->in[i] = '\0';
+		if (i > start) {
+			session_command(s, s->in + start);
+			answered++;
+		}
+		start = i + 1;
+	}
+
+	/*
+	 * A line longer than the buffer can not be a command, drop it
+	 */
+
+	if (start == 0 && s->in_len == SERVER_LINE) {
+		s->in_len = 0;
+	} else if (start > 0) {
+		memmove(s->in, s->in + start, s->in_len - start);
+		s->in_len -= start;
+	}
+	return answered;
+}
+
+/*
+ * Returns 0 when everything was sent, 1 when the socket is full, -1 on error
+ */
+
+static int session_flush(Session *s) {
+
+	ssize_t n;
+
+	while (s->out_sent < s->out_len) {
+		n = write(s->fd, s->out + s->out_sent, s->out_len - s->out_sent);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+		}
+		s->out_sent += (int) n;
+	}
+	s->out_len = 0;
+	s->out_sent = 0;
+	return 0;
+}
+
+/*
+ * Worker job: one turn of a ready session
+ */
+
+static void session_serve(void *arg) {
+
+	Session *s = arg;
+	ssize_t n;
+	int reads = 0, flushed;
+
+	for (;;) {
+		flushed = session_flush(s);
+		if (flushed < 0) {
+			goto hang_up;
+		}
+		if (flushed > 0) {
+			break;
+		}
+		if (session_parse(s) > 0) {
+			continue;
+		}
+		if (reads++ == SERVER_READS) {
+			break;
+		}
+
+		n = read(s->fd, s->in + s->in_len, SERVER_LINE - s->in_len);
+		if (n > 0) {
+			s->in_len += (int) n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else if (!s->pty) {
+			goto hang_up;
+		} else {
+			break;
+		}
+	}
+
+	if (session_arm(s, EPOLL_CTL_MOD) == 0) {
+		return;
+	}
+
+hang_up:
+	session_close(s);
+}
+
+static void accept_sessions(int listen_fd) {
+
+	static int warned;
+	Session *s;
+	int fd;
+
+	for (;;) {
+		fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if ((errno == EMFILE || errno == ENFILE) && !warned) {
+				fprintf(stderr, "gameServer: out of file descriptors at %ld"
+						" sessions\n", server.sessions);
+				warned = 1;
+			}
+			return;
+		}
+		s = session_create(fd, 0);
+		if (s == NULL) {
+			close(fd);
+		} else if (session_arm(s, EPOLL_CTL_ADD) != 0) {
+			session_close(s);
+		}
+	}
+}
+
+/*
+ * Pseudo terminal in raw mode, so a device bridged onto the slave side
+ * sees its own bytes only. The slave stays open here so that the master
+ * does not read end of file when the device goes away.
+ */
+
+static int open_pty(void) {
+
+	struct termios raw;
+	int master, slave;
+	Session *s;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		return -1;
+	}
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (slave < 0 || tcgetattr(slave, &raw) != 0) {
+		close(master);
+		return -1;
+	}
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+
+	s = session_create(master, 1);
+	if (s == NULL) {
+		close(master);
+		return -1;
+	}
+	if (session_arm(s, EPOLL_CTL_ADD) != 0) {
+		session_close(s);
+		return -1;
+	}
+	printf("Session on %s\n", ptsname(master));
+	return 0;
+}
+
+static int open_socket(const char *path) {
+
+	struct sockaddr_un addr;
+	struct epoll_event ev;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "gameServer: socket path too long\n");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+			|| listen(fd, SOMAXCONN) != 0) {
+		perror("gameServer");
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	return fd;
+}
+
+/*
+ * Thousands of sessions need more than the usual 1024 descriptors
+ */
+
+static void raise_file_limit(void) {
+
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--socket=PATH] [--pty=N] [--threads=N]"
+			" [--seed=S] [--map=WxH] [--obstacles=F] [--stats]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	const char *path = "/tmp/gameServer.sock", *v;
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	struct sigaction action;
+	Thread_Pool *pool;
+	int threads = 0, ptys = 0, stats = 0;
+	int map_width = 0, map_height = 0;
+	float obstacles = 0.2;
+	int listen_fd, i, n;
+	long events_prev = 0, events_now;
+	double start, start_cpu, tick, tick_cpu, t, c;
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--socket")) != NULL) {
+			path = v;
+		} else if ((v = option_value(argv[i], "--pty")) != NULL) {
+			ptys = atoi(v);
+		} else if ((v = option_value(argv[i], "--threads")) != NULL) {
+			threads = atoi(v);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			server.seed = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--map")) != NULL) {
+			if (sscanf(v, "%dx%d", &map_width, &map_height) != 2) {
+				usage(argv[0]);
+				return 2;
+			}
+		} else if ((v = option_value(argv[i], "--obstacles")) != NULL) {
+			obstacles = (float) atof(v);
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			stats = 1;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	raise_file_limit();
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (map_width > 0) {
+		server.map = Game_Map_Create(map_width, map_height);
+		if (server.map == NULL) {
+			fprintf(stderr, "gameServer: maps are at most %d x %d\n",
+					GAME_MAP_MAX_SIZE, GAME_MAP_MAX_SIZE);
+			return 1;
+		}
+		Game_Map_Random(server.map, obstacles, server.seed);
+	}
+
+	server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	pool = Thread_Pool_Create(threads);
+	if (server.epoll_fd < 0 || pool == NULL) {
+		fprintf(stderr, "gameServer: cannot create the event loop\n");
+		return 1;
+	}
+	listen_fd = open_socket(path);
+	if (listen_fd < 0) {
+		return 1;
+	}
+	for (i = 0; i < ptys; i++) {
+		if (open_pty() != 0) {
+			fprintf(stderr, "gameServer: cannot open a pseudo terminal\n");
+			return 1;
+		}
+	}
+	printf("Listening on %s with %d worker threads\n", path,
+			Thread_Pool_Size(pool));
+	fflush(stdout);
+
+	start = tick = now_ms();
+	start_cpu = tick_cpu = cpu_ms();
+	while (!stopping) {
+		n = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, 1000);
+		for (i = 0; i < n; i++) {
+			if (events[i].data.ptr == NULL) {
+				accept_sessions(listen_fd);
+			} else {
+				Thread_Pool_Submit(pool, session_serve, events[i].data.ptr);
+			}
+		}
+
+		t = now_ms();
+		if (stats && t - tick >= 1000) {
+			c = cpu_ms();
+			events_now = __atomic_load_n(&server.events, __ATOMIC_RELAXED);
+			printf("%ld sessions\t%.0f events/s\t%.2f cores\n",
+					__atomic_load_n(&server.sessions, __ATOMIC_RELAXED),
+					(events_now - events_prev) / ((t - tick) / 1e3),
+					(c - tick_cpu) / (t - tick));
+			fflush(stdout);
+			events_prev = events_now;
+			tick = t;
+			tick_cpu = c;
+		}
+	}
+
+	Thread_Pool_Wait(pool);
+	t = now_ms() - start;
+	c = cpu_ms() - start_cpu;
+	printf("\n%ld sessions served, %ld events in %.1f s, %.0f events per CPU"
+			" second\n", server.opened, server.events, t / 1e3,
+			c > 0 ? server.events / (c / 1e3) : 0);
+	Thread_Pool_Destroy(pool);
+	close(listen_fd);
+	unlink(path);
+	return 0;
+}
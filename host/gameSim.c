@@ -0,0 +1,606 @@
+/**
+ ******************************************************************************
+ * @file    gameSim.c
+ * @brief   Monte Carlo simulation of the game under classifier errors
+ ******************************************************************************
+ *
+ * Plays many games of gameCore.c with a simulated player whose gestures
+ * are misclassified as often as a measured confusion matrix says, for
+ * every combination of round count (GAME_ROUNDS), target range
+ * (rand() % GAME_TARGET_RANGE + 1) and start position given, and reports
+ * the win rate and the distribution of the round games are won on.
+ *
+ * The player reads what the SensorTile prints: the action that was taken,
+ * its position and heading, hotter or colder, and the distance after a
+ * check. The search player keeps every target cell those answers still
+ * allow, checks the distance whenever it has moved and more than one is
+ * left (checks do not use up a round), and heads for the nearest one.
+ * The oracle player knows the target, which isolates the cost of the
+ * classification errors.
+ *
+ * Usage:
+ *   gameSim [options]
+ *     --confusion=FILE   confusion matrix CSV written by crossval
+ *     --accuracy=A       instead, classify right with probability A and
+ *                        spread the errors evenly (default 1)
+ *     --rounds=15,20     round counts to try (default 15)
+ *     --range=5,7        target ranges to try (default 5)
+ *     --start=3:3,1:1    start positions to try (default 3:3)
+ *     --player=search    search, or oracle
+ *     --games=N          games per configuration (default 1000000)
+ *     --threads=N        worker threads (default: online CPUs)
+ *     --seed=S           game seed
+ *     --histogram        print the share of games ending on every round
+ *
+ * Games are played in chunks with a random state seeded from the chunk
+ * index, so the results do not depend on the number of threads. A game
+ * still going after SIM_GESTURE_LIMIT gestures per round, which only
+ * happens when moves are almost never recognized, counts as stalled.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gameCore.h"
+#include "threadPool.h"
+
+#define SIM_CLASSES (GAME_ROUND + 1)
+#define SIM_OUTCOMES (SIM_CLASSES + 1)  /* last = no class */
+#define SIM_MAX_VALUES 16
+#define SIM_MAX_RANGE 64
+#define SIM_CHUNK 4096                  /* games per chunk */
+#define SIM_GESTURE_LIMIT 8
+
+#define PLAYER_SEARCH 0
+#define PLAYER_ORACLE 1
+
+/*
+ * Running sums of every row of the confusion matrix, for sampling
+ */
+
+typedef struct {
+	unsigned int cumulative[SIM_CLASSES][SIM_OUTCOMES];
+} Error_Model;
+
+typedef struct {
+	int rounds;
+	int range;
+	int start_x;
+	int start_y;
+} Sim_Config;
+
+typedef struct {
+	long won;
+	long stalled;
+	long gestures;
+	long *ended;            /* games ending on each round, lost ones last */
+} Chunk_Result;
+
+typedef struct {
+	const Error_Model *model;
+	const Sim_Config *config;
+	int player;
+	int games;
+	unsigned int seed;
+	Chunk_Result *chunks;
+} Sim_Job;
+
+/*
+ * What the player still considers, in target coordinates 1 .. range
+ */
+
+typedef struct {
+	unsigned char possible[SIM_MAX_RANGE][SIM_MAX_RANGE];
+	int range;
+	int n_possible;
+	int checked;            /* distance known at the current position */
+} Player;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/*
+ * Game_Distance on the open grid
+ */
+
+static int distance(int x0, int y0, int x1, int y1) {
+	return (int) sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+}
+
+static int sign(int v) {
+	return (v > 0) - (v < 0);
+}
+
+static void player_start(Player *p, const Game_State *game, int range,
+		int oracle) {
+
+	int x, y;
+
+	p->range = range;
+	p->checked = 0;
+	for (x = 0; x < range; x++) {
+		for (y = 0; y < range; y++) {
+			p->possible[x][y] = !oracle
+					|| (x + 1 == game->x_loc && y + 1 == game->y_loc);
+		}
+	}
+	p->n_possible = oracle ? 1 : range * range;
+}
+
+/*
+ * Keep the cells that give the answer the game printed after moving from
+ * (x0, y0). check is the distance printed, or -1 after a move, when
+ * change is the hotter / colder direction.
+ */
+
+static void player_learn(Player *p, const Game_State *game, int x0, int y0,
+		int check, int change) {
+
+	int x, y, d;
+
+	p->n_possible = 0;
+	for (x = 0; x < p->range; x++) {
+		for (y = 0; y < p->range; y++) {
+			if (!p->possible[x][y]) {
+				continue;
+			}
+			d = distance(game->cur_x, game->cur_y, x + 1, y + 1);
+			if ((check >= 0 && d != check)
+					|| (check < 0
+							&& sign(d - distance(x0, y0, x + 1, y + 1)) != change)
+					|| (x + 1 == game->cur_x && y + 1 == game->cur_y)) {
+				p->possible[x][y] = 0;
+			} else {
+				p->n_possible++;
+			}
+		}
+	}
+	if (game->cur_x != x0 || game->cur_y != y0) {
+		p->checked = 0;
+	}
+	if (check >= 0) {
+		p->checked = 1;
+	}
+}
+
+/*
+ * Gesture that gets closer to the nearest cell left: forwards or
+ * backwards along the heading if that axis still needs steps, otherwise
+ * a turn onto the other axis
+ */
+
+static int player_choose(const Player *p, const Game_State *game) {
+
+	int x, y, d, dx = 0, dy = 0, best = -1;
+	int heading = Game_Orientation[game->cur_orientation];
+
+	if (p->n_possible > 1 && !p->checked) {
+		return GAME_CHECK;
+	}
+	for (x = 0; x < p->range; x++) {
+		for (y = 0; y < p->range; y++) {
+			d = abs(x + 1 - game->cur_x) + abs(y + 1 - game->cur_y);
+			if (p->possible[x][y] && (best < 0 || d < best)) {
+				best = d;
+				dx = x + 1 - game->cur_x;
+				dy = y + 1 - game->cur_y;
+			}
+		}
+	}
+
+	if ((heading == 'N' || heading == 'S') && dy != 0) {
+		return (heading == 'N') == (dy > 0) ? GAME_FORWARD : GAME_BACK;
+	}
+	if ((heading == 'E' || heading == 'W') && dx != 0) {
+		return (heading == 'E') == (dx > 0) ? GAME_FORWARD : GAME_BACK;
+	}
+	return GAME_RIGHT;
+}
+
+static int classify(const Error_Model *model, int intent, unsigned int *seed) {
+
+	const unsigned int *row = model->cumulative[intent];
+	unsigned int r = (unsigned int) rand_r(seed) % row[SIM_OUTCOMES - 1];
+	int loc = 0;
+
+	while (r >= row[loc]) {
+		loc++;
+	}
+	return loc == SIM_CLASSES ? -1 : loc;
+}
+
+/*
+ * Play one game, returning the index into Chunk_Result.ended, or -1 if it
+ * stalled
+ */
+
+static int play(const Sim_Job *job, unsigned int *seed, long *gestures) {
+
+	const Sim_Config *config = job->config;
+	Game_State game;
+	Player player;
+	int x0, y0, before, loc, limit, g;
+
+	Game_Start(&game, rand_r(seed) % config->range + 1,
+			rand_r(seed) % config->range + 1);
+	game.cur_x = config->start_x;
+	game.cur_y = config->start_y;
+	game.prev_dist = Game_Distance(&game);
+	game.max_rounds = config->rounds;
+	player_start(&player, &game, config->range, job->player == PLAYER_ORACLE);
+
+	limit = SIM_GESTURE_LIMIT * config->rounds;
+	for (g = 0; g < limit; g++) {
+		x0 = game.cur_x;
+		y0 = game.cur_y;
+		before = Game_Distance(&game);
+		loc = classify(job->model, player_choose(&player, &game), seed);
+		Game_Step(&game, loc, NULL, 0);
+		if (game.status == GAME_WON) {
+			*gestures += g + 1;
+			return game.round;
+		}
+		if (game.status == GAME_LOST) {
+			*gestures += g + 1;
+			return config->rounds;
+		}
+		player_learn(&player, &game, x0, y0,
+				loc == GAME_CHECK ? Game_Distance(&game) : -1,
+				sign(Game_Distance(&game) - before));
+	}
+	*gestures += limit;
+	return -1;
+}
+
+static void play_chunks(void *arg, int begin, int end) {
+
+	Sim_Job *job = arg;
+	Chunk_Result *chunk;
+	unsigned int seed;
+	int c, i, n, ended;
+
+	for (c = begin; c < end; c++) {
+		chunk = &job->chunks[c];
+		seed = (job->seed + 1) * 0x9E3779B9u ^ (unsigned int) c * 0x85EBCA6Bu;
+		n = job->games - c * SIM_CHUNK;
+		n = n < SIM_CHUNK ? n : SIM_CHUNK;
+		for (i = 0; i < n; i++) {
+			ended = play(job, &seed, &chunk->gestures);
+			if (ended < 0) {
+				chunk->stalled++;
+				chunk->ended[job->config->rounds]++;
+			} else {
+				chunk->won += ended < job->config->rounds;
+				chunk->ended[ended]++;
+			}
+		}
+	}
+}
+
+/*
+ * Rows of the CSV crossval --confusion writes: one per true class, one
+ * column per class it was classified as and an optional last column for
+ * none
+ */
+
+static int load_confusion(const char *path, Error_Model *model) {
+
+	FILE *f = fopen(path, "r");
+	char line[512], *v, *end;
+	unsigned int sum;
+	int row = 0, j;
+	long count;
+
+	if (f == NULL) {
+		fprintf(stderr, "gameSim: cannot read %s\n", path);
+		return -1;
+	}
+	memset(model, 0, sizeof(Error_Model));
+	while (row < SIM_CLASSES && fgets(line, sizeof(line), f) != NULL) {
+		v = line;
+		sum = 0;
+		for (j = 0; j < SIM_OUTCOMES; j++) {
+			count = strtol(v, &end, 10);
+			if (end == v) {
+				break;
+			}
+			sum += (unsigned int) (count > 0 ? count : 0);
+			model->cumulative[row][j] = sum;
+			v = *end == ',' ? end + 1 : end;
+		}
+		if (j < SIM_CLASSES) {
+			continue;
+		}
+		for (; j < SIM_OUTCOMES; j++) {
+			model->cumulative[row][j] = sum;
+		}
+		row++;
+	}
+	fclose(f);
+	if (row < SIM_CLASSES) {
+		fprintf(stderr, "gameSim: %s has %d of %d rows\n", path, row,
+				SIM_CLASSES);
+		return -1;
+	}
+
+	/* A class that was never seen is taken to be always recognized */
+	for (row = 0; row < SIM_CLASSES; row++) {
+		if (model->cumulative[row][SIM_OUTCOMES - 1] == 0) {
+			for (j = row; j < SIM_OUTCOMES; j++) {
+				model->cumulative[row][j] = 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void uniform_errors(float accuracy, Error_Model *model) {
+
+	unsigned int right = (unsigned int) (accuracy * 1e6f + 0.5f);
+	unsigned int wrong = (1000000 - right) / (SIM_OUTCOMES - 1);
+	int i, j;
+
+	for (i = 0; i < SIM_CLASSES; i++) {
+		for (j = 0; j < SIM_OUTCOMES; j++) {
+			model->cumulative[i][j] = (j ? model->cumulative[i][j - 1] : 0)
+					+ (i == j ? right : wrong);
+		}
+	}
+}
+
+static double model_accuracy(const Error_Model *model) {
+
+	const unsigned int *row;
+	double sum = 0;
+	int i;
+
+	for (i = 0; i < SIM_CLASSES; i++) {
+		row = model->cumulative[i];
+		sum += (double) (row[i] - (i ? row[i - 1] : 0)) / row[SIM_OUTCOMES - 1];
+	}
+	return sum / SIM_CLASSES;
+}
+
+static int parse_ints(const char *v, int *values, int max) {
+
+	char *end;
+	int n = 0;
+
+	while (*v != '\0' && n < max) {
+		values[n++] = (int) strtol(v, &end, 10);
+		if (end == v) {
+			return -1;
+		}
+		v = *end == ',' ? end + 1 : end;
+	}
+	return n;
+}
+
+static int parse_starts(const char *v, int (*starts)[2], int max) {
+
+	char *end;
+	int n = 0;
+
+	while (*v != '\0' && n < max) {
+		starts[n][0] = (int) strtol(v, &end, 10);
+		if (end == v || *end != ':') {
+			return -1;
+		}
+		v = end + 1;
+		starts[n][1] = (int) strtol(v, &end, 10);
+		if (end == v) {
+			return -1;
+		}
+		n++;
+		v = *end == ',' ? end + 1 : end;
+	}
+	return n;
+}
+
+/*
+ * Smallest round at least share of the won games were won by
+ */
+
+static int percentile(const long *ended, int rounds, long won, double share) {
+
+	long seen = 0;
+	int r;
+
+	for (r = 0; r < rounds; r++) {
+		seen += ended[r];
+		if (seen > 0 && seen >= share * won) {
+			return r;
+		}
+	}
+	return rounds;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--confusion=FILE | --accuracy=A]"
+			" [--rounds=R,...] [--range=N,...] [--start=X:Y,...]"
+			" [--player=search|oracle] [--games=N] [--threads=N] [--seed=S]"
+			" [--histogram]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	Error_Model model;
+	Sim_Config config;
+	Sim_Job job;
+	Thread_Pool *pool;
+	int rounds[SIM_MAX_VALUES] = { GAME_ROUNDS }, n_rounds = 1;
+	int ranges[SIM_MAX_VALUES] = { GAME_TARGET_RANGE }, n_ranges = 1;
+	int starts[SIM_MAX_VALUES][2] = { { GAME_START_X, GAME_START_Y } };
+	int n_starts = 1, games = 1000000, threads = 0, histogram = 0;
+	int player = PLAYER_SEARCH;
+	unsigned int seed = 0;
+	const char *confusion_path = NULL, *v;
+	float accuracy = 1.0f;
+	long *ended, won, stalled, gestures, total_games = 0;
+	int i, r, a, s, c, n_chunks;
+	double p, start, wall_ms;
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--confusion")) != NULL) {
+			confusion_path = v;
+		} else if ((v = option_value(argv[i], "--accuracy")) != NULL) {
+			accuracy = (float) atof(v);
+		} else if ((v = option_value(argv[i], "--rounds")) != NULL) {
+			n_rounds = parse_ints(v, rounds, SIM_MAX_VALUES);
+		} else if ((v = option_value(argv[i], "--range")) != NULL) {
+			n_ranges = parse_ints(v, ranges, SIM_MAX_VALUES);
+		} else if ((v = option_value(argv[i], "--start")) != NULL) {
+			n_starts = parse_starts(v, starts, SIM_MAX_VALUES);
+		} else if ((v = option_value(argv[i], "--player")) != NULL) {
+			if (strcmp(v, "search") == 0) {
+				player = PLAYER_SEARCH;
+			} else if (strcmp(v, "oracle") == 0) {
+				player = PLAYER_ORACLE;
+			} else {
+				usage(argv[0]);
+				return 2;
+			}
+		} else if ((v = option_value(argv[i], "--games")) != NULL) {
+			games = atoi(v);
+		} else if ((v = option_value(argv[i], "--threads")) != NULL) {
+			threads = atoi(v);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			seed = (unsigned int) strtoul(v, NULL, 10);
+		} else if (strcmp(argv[i], "--histogram") == 0) {
+			histogram = 1;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (n_rounds < 1 || n_ranges < 1 || n_starts < 1 || games < 1
+			|| accuracy < 0 || accuracy > 1) {
+		usage(argv[0]);
+		return 2;
+	}
+	for (i = 0; i < n_rounds; i++) {
+		if (rounds[i] < 1) {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	for (i = 0; i < n_ranges; i++) {
+		if (ranges[i] < 1 || ranges[i] > SIM_MAX_RANGE) {
+			fprintf(stderr, "gameSim: ranges go from 1 to %d\n", SIM_MAX_RANGE);
+			return 2;
+		}
+	}
+
+	if (confusion_path != NULL) {
+		if (load_confusion(confusion_path, &model) != 0) {
+			return 1;
+		}
+	} else {
+		uniform_errors(accuracy, &model);
+	}
+
+	pool = Thread_Pool_Create(threads);
+	n_chunks = (games + SIM_CHUNK - 1) / SIM_CHUNK;
+	job.chunks = malloc(sizeof(Chunk_Result) * n_chunks);
+	if (pool == NULL || job.chunks == NULL) {
+		fprintf(stderr, "gameSim: out of memory\n");
+		return 1;
+	}
+	job.model = &model;
+	job.config = &config;
+	job.player = player;
+	job.games = games;
+
+	printf("%s player, %d games per configuration on %d threads, %.1f%% of"
+			" gestures classified right\n\n",
+			player == PLAYER_ORACLE ? "Oracle" : "Search", games,
+			Thread_Pool_Size(pool), 100 * model_accuracy(&model));
+	printf("rounds range start   won%%    +-95%%  stalled%%  won on round"
+			" p10 p50 p90  gestures/game\n");
+
+	start = now_ms();
+	for (r = 0; r < n_rounds; r++) {
+		for (a = 0; a < n_ranges; a++) {
+			for (s = 0; s < n_starts; s++) {
+				config.rounds = rounds[r];
+				config.range = ranges[a];
+				config.start_x = starts[s][0];
+				config.start_y = starts[s][1];
+				job.seed = seed;
+
+				ended = calloc((size_t) n_chunks * (config.rounds + 1),
+						sizeof(long));
+				if (ended == NULL) {
+					fprintf(stderr, "gameSim: out of memory\n");
+					return 1;
+				}
+				for (c = 0; c < n_chunks; c++) {
+					memset(&job.chunks[c], 0, sizeof(Chunk_Result));
+					job.chunks[c].ended = ended + (size_t) c * (config.rounds + 1);
+				}
+				if (Thread_Pool_For(pool, n_chunks, 1, play_chunks, &job) != 0) {
+					fprintf(stderr, "gameSim: out of memory\n");
+					return 1;
+				}
+
+				won = stalled = gestures = 0;
+				for (c = 0; c < n_chunks; c++) {
+					won += job.chunks[c].won;
+					stalled += job.chunks[c].stalled;
+					gestures += job.chunks[c].gestures;
+					if (c > 0) {
+						for (i = 0; i <= config.rounds; i++) {
+							ended[i] += job.chunks[c].ended[i];
+						}
+					}
+				}
+				total_games += games;
+
+				p = (double) won / games;
+				printf("%6d %5d %2d:%-2d %7.3f %7.3f %9.3f  %15d %3d %3d %14.2f\n",
+						config.rounds, config.range, config.start_x,
+						config.start_y, 100 * p,
+						196 * sqrt(p * (1 - p) / games),
+						100.0 * stalled / games,
+						percentile(ended, config.rounds, won, 0.1),
+						percentile(ended, config.rounds, won, 0.5),
+						percentile(ended, config.rounds, won, 0.9),
+						(double) gestures / games);
+				if (histogram) {
+					printf("  ended on round:");
+					for (i = 0; i < config.rounds; i++) {
+						printf(" %d:%.4f", i, (double) ended[i] / games);
+					}
+					printf(" lost:%.4f\n", (double) ended[config.rounds] / games);
+				}
+				free(ended);
+			}
+		}
+	}
+	wall_ms = now_ms() - start;
+
+	printf("\n%ld games in %.1f ms, %.0f games/s\n", total_games, wall_ms,
+			total_games / (wall_ms / 1e3));
+
+	Thread_Pool_Destroy(pool);
+	free(job.chunks);
+	return 0;
+}
@@ -0,0 +1,300 @@
+/**
+ ******************************************************************************
+ * @file    hostModel.c
+ * @brief   Heap allocated embeddedML networks for the host tools
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gestureCore.h"
+#include "hostModel.h"
+
+unsigned int Host_Rand(unsigned int *state) {
+	return Gesture_Rand(state);
+}
+
+float Host_Rand_Uniform(unsigned int *state, float lo, float hi) {
+	return Gesture_Rand_Uniform(state, lo, hi);
+}
+
+static unsigned int count_weights(const unsigned int *topology,
+		unsigned int n_layers) {
+
+	unsigned int i, n = 0;
+
+	for (i = 1; i < n_layers; i++) {
+		n += topology[i - 1] * topology[i];
+	}
+	return n;
+}
+
+static unsigned int count_bias(const unsigned int *topology,
+		unsigned int n_layers) {
+
+	unsigned int i, n = 0;
+
+	for (i = 1; i < n_layers; i++) {
+		n += topology[i];
+	}
+	return n;
+}
+
+ANN *Host_ANN_Create(const unsigned int *topology, unsigned int n_layers,
+		unsigned int seed) {
+
+	unsigned int n_weights, n_bias, n_output;
+	size_t size;
+	ANN *net;
+	char *p;
+
+	if (n_layers < 2 || n_layers > HOST_ANN_MAX_LAYERS) {
+		return NULL;
+	}
+
+	n_weights = count_weights(topology, n_layers);
+	n_bias = count_bias(topology, n_layers);
+	n_output = topology[n_layers - 1];
+
+	size = sizeof(ANN) + n_layers * sizeof(unsigned int)
+			+ (2 * n_weights + n_bias + n_output) * sizeof(float);
+	net = calloc(1, size);
+	if (net == NULL) {
+		return NULL;
+	}
+
+	p = (char *) (net + 1);
+	net->topology = (unsigned int *) p;
+	p += n_layers * sizeof(unsigned int);
+	net->weights = (float *) p;
+	net->dedw = net->weights + n_weights;
+	net->bias = net->dedw + n_weights;
+	net->output = net->bias + n_bias;
+
+	memcpy(net->topology, topology, n_layers * sizeof(unsigned int));
+	net->n_layers = n_layers;
+	net->n_weights = n_weights;
+	net->n_bias = n_bias;
+
+	/*
+	 * Same options as main()
+	 */
+
+	net->eta = 0.13;
+	net->beta = 0.01;
+	net->alpha = 0.25;
+	net->output_activation_function = &relu2;
+	net->hidden_activation_function = &relu2;
+
+	Host_ANN_Reset(net, seed);
+	return net;
+}
+
+/*
+ * The 3-9-6 network ANN_Initial_Weights is laid out for
+ */
+
+static int is_firmware_topology(const ANN *net) {
+	return net->n_layers == 3 && net->topology[0] == 3
+			&& net->topology[1] == 9 && net->topology[2] == 6;
+}
+
+void Host_ANN_Reset(ANN *net, unsigned int seed) {
+
+	unsigned int i, l, n;
+	float limit;
+	float *w;
+
+	if (seed == 0 && is_firmware_topology(net)) {
+		memcpy(net->weights, ANN_Initial_Weights, sizeof(ANN_Initial_Weights));
+	} else if (is_firmware_topology(net)) {
+		for (i = 0; i < net->n_weights; i++) {
+			net->weights[i] = Host_Rand_Uniform(&seed, 0.2, 0.8);
+		}
+	} else {
+
+		/*
+		 * All positive starting weights leave every hidden neuron of a
+		 * wide layer computing nearly the same sum and training stalls,
+		 * so other topologies start symmetric about zero, scaled by the
+		 * fan-in of each layer
+		 */
+
+		w = net->weights;
+		for (l = 1; l < net->n_layers; l++) {
+			n = net->topology[l - 1] * net->topology[l];
+			limit = 1 / sqrtf((float) net->topology[l - 1]);
+			for (i = 0; i < n; i++) {
+				w[i] = Host_Rand_Uniform(&seed, -limit, limit);
+			}
+			w += n;
+		}
+	}
+
+	for (i = 0; i < net->n_weights; i++) {
+		net->dedw[i] = 0.0;
+	}
+	for (i = 0; i < net->n_bias; i++) {
+		net->bias[i] = 0.5;
+	}
+	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
+		net->output[i] = 0.0;
+	}
+
+	init_ann(net);
+}
+
+void Host_ANN_Destroy(ANN *net) {
+	free(net);
+}
+
+/*
+ * Parse a topology written as "3-9-6". Returns the number of layers or 0.
+ */
+
+int Host_Parse_Topology(const char *text, unsigned int *topology) {
+
+	int n = 0, i;
+	char *end;
+	unsigned long v;
+
+	while (*text != '\0') {
+		if (n == HOST_ANN_MAX_LAYERS) {
+			return 0;
+		}
+		v = strtoul(text, &end, 10);
+		if (end == text || v == 0) {
+			return 0;
+		}
+		topology[n++] = (unsigned int) v;
+		text = end;
+		if (*text == '-') {
+			text++;
+		}
+	}
+	if (n < 2 || topology[n - 1] > ANN_BATCH_MAX_OUTPUT) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (topology[i] > ANN_BATCH_MAX_WIDTH) {
+			return 0;
+		}
+	}
+	return n;
+}
+
+int Host_ANN_Count_Errors(ANN *net, const float *inputs, const int *labels,
+		int n_vectors) {
+
+	ANN_Result results[ANN_BATCH_BLOCK * 16];
+	int base, n, i, errors = 0;
+	int block = ANN_BATCH_BLOCK * 16;
+
+	for (base = 0; base < n_vectors; base += block) {
+		n = n_vectors - base < block ? n_vectors - base : block;
+		if (run_ann_batch(net, inputs + (size_t) base * net->topology[0], n,
+				NULL, results) != 0) {
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (ANN_Result_Error(&results[i], labels[base + i]) != ANN_CLASSIFIED) {
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+int Host_ANN_Train(ANN *net, const float *inputs, const int *labels,
+		int n_vectors, unsigned int training_cycles) {
+	return Host_ANN_Train_Masked(net, inputs, labels, n_vectors,
+			training_cycles, NULL);
+}
+
+int Host_ANN_Train_Masked(ANN *net, const float *inputs, const int *labels,
+		int n_vectors, unsigned int training_cycles,
+		const unsigned char *keep) {
+
+	unsigned int n_input = net->topology[0];
+	unsigned int n_output = net->topology[net->n_layers - 1];
+	int *order = malloc(n_vectors * sizeof(int));
+	int *sorted = malloc(n_vectors * sizeof(int));
+	int *start = calloc(n_output + 2, sizeof(int));
+	int *next = calloc(n_output + 1, sizeof(int));
+	float *target = calloc(n_output, sizeof(float));
+	unsigned int i, w;
+	int j, c, n, v, converged = -1;
+
+	if (order == NULL || sorted == NULL || start == NULL || next == NULL
+			|| target == NULL) {
+		goto done;
+	}
+
+	/*
+	 * Interleave the classes: first vector of every class, then the
+	 * second vector of every class, and so on. Vectors with labels the
+	 * network cannot represent form one extra bucket at the end.
+	 */
+
+	for (v = 0; v < n_vectors; v++) {
+		c = (labels[v] >= 0 && labels[v] < (int) n_output) ? labels[v] : (int) n_output;
+		start[c + 1]++;
+	}
+	for (c = 0; c <= (int) n_output; c++) {
+		start[c + 1] += start[c];
+		next[c] = start[c];
+	}
+	for (v = 0; v < n_vectors; v++) {
+		c = (labels[v] >= 0 && labels[v] < (int) n_output) ? labels[v] : (int) n_output;
+		sorted[next[c]++] = v;
+	}
+	for (c = 0; c <= (int) n_output; c++) {
+		next[c] = start[c];
+	}
+
+	n = 0;
+	while (n < n_vectors) {
+		for (c = 0; c <= (int) n_output; c++) {
+			if (next[c] < start[c + 1]) {
+				order[n++] = sorted[next[c]++];
+			}
+		}
+	}
+
+	i = 0;
+	while (i < training_cycles) {
+		for (j = 0; j < n_vectors && i < training_cycles; j++) {
+
+			if ((i % 20 == 0 && i < 100) || i % 100 == 0) {
+				if (Host_ANN_Count_Errors(net, inputs, labels, n_vectors) == 0) {
+					converged = (int) i;
+					goto done;
+				}
+			}
+
+			v = order[j];
+			if (labels[v] >= 0 && labels[v] < (int) n_output) {
+				target[labels[v]] = 1.0;
+				train_ann(net, (float *) inputs + (size_t) v * n_input, target);
+				target[labels[v]] = 0.0;
+				for (w = 0; keep != NULL && w < net->n_weights; w++) {
+					if (!keep[w]) {
+						net->weights[w] = 0;
+						net->dedw[w] = 0;
+					}
+				}
+			}
+			i++;
+		}
+	}
+
+done:
+	free(target);
+	free(next);
+	free(start);
+	free(sorted);
+	free(order);
+	return converged;
+}
@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * @file    hostModel.h
+ * @brief   Heap allocated embeddedML networks for the host tools
+ ******************************************************************************
+ *
+ * The firmware builds its 3-9-6 network out of arrays on the stack of
+ * main(). Host tools need networks of arbitrary topology and one instance
+ * per worker thread, so Host_ANN_Create allocates everything an ANN
+ * points to in a single block and applies the same options as main().
+ */
+
+#ifndef HOST_MODEL_H
+#define HOST_MODEL_H
+
+#include "embeddedML.h"
+
+#define HOST_ANN_MAX_LAYERS 8
+
+/*
+ * Deterministic generator so runs can be repeated with a fixed seed, the
+ * Gesture_Rand of gestureCore.h
+ */
+
+unsigned int Host_Rand(unsigned int *state);
+float Host_Rand_Uniform(unsigned int *state, float lo, float hi);
+
+/*
+ * Seed 0 with the 3-9-6 topology reproduces the firmware starting
+ * weights exactly, and other seeds draw 3-9-6 weights uniformly from the
+ * same 0.2 .. 0.8 range as the firmware table. Other topologies draw
+ * from +-1/sqrt(fan-in) of each layer.
+ */
+
+ANN *Host_ANN_Create(const unsigned int *topology, unsigned int n_layers,
+		unsigned int seed);
+void Host_ANN_Reset(ANN *net, unsigned int seed);
+void Host_ANN_Destroy(ANN *net);
+
+/*
+ * Parse a topology like "3-9-6". Returns the number of layers, or 0 when
+ * malformed, when the output layer is wider than ANN_BATCH_MAX_OUTPUT or
+ * when any layer is wider than ANN_BATCH_MAX_WIDTH.
+ */
+
+int Host_Parse_Topology(const char *text, unsigned int *topology);
+
+/*
+ * The TrainOrientation training loop on a host data set.
+ *
+ * inputs holds n_vectors network input vectors back to back and labels
+ * their output indices. Vectors are presented one train_ann update at a
+ * time with the classes interleaved, so one vector per class reproduces
+ * the firmware order. As in TrainOrientation the whole set is scored
+ * after every 20 updates for the first 100 and every 100 updates after
+ * that, and training stops once every vector meets the printOutput_ANN
+ * criteria.
+ *
+ * Returns the number of updates needed to converge, or -1 when
+ * training_cycles updates were not enough.
+ */
+
+int Host_ANN_Train(ANN *net, const float *inputs, const int *labels,
+		int n_vectors, unsigned int training_cycles);
+
+/*
+ * Host_ANN_Train holding the weights whose keep entry is 0 at zero, for
+ * fine-tuning a pruned network (gestureSparse.h)
+ */
+
+int Host_ANN_Train_Masked(ANN *net, const float *inputs, const int *labels,
+		int n_vectors, unsigned int training_cycles,
+		const unsigned char *keep);
+
+/*
+ * Number of vectors that fail the printOutput_ANN criteria, -1 if
+ * run_ann_batch rejects the net
+ */
+
+int Host_ANN_Count_Errors(ANN *net, const float *inputs, const int *labels,
+		int n_vectors);
+
+#endif /* HOST_MODEL_H */
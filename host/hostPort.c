@@ -0,0 +1,21 @@
+/**
+ ******************************************************************************
+ * @file    hostPort.c
+ * @brief   Host implementations of the firmware services used by the
+ *          shared modules
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+
+#include "usbd_cdc_interface.h"
+
+volatile int Host_CDC_Echo = 0;
+
+uint8_t CDC_Fill_Buffer(uint8_t *Buf, uint32_t TotalLen) {
+
+	if (Host_CDC_Echo) {
+		fwrite(Buf, 1, TotalLen, stdout);
+	}
+	return 0;
+}
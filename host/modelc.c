@@ -0,0 +1,400 @@
+/**
+ ******************************************************************************
+ * @file    modelc.c
+ * @brief   Train the gesture network on the host and emit it as C source
+ ******************************************************************************
+ *
+ * Trains a network on a labeled feature corpus (see corpus.h) with the
+ * TrainOrientation loop and writes a header holding the trained model as
+ * const data, ready to be compiled into the firmware so a SensorTile can
+ * classify straight after boot without a training session. Build the
+ * firmware with -DGESTURE_MODEL_PRETRAINED to use it.
+ *
+ * The header contains:
+ *   - the layer sizes and feature thresholds as #defines
+ *   - topology, weights and bias as const arrays (placed in flash)
+ *   - Gesture_Model_Load(), which copies the model into an ANN set up as
+ *     in main() so run_ann, printOutput_ANN and retraining work unchanged
+ *   - Gesture_Model_Bind(), float models only, which points an ANN at
+ *     the const arrays for the firmware's GESTURE_INFERENCE_ONLY build
+ *   - Gesture_Model_Run(), a forward pass with every layer size folded
+ *     into the loop bounds, for callers that do not need an ANN at all
+ *
+ * With --int8 the weights are stored as int8_t with one scale per layer,
+ * a quarter of the flash, and the float model is printed next to the
+ * quantized one so the accuracy cost can be checked.
+ *
+ * Usage:
+ *   modelc [options] CORPUS
+ *     --out=FILE         header to write (default gestureModel.h)
+ *     --topology=3-9-6   network topology, input width must match corpus
+ *     --cycles=N         training_cycles limit (default 2000)
+ *     --seed=S           weight seed (0 = firmware starting weights)
+ *     --eta=F --beta=F --alpha=F
+ *     --angle=30 --accel=600 --acquire=800
+ *                        feature thresholds the corpus was captured with
+ *     --int8             quantize the weights
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gestureCore.h"
+#include "corpus.h"
+#include "evaluate.h"
+#include "hostModel.h"
+
+typedef struct {
+	float angle;
+	float accel;
+	int acquire;
+	int int8;
+} Model_Options;
+
+/*
+ * Symmetric per layer quantization: q = round(w / scale), |q| <= 127
+ */
+
+static void quantize(const ANN *net, signed char *q, float *scale) {
+
+	unsigned int l, i, n;
+	const float *w = net->weights;
+	float max;
+
+	for (l = 1; l < net->n_layers; l++) {
+		n = net->topology[l - 1] * net->topology[l];
+		max = 0;
+		for (i = 0; i < n; i++) {
+			max = fabsf(w[i]) > max ? fabsf(w[i]) : max;
+		}
+		scale[l - 1] = max > 0 ? max / 127 : 1;
+		for (i = 0; i < n; i++) {
+			q[i] = (signed char) lrintf(w[i] / scale[l - 1]);
+		}
+		w += n;
+		q += n;
+	}
+}
+
+static void dequantize(ANN *net, const signed char *q, const float *scale) {
+
+	unsigned int l, i, n;
+	float *w = net->weights;
+
+	for (l = 1; l < net->n_layers; l++) {
+		n = net->topology[l - 1] * net->topology[l];
+		for (i = 0; i < n; i++) {
+			w[i] = q[i] * scale[l - 1];
+		}
+		w += n;
+		q += n;
+	}
+}
+
+static void print_floats(FILE *f, const float *x, unsigned int n) {
+
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		fprintf(f, "%s%.9gf,", i % 6 ? " " : "\n\t", x[i]);
+	}
+	fprintf(f, "\n");
+}
+
+static void write_run(FILE *f, const ANN *net, const Model_Options *model) {
+
+	unsigned int l, max_width = 0, offset_w = 0, offset_b = 0;
+
+	for (l = 1; l < net->n_layers; l++) {
+		if (net->topology[l] > max_width) {
+			max_width = net->topology[l];
+		}
+	}
+
+	fprintf(f, "/*\n * Forward pass with the layer sizes folded into the loop"
+			" bounds. input holds\n * GESTURE_MODEL_N_INPUT features after"
+			" motion_softmax, output receives\n * GESTURE_MODEL_N_OUTPUT"
+			" values.\n */\n\n");
+	fprintf(f, "static inline void Gesture_Model_Run(const float *input,"
+			" float *output) {\n\n");
+	fprintf(f, "\tfloat act[2][%u];\n", max_width);
+	fprintf(f, "\tconst float *x = input;\n\tfloat *y;\n\tfloat sum;\n"
+			"\tint j, k;\n");
+
+	for (l = 1; l < net->n_layers; l++) {
+		unsigned int n_in = net->topology[l - 1], n_out = net->topology[l];
+		fprintf(f, "\n\t/* layer %u: %u -> %u */\n", l, n_in, n_out);
+		if (l == net->n_layers - 1) {
+			fprintf(f, "\ty = output;\n");
+		} else {
+			fprintf(f, "\ty = act[%u];\n", (l - 1) % 2);
+		}
+		fprintf(f, "\tfor (j = 0; j < %u; j++) {\n", n_out);
+		fprintf(f, "\t\tsum = 0;\n");
+		fprintf(f, "\t\tfor (k = 0; k < %u; k++) {\n", n_in);
+		fprintf(f, "\t\t\tsum += Gesture_Model_Weights[%u + j * %u + k] * x[k];\n",
+				offset_w, n_in);
+		fprintf(f, "\t\t}\n");
+		if (model->int8) {
+			fprintf(f, "\t\ty[j] = relu2(Gesture_Model_Bias[%u + j]"
+					" + Gesture_Model_Scale[%u] * sum);\n", offset_b, l - 1);
+		} else {
+			fprintf(f, "\t\ty[j] = relu2(Gesture_Model_Bias[%u + j] + sum);\n",
+					offset_b);
+		}
+		fprintf(f, "\t}\n");
+		if (l < net->n_layers - 1) {
+			fprintf(f, "\tx = y;\n");
+		}
+		offset_w += n_in * n_out;
+		offset_b += n_out;
+	}
+	fprintf(f, "}\n\n");
+}
+
+static int write_model(const char *path, const char *corpus_path,
+		const ANN *net, const Model_Options *model, const signed char *q,
+		const float *scale) {
+
+	unsigned int l;
+	const char *base;
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		fprintf(stderr, "modelc: cannot write %s\n", path);
+		return -1;
+	}
+
+	fprintf(f, "/**\n ****************************************************"
+			"**************************\n");
+	base = strrchr(path, '/');
+	fprintf(f, " * @file    %s\n", base != NULL ? base + 1 : path);
+	fprintf(f, " * @brief   Pretrained gesture network\n");
+	fprintf(f, " ****************************************************"
+			"**************************\n *\n");
+	fprintf(f, " * Generated by host/modelc from %s, do not edit.\n",
+			corpus_path);
+	fprintf(f, " * Include in exactly one translation unit.\n */\n\n");
+	fprintf(f, "#ifndef GESTURE_MODEL_H\n#define GESTURE_MODEL_H\n\n");
+	fprintf(f, "#include <stdint.h>\n#include <string.h>\n\n");
+	fprintf(f, "#include \"embeddedML.h\"\n\n");
+
+	fprintf(f, "#define GESTURE_MODEL_N_LAYERS %u\n", net->n_layers);
+	fprintf(f, "#define GESTURE_MODEL_N_INPUT %u\n", net->topology[0]);
+	fprintf(f, "#define GESTURE_MODEL_N_OUTPUT %u\n",
+			net->topology[net->n_layers - 1]);
+	fprintf(f, "#define GESTURE_MODEL_N_WEIGHTS %u\n", net->n_weights);
+	fprintf(f, "#define GESTURE_MODEL_N_BIAS %u\n", net->n_bias);
+	if (model->int8) {
+		fprintf(f, "#define GESTURE_MODEL_INT8 1\n");
+	}
+	fprintf(f, "\n/* Feature thresholds the training corpus was captured with */"
+			"\n\n");
+	fprintf(f, "#define GESTURE_MODEL_ANGLE_MAG_MAX_THRESHOLD %g\n", model->angle);
+	fprintf(f, "#define GESTURE_MODEL_ACCEL_THRESHOLD %g\n", model->accel);
+	fprintf(f, "#define GESTURE_MODEL_MAX_ACQUIRE_CYCLES %d\n\n", model->acquire);
+
+	fprintf(f, "static const unsigned int Gesture_Model_Topology"
+			"[GESTURE_MODEL_N_LAYERS] = {");
+	for (l = 0; l < net->n_layers; l++) {
+		fprintf(f, "%s%u", l ? ", " : " ", net->topology[l]);
+	}
+	fprintf(f, " };\n\n");
+
+	if (model->int8) {
+		fprintf(f, "static const int8_t Gesture_Model_Weights"
+				"[GESTURE_MODEL_N_WEIGHTS] = {");
+		for (l = 0; l < net->n_weights; l++) {
+			fprintf(f, "%s%d,", l % 12 ? " " : "\n\t", q[l]);
+		}
+		fprintf(f, "\n};\n\n");
+		fprintf(f, "static const float Gesture_Model_Scale"
+				"[GESTURE_MODEL_N_LAYERS - 1] = {");
+		print_floats(f, scale, net->n_layers - 1);
+		fprintf(f, "};\n\n");
+	} else {
+		fprintf(f, "static const float Gesture_Model_Weights"
+				"[GESTURE_MODEL_N_WEIGHTS] = {");
+		print_floats(f, net->weights, net->n_weights);
+		fprintf(f, "};\n\n");
+	}
+	fprintf(f, "static const float Gesture_Model_Bias[GESTURE_MODEL_N_BIAS] = {");
+	print_floats(f, net->bias, net->n_bias);
+	fprintf(f, "};\n\n");
+
+	fprintf(f, "/*\n * Copy the model into net, which must have the same"
+			" topology. Returns 0,\n * or -1 on a topology mismatch.\n */\n\n");
+	fprintf(f, "static inline int Gesture_Model_Load(ANN *net) {\n\n");
+	fprintf(f, model->int8 ? "\tint i, layer = 0, n = 0;\n\n" : "\tint i;\n\n");
+	fprintf(f, "\tif (net->n_layers != GESTURE_MODEL_N_LAYERS\n"
+			"\t\t\t|| memcmp(net->topology, Gesture_Model_Topology,"
+			" sizeof(Gesture_Model_Topology)) != 0) {\n\t\treturn -1;\n\t}\n");
+	if (model->int8) {
+		fprintf(f, "\tfor (i = 0; i < GESTURE_MODEL_N_WEIGHTS; i++) {\n");
+		fprintf(f, "\t\tif (i == n + (int) (Gesture_Model_Topology[layer]"
+				" * Gesture_Model_Topology[layer + 1])) {\n");
+		fprintf(f, "\t\t\tn = i;\n\t\t\tlayer++;\n\t\t}\n");
+		fprintf(f, "\t\tnet->weights[i] = Gesture_Model_Weights[i]"
+				" * Gesture_Model_Scale[layer];\n");
+		fprintf(f, "\t\tnet->dedw[i] = 0.0;\n\t}\n");
+	} else {
+		fprintf(f, "\tfor (i = 0; i < GESTURE_MODEL_N_WEIGHTS; i++) {\n");
+		fprintf(f, "\t\tnet->weights[i] = Gesture_Model_Weights[i];\n");
+		fprintf(f, "\t\tnet->dedw[i] = 0.0;\n\t}\n");
+	}
+	fprintf(f, "\tfor (i = 0; i < GESTURE_MODEL_N_BIAS; i++) {\n");
+	fprintf(f, "\t\tnet->bias[i] = Gesture_Model_Bias[i];\n\t}\n");
+	fprintf(f, "\treturn 0;\n}\n\n");
+
+	if (!model->int8) {
+		fprintf(f, "/*\n * Point net at the model in flash instead of copying"
+				" it, for builds that\n * never train: no weights, bias or dedw"
+				" in RAM. train_ann must not be\n * called on net. The caller"
+				" still provides net->output.\n */\n\n");
+		fprintf(f, "static inline void Gesture_Model_Bind(ANN *net) {\n");
+		fprintf(f, "\tnet->weights = (float *) Gesture_Model_Weights;\n");
+		fprintf(f, "\tnet->dedw = NULL;\n");
+		fprintf(f, "\tnet->bias = (float *) Gesture_Model_Bias;\n");
+		fprintf(f, "\tnet->topology = (unsigned int *) Gesture_Model_Topology;\n");
+		fprintf(f, "\tnet->n_layers = GESTURE_MODEL_N_LAYERS;\n");
+		fprintf(f, "\tnet->n_weights = GESTURE_MODEL_N_WEIGHTS;\n");
+		fprintf(f, "\tnet->n_bias = GESTURE_MODEL_N_BIAS;\n}\n\n");
+	}
+
+	write_run(f, net, model);
+
+	fprintf(f, "#endif /* GESTURE_MODEL_H */\n");
+	return fclose(f);
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--out=FILE] [--topology=3-9-6] [--cycles=N]"
+			" [--seed=S] [--eta=F] [--beta=F] [--alpha=F] [--angle=DEG]"
+			" [--accel=MG] [--acquire=N] [--int8] CORPUS\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	Gesture_Corpus corpus;
+	Train_Options options;
+	Model_Options model = { 30, 600, 800, 0 };
+	const char *path = NULL, *out_path = "gestureModel.h", *v;
+	signed char *q = NULL;
+	float scale[HOST_ANN_MAX_LAYERS];
+	ANN *net;
+	int i, epochs, errors;
+
+	Train_Options_Default(&options);
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--out")) != NULL) {
+			out_path = v;
+		} else if ((v = option_value(argv[i], "--topology")) != NULL) {
+			options.n_layers = Host_Parse_Topology(v, options.topology);
+		} else if ((v = option_value(argv[i], "--cycles")) != NULL) {
+			options.training_cycles = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			options.weight_seed = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--eta")) != NULL) {
+			options.eta = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--beta")) != NULL) {
+			options.beta = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--alpha")) != NULL) {
+			options.alpha = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--angle")) != NULL) {
+			model.angle = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--accel")) != NULL) {
+			model.accel = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--acquire")) != NULL) {
+			model.acquire = atoi(v);
+		} else if (strcmp(argv[i], "--int8") == 0) {
+			model.int8 = 1;
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (path == NULL || options.n_layers == 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (Corpus_Load(path, &corpus) != 0) {
+		return 1;
+	}
+	if ((int) options.topology[0] != corpus.n_features
+			|| (int) options.topology[options.n_layers - 1] < corpus.n_classes) {
+		fprintf(stderr, "modelc: topology does not fit the %d features and %d"
+				" classes of %s\n", corpus.n_features, corpus.n_classes, path);
+		return 1;
+	}
+	Corpus_Normalize(&corpus);
+
+	net = Host_ANN_Create(options.topology, options.n_layers,
+			options.weight_seed);
+	if (net == NULL) {
+		fprintf(stderr, "modelc: out of memory\n");
+		return 1;
+	}
+	net->eta = options.eta;
+	net->beta = options.beta;
+	net->alpha = options.alpha;
+
+	epochs = Host_ANN_Train(net, corpus.features, corpus.labels,
+			corpus.n_samples, options.training_cycles);
+	errors = Host_ANN_Count_Errors(net, corpus.features, corpus.labels,
+			corpus.n_samples);
+	if (epochs < 0) {
+		printf("Not converged after %u updates\n", options.training_cycles);
+	} else {
+		printf("Converged after %d updates\n", epochs);
+	}
+	printf("float: %d of %d corpus gestures fail the printOutput_ANN limits\n",
+			errors, corpus.n_samples);
+
+	if (model.int8) {
+		q = malloc(net->n_weights);
+		if (q == NULL) {
+			fprintf(stderr, "modelc: out of memory\n");
+			return 1;
+		}
+		quantize(net, q, scale);
+	}
+
+	if (write_model(out_path, path, net, &model, q, scale) != 0) {
+		return 1;
+	}
+
+	if (model.int8) {
+		dequantize(net, q, scale);
+		errors = Host_ANN_Count_Errors(net, corpus.features, corpus.labels,
+				corpus.n_samples);
+		printf("int8:  %d of %d corpus gestures fail the printOutput_ANN limits\n",
+				errors, corpus.n_samples);
+	}
+	printf("Wrote %s: %u weights, %u bias, %u bytes of const data\n", out_path,
+			net->n_weights, net->n_bias,
+			(unsigned int) (net->n_weights * (model.int8 ? 1 : sizeof(float))
+					+ net->n_bias * sizeof(float)
+					+ (model.int8 ? (net->n_layers - 1) * sizeof(float) : 0)
+					+ net->n_layers * sizeof(unsigned int)));
+
+	free(q);
+	Host_ANN_Destroy(net);
+	Corpus_Free(&corpus);
+	return 0;
+}
@@ -0,0 +1,369 @@
+/**
+ ******************************************************************************
+ * @file    prune.c
+ * @brief   Accuracy, latency and memory of pruned gesture networks
+ ******************************************************************************
+ *
+ * Cross-validates a network on a labeled corpus (see corpus.h) at several
+ * block sparsity levels. On every fold a dense network is trained with the
+ * TrainOrientation loop, then pruned to each level in --steps steps that
+ * prune fast at first and slowly at the end (cubic schedule), with
+ * --finetune masked updates after each step. The result is packed with
+ * Sparse_Pack and the held out fold is scored with Sparse_Run.
+ *
+ * For each level it prints accuracy, weights and blocks kept,
+ * multiply-accumulates per pass, the bytes of the sparse storage and of
+ * the dense weights, and the time per forward pass of Sparse_Run and of
+ * run_ann on the same pruned network.
+ *
+ * Usage:
+ *   prune [options] CORPUS
+ *     --sparsity=0,0.5   shares of the blocks to prune
+ *                        (default 0,0.25,0.5,0.75,0.9)
+ *     --topology=3-32-32-6
+ *     --cycles=N         dense training updates (default 4000)
+ *     --finetune=N       masked updates after each step (default 500)
+ *     --steps=N          pruning steps to each level (default 4)
+ *     --folds=K          folds (default 5)
+ *     --seed=S           fold and weight seed (0 = firmware weights)
+ *     --eta=F --beta=F --alpha=F
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gestureCore.h"
+#include "gestureSparse.h"
+#include "corpus.h"
+#include "evaluate.h"
+#include "hostModel.h"
+
+#define PRUNE_MAX_LEVELS 16
+
+/*
+ * Forward passes are repeated for at least this long when timed
+ */
+
+#define PRUNE_TIMING_MS 50
+
+typedef struct {
+	float sparsity;
+	int correct;
+	int tested;
+	long weights;               /* kept, summed over folds */
+	long blocks;
+	long bytes;
+	double sparse_ns;           /* per forward pass, summed over folds */
+	double dense_ns;
+	float max_difference;       /* Sparse_Run against run_ann */
+} Level_Score;
+
+static volatile float prune_sink;
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static double time_sparse(const Sparse_ANN *sparse, const float *x, int n,
+		int width, float *output) {
+
+	double start = now_ms(), elapsed;
+	long passes = 0;
+	int i;
+
+	do {
+		for (i = 0; i < n; i++) {
+			Sparse_Run(sparse, x + (size_t) i * width, output);
+			prune_sink = output[0];
+		}
+		passes += n;
+	} while ((elapsed = now_ms() - start) < PRUNE_TIMING_MS);
+	return elapsed * 1e6 / passes;
+}
+
+static double time_dense(ANN *net, const float *x, int n, int width) {
+
+	double start = now_ms(), elapsed;
+	long passes = 0;
+	int i;
+
+	do {
+		for (i = 0; i < n; i++) {
+			run_ann(net, (float *) x + (size_t) i * width);
+			prune_sink = net->output[0];
+		}
+		passes += n;
+	} while ((elapsed = now_ms() - start) < PRUNE_TIMING_MS);
+	return elapsed * 1e6 / passes;
+}
+
+/*
+ * Prune the trained network net to level, fine-tuning after every step,
+ * and score it on the test set
+ */
+
+static int run_level(ANN *net, Level_Score *level, int steps,
+		unsigned int finetune, const float *train_x, const int *train_y,
+		int n_train, const float *test_x, const int *test_y, int n_test) {
+
+	int width = net->topology[0];
+	int n_output = net->topology[net->n_layers - 1];
+	int max_blocks = Sparse_Max_Blocks(net);
+	unsigned char *keep = malloc(net->n_weights);
+	uint16_t *row_start = malloc(sizeof(uint16_t) * (Sparse_Rows(net) + 1));
+	uint16_t *block_col = malloc(sizeof(uint16_t) * max_blocks);
+	float *values = malloc(sizeof(float) * SPARSE_BLOCK * max_blocks);
+	float output[SPARSE_MAX_WIDTH];
+	Sparse_ANN sparse;
+	ANN_Result result;
+	float s, d;
+	int i, j, step, kept = 0, status = -1;
+
+	if (keep == NULL || row_start == NULL || block_col == NULL
+			|| values == NULL) {
+		goto done;
+	}
+
+	for (step = 1; step <= steps && level->sparsity > 0; step++) {
+		s = 1 - (float) step / steps;
+		s = level->sparsity * (1 - s * s * s);
+		kept = Sparse_Prune(net, s, keep);
+		if (kept < 0) {
+			goto done;
+		}
+		Host_ANN_Train_Masked(net, train_x, train_y, n_train, finetune, keep);
+	}
+	if (level->sparsity <= 0) {
+		kept = (int) net->n_weights;
+	}
+	if (Sparse_Pack(net, &sparse, row_start, block_col, values,
+			max_blocks) < 0) {
+		goto done;
+	}
+
+	for (i = 0; i < n_test; i++) {
+		Sparse_Run(&sparse, test_x + (size_t) i * width, output);
+		ANN_Scan_Output(output, n_output, &result);
+		level->correct += result.loc == test_y[i];
+		level->tested++;
+
+		run_ann(net, (float *) test_x + (size_t) i * width);
+		for (j = 0; j < n_output; j++) {
+			d = fabsf(output[j] - net->output[j]);
+			if (d > level->max_difference) {
+				level->max_difference = d;
+			}
+		}
+	}
+
+	level->weights += kept;
+	level->blocks += sparse.n_blocks;
+	level->bytes += Sparse_Bytes(&sparse);
+	level->sparse_ns += time_sparse(&sparse, test_x, n_test, width, output);
+	level->dense_ns += time_dense(net, test_x, n_test, width);
+	status = 0;
+
+done:
+	free(values);
+	free(block_col);
+	free(row_start);
+	free(keep);
+	return status;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--sparsity=F,F,...] [--topology=3-32-32-6]"
+			" [--cycles=N] [--finetune=N] [--steps=N] [--folds=K] [--seed=S]"
+			" [--eta=F] [--beta=F] [--alpha=F] CORPUS\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	static const float default_levels[] = { 0, 0.25, 0.5, 0.75, 0.9 };
+	Level_Score levels[PRUNE_MAX_LEVELS];
+	Gesture_Corpus corpus;
+	Train_Options options;
+	const char *path = NULL, *v;
+	char *end;
+	unsigned int finetune = 500;
+	float *train_x, *test_x, *snapshot;
+	int *train_y, *test_y, *fold_of;
+	int i, f, n_levels = 0, folds = 5, steps = 4, width, n_train, n_test;
+	size_t n_state;
+	ANN *net;
+
+	Train_Options_Default(&options);
+	options.n_layers = Host_Parse_Topology("3-32-32-6", options.topology);
+	options.training_cycles = 4000;
+	memset(levels, 0, sizeof(levels));
+
+	for (i = 1; i < argc; i++) {
+		if ((v = option_value(argv[i], "--sparsity")) != NULL) {
+			while (*v != '\0' && n_levels < PRUNE_MAX_LEVELS) {
+				levels[n_levels].sparsity = strtof(v, &end);
+				if (end == v || levels[n_levels].sparsity < 0
+						|| levels[n_levels].sparsity >= 1) {
+					usage(argv[0]);
+					return 2;
+				}
+				n_levels++;
+				v = *end == ',' ? end + 1 : end;
+			}
+		} else if ((v = option_value(argv[i], "--topology")) != NULL) {
+			options.n_layers = Host_Parse_Topology(v, options.topology);
+		} else if ((v = option_value(argv[i], "--cycles")) != NULL) {
+			options.training_cycles = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--finetune")) != NULL) {
+			finetune = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--steps")) != NULL) {
+			steps = atoi(v);
+		} else if ((v = option_value(argv[i], "--folds")) != NULL) {
+			folds = atoi(v);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			options.weight_seed = (unsigned int) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--eta")) != NULL) {
+			options.eta = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--beta")) != NULL) {
+			options.beta = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--alpha")) != NULL) {
+			options.alpha = strtof(v, NULL);
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (path == NULL || options.n_layers < 2 || folds < 2 || steps < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (n_levels == 0) {
+		n_levels = sizeof(default_levels) / sizeof(default_levels[0]);
+		for (i = 0; i < n_levels; i++) {
+			levels[i].sparsity = default_levels[i];
+		}
+	}
+
+	if (Corpus_Load(path, &corpus) != 0) {
+		return 1;
+	}
+	width = corpus.n_features;
+	if ((int) options.topology[0] != width
+			|| (int) options.topology[options.n_layers - 1] < corpus.n_classes) {
+		fprintf(stderr, "prune: topology does not fit the %d features and %d"
+				" classes of %s\n", width, corpus.n_classes, path);
+		return 1;
+	}
+	for (i = 0; i < (int) options.n_layers; i++) {
+		if (options.topology[i] > SPARSE_MAX_WIDTH) {
+			fprintf(stderr, "prune: layers are at most SPARSE_MAX_WIDTH %d"
+					" neurons wide\n", SPARSE_MAX_WIDTH);
+			return 1;
+		}
+	}
+	Corpus_Normalize(&corpus);
+
+	net = Host_ANN_Create(options.topology, options.n_layers,
+			options.weight_seed);
+	n_state = 2 * net->n_weights + net->n_bias;
+	snapshot = malloc(sizeof(float) * n_state);
+	train_x = malloc(sizeof(float) * corpus.n_samples * width);
+	test_x = malloc(sizeof(float) * corpus.n_samples * width);
+	train_y = malloc(sizeof(int) * corpus.n_samples);
+	test_y = malloc(sizeof(int) * corpus.n_samples);
+	fold_of = malloc(sizeof(int) * corpus.n_samples);
+	if (snapshot == NULL || train_x == NULL || test_x == NULL
+			|| train_y == NULL || test_y == NULL || fold_of == NULL) {
+		fprintf(stderr, "prune: out of memory\n");
+		return 1;
+	}
+	if (Evaluate_Assign_Folds(&corpus, folds, options.weight_seed,
+			fold_of) != 0) {
+		fprintf(stderr, "prune: out of memory\n");
+		return 1;
+	}
+
+	for (f = 0; f < folds; f++) {
+		n_train = 0;
+		n_test = 0;
+		for (i = 0; i < corpus.n_samples; i++) {
+			if (fold_of[i] == f) {
+				memcpy(test_x + (size_t) n_test * width,
+						corpus.features + (size_t) i * width,
+						sizeof(float) * width);
+				test_y[n_test++] = corpus.labels[i];
+			} else {
+				memcpy(train_x + (size_t) n_train * width,
+						corpus.features + (size_t) i * width,
+						sizeof(float) * width);
+				train_y[n_train++] = corpus.labels[i];
+			}
+		}
+
+		/*
+		 * Every level starts from the same dense network; weights, dedw and
+		 * bias are one block (hostModel.c)
+		 */
+
+		Host_ANN_Reset(net, options.weight_seed);
+		net->eta = options.eta;
+		net->beta = options.beta;
+		net->alpha = options.alpha;
+		Host_ANN_Train(net, train_x, train_y, n_train, options.training_cycles);
+		memcpy(snapshot, net->weights, sizeof(float) * n_state);
+
+		for (i = 0; i < n_levels; i++) {
+			memcpy(net->weights, snapshot, sizeof(float) * n_state);
+			if (run_level(net, &levels[i], steps, finetune, train_x, train_y,
+					n_train, test_x, test_y, n_test) != 0) {
+				fprintf(stderr, "prune: out of memory\n");
+				return 1;
+			}
+		}
+	}
+
+	printf("Topology");
+	for (i = 0; i < (int) options.n_layers; i++) {
+		printf("%s%u", i ? "-" : " ", options.topology[i]);
+	}
+	printf(", %u weights, %u dense bytes, %d folds\n\n", net->n_weights,
+			(unsigned int) (net->n_weights * sizeof(float)), folds);
+	printf("Sparsity\tAccuracy\tWeights\tBlocks\tMACs\tBytes\tSparse ns"
+			"\tDense ns\tMax diff\n");
+	for (i = 0; i < n_levels; i++) {
+		Level_Score *l = &levels[i];
+		printf("%.2f\t\t%.2f%%\t\t%ld\t%ld\t%ld\t%ld\t%.1f\t\t%.1f\t\t%.1e\n",
+				l->sparsity, l->tested ? 100.0 * l->correct / l->tested : 0,
+				l->weights / folds, l->blocks / folds,
+				l->blocks / folds * SPARSE_BLOCK, l->bytes / folds,
+				l->sparse_ns / folds, l->dense_ns / folds, l->max_difference);
+	}
+
+	free(fold_of);
+	free(test_y);
+	free(train_y);
+	free(test_x);
+	free(train_x);
+	free(snapshot);
+	Host_ANN_Destroy(net);
+	Corpus_Free(&corpus);
+	return 0;
+}
@@ -0,0 +1,131 @@
+#!/bin/sh
+#
+# ramReport.sh - stack and static RAM use of the firmware, per function
+#
+# Compiles ACTUALLY-THE-FINAL-MAIN.c and the shared modules it links with
+# -fcallgraph-info=su (GCC 10 or later) and prints:
+#   - the stack frame of every function, largest first
+#   - the deepest stack below main() along the call graph, with its path
+#   - static RAM (.data and .bss) per symbol and in total
+#
+# Functions that are not compiled here (HAL, BSP, embeddedML, the C
+# library) count as 0 bytes, and interrupt handlers run on top of the
+# reported depth, so take it as a lower bound.
+#
+# Usage:
+#   host/ramReport.sh [compiler options]
+#     CC       compiler (default arm-none-eabi-gcc)
+#     NM       nm matching CC (default derived from CC)
+#     CFLAGS   target and include options (default -Os)
+#     TOP      functions listed (default 15)
+#
+# Options given on the command line select the build, e.g.
+#   host/ramReport.sh -DGESTURE_MODEL_PRETRAINED -DGESTURE_INFERENCE_ONLY
+#
+
+CC=${CC:-arm-none-eabi-gcc}
+NM=${NM:-${CC%gcc}nm}
+CFLAGS=${CFLAGS:--Os}
+TOP=${TOP:-15}
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+sources="ACTUALLY-THE-FINAL-MAIN.c gameCore.c gameMap.c gestureCore.c
+	gestureClassifier.c gestureGrammar.c gestureOnline.c gestureAnytime.c
+	gestureEnergy.c gestureFeatures.c imuEvents.c imuInterrupts.c imuStream.c
+	bootSequence.c gestureDtw.c gestureCnn.c"
+
+for f in $sources; do
+	(cd "$work" && $CC $CFLAGS "$@" -I"$root" -fcallgraph-info=su \
+			-c "$root/$f" -o "${f%.c}.o") || exit 1
+done
+
+cat "$work"/*.ci | awk -v top="$TOP" '
+function quoted(key,    s) {
+	if (!match($0, key ": \"[^\"]*\"")) {
+		return ""
+	}
+	s = substr($0, RSTART, RLENGTH)
+	sub(key ": \"", "", s)
+	sub("\"$", "", s)
+	return s
+}
+
+function depth(f,    i, d, best) {
+	if (f in memo) {
+		return memo[f]
+	}
+	if (f in visiting) {
+		recursive[f] = 1
+		return 0
+	}
+	visiting[f] = 1
+	best = 0
+	for (i = 1; i <= n_calls[f]; i++) {
+		d = depth(callee[f, i])
+		if (d > best) {
+			best = d
+			deepest[f] = callee[f, i]
+		}
+	}
+	delete visiting[f]
+	memo[f] = frame[f] + best
+	return memo[f]
+}
+
+/^node:/ {
+	name = quoted("title")
+	if (match($0, /\\n[0-9]+ bytes/)) {
+		frame[name] = substr($0, RSTART + 2, RLENGTH - 8) + 0
+		kind[name] = $0 ~ /bytes \(static\)/ ? "static" : "dynamic"
+		functions[++n_functions] = name
+	}
+}
+
+/^edge:/ {
+	from = quoted("sourcename")
+	to = quoted("targetname")
+	if (!((from, to) in seen)) {
+		seen[from, to] = 1
+		callee[from, ++n_calls[from]] = to
+	}
+}
+
+END {
+	for (i = 1; i <= n_functions; i++) {
+		for (j = i + 1; j <= n_functions; j++) {
+			if (frame[functions[j]] > frame[functions[i]]) {
+				f = functions[i]
+				functions[i] = functions[j]
+				functions[j] = f
+			}
+		}
+	}
+	printf "Function\tFrame\n"
+	for (i = 1; i <= n_functions && i <= top; i++) {
+		f = functions[i]
+		printf "%s\t%d%s\n", f, frame[f], kind[f] == "static" ? "" : " (dynamic)"
+	}
+
+	printf "\nDeepest stack below main: %d bytes\n", depth("main")
+	for (f = "main"; f != ""; f = deepest[f]) {
+		if (frame[f] > 0) {
+			printf "  %s\t%d\n", f, frame[f]
+		}
+	}
+	for (f in recursive) {
+		printf "  recursion through %s not counted\n", f
+	}
+}'
+
+printf "\nSymbol\tStatic RAM\n"
+$NM -S -r -t d --size-sort "$work"/*.o | awk '
+$3 ~ /^[bBdD]$/ {
+	printf "%s\t%d\n", $4, $2
+	total += $2
+}
+END {
+	printf "Total\t%d\n", total
+}'
@@ -0,0 +1,382 @@
+/**
+ ******************************************************************************
+ * @file    store.c
+ * @brief   Build, inspect and scan memory-mapped gesture stores
+ ******************************************************************************
+ *
+ * Packs recorded IMU traces (trace.h) into the columnar store format of
+ * columnStore.h, which sweep, anytime and every other tool reading traces
+ * load directly, and reads stores back.
+ *
+ * Usage:
+ *   store pack [options] OUT TRACES...
+ *     --device=N         device number of the first trace file, the next
+ *                        files get N+1, N+2 ... (default 0)
+ *     --angle=30 --accel=600 --acquire=800 --period=10
+ *                        firmware thresholds the traces were captured with,
+ *                        stored with every gesture
+ *   store info STORE     gestures, rows and size, gestures per class and
+ *                        device
+ *   store dump STORE     write the store as a text trace to stdout
+ *   store scan [--repeat=N] STORE
+ *                        per axis sum, minimum and maximum over every
+ *                        sample, read in place; prints the scan rate
+ *
+ * Samples are stored as int16 counts. pack picks the smallest whole
+ * number of BSP units per count that holds each gesture's largest value,
+ * 1 unless a value exceeds 32767.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "corpus.h"
+#include "columnStore.h"
+#include "trace.h"
+
+#define STORE_MAX_DEVICES 256
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static float count_scale(int (*samples)[3], int n) {
+
+	int i, a, largest = 0;
+
+	for (i = 0; i < n; i++) {
+		for (a = 0; a < 3; a++) {
+			if (abs(samples[i][a]) > largest) {
+				largest = abs(samples[i][a]);
+			}
+		}
+	}
+	return largest > INT16_MAX ? ceilf((float) largest / INT16_MAX) : 1;
+}
+
+static int16_t to_count(int x, float scale) {
+
+	long c = lrintf(x / scale);
+
+	return (int16_t) (c > INT16_MAX ? INT16_MAX : c < -INT16_MAX ? -INT16_MAX : c);
+}
+
+static int pack_trace(Store_Writer *writer, const Gesture_Trace *trace,
+		Store_Meta *meta, int16_t *rows) {
+
+	const int16_t *columns[STORE_AXES];
+	int n = trace->n_0 + trace->n_1;
+	int i, a;
+
+	meta->label = trace->label;
+	meta->n = (uint32_t) n;
+	meta->n_0 = (uint32_t) trace->n_0;
+	meta->gyro_scale = count_scale(trace->state_0, trace->n_0);
+	meta->accel_scale = count_scale(trace->state_1, trace->n_1);
+
+	/*
+	 * Each state reads one sensor; the other's axes are left at zero
+	 */
+
+	memset(rows, 0, sizeof(int16_t) * STORE_AXES * n);
+	for (a = 0; a < STORE_AXES; a++) {
+		columns[a] = rows + (size_t) a * n;
+	}
+	for (i = 0; i < trace->n_0; i++) {
+		for (a = 0; a < 3; a++) {
+			rows[(size_t) (STORE_GX + a) * n + i] = to_count(trace->state_0[i][a],
+					meta->gyro_scale);
+		}
+	}
+	for (i = 0; i < trace->n_1; i++) {
+		for (a = 0; a < 3; a++) {
+			rows[(size_t) (STORE_AX + a) * n + trace->n_0 + i] = to_count(
+					trace->state_1[i][a], meta->accel_scale);
+		}
+	}
+	return Store_Append(writer, meta, columns);
+}
+
+static int pack(const char *out, char **paths, int n_paths, Store_Meta *meta) {
+
+	Store_Writer writer;
+	Trace_Set set;
+	int16_t *rows = NULL;
+	int i, t, n, capacity = 0;
+	long gestures = 0;
+
+	if (Store_Create(&writer, out) != 0) {
+		Store_Finish(&writer);
+		return 1;
+	}
+	for (i = 0; i < n_paths; i++) {
+		if (Trace_Load(paths[i], &set) != 0) {
+			goto fail;
+		}
+		for (t = 0; t < set.n_traces; t++) {
+			n = set.traces[t].n_0 + set.traces[t].n_1;
+			if (n > capacity) {
+				int16_t *grow = realloc(rows, sizeof(int16_t) * STORE_AXES * n);
+				if (grow == NULL) {
+					fprintf(stderr, "store: out of memory\n");
+					Trace_Free(&set);
+					goto fail;
+				}
+				rows = grow;
+				capacity = n;
+			}
+			if (pack_trace(&writer, &set.traces[t], meta, rows) != 0) {
+				Trace_Free(&set);
+				goto fail;
+			}
+		}
+		gestures += set.n_traces;
+		Trace_Free(&set);
+		meta->device++;
+	}
+	free(rows);
+	if (Store_Finish(&writer) != 0) {
+		return 1;
+	}
+	printf("Packed %ld gestures from %d files into %s\n", gestures, n_paths,
+			out);
+	return 0;
+
+fail:
+	free(rows);
+	Store_Finish(&writer);
+	remove(out);
+	return 1;
+}
+
+static int info(const Gesture_Store *store) {
+
+	long per_class[CORPUS_MAX_CLASSES] = { 0 };
+	long per_device[STORE_MAX_DEVICES] = { 0 };
+	long other_devices = 0;
+	int i;
+
+	for (i = 0; i < store->n_gestures; i++) {
+		per_class[store->meta[i].label]++;
+		if (store->meta[i].device < STORE_MAX_DEVICES) {
+			per_device[store->meta[i].device]++;
+		} else {
+			other_devices++;
+		}
+	}
+
+	printf("Gestures %d  classes %d  rows %llu  bytes %zu (%.1f per row)\n",
+			store->n_gestures, store->n_classes,
+			(unsigned long long) store->n_rows, store->size,
+			store->n_rows ? (double) store->size / store->n_rows : 0);
+	printf("\nClass\tGestures\n");
+	for (i = 0; i < store->n_classes; i++) {
+		printf("%d\t%ld\n", i, per_class[i]);
+	}
+	printf("\nDevice\tGestures\n");
+	for (i = 0; i < STORE_MAX_DEVICES; i++) {
+		if (per_device[i] > 0) {
+			printf("%d\t%ld\n", i, per_device[i]);
+		}
+	}
+	if (other_devices > 0) {
+		printf(">=%d\t%ld\n", STORE_MAX_DEVICES, other_devices);
+	}
+	return 0;
+}
+
+static int dump(const Gesture_Store *store) {
+
+	const Store_Meta *m;
+	const int16_t *x, *y, *z;
+	uint32_t j;
+	int i;
+
+	printf("# gesture store, %d gestures\n", store->n_gestures);
+	for (i = 0; i < store->n_gestures; i++) {
+		m = &store->meta[i];
+		printf("gesture %d %u %u\n", m->label, m->n_0, m->n - m->n_0);
+		x = Store_Column(store, i, STORE_GX);
+		y = Store_Column(store, i, STORE_GY);
+		z = Store_Column(store, i, STORE_GZ);
+		for (j = 0; j < m->n_0; j++) {
+			printf("%ld %ld %ld\n", lrintf(x[j] * m->gyro_scale),
+					lrintf(y[j] * m->gyro_scale), lrintf(z[j] * m->gyro_scale));
+		}
+		x = Store_Column(store, i, STORE_AX);
+		y = Store_Column(store, i, STORE_AY);
+		z = Store_Column(store, i, STORE_AZ);
+		for (; j < m->n; j++) {
+			printf("%ld %ld %ld\n", lrintf(x[j] * m->accel_scale),
+					lrintf(y[j] * m->accel_scale), lrintf(z[j] * m->accel_scale));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Reads every column once per pass, in file order, straight from the
+ * mapping
+ */
+
+static int scan(const Gesture_Store *store, int repeat) {
+
+	static const char *names[STORE_AXES] = { "ax", "ay", "az", "gx", "gy", "gz" };
+	long long sum[STORE_AXES];
+	int min[STORE_AXES], max[STORE_AXES];
+	const int16_t *column;
+	double start, elapsed, bytes;
+	long long s;
+	uint32_t j, n;
+	int r, i, a, lo, hi;
+
+	start = now_ms();
+	for (r = 0; r < repeat; r++) {
+		for (a = 0; a < STORE_AXES; a++) {
+			sum[a] = 0;
+			min[a] = INT16_MAX;
+			max[a] = INT16_MIN;
+		}
+		for (i = 0; i < store->n_gestures; i++) {
+			n = store->meta[i].n;
+			for (a = 0; a < STORE_AXES; a++) {
+				column = Store_Column(store, i, a);
+				s = 0;
+				lo = min[a];
+				hi = max[a];
+				for (j = 0; j < n; j++) {
+					s += column[j];
+					lo = column[j] < lo ? column[j] : lo;
+					hi = column[j] > hi ? column[j] : hi;
+				}
+				sum[a] += s;
+				min[a] = lo;
+				max[a] = hi;
+			}
+		}
+	}
+	elapsed = now_ms() - start;
+	bytes = (double) store->n_rows * STORE_AXES * sizeof(int16_t) * repeat;
+
+	printf("Axis\tMean count\tMin\tMax\n");
+	for (a = 0; a < STORE_AXES; a++) {
+		printf("%s\t%.2f\t\t%d\t%d\n", names[a],
+				store->n_rows ? (double) sum[a] / store->n_rows : 0, min[a],
+				max[a]);
+	}
+	printf("\nScanned %.0f MB in %.1f ms, %.2f GB/s, %.1f M rows/s\n",
+			bytes / 1e6, elapsed, elapsed > 0 ? bytes / elapsed / 1e6 : 0,
+			elapsed > 0 ? store->n_rows * (double) repeat / elapsed / 1e3 : 0);
+	return 0;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s pack [--device=N] [--angle=F] [--accel=F]"
+			" [--acquire=N] [--period=MS] OUT TRACES...\n"
+			"       %s info|dump STORE\n"
+			"       %s scan [--repeat=N] STORE\n", argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+
+	Gesture_Store store;
+	Store_Meta meta;
+	const char *v, *path = NULL;
+	int i, status, repeat = 1, first_path = 0;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	memset(&meta, 0, sizeof(meta));
+	meta.angle_threshold = 30;
+	meta.accel_threshold = 600;
+	meta.max_acquire_cycles = 800;
+	meta.Tsample = 0.01f;
+
+	for (i = 2; i < argc; i++) {
+		if ((v = option_value(argv[i], "--device")) != NULL) {
+			meta.device = (uint32_t) strtoul(v, NULL, 10);
+		} else if ((v = option_value(argv[i], "--angle")) != NULL) {
+			meta.angle_threshold = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--accel")) != NULL) {
+			meta.accel_threshold = strtof(v, NULL);
+		} else if ((v = option_value(argv[i], "--acquire")) != NULL) {
+			meta.max_acquire_cycles = atoi(v);
+		} else if ((v = option_value(argv[i], "--period")) != NULL) {
+			meta.Tsample = strtof(v, NULL) / 1000;
+		} else if ((v = option_value(argv[i], "--repeat")) != NULL) {
+			repeat = atoi(v);
+		} else if (argv[i][0] != '-') {
+			if (first_path == 0) {
+				first_path = i;
+				path = argv[i];
+			}
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (strcmp(argv[1], "pack") == 0) {
+		if (path == NULL || first_path + 1 >= argc) {
+			usage(argv[0]);
+			return 2;
+		}
+
+		/*
+		 * Options may sit between the trace files, so they are skipped here
+		 */
+
+		char **paths = malloc(sizeof(char *) * argc);
+		int n_paths = 0;
+
+		for (i = first_path + 1; i < argc; i++) {
+			if (argv[i][0] != '-') {
+				paths[n_paths++] = argv[i];
+			}
+		}
+		status = n_paths > 0 ? pack(path, paths, n_paths, &meta) : 2;
+		if (status == 2) {
+			usage(argv[0]);
+		}
+		free(paths);
+		return status;
+	}
+
+	if (path == NULL || repeat < 1 || (strcmp(argv[1], "info") != 0
+			&& strcmp(argv[1], "dump") != 0 && strcmp(argv[1], "scan") != 0)) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (Store_Open(path, &store) != 0) {
+		return 1;
+	}
+	if (strcmp(argv[1], "info") == 0) {
+		status = info(&store);
+	} else if (strcmp(argv[1], "dump") == 0) {
+		status = dump(&store);
+	} else {
+		status = scan(&store, repeat);
+	}
+	Store_Close(&store);
+	return status;
+}
@@ -0,0 +1,446 @@
+/**
+ ******************************************************************************
+ * @file    sweep.c
+ * @brief   Parameter sweep of feature thresholds and training options
+ ******************************************************************************
+ *
+ * Replays recorded IMU traces (see trace.h) through the firmware feature
+ * extraction (gestureFeatures.c), then cross-validates a fresh network on
+ * the resulting features, for every combination of the thresholds and
+ * training options that are otherwise tuned by editing #defines and
+ * reflashing. Each configuration is one job on the worker pool with its
+ * own corpus and networks.
+ *
+ * Every value option takes a comma separated list; the default is the
+ * firmware value.
+ *
+ * Usage:
+ *   sweep [options] TRACES
+ *     --angle=30         ANGLE_MAG_MAX_THRESHOLD [degrees]
+ *     --accel=600        State 1 acceleration change, 2 * Z_ACCEL_THRESHOLD [mg]
+ *     --acquire=800      MAX_ROTATION_ACQUIRE_CYCLES
+ *     --cycles=2000      TRAINING_CYCLES
+ *     --eta=0.13 --beta=0.01 --alpha=0.25
+ *     --random=N         draw N configurations uniformly between the smallest
+ *                        and largest value of each list instead of running
+ *                        the full grid
+ *     --folds=K          folds per configuration (default 5)
+ *     --window           add the running window statistics of both states
+ *                        (gestureFeatures.h) to the three snapshot features
+ *     --topology=3-9-6   network topology, input width must be 3, or 37 with
+ *                        --window (default 37-9-6)
+ *     --threads=N        worker threads (default: online CPUs)
+ *     --seed=S           fold, random draw and weight seed (0 = firmware weights)
+ *     --csv=FILE         write every configuration as CSV
+ *
+ * Latency is the mean time from LED on to the end of capture over both
+ * states, samples * DATA_PERIOD_MS. The fixed holds after each state are
+ * not included. The printed table is the Pareto front: configurations no
+ * other configuration beats on both accuracy and latency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gestureConfig.h"
+#include "gestureCore.h"
+#include "gestureFeatures.h"
+#include "corpus.h"
+#include "evaluate.h"
+#include "featurePipeline.h"
+#include "hostModel.h"
+#include "threadPool.h"
+#include "trace.h"
+
+#define SWEEP_MAX_VALUES 32
+
+enum {
+	PARAM_ANGLE,
+	PARAM_ACCEL,
+	PARAM_ACQUIRE,
+	PARAM_CYCLES,
+	PARAM_ETA,
+	PARAM_BETA,
+	PARAM_ALPHA,
+	N_PARAMS
+};
+
+typedef struct {
+	const char *option;
+	int integer;
+	int n_values;
+	double values[SWEEP_MAX_VALUES];
+} Sweep_Param;
+
+typedef struct {
+	const Trace_Set *traces;
+	int window;
+	int folds;
+	unsigned int seed;
+	Feature_Config features;
+	Train_Options options;
+
+	/* results */
+	int status;               /* 0 ok, -1 out of memory */
+	int n_test;
+	int correct;
+	int accepted;
+	int converged;
+	double latency_ms;
+	int pareto;
+} Sweep_Job;
+
+static Sweep_Param params[N_PARAMS] = {
+	{ "--angle", 0, 1, { 30 } },
+	{ "--accel", 0, 1, { 600 } },
+	{ "--acquire", 1, 1, { 800 } },
+	{ "--cycles", 1, 1, { 2000 } },
+	{ "--eta", 0, 1, { 0.13 } },
+	{ "--beta", 0, 1, { 0.01 } },
+	{ "--alpha", 0, 1, { 0.25 } },
+};
+
+static double now_ms(void) {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void run_config(void *arg) {
+
+	Sweep_Job *job = arg;
+	const Trace_Set *set = job->traces;
+	Gesture_Corpus corpus;
+	Fold_Score score;
+	int *fold_of = malloc(sizeof(int) * set->n_traces);
+	int samples_used[2];
+	long samples = 0;
+	float *x;
+	int i, width;
+
+	width = Pipeline_Width(job->window);
+	corpus.n_samples = set->n_traces;
+	corpus.n_features = width;
+	corpus.n_classes = set->n_classes;
+	corpus.normalized = 1;
+	corpus.labels = malloc(sizeof(int) * set->n_traces);
+	corpus.features = malloc(sizeof(float) * width * set->n_traces);
+	if (fold_of == NULL || corpus.labels == NULL || corpus.features == NULL) {
+		job->status = -1;
+		goto done;
+	}
+
+	for (i = 0; i < set->n_traces; i++) {
+		const Gesture_Trace *trace = &set->traces[i];
+		x = corpus.features + (size_t) i * width;
+		Pipeline_Extract(&job->features, job->window,
+				(const int (*)[3]) trace->state_0, trace->n_0,
+				(const int (*)[3]) trace->state_1, trace->n_1, x, samples_used);
+		corpus.labels[i] = trace->label;
+		samples += samples_used[0] + samples_used[1];
+	}
+	job->latency_ms = (double) samples * DATA_PERIOD_MS / set->n_traces;
+
+	if (Evaluate_Assign_Folds(&corpus, job->folds, job->seed, fold_of) != 0) {
+		job->status = -1;
+		goto done;
+	}
+
+	for (i = 0; i < job->folds; i++) {
+		Evaluate_Fold(&corpus, fold_of, i, &job->options, &score, NULL);
+		if (score.steps == -2) {
+			job->status = -1;
+			goto done;
+		}
+		job->n_test += score.n_test;
+		job->correct += score.correct;
+		job->accepted += score.accepted;
+		job->converged += score.steps >= 0;
+	}
+
+done:
+	free(corpus.features);
+	free(corpus.labels);
+	free(fold_of);
+}
+
+static double accuracy(const Sweep_Job *job) {
+	return job->n_test ? (double) job->correct / job->n_test : 0;
+}
+
+static int by_latency(const void *a, const void *b) {
+
+	const Sweep_Job *x = *(const Sweep_Job * const *) a;
+	const Sweep_Job *y = *(const Sweep_Job * const *) b;
+
+	if (x->latency_ms != y->latency_ms) {
+		return x->latency_ms < y->latency_ms ? -1 : 1;
+	}
+	if (accuracy(x) != accuracy(y)) {
+		return accuracy(x) > accuracy(y) ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Value of every parameter for configuration index, either a point of the
+ * full grid or a uniform draw over the range of each list
+ */
+
+static void pick_values(int index, int random, unsigned int *rng,
+		double *values) {
+
+	int p, n, lo, hi, k;
+	double min, max;
+
+	for (p = 0; p < N_PARAMS; p++) {
+		Sweep_Param *param = &params[p];
+		if (!random) {
+			values[p] = param->values[index % param->n_values];
+			index /= param->n_values;
+			continue;
+		}
+		min = max = param->values[0];
+		for (n = 1; n < param->n_values; n++) {
+			min = param->values[n] < min ? param->values[n] : min;
+			max = param->values[n] > max ? param->values[n] : max;
+		}
+		if (param->integer) {
+			lo = (int) min;
+			hi = (int) max;
+			k = lo + (int) (Host_Rand(rng) % (unsigned int) (hi - lo + 1));
+			values[p] = k;
+		} else {
+			values[p] = Host_Rand_Uniform(rng, min, max);
+		}
+	}
+}
+
+static int parse_list(const char *text, Sweep_Param *param) {
+
+	char *end;
+
+	param->n_values = 0;
+	while (*text != '\0') {
+		if (param->n_values == SWEEP_MAX_VALUES) {
+			return -1;
+		}
+		param->values[param->n_values] = strtod(text, &end);
+		if (end == text || param->values[param->n_values] < 0) {
+			return -1;
+		}
+		param->n_values++;
+		text = end;
+		if (*text == ',') {
+			text++;
+		}
+	}
+	return param->n_values > 0 ? 0 : -1;
+}
+
+static const char *option_value(const char *arg, const char *name) {
+
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+		return arg + n + 1;
+	}
+	return NULL;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [--angle=LIST] [--accel=LIST] [--acquire=LIST]"
+			" [--cycles=LIST] [--eta=LIST] [--beta=LIST] [--alpha=LIST]"
+			" [--random=N] [--window] [--folds=K] [--topology=3-9-6] [--threads=N]"
+			" [--seed=S] [--csv=FILE] TRACES\n", argv0);
+}
+
+int main(int argc, char **argv) {
+
+	Trace_Set traces;
+	Train_Options options;
+	int folds = 5, threads = 0, random = 0, window = 0, topology_set = 0;
+	unsigned int seed = 0, rng;
+	const char *path = NULL, *csv_path = NULL, *v;
+	double values[N_PARAMS];
+	Thread_Pool *pool;
+	Sweep_Job *jobs, **sorted;
+	double start, wall_ms, best;
+	int i, p, n_jobs, n_front = 0, matched;
+
+	Train_Options_Default(&options);
+
+	for (i = 1; i < argc; i++) {
+		matched = 0;
+		for (p = 0; p < N_PARAMS; p++) {
+			if ((v = option_value(argv[i], params[p].option)) != NULL) {
+				if (parse_list(v, &params[p]) != 0) {
+					usage(argv[0]);
+					return 2;
+				}
+				matched = 1;
+			}
+		}
+		if (matched) {
+			continue;
+		}
+		if ((v = option_value(argv[i], "--random")) != NULL) {
+			random = atoi(v);
+		} else if ((v = option_value(argv[i], "--folds")) != NULL) {
+			folds = atoi(v);
+		} else if ((v = option_value(argv[i], "--topology")) != NULL) {
+			options.n_layers = Host_Parse_Topology(v, options.topology);
+			topology_set = 1;
+		} else if (strcmp(argv[i], "--window") == 0) {
+			window = PIPELINE_WINDOW;
+		} else if ((v = option_value(argv[i], "--threads")) != NULL) {
+			threads = atoi(v);
+		} else if ((v = option_value(argv[i], "--seed")) != NULL) {
+			seed = (unsigned int) strtoul(v, NULL, 10);
+			options.weight_seed = seed;
+		} else if ((v = option_value(argv[i], "--csv")) != NULL) {
+			csv_path = v;
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (window && !topology_set) {
+		options.topology[0] = 3 + FEATURE_REPLAY_WINDOW_SIZE;
+	}
+	if (path == NULL || folds < 2 || random < 0 || options.n_layers == 0
+			|| options.topology[0] != (unsigned int) Pipeline_Width(window)) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (Trace_Load(path, &traces) != 0) {
+		return 1;
+	}
+	if ((int) options.topology[options.n_layers - 1] < traces.n_classes) {
+		fprintf(stderr, "sweep: topology output %u is smaller than the %d"
+				" trace classes\n", options.topology[options.n_layers - 1],
+				traces.n_classes);
+		return 1;
+	}
+
+	n_jobs = random;
+	if (n_jobs == 0) {
+		n_jobs = 1;
+		for (p = 0; p < N_PARAMS; p++) {
+			n_jobs *= params[p].n_values;
+		}
+	}
+
+	jobs = calloc(n_jobs, sizeof(Sweep_Job));
+	sorted = malloc(n_jobs * sizeof(Sweep_Job *));
+	pool = Thread_Pool_Create(threads);
+	if (jobs == NULL || sorted == NULL || pool == NULL) {
+		fprintf(stderr, "sweep: out of memory\n");
+		return 1;
+	}
+
+	rng = seed + 1;
+	start = now_ms();
+	for (i = 0; i < n_jobs; i++) {
+		Sweep_Job *job = &jobs[i];
+		pick_values(i, random, &rng, values);
+		job->traces = &traces;
+		job->window = window;
+		job->folds = folds;
+		job->seed = seed + 7919u;
+		job->features.angle_mag_max_threshold = values[PARAM_ANGLE];
+		job->features.accel_threshold = values[PARAM_ACCEL];
+		job->features.max_acquire_cycles = (int) values[PARAM_ACQUIRE];
+		job->features.Tsample = (float) (DATA_PERIOD_MS) / 1000;
+		job->options = options;
+		job->options.training_cycles = (unsigned int) values[PARAM_CYCLES];
+		job->options.eta = values[PARAM_ETA];
+		job->options.beta = values[PARAM_BETA];
+		job->options.alpha = values[PARAM_ALPHA];
+		Thread_Pool_Submit(pool, run_config, job);
+	}
+	Thread_Pool_Wait(pool);
+	wall_ms = now_ms() - start;
+
+	for (i = 0; i < n_jobs; i++) {
+		if (jobs[i].status != 0) {
+			fprintf(stderr, "sweep: configuration %d ran out of memory\n", i);
+			return 1;
+		}
+		sorted[i] = &jobs[i];
+	}
+
+	/*
+	 * Walking up in latency, a configuration is on the front when it is
+	 * more accurate than everything faster
+	 */
+
+	qsort(sorted, n_jobs, sizeof(Sweep_Job *), by_latency);
+	best = -1;
+	for (i = 0; i < n_jobs; i++) {
+		if (accuracy(sorted[i]) > best) {
+			sorted[i]->pareto = 1;
+			best = accuracy(sorted[i]);
+			n_front++;
+		}
+	}
+
+	printf("Traces %s: %d gestures, %d classes\n", path, traces.n_traces,
+			traces.n_classes);
+	printf("%d configurations x %d folds on %d threads, %.1f ms, %.2f"
+			" configurations/s\n\n", n_jobs, folds, Thread_Pool_Size(pool),
+			wall_ms, n_jobs / (wall_ms / 1e3));
+
+	printf("Pareto front, %d of %d configurations\n", n_front, n_jobs);
+	printf("Latency ms\tAccuracy\tAccepted\tConverged\tAngle\tAccel\tAcquire"
+			"\tCycles\tEta\tBeta\tAlpha\n");
+	for (i = 0; i < n_jobs; i++) {
+		Sweep_Job *job = sorted[i];
+		if (!job->pareto) {
+			continue;
+		}
+		printf("%.1f\t\t%.1f%%\t\t%.1f%%\t\t%d/%d\t\t%.1f\t%.0f\t%d\t%u\t%.4f"
+				"\t%.4f\t%.4f\n", job->latency_ms, 100.0 * accuracy(job),
+				job->n_test ? 100.0 * job->accepted / job->n_test : 0,
+				job->converged, folds, job->features.angle_mag_max_threshold,
+				job->features.accel_threshold, job->features.max_acquire_cycles,
+				job->options.training_cycles, job->options.eta,
+				job->options.beta, job->options.alpha);
+	}
+
+	if (csv_path != NULL) {
+		FILE *f = fopen(csv_path, "w");
+		if (f == NULL) {
+			fprintf(stderr, "sweep: cannot write %s\n", csv_path);
+			return 1;
+		}
+		fprintf(f, "angle,accel,acquire,cycles,eta,beta,alpha,latency_ms,"
+				"accuracy,accepted,converged,pareto\n");
+		for (i = 0; i < n_jobs; i++) {
+			Sweep_Job *job = &jobs[i];
+			fprintf(f, "%g,%g,%d,%u,%g,%g,%g,%.2f,%.4f,%.4f,%d,%d\n",
+					job->features.angle_mag_max_threshold,
+					job->features.accel_threshold,
+					job->features.max_acquire_cycles,
+					job->options.training_cycles, job->options.eta,
+					job->options.beta, job->options.alpha, job->latency_ms,
+					accuracy(job),
+					job->n_test ? (double) job->accepted / job->n_test : 0,
+					job->converged, job->pareto);
+		}
+		fclose(f);
+	}
+
+	Thread_Pool_Destroy(pool);
+	free(sorted);
+	free(jobs);
+	Trace_Free(&traces);
+	return 0;
+}
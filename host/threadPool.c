@@ -0,0 +1,326 @@
+/**
+ ******************************************************************************
+ * @file    threadPool.c
+ * @brief   Fixed size worker pool for the host tools
+ ******************************************************************************
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "threadPool.h"
+
+typedef struct Thread_Pool_Task {
+	Thread_Pool_Job job;
+	void *arg;
+	struct Thread_Pool_Task *next;
+} Thread_Pool_Task;
+
+struct Thread_Pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	Thread_Pool_Task *head;
+	Thread_Pool_Task *tail;
+	int pending;
+	int stopping;
+	int n_threads;
+	pthread_t *threads;
+};
+
+int Thread_Pool_Online_CPUs(void) {
+
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? (int) n : 1;
+}
+
+static void *worker(void *arg) {
+
+	Thread_Pool *pool = arg;
+	Thread_Pool_Task *task;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->head == NULL && !pool->stopping) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		if (pool->head == NULL) {
+			break;
+		}
+
+		task = pool->head;
+		pool->head = task->next;
+		if (pool->head == NULL) {
+			pool->tail = NULL;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		task->job(task->arg);
+		free(task);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0) {
+			pthread_cond_broadcast(&pool->idle);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+Thread_Pool *Thread_Pool_Create(int n_threads) {
+
+	Thread_Pool *pool;
+	int i;
+
+	if (n_threads <= 0) {
+		n_threads = Thread_Pool_Online_CPUs();
+	}
+
+	pool = calloc(1, sizeof(Thread_Pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	pool->threads = calloc(n_threads, sizeof(pthread_t));
+	if (pool->threads == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	for (i = 0; i < n_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+			break;
+		}
+	}
+	pool->n_threads = i;
+	if (i == 0) {
+		Thread_Pool_Destroy(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+int Thread_Pool_Size(const Thread_Pool *pool) {
+	return pool->n_threads;
+}
+
+int Thread_Pool_Submit(Thread_Pool *pool, Thread_Pool_Job job, void *arg) {
+
+	Thread_Pool_Task *task = malloc(sizeof(Thread_Pool_Task));
+
+	if (task == NULL) {
+		return -1;
+	}
+	task->job = job;
+	task->arg = arg;
+	task->next = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail != NULL) {
+		pool->tail->next = task;
+	} else {
+		pool->head = task;
+	}
+	pool->tail = task;
+	pool->pending++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+void Thread_Pool_Wait(Thread_Pool *pool) {
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Chunks left to a worker, first << 32 | end, changed by compare and swap
+ * only. Its owner takes from the front, thieves cut off the back. A range
+ * is refilled only by its owner, and only once empty, so it never returns
+ * to a value a stalled thief may still hold.
+ */
+
+typedef struct {
+	_Atomic uint64_t chunks;
+	char pad[64 - sizeof(uint64_t)];   /* one cache line each */
+} Steal_Range;
+
+typedef struct {
+	Thread_Pool_Range body;
+	void *arg;
+	int n;
+	int chunk;
+	int n_ranges;
+	Steal_Range *ranges;
+	atomic_int next_runner;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	int running;
+} Steal_Loop;
+
+static uint64_t pack_range(uint32_t first, uint32_t end) {
+	return (uint64_t) first << 32 | end;
+}
+
+static int take_front(Steal_Range *range, uint32_t *chunk) {
+
+	uint64_t r = atomic_load(&range->chunks);
+	uint32_t first, end;
+
+	do {
+		first = (uint32_t) (r >> 32);
+		end = (uint32_t) r;
+		if (first >= end) {
+			return 0;
+		}
+	} while (!atomic_compare_exchange_weak(&range->chunks, &r,
+			pack_range(first + 1, end)));
+	*chunk = first;
+	return 1;
+}
+
+static int steal_back(Steal_Range *victim, Steal_Range *own) {
+
+	uint64_t r = atomic_load(&victim->chunks);
+	uint32_t first, end, half;
+
+	do {
+		first = (uint32_t) (r >> 32);
+		end = (uint32_t) r;
+		if (first >= end) {
+			return 0;
+		}
+		half = (end - first + 1) / 2;
+	} while (!atomic_compare_exchange_weak(&victim->chunks, &r,
+			pack_range(first, end - half)));
+	atomic_store(&own->chunks, pack_range(end - half, end));
+	return 1;
+}
+
+static void run_chunk(Steal_Loop *loop, uint32_t chunk) {
+
+	int begin = (int) chunk * loop->chunk;
+	int end = begin + loop->chunk;
+
+	loop->body(loop->arg, begin, end < loop->n ? end : loop->n);
+}
+
+/*
+ * One per worker. A runner that starts late finds its range partly or
+ * wholly stolen, which is fine.
+ */
+
+static void runner(void *arg) {
+
+	Steal_Loop *loop = arg;
+	int self = atomic_fetch_add(&loop->next_runner, 1);
+	Steal_Range *own = &loop->ranges[self];
+	uint32_t chunk;
+	int i, stolen;
+
+	do {
+		while (take_front(own, &chunk)) {
+			run_chunk(loop, chunk);
+		}
+		stolen = 0;
+		for (i = 1; i < loop->n_ranges && !stolen; i++) {
+			stolen = steal_back(&loop->ranges[(self + i) % loop->n_ranges], own);
+		}
+	} while (stolen);
+
+	pthread_mutex_lock(&loop->lock);
+	if (--loop->running == 0) {
+		pthread_cond_signal(&loop->done);
+	}
+	pthread_mutex_unlock(&loop->lock);
+}
+
+int Thread_Pool_For(Thread_Pool *pool, int n, int chunk, Thread_Pool_Range body,
+		void *arg) {
+
+	Steal_Loop loop;
+	int i, n_chunks;
+
+	if (n <= 0) {
+		return 0;
+	}
+	if (chunk < 1) {
+		chunk = 1;
+	}
+	n_chunks = (n - 1) / chunk + 1;
+
+	loop.body = body;
+	loop.arg = arg;
+	loop.n = n;
+	loop.chunk = chunk;
+	loop.n_ranges = pool->n_threads < n_chunks ? pool->n_threads : n_chunks;
+	loop.ranges = aligned_alloc(64, sizeof(Steal_Range) * loop.n_ranges);
+	if (loop.ranges == NULL) {
+		return -1;
+	}
+	for (i = 0; i < loop.n_ranges; i++) {
+		atomic_init(&loop.ranges[i].chunks, pack_range(
+				(uint32_t) ((long) n_chunks * i / loop.n_ranges),
+				(uint32_t) ((long) n_chunks * (i + 1) / loop.n_ranges)));
+	}
+	atomic_init(&loop.next_runner, 0);
+	pthread_mutex_init(&loop.lock, NULL);
+	pthread_cond_init(&loop.done, NULL);
+	loop.running = loop.n_ranges;
+
+	/*
+	 * A runner that cannot be queued is run here, after the others
+	 * started; its range is stolen meanwhile or worked off then
+	 */
+
+	for (i = 0; i < loop.n_ranges; i++) {
+		if (Thread_Pool_Submit(pool, runner, &loop) != 0) {
+			break;
+		}
+	}
+	for (; i < loop.n_ranges; i++) {
+		runner(&loop);
+	}
+
+	pthread_mutex_lock(&loop.lock);
+	while (loop.running > 0) {
+		pthread_cond_wait(&loop.done, &loop.lock);
+	}
+	pthread_mutex_unlock(&loop.lock);
+
+	pthread_cond_destroy(&loop.done);
+	pthread_mutex_destroy(&loop.lock);
+	free(loop.ranges);
+	return 0;
+}
+
+void Thread_Pool_Destroy(Thread_Pool *pool) {
+
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_threads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->idle);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * @file    threadPool.h
+ * @brief   Fixed size worker pool for the host tools
+ ******************************************************************************
+ */
+
+#ifndef HOST_THREAD_POOL_H
+#define HOST_THREAD_POOL_H
+
+typedef void (*Thread_Pool_Job)(void *arg);
+
+typedef struct Thread_Pool Thread_Pool;
+
+/*
+ * n_threads <= 0 selects one worker per online CPU
+ */
+
+Thread_Pool *Thread_Pool_Create(int n_threads);
+int Thread_Pool_Size(const Thread_Pool *pool);
+
+/*
+ * Jobs run in submission order as workers become free
+ */
+
+int Thread_Pool_Submit(Thread_Pool *pool, Thread_Pool_Job job, void *arg);
+
+/*
+ * Block until every submitted job has finished
+ */
+
+void Thread_Pool_Wait(Thread_Pool *pool);
+
+/*
+ * Run body over the items 0 .. n - 1 in chunks of chunk items and return
+ * once all are done. The chunks are dealt out evenly, one range per
+ * worker; a worker takes chunks from the front of its own range and, once
+ * that is empty, steals the back half of another's. body is called with
+ * [begin, end) and must only write state owned by those items, so the
+ * result does not depend on which worker ran a chunk. Not to be called
+ * from a pool job.
+ */
+
+typedef void (*Thread_Pool_Range)(void *arg, int begin, int end);
+
+int Thread_Pool_For(Thread_Pool *pool, int n, int chunk, Thread_Pool_Range body,
+		void *arg);
+void Thread_Pool_Destroy(Thread_Pool *pool);
+
+int Thread_Pool_Online_CPUs(void);
+
+#endif /* HOST_THREAD_POOL_H */
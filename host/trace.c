@@ -0,0 +1,211 @@
+/**
+ ******************************************************************************
+ * @file    trace.c
+ * @brief   Recorded IMU gesture traces for the host sweep tools
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+#include "columnStore.h"
+#include "trace.h"
+
+/*
+ * Next line that is not blank or a comment, NULL at end of file
+ */
+
+static char *next_line(FILE *f, char *line, int size, int *line_number) {
+
+	char *p;
+
+	while (fgets(line, size, f) != NULL) {
+		(*line_number)++;
+		p = line;
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if (*p != '#' && *p != '\n' && *p != '\r' && *p != '\0') {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static int read_samples(FILE *f, const char *path, int *line_number,
+		int (*samples)[3], int n) {
+
+	char line[256];
+	char *p;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		p = next_line(f, line, sizeof(line), line_number);
+		if (p == NULL || sscanf(p, "%d %d %d", &samples[i][0], &samples[i][1],
+				&samples[i][2]) != 3) {
+			fprintf(stderr, "trace: %s:%d: expected three sensor values\n",
+					path, *line_number);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Copy the gyro rows of State 0 and the accelerometer rows of State 1
+ * out of a store, in the BSP units of the text format
+ */
+
+static int load_store(const char *path, Trace_Set *set) {
+
+	Gesture_Store store;
+	const Store_Meta *m;
+	const int16_t *column[STORE_AXES];
+	Gesture_Trace *trace;
+	int i, j, a;
+
+	if (Store_Open(path, &store) != 0) {
+		return -1;
+	}
+	set->traces = calloc(store.n_gestures, sizeof(Gesture_Trace));
+	if (set->traces == NULL) {
+		fprintf(stderr, "trace: out of memory\n");
+		goto fail;
+	}
+
+	for (i = 0; i < store.n_gestures; i++) {
+		m = &store.meta[i];
+		if (m->n_0 < 1 || m->n - m->n_0 < 1) {
+			fprintf(stderr, "trace: %s: gesture %d lacks a state\n", path, i);
+			goto fail;
+		}
+		trace = &set->traces[set->n_traces++];
+		trace->label = m->label;
+		trace->n_0 = (int) m->n_0;
+		trace->n_1 = (int) (m->n - m->n_0);
+		trace->state_0 = malloc(sizeof(int[3]) * trace->n_0);
+		trace->state_1 = malloc(sizeof(int[3]) * trace->n_1);
+		if (trace->state_0 == NULL || trace->state_1 == NULL) {
+			fprintf(stderr, "trace: out of memory\n");
+			goto fail;
+		}
+		for (a = 0; a < STORE_AXES; a++) {
+			column[a] = Store_Column(&store, i, a);
+		}
+		for (j = 0; j < trace->n_0; j++) {
+			for (a = 0; a < 3; a++) {
+				trace->state_0[j][a] = (int) lrintf(column[STORE_GX + a][j]
+						* m->gyro_scale);
+			}
+		}
+		for (j = 0; j < trace->n_1; j++) {
+			for (a = 0; a < 3; a++) {
+				trace->state_1[j][a] = (int) lrintf(column[STORE_AX + a][trace->n_0
+						+ j] * m->accel_scale);
+			}
+		}
+	}
+	set->n_classes = store.n_classes;
+
+	Store_Close(&store);
+	if (set->n_traces == 0) {
+		fprintf(stderr, "trace: %s holds no gestures\n", path);
+		return -1;
+	}
+	return 0;
+
+fail:
+	Store_Close(&store);
+	Trace_Free(set);
+	return -1;
+}
+
+int Trace_Load(const char *path, Trace_Set *set) {
+
+	char line[256];
+	int capacity = 0, line_number = 0;
+	Gesture_Trace *trace;
+	char *p;
+	FILE *f;
+
+	memset(set, 0, sizeof(Trace_Set));
+
+	if (Store_Is_Store(path)) {
+		return load_store(path, set);
+	}
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "trace: cannot open %s\n", path);
+		return -1;
+	}
+
+	while ((p = next_line(f, line, sizeof(line), &line_number)) != NULL) {
+
+		if (set->n_traces == capacity) {
+			int grow = capacity ? capacity * 2 : 64;
+			Gesture_Trace *traces = realloc(set->traces,
+					grow * sizeof(Gesture_Trace));
+			if (traces == NULL) {
+				fprintf(stderr, "trace: out of memory\n");
+				goto fail;
+			}
+			set->traces = traces;
+			capacity = grow;
+		}
+		trace = &set->traces[set->n_traces];
+		memset(trace, 0, sizeof(Gesture_Trace));
+
+		if (sscanf(p, "gesture %d %d %d", &trace->label, &trace->n_0,
+				&trace->n_1) != 3 || trace->label < 0
+				|| trace->label >= CORPUS_MAX_CLASSES || trace->n_0 < 1
+				|| trace->n_1 < 1) {
+			fprintf(stderr, "trace: %s:%d: expected gesture LABEL N0 N1\n",
+					path, line_number);
+			goto fail;
+		}
+		set->n_traces++;
+
+		trace->state_0 = malloc(sizeof(int[3]) * trace->n_0);
+		trace->state_1 = malloc(sizeof(int[3]) * trace->n_1);
+		if (trace->state_0 == NULL || trace->state_1 == NULL) {
+			fprintf(stderr, "trace: out of memory\n");
+			goto fail;
+		}
+		if (read_samples(f, path, &line_number, trace->state_0, trace->n_0) != 0
+				|| read_samples(f, path, &line_number, trace->state_1,
+						trace->n_1) != 0) {
+			goto fail;
+		}
+		if (trace->label + 1 > set->n_classes) {
+			set->n_classes = trace->label + 1;
+		}
+	}
+
+	fclose(f);
+	if (set->n_traces == 0) {
+		fprintf(stderr, "trace: %s holds no gestures\n", path);
+		return -1;
+	}
+	return 0;
+
+fail:
+	fclose(f);
+	Trace_Free(set);
+	return -1;
+}
+
+void Trace_Free(Trace_Set *set) {
+
+	int i;
+
+	for (i = 0; i < set->n_traces; i++) {
+		free(set->traces[i].state_0);
+		free(set->traces[i].state_1);
+	}
+	free(set->traces);
+	memset(set, 0, sizeof(Trace_Set));
+}
@@ -0,0 +1,45 @@
+/**
+ ******************************************************************************
+ * @file    trace.h
+ * @brief   Recorded IMU gesture traces for the host sweep tools
+ ******************************************************************************
+ *
+ * A trace file holds the raw sensor reads behind captured gestures, so the
+ * feature extraction can be replayed with other thresholds. Each gesture
+ * starts with a header line followed by its samples:
+ *
+ *   gesture LABEL N0 N1
+ *   gx gy gz          N0 lines, State 0 gyro reads (milli-degrees/s)
+ *   ax ay az          N1 lines, State 1 accelerometer reads (mg)
+ *
+ * The first sample of each state is the reference read taken before the
+ * LED turns on (ttt_offset and ttt_initial in the firmware), followed by
+ * one read per DATA_PERIOD_MS. Record more samples than the longest
+ * capture a sweep should consider; replay stops at the thresholds.
+ * Blank lines and lines starting with '#' are ignored.
+ *
+ * Trace_Load also reads gesture stores (columnStore.h), told apart by
+ * their magic.
+ */
+
+#ifndef HOST_TRACE_H
+#define HOST_TRACE_H
+
+typedef struct {
+	int label;
+	int n_0;
+	int n_1;
+	int (*state_0)[3];
+	int (*state_1)[3];
+} Gesture_Trace;
+
+typedef struct {
+	int n_traces;
+	int n_classes;
+	Gesture_Trace *traces;
+} Trace_Set;
+
+int Trace_Load(const char *path, Trace_Set *set);
+void Trace_Free(Trace_Set *set);
+
+#endif /* HOST_TRACE_H */
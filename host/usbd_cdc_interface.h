@@ -0,0 +1,25 @@
+/**
+ ******************************************************************************
+ * @file    usbd_cdc_interface.h
+ * @brief   Host stand-in for the SensorTile USB CDC interface header
+ ******************************************************************************
+ *
+ * Host tools compile the shared firmware modules with -Ihost so that
+ * CDC_Fill_Buffer resolves to hostPort.c instead of the USB device stack.
+ */
+
+#ifndef HOST_USBD_CDC_INTERFACE_H
+#define HOST_USBD_CDC_INTERFACE_H
+
+#include <stdint.h>
+
+/*
+ * Host_CDC_Echo = 0  --> CDC output is discarded (benchmarks, batch tools)
+ * Host_CDC_Echo = 1  --> CDC output is written to stdout
+ */
+
+extern volatile int Host_CDC_Echo;
+
+uint8_t CDC_Fill_Buffer(uint8_t *Buf, uint32_t TotalLen);
+
+#endif /* HOST_USBD_CDC_INTERFACE_H */
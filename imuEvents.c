@@ -0,0 +1,57 @@
+/**
+ ******************************************************************************
+ * @file    imuEvents.c
+ * @brief   Queue of IMU interrupt events from the EXTI callback
+ ******************************************************************************
+ */
+
+#include "imuEvents.h"
+
+void IMU_Event_Reset(IMU_Event_Queue *queue) {
+	queue->head = 0;
+	queue->tail = 0;
+	queue->dropped = 0;
+}
+
+int IMU_Event_Post(IMU_Event_Queue *queue, uint16_t pin, uint32_t tick) {
+
+	uint32_t head = queue->head;
+	IMU_Event *event;
+
+	if (head - queue->tail == IMU_EVENT_QUEUE_SIZE) {
+		queue->dropped++;
+		return -1;
+	}
+	event = &queue->events[head % IMU_EVENT_QUEUE_SIZE];
+	event->pin = pin;
+	event->tick = tick;
+
+	/*
+	 * The event must be complete before the main loop can see it
+	 */
+
+	__sync_synchronize();
+	queue->head = head + 1;
+	return 0;
+}
+
+int IMU_Event_Get(IMU_Event_Queue *queue, IMU_Event *event) {
+
+	uint32_t tail = queue->tail;
+
+	if (queue->head == tail) {
+		return 0;
+	}
+	__sync_synchronize();
+	*event = queue->events[tail % IMU_EVENT_QUEUE_SIZE];
+	queue->tail = tail + 1;
+	return 1;
+}
+
+int IMU_Event_Pending(const IMU_Event_Queue *queue) {
+	return queue->head != queue->tail;
+}
+
+void IMU_Event_Flush(IMU_Event_Queue *queue) {
+	queue->tail = queue->head;
+}
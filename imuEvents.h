@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * @file    imuEvents.h
+ * @brief   Queue of IMU interrupt events from the EXTI callback
+ ******************************************************************************
+ *
+ * HAL_GPIO_EXTI_Callback posts one event per interrupt line edge with the
+ * tick it happened at; the main loop takes them off and reads the LSM6DSM
+ * event source once per event. Nothing talks to the sensor while waiting,
+ * so the MCU can sleep until the interrupt arrives.
+ *
+ * The queue has a single producer (the interrupt) and a single consumer
+ * (the main loop) and needs no locking: only the interrupt writes head and
+ * only the main loop writes tail. Events that arrive while the queue is
+ * full are counted in dropped.
+ */
+
+#ifndef IMU_EVENTS_H
+#define IMU_EVENTS_H
+
+#include <stdint.h>
+
+#define IMU_EVENT_QUEUE_SIZE 8  /* power of two */
+
+/*
+ * Decoded event source
+ */
+
+#define IMU_EVENT_DOUBLE_TAP 0x01
+#define IMU_EVENT_WAKE_UP 0x02
+
+typedef struct {
+	uint16_t pin;               /* GPIO_Pin of the interrupt */
+	uint32_t tick;              /* HAL_GetTick() when it arrived */
+} IMU_Event;
+
+typedef struct {
+	volatile uint32_t head;     /* next slot to write */
+	volatile uint32_t tail;     /* next slot to read */
+	volatile uint32_t dropped;
+	IMU_Event events[IMU_EVENT_QUEUE_SIZE];
+} IMU_Event_Queue;
+
+void IMU_Event_Reset(IMU_Event_Queue *queue);
+
+/*
+ * Interrupt side. Returns -1 and counts the event as dropped when full.
+ */
+
+int IMU_Event_Post(IMU_Event_Queue *queue, uint16_t pin, uint32_t tick);
+
+/*
+ * Main loop side. Returns 1 and fills event when one was waiting.
+ */
+
+int IMU_Event_Get(IMU_Event_Queue *queue, IMU_Event *event);
+
+int IMU_Event_Pending(const IMU_Event_Queue *queue);
+
+/*
+ * Discard every queued event, e.g. taps made during a game
+ */
+
+void IMU_Event_Flush(IMU_Event_Queue *queue);
+
+#endif /* IMU_EVENTS_H */
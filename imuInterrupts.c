@@ -0,0 +1,94 @@
+/**
+ ******************************************************************************
+ * @file    imuInterrupts.c
+ * @brief   LSM6DSM double tap and wake-up interrupts
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+
+#include "imuInterrupts.h"
+#include "main.h"
+
+#ifndef LSM6DSM_INT2_PIN
+#define LSM6DSM_INT2_GPIO_PORT GPIOA
+#define LSM6DSM_INT2_GPIO_CLK_ENABLE() __HAL_RCC_GPIOA_CLK_ENABLE()
+#define LSM6DSM_INT2_PIN GPIO_PIN_2
+#define LSM6DSM_INT2_EXTI_IRQn EXTI2_IRQn
+#endif
+
+#define LSM6DSM_MD2_CFG 0x5F
+#define LSM6DSM_INT2_DOUBLE_TAP 0x08
+#define LSM6DSM_INT2_WU 0x20
+
+static IMU_Event_Queue imu_events;
+
+void Enable_IMU_Interrupts(void *handle) {
+
+	GPIO_InitTypeDef GPIO_InitStruct;
+	uint8_t md2_cfg = 0;
+
+	IMU_Event_Reset(&imu_events);
+
+	BSP_ACCELERO_Enable_Wake_Up_Detection_Ext(handle);
+	BSP_ACCELERO_Read_Reg(handle, LSM6DSM_MD2_CFG, &md2_cfg);
+	md2_cfg |= LSM6DSM_INT2_DOUBLE_TAP | LSM6DSM_INT2_WU;
+	BSP_ACCELERO_Write_Reg(handle, LSM6DSM_MD2_CFG, md2_cfg);
+
+	LSM6DSM_INT2_GPIO_CLK_ENABLE();
+	GPIO_InitStruct.Pin = LSM6DSM_INT2_PIN;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(LSM6DSM_INT2_GPIO_PORT, &GPIO_InitStruct);
+
+	HAL_NVIC_SetPriority(LSM6DSM_INT2_EXTI_IRQn, 0x08, 0x00);
+	HAL_NVIC_EnableIRQ(LSM6DSM_INT2_EXTI_IRQn);
+}
+
+int Wait_For_IMU_Event(void *handle, int mask, int (*idle)(void)) {
+
+	IMU_Event event;
+	uint8_t double_tap, wake_up;
+	int source;
+
+	IMU_Event_Flush(&imu_events);
+	while (1) {
+		while (IMU_Event_Get(&imu_events, &event)) {
+			if (event.pin != LSM6DSM_INT2_PIN) {
+				continue;
+			}
+			double_tap = 0;
+			wake_up = 0;
+			BSP_ACCELERO_Get_Double_Tap_Detection_Status_Ext(handle,
+					&double_tap);
+			BSP_ACCELERO_Get_Wake_Up_Detection_Status_Ext(handle, &wake_up);
+			source = (double_tap ? IMU_EVENT_DOUBLE_TAP : 0)
+					| (wake_up ? IMU_EVENT_WAKE_UP : 0);
+			if (source & mask) {
+				return source & mask;
+			}
+		}
+		if (idle != NULL && idle()) {
+			continue;
+		}
+
+		/*
+		 * With interrupts masked no event can arrive between the check and
+		 * __WFI, and a pending interrupt still ends the sleep. SysTick is
+		 * stopped meanwhile so that only an interrupt wakes the MCU.
+		 */
+
+		__disable_irq();
+		if (!IMU_Event_Pending(&imu_events)) {
+			HAL_SuspendTick();
+			__WFI();
+			HAL_ResumeTick();
+		}
+		__enable_irq();
+	}
+}
+
+void IMU_Interrupt_Post(uint16_t pin) {
+	IMU_Event_Post(&imu_events, pin, HAL_GetTick());
+}
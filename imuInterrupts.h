@@ -0,0 +1,48 @@
+/**
+ ******************************************************************************
+ * @file    imuInterrupts.h
+ * @brief   LSM6DSM double tap and wake-up interrupts
+ ******************************************************************************
+ *
+ * Double tap and wake-up are routed to the LSM6DSM INT2 pin, wired to an
+ * EXTI line of the MCU. HAL_GPIO_EXTI_Callback passes every edge to
+ * IMU_Interrupt_Post, which queues it (imuEvents.h), and
+ * Wait_For_IMU_Event reads the event source once per queued edge, so the
+ * sensor bus is idle while waiting. The EXTI handler of the line
+ * (stm32l4xx_it.c) calls HAL_GPIO_EXTI_IRQHandler(LSM6DSM_INT2_PIN).
+ *
+ * LSM6DSM_INT2_PIN and the other LSM6DSM_INT2_* macros default to PA2 and
+ * may be defined on the command line for another wiring.
+ */
+
+#ifndef IMU_INTERRUPTS_H
+#define IMU_INTERRUPTS_H
+
+#include <stdint.h>
+
+#include "imuEvents.h"
+
+/*
+ * Route the events of the LSM6DSM accelerometer at handle to INT2 and
+ * enable its EXTI line
+ */
+
+void Enable_IMU_Interrupts(void *handle);
+
+/*
+ * Sleep until the LSM6DSM at handle reports one of the events in mask
+ * (IMU_EVENT_DOUBLE_TAP, IMU_EVENT_WAKE_UP) and return it. Events from
+ * before the call, such as taps made during a game, are discarded. idle,
+ * if not NULL, runs before each sleep; when it returns nonzero the queue
+ * is checked again instead of sleeping.
+ */
+
+int Wait_For_IMU_Event(void *handle, int mask, int (*idle)(void));
+
+/*
+ * Called from HAL_GPIO_EXTI_Callback with the pin of every edge
+ */
+
+void IMU_Interrupt_Post(uint16_t pin);
+
+#endif /* IMU_INTERRUPTS_H */
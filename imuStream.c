@@ -0,0 +1,140 @@
+/**
+ ******************************************************************************
+ * @file    imuStream.c
+ * @brief   Framed raw IMU sample stream over USB CDC
+ ******************************************************************************
+ */
+
+#include "imuStream.h"
+
+static void put_16(uint8_t *p, uint16_t x) {
+	p[0] = (uint8_t) x;
+	p[1] = (uint8_t) (x >> 8);
+}
+
+static uint16_t get_16(const uint8_t *p) {
+	return (uint16_t) (p[0] | p[1] << 8);
+}
+
+uint16_t IMU_Stream_CRC(const uint8_t *data, int n) {
+
+	uint16_t crc = 0xFFFF;
+	int i, bit;
+
+	for (i = 0; i < n; i++) {
+		crc ^= (uint16_t) data[i] << 8;
+		for (bit = 0; bit < 8; bit++) {
+			crc = crc & 0x8000 ? (uint16_t) (crc << 1) ^ 0x1021
+					: (uint16_t) (crc << 1);
+		}
+	}
+	return crc;
+}
+
+void IMU_Stream_Start(IMU_Stream_Packet *packet) {
+	packet->seq = 0;
+	packet->n = 0;
+	packet->flags = 0;
+	packet->tick = 0;
+}
+
+int IMU_Stream_Add(IMU_Stream_Packet *packet, uint32_t tick,
+		const int16_t *accel, const int16_t *gyro) {
+
+	int16_t *sample = packet->samples[packet->n];
+
+	if (packet->n == 0) {
+		packet->tick = tick;
+	}
+	sample[0] = accel[0];
+	sample[1] = accel[1];
+	sample[2] = accel[2];
+	sample[3] = gyro[0];
+	sample[4] = gyro[1];
+	sample[5] = gyro[2];
+	packet->n++;
+	return packet->n == IMU_STREAM_SAMPLES_PER_PACKET;
+}
+
+int IMU_Stream_Encode(const IMU_Stream_Packet *packet, uint8_t *frame) {
+
+	uint8_t *p = frame + IMU_STREAM_HEADER_SIZE;
+	int i, j, length = IMU_STREAM_FRAME_SIZE(packet->n);
+
+	frame[0] = IMU_STREAM_SYNC_0;
+	frame[1] = IMU_STREAM_SYNC_1;
+	put_16(frame + 2, packet->seq);
+	frame[4] = packet->n;
+	frame[5] = packet->flags;
+	put_16(frame + 6, (uint16_t) packet->tick);
+	put_16(frame + 8, (uint16_t) (packet->tick >> 16));
+	for (i = 0; i < packet->n; i++) {
+		for (j = 0; j < IMU_STREAM_AXES; j++) {
+			put_16(p, (uint16_t) packet->samples[i][j]);
+			p += 2;
+		}
+	}
+	put_16(p, IMU_Stream_CRC(frame + 2, length - 4));
+	return length;
+}
+
+void IMU_Stream_Next(IMU_Stream_Packet *packet) {
+	packet->seq++;
+	packet->n = 0;
+	packet->flags = 0;
+}
+
+int IMU_Stream_Decode(const uint8_t *data, int n, IMU_Stream_Packet *packet,
+		int *used) {
+
+	const uint8_t *p;
+	int i, j, length;
+
+	for (i = 0; i < n && data[i] != IMU_STREAM_SYNC_0; i++) {
+	}
+	if (i > 0) {
+		*used = i;
+		return IMU_STREAM_SKIP;
+	}
+	if (n < IMU_STREAM_HEADER_SIZE) {
+		return IMU_STREAM_MORE;
+	}
+	if (data[1] != IMU_STREAM_SYNC_1 || data[4] == 0
+			|| data[4] > IMU_STREAM_SAMPLES_PER_PACKET) {
+		*used = 1;
+		return IMU_STREAM_SKIP;
+	}
+
+	length = IMU_STREAM_FRAME_SIZE(data[4]);
+	if (n < length) {
+		return IMU_STREAM_MORE;
+	}
+
+	/*
+	 * A damaged frame may hide the sync of the next one, so only its
+	 * first byte is dropped
+	 */
+
+	if (IMU_Stream_CRC(data + 2, length - 4) != get_16(data + length - 2)) {
+		*used = 1;
+		return IMU_STREAM_CRC_ERROR;
+	}
+
+	packet->seq = get_16(data + 2);
+	packet->n = data[4];
+	packet->flags = data[5];
+	packet->tick = get_16(data + 6) | (uint32_t) get_16(data + 8) << 16;
+	p = data + IMU_STREAM_HEADER_SIZE;
+	for (i = 0; i < packet->n; i++) {
+		for (j = 0; j < IMU_STREAM_AXES; j++) {
+			packet->samples[i][j] = (int16_t) get_16(p);
+			p += 2;
+		}
+	}
+	*used = length;
+	return IMU_STREAM_PACKET;
+}
+
+int IMU_Stream_Gap(uint16_t last_seq, uint16_t seq) {
+	return (uint16_t) (seq - last_seq - 1);
+}
@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * @file    imuStream.h
+ * @brief   Framed raw IMU sample stream over USB CDC
+ ******************************************************************************
+ *
+ * For data collection the firmware can send every LSM6DSM accelerometer
+ * and gyroscope read instead of playing. Samples are packed
+ * IMU_STREAM_SAMPLES_PER_PACKET at a time into binary frames, all fields
+ * little endian:
+ *
+ *   offset  size
+ *   0       2     sync, 0xA5 0x5A
+ *   2       2     sequence number, +1 per frame, wraps at 65536
+ *   4       1     samples n, 1 to IMU_STREAM_SAMPLES_PER_PACKET
+ *   5       1     flags, IMU_STREAM_FLAG_*
+ *   6       4     HAL_GetTick() of the first sample [ms]
+ *   10      12n   n samples of ax ay az gx gy gz, raw int16 counts
+ *   10+12n  2     CRC-16/CCITT (0x1021, start 0xFFFF) of bytes 2 to 9+12n
+ *
+ * At 1660 Hz that is 208 frames and 22 kB per second. A receiver finds
+ * lost frames from the sequence number and drops damaged ones by their
+ * CRC, then resynchronizes on the next sync pattern.
+ */
+
+#ifndef IMU_STREAM_H
+#define IMU_STREAM_H
+
+#include <stdint.h>
+
+#define IMU_STREAM_SYNC_0 0xA5
+#define IMU_STREAM_SYNC_1 0x5A
+
+#define IMU_STREAM_AXES 6
+#define IMU_STREAM_SAMPLES_PER_PACKET 8
+#define IMU_STREAM_HEADER_SIZE 10
+#define IMU_STREAM_FRAME_SIZE(n) \
+	(IMU_STREAM_HEADER_SIZE + (n) * IMU_STREAM_AXES * 2 + 2)
+#define IMU_STREAM_MAX_FRAME IMU_STREAM_FRAME_SIZE(IMU_STREAM_SAMPLES_PER_PACKET)
+
+/*
+ * A sensor read failed in this frame; its values are 0
+ */
+
+#define IMU_STREAM_FLAG_READ_ERROR 0x01
+
+/*
+ * IMU_Stream_Decode results
+ */
+
+#define IMU_STREAM_PACKET 1
+#define IMU_STREAM_MORE 0       /* frame incomplete, read more */
+#define IMU_STREAM_SKIP -1      /* bytes before a sync pattern */
+#define IMU_STREAM_CRC_ERROR -2
+
+typedef struct {
+	uint16_t seq;
+	uint8_t n;
+	uint8_t flags;
+	uint32_t tick;
+	int16_t samples[IMU_STREAM_SAMPLES_PER_PACKET][IMU_STREAM_AXES];
+} IMU_Stream_Packet;
+
+uint16_t IMU_Stream_CRC(const uint8_t *data, int n);
+
+/*
+ * Sender side: start at sequence number 0, add samples until the packet
+ * is full (IMU_Stream_Add returns 1), encode it and move on to the next.
+ */
+
+void IMU_Stream_Start(IMU_Stream_Packet *packet);
+
+int IMU_Stream_Add(IMU_Stream_Packet *packet, uint32_t tick,
+		const int16_t *accel, const int16_t *gyro);
+
+int IMU_Stream_Encode(const IMU_Stream_Packet *packet, uint8_t *frame);
+
+void IMU_Stream_Next(IMU_Stream_Packet *packet);
+
+/*
+ * Receiver side: decode the frame at the start of data. Returns
+ * IMU_STREAM_PACKET with packet filled, or IMU_STREAM_SKIP /
+ * IMU_STREAM_CRC_ERROR; used is set to the bytes to drop in every case
+ * but IMU_STREAM_MORE.
+ */
+
+int IMU_Stream_Decode(const uint8_t *data, int n, IMU_Stream_Packet *packet,
+		int *used);
+
+/*
+ * Frames lost between the last sequence number seen and seq
+ */
+
+int IMU_Stream_Gap(uint16_t last_seq, uint16_t seq);
+
+#endif /* IMU_STREAM_H */
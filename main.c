@@ -47,6 +47,10 @@
 #include <stdio.h>  /* sprintf */
 #include <math.h>   /* trunc */
 #include "embeddedML.h"
+#include "gestureCore.h"
+#include "imuInterrupts.h"
+#include "accelFusion.h"
+#include "modelRegistry.h"
 #include "main.h"
 
 #include "datalog_application.h"
@@ -65,8 +69,6 @@
 
 #define NUMBER_TEST_CYCLES 10
 #define STATE_1_DWELL 10000
-#define CLASSIFICATION_ACC_THRESHOLD 1
-#define CLASSIFICATION_DISC_THRESHOLD 1.05
 #define Z_ACCEL_THRESHOLD 300
 #define START_POSITION_INTERVAL 3000
 #define TRAINING_CYCLES 2000
@@ -86,6 +88,26 @@
 
 //#define NOT_DEBUGGING
 
+
+/*
+ * State 1 ends as soon as the accelerometer reading has settled
+ * FUSION_DWELL_CONFIDENCE standard errors above Z_ACCEL_THRESHOLD, rather
+ * than after the whole STATE_1_MAX_DWELL_MS, over a window sized from the
+ * noise measured at boot (accelFusion.h). Define DUAL_ACCEL to read the
+ * LSM303AGR accelerometer along with the LSM6DSM and average the two: the
+ * lower noise shortens the window. host/fusionCheck simulates both.
+ *
+ * Set LSM303AGR_AXES and LSM303AGR_SIGNS to the way the LSM303AGR is
+ * mounted relative to the LSM6DSM before defining it: the identity map
+ * below is a placeholder, not the measured mounting. Boot calibration
+ * falls back to the LSM6DSM alone if they do not agree.
+ */
+//#define DUAL_ACCEL
+#define STATE_1_MAX_DWELL_MS FUSION_MAX_DWELL_MS
+#define LSM303AGR_AXES { 0, 1, 2 }
+#define LSM303AGR_SIGNS { 1, 1, 1 }
+#define FUSION_CALIBRATION_SAMPLES 32
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 
@@ -110,6 +132,8 @@ static void *HTS221_H_0_handle = NULL;
 static void *HTS221_T_0_handle = NULL;
 static void *GG_handle = NULL;
 
+static Accel_Fusion fusion;
+
 int xyz_initial[3], xyz_initial_prev[3];
 int xyz_initial_filter[3], xyz_initial_filter_prev[3];
 int xyz_initial_HP[3], xyz_initial_prev_HP[3];
@@ -130,6 +154,15 @@ float angular_displacement = 0;
 /* Private function prototypes -----------------------------------------------*/
 
 static void Error_Handler(void);
+
+/*
+ * Ids of the model registry networks, as returned by Registry_Add:
+ * TrainOrientation and Accel_Sensor_Handler use the accelerometer
+ * orientation model, TrainRotation and Gyro_Sensor_Handler_Rotation the
+ * gyroscope rotation model
+ */
+static int model_orientation = -1;
+static int model_rotation = -1;
 static void RTC_Config(void);
 static void RTC_TimeStampConfig(void);
 static void initializeAllSensors(void);
@@ -139,45 +172,6 @@ static void initializeAllSensors(void);
 static volatile uint8_t hasTrained = 0;
 unsigned int training_cycles = TRAINING_CYCLES;
 
-void stable_softmax(float *x, float *y) {
-	int size = 3;
-	float multiplier = 1.0;
-
-	int i;
-
-	//softmax implemented as square law algorithm to be accommodate numerical precision requirements
-
-	y[0] = (x[0] * x[0] * multiplier)
-			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
-					+ (x[2] * x[2] * multiplier));
-	y[1] = (x[1] * x[1] * multiplier)
-			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
-					+ (x[2] * x[2] * multiplier));
-	y[2] = (x[2] * x[2] * multiplier)
-			/ ((x[0] * x[0] * multiplier) + (x[1] * x[1] * multiplier)
-					+ (x[2] * x[2] * multiplier));
-
-	for (i = 0; i < size; i++) {
-		if (x[i] < 0.0)
-			y[i] = y[i] * -1.0;
-	}
-}
-
-void motion_softmax(int size, float *x, float *y) {
-	float norm;
-
-	norm = sqrt((x[0] * x[0]) + (x[1] * x[1]) + (x[2] * x[2]));
-	y[0] = abs(x[0]) / norm;
-	y[1] = abs(x[1]) / norm;
-	y[2] = abs(x[2]) / norm;
-
-	int i;
-	for (i = 0; i < size; i++) {
-		if (x[i] < 0.0)
-			y[i] = y[i] * -1.0;
-	}
-}
-
 void LED_Code_Blink(int count) {
 
 	int i;
@@ -256,6 +250,101 @@ void getAccel(void *handle, int *xyz) {
 	}
 }
 
+#ifdef DUAL_ACCEL
+/*
+ * Read the LSM6DSM and LSM303AGR accelerometers back to back, returning
+ * how many reads succeeded
+ */
+
+static int getAccelPair(void *handle, int raw[FUSION_SENSORS][3],
+		uint8_t valid[FUSION_SENSORS]) {
+
+	void *handles[FUSION_SENSORS] = { handle, LSM303AGR_X_0_handle };
+	SensorAxes_t acceleration;
+	int s, n = 0;
+
+	for (s = 0; s < FUSION_SENSORS; s++) {
+		valid[s] = BSP_ACCELERO_Get_Axes(handles[s], &acceleration)
+				!= COMPONENT_ERROR;
+		if (!valid[s]) {
+			acceleration.AXIS_X = 0;
+			acceleration.AXIS_Y = 0;
+			acceleration.AXIS_Z = 0;
+		}
+		raw[s][0] = (int) acceleration.AXIS_X;
+		raw[s][1] = (int) acceleration.AXIS_Y;
+		raw[s][2] = (int) acceleration.AXIS_Z;
+		n += valid[s];
+	}
+	return n;
+}
+
+/*
+ * Fused acceleration of the LSM6DSM at handle and the LSM303AGR, in the
+ * axes of the LSM6DSM [mg]
+ */
+
+static void getFusedAccel(void *handle, int *xyz) {
+
+	int raw[FUSION_SENSORS][3];
+	uint8_t valid[FUSION_SENSORS];
+
+	getAccelPair(handle, raw, valid);
+	Fusion_Combine(&fusion, (const int (*)[3]) raw, valid, xyz);
+}
+#endif
+
+/*
+ * Measure the offset and noise of the accelerometers while the
+ * SensorTile is held still, the LSM6DSM alone without DUAL_ACCEL
+ */
+
+static void calibrateFusion(void) {
+
+	static const Fusion_Calibration axes[FUSION_SENSORS] = {
+		{ { 0, 1, 2 }, { 1, 1, 1 }, { 0, 0, 0 }, 0 },
+		{ LSM303AGR_AXES, LSM303AGR_SIGNS, { 0, 0, 0 }, 0 }
+	};
+	int samples[FUSION_CALIBRATION_SAMPLES][FUSION_SENSORS][3];
+	int n = 0;
+	char msg[128];
+#ifdef DUAL_ACCEL
+	uint8_t valid[FUSION_SENSORS];
+	int tries;
+
+	/* Sample the LSM303AGR as often as the reads are paired */
+	BSP_ACCELERO_Set_ODR_Value(LSM303AGR_X_0_handle, 1000.0f / DATA_PERIOD_MS);
+
+	Fusion_Init(&fusion, axes, FUSION_SENSORS);
+	for (tries = 0; tries < 2 * FUSION_CALIBRATION_SAMPLES
+			&& n < FUSION_CALIBRATION_SAMPLES; tries++) {
+		HAL_Delay(DATA_PERIOD_MS);
+		n += getAccelPair(LSM6DSM_X_0_handle, samples[n], valid)
+				== FUSION_SENSORS;
+	}
+
+	if (Fusion_Calibrate(&fusion, (const int (*)[FUSION_SENSORS][3]) samples,
+			n) != 0) {
+		sprintf(msg, "\r\nLSM303AGR does not agree with the LSM6DSM, using the LSM6DSM only");
+	} else {
+		sprintf(msg, "\r\nAccelerometer noise %d, %d, fused %d mg^2",
+				(int) fusion.calibration[0].variance,
+				(int) fusion.calibration[1].variance,
+				(int) Fusion_Variance(&fusion));
+	}
+#else
+	Fusion_Init(&fusion, axes, 1);
+	for (n = 0; n < FUSION_CALIBRATION_SAMPLES; n++) {
+		HAL_Delay(DATA_PERIOD_MS);
+		getAccel(LSM6DSM_X_0_handle, samples[n][0]);
+	}
+	Fusion_Calibrate(&fusion, (const int (*)[FUSION_SENSORS][3]) samples, n);
+	sprintf(msg, "\r\nAccelerometer noise %d mg^2",
+			(int) Fusion_Variance(&fusion));
+#endif
+	CDC_Fill_Buffer((uint8_t *) msg, strlen(msg));
+}
+
 /*
  * Note : Feature_Extraction_State_0() sets Z-axis acceleration, ttt_3 = 0
  */
@@ -314,6 +403,8 @@ void Feature_Extraction_State_1(void *handle, int * ttt_1, int * ttt_2,
 		int * ttt_3, int * ttt_mag_scale) {
 	int ttt[3], ttt_initial[3];
 	char msg1[128];
+	Fusion_Dwell dwell;
+	uint32_t start;
 
 	ttt_initial[0] = *ttt_1;
 	ttt_initial[1] = *ttt_2;
@@ -327,7 +418,6 @@ void Feature_Extraction_State_1(void *handle, int * ttt_1, int * ttt_2,
 	sprintf(msg1, "\r\nNow Rotate to Z-Axis Level when LED On");
 	CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 	BSP_LED_On(LED1);
-	HAL_Delay(3000);
 
 
 	/*
@@ -345,7 +435,24 @@ void Feature_Extraction_State_1(void *handle, int * ttt_1, int * ttt_2,
 	 * axis acceleration or to zero.
 	 */
 
-	getAccel(handle, ttt);
+	/*
+	 * Sample until the new orientation is settled clearly beyond the
+	 * threshold, or the dwell is over
+	 */
+
+	Fusion_Dwell_Start(&dwell, Z_ACCEL_THRESHOLD, FUSION_DWELL_CONFIDENCE,
+			FUSION_DWELL_SETTLED_MG, Fusion_Variance(&fusion));
+	start = HAL_GetTick();
+	do {
+		HAL_Delay(DATA_PERIOD_MS);
+#ifdef DUAL_ACCEL
+		getFusedAccel(handle, ttt);
+#else
+		getAccel(handle, ttt);
+#endif
+	} while (!Fusion_Dwell_Add(&dwell, sqrt(pow(ttt[0] - ttt_initial[0], 2)
+			+ pow(ttt[1] - ttt_initial[1], 2)))
+			&& HAL_GetTick() - start < STATE_1_MAX_DWELL_MS);
 
 	double xyMag = sqrt(pow(ttt[0] - ttt_initial[0], 2) + pow(ttt[1] - ttt_initial[1], 2));
 
@@ -533,103 +640,9 @@ void Feature_Extraction_Gyro(void *handle, int * ttt_1, int * ttt_2,
 }
 
 
-void printOutput_ANN(ANN *net, int input_state, int * error) {
-
-	char dataOut[256] = { };
-	int i, loc, count;
-	float point = 0.0;
-	float rms_output, mean_output, mean_output_rem, next_max;
-	float classification_metric;
-
-	/*
-	 * Initialize error state
-	 */
-
-	*error = 0;
-
-	count = 0;
-	mean_output = 0;
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		mean_output = mean_output + (net->output[i]);
-		if (net->output[i] > point && net->output[i] > 0.1) {
-			point = net->output[i];
-			loc = i;
-		}
-		count++;
-	}
-
-	next_max = 0;
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		if (i == loc) {
-			continue;
-		}
-		if (net->output[i] > next_max && net->output[i] > 0.1) {
-			next_max = net->output[i];
-		}
-	}
-
-	mean_output = (mean_output) / (count);
-
-	count = 0;
-	mean_output_rem = 0;
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		mean_output_rem = mean_output_rem + (net->output[i]);
-		if (i == loc) {
-			continue;
-		}
-		count++;
-	}
-
-	mean_output_rem = (mean_output_rem) / (count);
+void TrainOrientation(void *handle, Model_Registry *models) {
 
-	rms_output = 0;
-
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		rms_output = rms_output + pow((net->output[i] - mean_output), 2);
-	}
-
-	rms_output = sqrt(rms_output / count);
-	if (rms_output != 0) {
-		classification_metric = (point - mean_output) / rms_output;
-	} else {
-		classification_metric = 0;
-	}
-
-	if (loc != input_state) {
-		rms_output = 0;
-		classification_metric = 0;
-		point = 0;
-		mean_output = 0;
-		mean_output_rem = 0;
-	}
-
-	sprintf(dataOut, "\r\nState %i\tMax %i\tMean %i\t\tZ-score %i\tOutputs",
-			loc, (int) (100 * point), (int) (100 * mean_output),
-			(int) (100 * classification_metric));
-	CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-
-	for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-		sprintf(dataOut, "\t%i", (int) (100 * net->output[i]));
-		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-	}
-
-	if (loc != input_state) {
-		*error = 1;
-		sprintf(dataOut, "\t Classification Error");
-		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-	}
-
-	if ((loc == input_state)
-			&& ((classification_metric < CLASSIFICATION_ACC_THRESHOLD)
-					|| ((point / next_max) < CLASSIFICATION_DISC_THRESHOLD))) {
-		*error = 1;
-		sprintf(dataOut, "\t Classification Accuracy Limit");
-		CDC_Fill_Buffer((uint8_t *) dataOut, strlen(dataOut));
-	}
-
-}
-
-void TrainOrientation(void *handle, ANN *net) {
+	ANN *net = Registry_Train(models, model_orientation);
 
 	uint8_t id;
 	SensorAxes_t acceleration;
@@ -668,7 +681,6 @@ void TrainOrientation(void *handle, ANN *net) {
 		for (k = 0; k < num_train_data_cycles; k++) {
 			for (i = 0; i < 5; i++) {
 				int hasTrainedLocal = 0;
-				uint8_t doubleTapConfirm = 0;
 				sprintf(msg1, "\r\nMove to Start Position - Wait for LED On");
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
 				HAL_Delay(START_POSITION_INTERVAL);
@@ -683,10 +695,8 @@ void TrainOrientation(void *handle, ANN *net) {
 
 
 
-				while(!doubleTapConfirm) {
-					BSP_ACCELERO_Get_Double_Tap_Detection_Status_Ext(LSM6DSM_X_0_handle, &doubleTapConfirm);
-					//HAL_Delay(200);
-				}
+				Wait_For_IMU_Event(LSM6DSM_X_0_handle,
+						IMU_EVENT_DOUBLE_TAP, NULL);
 
 
 				CDC_Fill_Buffer((uint8_t *) msg1, strlen(msg1));
@@ -921,7 +931,9 @@ void TrainOrientation(void *handle, ANN *net) {
 	return;
 }
 
-void TrainRotation(void *handle, ANN *net) {
+void TrainRotation(void *handle, Model_Registry *models) {
+
+	ANN *net = Registry_Train(models, model_rotation);
 
 	uint8_t id;
 	SensorAxes_t angular_velocity;
@@ -1206,7 +1218,9 @@ void TrainRotation(void *handle, ANN *net) {
 	return;
 }
 
-int Gyro_Sensor_Handler_Rotation(void *handle, ANN *net, int prev_loc) {
+int Gyro_Sensor_Handler_Rotation(void *handle, Model_Registry *models,
+		int prev_loc) {
+	ANN *net = Registry_Get(models, model_rotation);
 	uint8_t id;
 	SensorAxes_t angular_velocity;
 	uint8_t status;
@@ -1264,16 +1278,11 @@ int Gyro_Sensor_Handler_Rotation(void *handle, ANN *net, int prev_loc) {
 		run_ann(net, xyz);
 
 		char msg3[128];
-		float point = 0.0;
-		int i;
-		int loc = -1;
-
-		for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-			if (net->output[i] > point && net->output[i] > 0.1) {
-				point = net->output[i];
-				loc = i;
-			}
-		}
+		ANN_Result result;
+		int loc;
+
+		ANN_Scan_Output(net->output, net->topology[net->n_layers - 1], &result);
+		loc = result.loc;
 
 		if (loc == -1) {
 			LED_Code_Blink(0);
@@ -1321,7 +1330,8 @@ int Gyro_Sensor_Handler_Rotation(void *handle, ANN *net, int prev_loc) {
 
 
 
-int Accel_Sensor_Handler(void *handle, ANN *net, int prev_loc) {
+int Accel_Sensor_Handler(void *handle, Model_Registry *models, int prev_loc) {
+	ANN *net = Registry_Get(models, model_orientation);
 	uint8_t id;
 	SensorAxes_t acceleration;
 	uint8_t status;
@@ -1391,16 +1401,11 @@ int Accel_Sensor_Handler(void *handle, ANN *net, int prev_loc) {
 			run_ann(net, xyz);
 
 			char msg3[128];
-			float point = 0.0;
-			int i;
-			int loc = -1;
-
-			for (i = 0; i < net->topology[net->n_layers - 1]; i++) {
-				if (net->output[i] > point && net->output[i] > 0.1) {
-					point = net->output[i];
-					loc = i;
-				}
-			}
+			ANN_Result result;
+			int loc;
+
+			ANN_Scan_Output(net->output, net->topology[net->n_layers - 1], &result);
+			loc = result.loc;
 
 			if (loc == -1) {
 				LED_Code_Blink(0);
@@ -1452,7 +1457,6 @@ int Accel_Sensor_Handler(void *handle, ANN *net, int prev_loc) {
 
 int main(void) {
 	uint32_t msTick, msTickPrev = 0;
-	uint8_t doubleTap = 0;
 	char msg2[128];
 	int i;
 
@@ -1512,6 +1516,9 @@ int main(void) {
 	enableAllSensors();
 
 	/* Notify user */
+	sprintf(msg2, "\n\rCalibrating accelerometers, hold still");
+	CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
+	calibrateFusion();
 
 	sprintf(msg2, "\n\rEmbeddedML Motion Pattern Classification\r\n");
 	CDC_Fill_Buffer((uint8_t *) msg2, strlen(msg2));
@@ -1534,11 +1541,19 @@ int main(void) {
 			0.285300, 0.697700, 0.540800, 0.222800, 0.693300, 0.229800,
 			0.698100, 0.463500, 0.201300, 0.786500, 0.581400, 0.706300,
 			0.653600, 0.542500, 0.766900, 0.411500 };
+	float rotation_weights[81];
 	float dedw[81];
 	float bias[15];
+	float rotation_bias[15];
 	unsigned int network_topology[3] = { 3, 9, 6 };
 	float output[6];
 
+	/*
+	 * The orientation and rotation networks keep their own weights and
+	 * bias and share output and dedw (modelRegistry.h)
+	 */
+
+	Model_Registry models;
 	ANN net;
 	net.weights = weights;
 	net.dedw = dedw;
@@ -1567,6 +1582,17 @@ int main(void) {
 	net.hidden_activation_function = &relu2;
 
 	init_ann(&net);
+
+	Registry_Init(&models, output, 6, dedw, 81);
+	model_orientation = Registry_Add(&models, "orientation", &net);
+	memcpy(rotation_weights, weights, sizeof(weights));
+	memcpy(rotation_bias, bias, sizeof(bias));
+	net.weights = rotation_weights;
+	net.bias = rotation_bias;
+	model_rotation = Registry_Add(&models, "rotation", &net);
+	if (model_orientation < 0 || model_rotation < 0) {
+		Error_Handler();
+	}
 	//---------------------
 
 	int loc = -1;
@@ -1584,10 +1610,10 @@ int main(void) {
 			//RTC_Handler( &RtcHandle );
 
 			if (hasTrained){
-				loc2 = Gyro_Sensor_Handler_Rotation(LSM6DSM_G_0_handle, &net,
+				loc2 = Gyro_Sensor_Handler_Rotation(LSM6DSM_G_0_handle, &models,
 						loc2);
 				
-				loc = Accel_Sensor_Handler(LSM6DSM_X_0_handle, &net, loc);
+				loc = Accel_Sensor_Handler(LSM6DSM_X_0_handle, &models, loc);
 				/*
 				 * Upon return from Accel_Sensor_Handler, initiate retraining.
 				 */
@@ -1602,14 +1628,13 @@ int main(void) {
 
 		}
 
-		/* Check LSM6DSM Double Tap Event  */
+		/* Sleep until the LSM6DSM reports a Double Tap */
 		if (!hasTrained) {
-			BSP_ACCELERO_Get_Double_Tap_Detection_Status_Ext(LSM6DSM_X_0_handle,
-					&doubleTap);
-			if (doubleTap) { /* Double Tap event */
+			if (Wait_For_IMU_Event(LSM6DSM_X_0_handle,
+					IMU_EVENT_DOUBLE_TAP, NULL)) {
 				LED_Code_Blink(0);
-				TrainOrientation(LSM6DSM_X_0_handle, &net);
-				TrainRotation(LSM6DSM_G_0_handle, &net);
+				TrainOrientation(LSM6DSM_X_0_handle, &models);
+				TrainRotation(LSM6DSM_G_0_handle, &models);
 				hasTrained = 1;
 			}
 		}
@@ -1678,6 +1703,7 @@ static void initializeAllSensors(void) {
 	BSP_ACCELERO_Enable_Double_Tap_Detection_Ext(LSM6DSM_X_0_handle);
 	BSP_ACCELERO_Set_Tap_Threshold_Ext(LSM6DSM_X_0_handle,
 	LSM6DSM_TAP_THRESHOLD_MID);
+	Enable_IMU_Interrupts(LSM6DSM_X_0_handle);
 	//}
 
 }
@@ -1818,6 +1844,7 @@ void RTC_TimeRegulate(uint8_t hh, uint8_t mm, uint8_t ss) {
  */
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
 	MEMSInterrupt = 1;
+	IMU_Interrupt_Post(GPIO_Pin);
 }
 
 /**
@@ -0,0 +1,54 @@
+/**
+ ******************************************************************************
+ * @file    modelRegistry.c
+ * @brief   Several named networks sharing one output and training arena
+ ******************************************************************************
+ */
+
+#include <string.h>
+
+#include "modelRegistry.h"
+
+void Registry_Init(Model_Registry *registry, float *output,
+		unsigned int output_size, float *dedw, unsigned int dedw_size) {
+	memset(registry, 0, sizeof(Model_Registry));
+	registry->output = output;
+	registry->output_size = output_size;
+	registry->dedw = dedw;
+	registry->dedw_size = dedw_size;
+}
+
+int Registry_Add(Model_Registry *registry, const char *name, const ANN *net) {
+
+	Registry_Model *model;
+
+	if (registry->n_models == REGISTRY_MAX_MODELS
+			|| net->topology[net->n_layers - 1] > registry->output_size
+			|| net->n_weights > registry->dedw_size) {
+		return -1;
+	}
+	model = &registry->models[registry->n_models];
+	model->name = name;
+	model->net = *net;
+	model->net.output = registry->output;
+	model->net.dedw = registry->dedw;
+	return registry->n_models++;
+}
+
+ANN *Registry_Get(Model_Registry *registry, int id) {
+	if (id < 0 || id >= registry->n_models) {
+		return NULL;
+	}
+	return &registry->models[id].net;
+}
+
+ANN *Registry_Train(Model_Registry *registry, int id) {
+
+	ANN *net = Registry_Get(registry, id);
+
+	if (net == NULL) {
+		return NULL;
+	}
+	memset(registry->dedw, 0, sizeof(float) * net->n_weights);
+	return net;
+}
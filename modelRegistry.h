@@ -0,0 +1,65 @@
+/**
+ ******************************************************************************
+ * @file    modelRegistry.h
+ * @brief   Several named networks sharing one output and training arena
+ ******************************************************************************
+ *
+ * Each network added to a Model_Registry keeps its own weights, bias and
+ * topology, so training one no longer overwrites another. The output
+ * activations and the dedw momentum terms are only needed while a network
+ * runs or trains, which the firmware does one network at a time: every
+ * network of the registry points at the same two buffers, sized for the
+ * largest of them.
+ *
+ * The output of a network is therefore only valid until the next network
+ * of the registry runs, and Registry_Train clears the momentum left by
+ * whichever network trained last.
+ */
+
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include "embeddedML.h"
+
+#define REGISTRY_MAX_MODELS 4
+
+typedef struct {
+	const char *name;
+	ANN net;
+} Registry_Model;
+
+typedef struct {
+	Registry_Model models[REGISTRY_MAX_MODELS];
+	int n_models;
+	float *output;              /* shared output activations */
+	unsigned int output_size;
+	float *dedw;                /* shared momentum terms */
+	unsigned int dedw_size;
+} Model_Registry;
+
+void Registry_Init(Model_Registry *registry, float *output,
+		unsigned int output_size, float *dedw, unsigned int dedw_size);
+
+/*
+ * Add a copy of net, whose weights, bias and topology must stay owned by
+ * the caller; its output and dedw are replaced by the shared buffers.
+ * Returns the model id, or -1 if the registry is full or the network does
+ * not fit the shared buffers.
+ */
+
+int Registry_Add(Model_Registry *registry, const char *name, const ANN *net);
+
+/*
+ * Network of model id, to run, or NULL if no model has that id
+ */
+
+ANN *Registry_Get(Model_Registry *registry, int id);
+
+/*
+ * Network of model id, to train: the shared momentum terms are cleared.
+ * NULL if no model has that id.
+ */
+
+ANN *Registry_Train(Model_Registry *registry, int id);
+
+#endif /* MODEL_REGISTRY_H */